@@ -49,6 +49,7 @@ char *cryptalgostr(int algo)
     {
         case ENCRYPT_NONE:     return "none";
         case ENCRYPT_BLOWFISH: return "blowfish";
+        case ENCRYPT_AES256GCM: return "aes256gcm";
         default:               return "unknown";
     }
 }
@@ -74,6 +75,14 @@ int archinfo_show_mainhead(carchreader *ai, cdico *dicomainhead)
     if (ai->minfsaver > 0) // fsarchiver < 0.6.7 had no per-archive minfsaver version requirement
         msgprintf(MSG_FORCE, "Minimum fsarchiver version:\t%d.%d.%d.%d\n", (int)FSA_VERSION_GET_A(ai->minfsaver),
             (int)FSA_VERSION_GET_B(ai->minfsaver), (int)FSA_VERSION_GET_C(ai->minfsaver), (int)FSA_VERSION_GET_D(ai->minfsaver));
+    if (ai->fsinterleaved==true)
+        msgprintf(MSG_FORCE, "Filesystems interleaved: \tyes\n");
+    if (ai->hasduplicates==true)
+        msgprintf(MSG_FORCE, "Small files deduplicated: \tyes\n");
+    if (ai->hasreflinks==true)
+        msgprintf(MSG_FORCE, "Shared extents saved once: \tyes\n");
+    if (ai->maxblksize > FSA_MAX_BLKSIZE)
+        msgprintf(MSG_FORCE, "Large data blocks: \t\t%ld MB\n", (long)(ai->maxblksize>>20));
     msgprintf(MSG_FORCE, "Compression level: \t\t%d (%s level %d)\n", ai->fsacomp, compalgostr(ai->compalgo), ai->complevel);
     msgprintf(MSG_FORCE, "Encryption algorithm: \t\t%s\n", cryptalgostr(ai->cryptalgo));
     msgprintf(MSG_FORCE, "\n");
@@ -35,6 +35,7 @@
 #include "queue.h"
 #include "comp_gzip.h"
 #include "comp_bzip2.h"
+#include "runindex.h"
 #include "error.h"
 
 int archreader_init(carchreader *ai)
@@ -50,12 +51,80 @@ int archreader_init(carchreader *ai)
     ai->curvol=0;
     ai->filefmtver=0;
     ai->hasdirsinfohead=false;
+    ai->maxblksize=FSA_MAX_BLKSIZE;
+    ai->nextfd=-1;
+    ai->prefetching=false;
     return 0;
 }
 
+static void archreader_prefetch_wait(carchreader *ai)
+{
+    if (ai->prefetching==true)
+    {   pthread_join(ai->prefetchthr, NULL);
+        ai->prefetching=false;
+    }
+}
+
 int archreader_destroy(carchreader *ai)
 {
     assert(ai);
+    archreader_prefetch_wait(ai);
+    if (ai->nextfd>=0)
+    {   close(ai->nextfd);
+        ai->nextfd=-1;
+    }
+    free(ai->pushbuf);
+    ai->pushbuf=NULL;
+    return 0;
+}
+
+// runs while the current volume is being read so that a slow storage does not stall the restore at each volume boundary
+static void *archreader_prefetch_fct(void *args)
+{
+    carchreader *ai=(carchreader *)args;
+    char *buffer;
+    s64 offset;
+    long lres;
+    int fd;
+    
+    if ((fd=open64(ai->nextpath, O_RDONLY|O_LARGEFILE))<0)
+        return NULL; // not available yet: the reader will ask for that volume when it needs it
+    
+    posix_fadvise(fd, 0, FSA_VOLUME_READAHEAD, POSIX_FADV_WILLNEED);
+    if ((buffer=malloc(FSA_MAX_BLKSIZE))!=NULL)
+    {
+        for (offset=0; offset < FSA_VOLUME_READAHEAD; offset+=lres)
+            if ((lres=pread64(fd, buffer, FSA_MAX_BLKSIZE, offset))<=0)
+                break;
+        free(buffer);
+    }
+    
+    ai->nextfd=fd;
+    return NULL;
+}
+
+// start to open the volume which follows the current one in a background thread
+int archreader_prefetch_next(carchreader *ai)
+{
+    assert(ai);
+    
+    if (ai->stream==true) // there is no next volume on stdin
+        return 0;
+    
+    archreader_prefetch_wait(ai);
+    if (ai->nextfd>=0)
+    {   close(ai->nextfd);
+        ai->nextfd=-1;
+    }
+    
+    if (get_path_to_volume(ai->nextpath, PATH_MAX, ai->basepath, ai->curvol+1, &g_options.voldirs)!=0)
+        return -1;
+    if (pthread_create(&ai->prefetchthr, NULL, archreader_prefetch_fct, (void*)ai)!=0)
+    {   errprintf("pthread_create(archreader_prefetch_fct) failed\n");
+        return -1;
+    }
+    ai->prefetching=true;
+    
     return 0;
 }
 
@@ -67,8 +136,27 @@ int archreader_open(carchreader *ai)
     
     assert(ai);
     
-    // on the archive volume
-    ai->archfd=open64(ai->volpath, O_RDONLY|O_LARGEFILE);
+    if (ai->stream==true) // the beginning of stdin is kept in memory as it cannot be read twice
+    {   ai->archfd=STDIN_FILENO;
+        if ((archreader_read_data(ai, volhead, sizeof(volhead))!=0) || (archreader_unread_data(ai, volhead, sizeof(volhead))!=0))
+        {   errprintf("cannot read magic from the standard input\n");
+            return -1;
+        }
+        goto archreader_open_format;
+    }
+    
+    // use the volume which has been opened in advance unless the user provided another path
+    archreader_prefetch_wait(ai);
+    if ((ai->nextfd>=0) && (strcmp(ai->nextpath, ai->volpath)==0))
+    {   ai->archfd=ai->nextfd;
+        msgprintf(MSG_VERB2, "Volume [%s] has been opened in advance\n", ai->volpath);
+    }
+    else
+    {   if (ai->nextfd>=0)
+            close(ai->nextfd);
+        ai->archfd=open64(ai->volpath, O_RDONLY|O_LARGEFILE);
+    }
+    ai->nextfd=-1;
     if (ai->archfd<0)
     {   sysprintf ("cannot open archive %s\n", ai->volpath);
         return -1;
@@ -97,6 +185,7 @@ int archreader_open(carchreader *ai)
         return -1;
     }
     
+archreader_open_format:
     // interpret magic an get file format version
     magiclen=strlen(FSA_FILEFORMAT);
     if ((memcmp(volhead+40, "FsArCh_001", magiclen)==0) || (memcmp(volhead+40, "FsArCh_00Y", magiclen)==0))
@@ -136,24 +225,56 @@ int archreader_close(carchreader *ai)
 int archreader_volpath(carchreader *ai)
 {
     int res;
-    res=get_path_to_volume(ai->volpath, PATH_MAX, ai->basepath, ai->curvol);
+    if (strcmp(ai->basepath, FSA_STREAM_PATH)==0) // archive piped on stdin
+    {   ai->stream=true;
+        snprintf(ai->volpath, PATH_MAX, "%s", FSA_STREAM_PATH);
+        return 0;
+    }
+    res=get_path_to_volume(ai->volpath, PATH_MAX, ai->basepath, ai->curvol, &g_options.voldirs);
     return res;
 }
 
 int archreader_incvolume(carchreader *ai, bool waitkeypress)
 {
     assert(ai);
+    archreader_prefetch_wait(ai); // the next volume is known to exist if it has been opened in advance
     ai->curvol++;
     return archreader_volpath(ai);
 }
 
 int archreader_read_data(carchreader *ai, void *data, u64 size)
 {
+    u64 done=0;
     long lres;
     
     assert(ai);
+    
+    // first give the data which has been pushed back
+    if (ai->pushbuf!=NULL)
+    {
+        done=min(size, (u64)(ai->pushlen-ai->pushpos));
+        memcpy(data, ai->pushbuf+ai->pushpos, done);
+        ai->pushpos+=done;
+        if (ai->pushpos>=ai->pushlen)
+        {   free(ai->pushbuf);
+            ai->pushbuf=NULL;
+        }
+        if (done==size)
+            return 0;
+    }
+    
+    if (ai->stream==true) // a pipe can return less than requested
+    {
+        while ((done < size) && ((lres=read(ai->archfd, (char*)data+done, (long)(size-done)))>0))
+            done+=lres;
+        if (done!=size)
+        {   sysprintf("read failed: read(size=%ld)=%ld\n", (long)size, (long)done);
+            return -1;
+        }
+        return 0;
+    }
 
-    if ((lres=read(ai->archfd, (char*)data, (long)size))!=(long)size)
+    if ((lres=read(ai->archfd, (char*)data+done, (long)(size-done)))!=(long)(size-done))
     {   sysprintf("read failed: read(size=%ld)=%ld\n", (long)size, lres);
         return -1;
     }
@@ -161,6 +282,54 @@ int archreader_read_data(carchreader *ai, void *data, u64 size)
     return 0;
 }
 
+// the next archreader_read_data() will return that data again (used where a file would be rewound)
+int archreader_unread_data(carchreader *ai, void *data, u32 size)
+{
+    u32 remaining;
+    char *buffer;
+    
+    assert(ai);
+    
+    remaining=(ai->pushbuf!=NULL)?(ai->pushlen-ai->pushpos):(0);
+    if ((buffer=malloc(size+remaining))==NULL)
+    {   errprintf("malloc(%ld) failed: out of memory\n", (long)(size+remaining));
+        return -1;
+    }
+    memcpy(buffer, data, size);
+    if (remaining>0)
+        memcpy(buffer+size, ai->pushbuf+ai->pushpos, remaining);
+    free(ai->pushbuf);
+    ai->pushbuf=buffer;
+    ai->pushlen=size+remaining;
+    ai->pushpos=0;
+    return 0;
+}
+
+int archreader_skip_data(carchreader *ai, u64 size)
+{
+    char buffer[65536];
+    u64 len;
+    
+    assert(ai);
+    
+    if ((ai->stream==false) && (ai->pushbuf==NULL))
+    {
+        if (lseek64(ai->archfd, (long)size, SEEK_CUR)<0)
+        {   sysprintf("lseek64(size=%ld, SEEK_CUR) failed\n", (long)size);
+            return -1;
+        }
+        return 0;
+    }
+    
+    for (; size>0; size-=len) // stdin: read and discard
+    {
+        len=min(size, (u64)sizeof(buffer));
+        if (archreader_read_data(ai, buffer, len)!=0)
+            return -1;
+    }
+    return 0;
+}
+
 int archreader_read_dico(carchreader *ai, cdico *d)
 {
     u16 size;
@@ -268,7 +437,6 @@ int archreader_read_dico(carchreader *ai, cdico *d)
 
 int archreader_read_header(carchreader *ai, char *magic, cdico **d, bool allowseek, u16 *fsid)
 {
-    s64 curpos;
     u16 temp16;
     u32 temp32;
     u32 archid;
@@ -289,11 +457,6 @@ int archreader_read_header(carchreader *ai, char *magic, cdico **d, bool allowse
     }
     
     // search for next read header marker and magic (it may be further if corruption in archive)
-    if ((curpos=lseek64(ai->archfd, 0, SEEK_CUR))<0)
-    {   sysprintf("lseek64() failed to get the current position in archive\n");
-        return OLDERR_FATAL;
-    }
-    
     if ((res=archreader_read_data(ai, magic, FSA_SIZEOF_MAGIC))!=FSAERR_SUCCESS)
     {   msgprintf(MSG_STACK, "cannot read header magic: res=%d\n", res);
         return OLDERR_FATAL;
@@ -305,13 +468,10 @@ int archreader_read_header(carchreader *ai, char *magic, cdico **d, bool allowse
         return OLDERR_FATAL;
     }
     
-    while (is_magic_valid(magic)!=true)
+    while (is_magic_valid(magic)!=true) // move the window one byte further (works without seeking on stdin)
     {
-        if (lseek64(ai->archfd, curpos++, SEEK_SET)<0)
-        {   sysprintf("lseek64(pos=%lld, SEEK_SET) failed\n", (long long)curpos);
-            return OLDERR_FATAL;
-        }
-        if ((res=archreader_read_data(ai, magic, FSA_SIZEOF_MAGIC))!=FSAERR_SUCCESS)
+        memmove(magic, magic+1, FSA_SIZEOF_MAGIC-1);
+        if ((res=archreader_read_data(ai, magic+FSA_SIZEOF_MAGIC-1, 1))!=FSAERR_SUCCESS)
         {   msgprintf(MSG_STACK, "cannot read header magic: res=%d\n", res);
             return OLDERR_FATAL;
         }
@@ -443,6 +603,8 @@ int archreader_read_block(carchreader *ai, cdico *in_blkdico, int in_skipblock,
     u32 finalsize; // compressed  block size
     u32 compsize;
     u8 *buffer;
+    u8 cryptnonce[FSA_CRYPT_NONCESIZE];
+    u8 crypttag[FSA_CRYPT_TAGSIZE];
     
     assert(ai);
     assert(out_sumok);
@@ -458,7 +620,7 @@ int archreader_read_block(carchreader *ai, cdico *in_blkdico, int in_skipblock,
         return -1;
     }
     
-    if (dico_get_u32(in_blkdico, 0, BLOCKHEADITEMKEY_REALSIZE, &curblocksize)!=0 || curblocksize>FSA_MAX_BLKSIZE)
+    if (dico_get_u32(in_blkdico, 0, BLOCKHEADITEMKEY_REALSIZE, &curblocksize)!=0 || curblocksize>ai->maxblksize)
     {   msgprintf(3, "cannot get blocksize from block-header\n");
         return -1;
     }
@@ -473,7 +635,8 @@ int archreader_read_block(carchreader *ai, cdico *in_blkdico, int in_skipblock,
         return -1;
     }
     
-    if (dico_get_u32(in_blkdico, 0, BLOCKHEADITEMKEY_ARSIZE, &finalsize)!=0)
+    // a block is stored as it is when its compression does not save space: what is read is never much bigger
+    if (dico_get_u32(in_blkdico, 0, BLOCKHEADITEMKEY_ARSIZE, &finalsize)!=0 || finalsize>ai->maxblksize+64)
     {   msgprintf(3, "cannot get BLOCKHEADITEMKEY_ARSIZE from block-header\n");
         return -1;
     }
@@ -488,10 +651,17 @@ int archreader_read_block(carchreader *ai, cdico *in_blkdico, int in_skipblock,
         return -1;
     }
     
+    if ((cryptalgo==ENCRYPT_AES256GCM) &&
+        ((dico_get_data(in_blkdico, 0, BLOCKHEADITEMKEY_CRYPTNONCE, cryptnonce, sizeof(cryptnonce), NULL)!=0) ||
+        (dico_get_data(in_blkdico, 0, BLOCKHEADITEMKEY_CRYPTTAG, crypttag, sizeof(crypttag), NULL)!=0)))
+    {   msgprintf(3, "cannot get BLOCKHEADITEMKEY_CRYPTNONCE or BLOCKHEADITEMKEY_CRYPTTAG from block-header\n");
+        return -1;
+    }
+    
     if (in_skipblock==true) // the main thread does not need that block (block belongs to a filesys we want to skip)
     {
-        if (lseek64(ai->archfd, (long)finalsize, SEEK_CUR)<0)
-        {   sysprintf("cannot skip block (finalsize=%ld) failed\n", (long)finalsize);
+        if (archreader_skip_data(ai, finalsize)!=0)
+        {   msgprintf(MSG_STACK, "cannot skip block (finalsize=%ld) failed\n", (long)finalsize);
             return -1;
         }
         return 0;
@@ -503,8 +673,8 @@ int archreader_read_block(carchreader *ai, cdico *in_blkdico, int in_skipblock,
         return FSAERR_ENOMEM;
     }
     
-    if (read(ai->archfd, buffer, (long)finalsize)!=(long)finalsize)
-    {   sysprintf("cannot read block (finalsize=%ld) failed\n", (long)finalsize);
+    if (archreader_read_data(ai, buffer, finalsize)!=0)
+    {   msgprintf(MSG_STACK, "cannot read block (finalsize=%ld) failed\n", (long)finalsize);
         free(buffer);
         return -1;
     }
@@ -518,12 +688,21 @@ int archreader_read_block(carchreader *ai, cdico *in_blkdico, int in_skipblock,
     out_blkinfo->blkcryptalgo=cryptalgo;
     out_blkinfo->blkarsize=finalsize;
     out_blkinfo->blkcompsize=compsize;
+    if (cryptalgo==ENCRYPT_AES256GCM)
+    {   memcpy(out_blkinfo->blkcryptnonce, cryptnonce, FSA_CRYPT_NONCESIZE);
+        memcpy(out_blkinfo->blkcrypttag, crypttag, FSA_CRYPT_TAGSIZE);
+    }
     
     // ---- checksum
     arblockcsumcalc=fletcher32(buffer, finalsize);
     if (arblockcsumcalc!=arblockcsumorig) // bad checksum
     {
         errprintf("block is corrupt at offset=%ld, blksize=%ld\n", (long)blockoffset, (long)curblocksize);
+        // go to the beginning of the corrupted contents so that the next header is searched here
+        if ((ai->stream==true) && (archreader_unread_data(ai, buffer, finalsize)!=0))
+            errprintf("archreader_unread_data() failed\n");
+        else if ((ai->stream==false) && (lseek64(ai->archfd, -(long long)finalsize, SEEK_CUR)<0))
+            errprintf("lseek64() failed\n");
         free(out_blkinfo->blkdata);
         if ((out_blkinfo->blkdata=malloc(curblocksize))==NULL)
         {   errprintf("cannot allocate block: malloc(%d) failed\n", curblocksize);
@@ -531,10 +710,6 @@ int archreader_read_block(carchreader *ai, cdico *in_blkdico, int in_skipblock,
         }
         memset(out_blkinfo->blkdata, 0, curblocksize);
         *out_sumok=false;
-        // go to the beginning of the corrupted contents so that the next header is searched here
-        if (lseek64(ai->archfd, -(long long)finalsize, SEEK_CUR)<0)
-        {   errprintf("lseek64() failed\n");
-        }
     }
     else // no corruption detected
     {
@@ -543,3 +718,115 @@ int archreader_read_block(carchreader *ai, cdico *in_blkdico, int in_skipblock,
     
     return 0;
 }
+
+s64 archreader_get_currentpos(carchreader *ai)
+{
+    assert(ai);
+    return (s64)lseek64(ai->archfd, 0, SEEK_CUR);
+}
+
+// true while the reader has not reached that position of the archive
+int archreader_is_before(carchreader *ai, u32 curvol, u64 offset)
+{
+    s64 curpos;
+    
+    assert(ai);
+    
+    if (ai->curvol!=curvol)
+        return (ai->curvol < curvol);
+    return ((curpos=archreader_get_currentpos(ai))>=0) && ((u64)curpos < offset);
+}
+
+// go to the beginning of a run, which may be in another volume
+int archreader_seek(carchreader *ai, u32 curvol, u64 offset)
+{
+    assert(ai);
+    
+    if ((ai->curvol!=curvol) || (ai->archfd<0))
+    {
+        archreader_close(ai);
+        ai->curvol=curvol;
+        if (archreader_volpath(ai)!=0)
+        {   errprintf("archreader_volpath() failed\n");
+            return -1;
+        }
+        msgprintf(MSG_VERB2, "Opening volume [%s]\n", ai->volpath);
+        if (archreader_open(ai)!=0)
+        {   msgprintf(MSG_STACK, "archreader_open() failed\n");
+            return -1;
+        }
+        if (archreader_read_volheader(ai)!=0)
+        {   msgprintf(MSG_STACK, "archreader_read_volheader() failed\n");
+            return -1;
+        }
+    }
+    
+    if (lseek64(ai->archfd, (off64_t)offset, SEEK_SET)<0)
+    {   sysprintf("lseek64(%lld) failed in volume %s\n", (long long)offset, ai->volpath);
+        return -1;
+    }
+    return 0;
+}
+
+// read the index of the runs from the end of the last volume of an archive saved with --concurrent-fs
+int archreader_read_runindex(carchreader *ai, crunindex *ri)
+{
+    u8 trailer[RUNINDEX_TRAILER_SIZE];
+    char magic[FSA_SIZEOF_MAGIC];
+    char nextpath[PATH_MAX];
+    struct stat64 st;
+    carchreader idx;
+    cdico *d=NULL;
+    u64 offset;
+    u16 fsid;
+    int ret=-1;
+    
+    assert(ai);
+    assert(ri);
+    
+    // the volumes which are not found here may be elsewhere: then the archive is read from the beginning
+    archreader_init(&idx);
+    snprintf(idx.basepath, PATH_MAX, "%s", ai->basepath);
+    idx.archid=ai->archid;
+    for (idx.curvol=ai->curvol; (get_path_to_volume(nextpath, PATH_MAX, idx.basepath, idx.curvol+1, &g_options.voldirs)==0) &&
+        (regfile_exists(nextpath)==true); idx.curvol++);
+    
+    if ((archreader_volpath(&idx)!=0) || (archreader_open(&idx)!=0))
+        goto archreader_read_runindex_end;
+    if ((fstat64(idx.archfd, &st)!=0) || (st.st_size < RUNINDEX_TRAILER_SIZE) ||
+        (pread64(idx.archfd, trailer, RUNINDEX_TRAILER_SIZE, st.st_size-RUNINDEX_TRAILER_SIZE)!=RUNINDEX_TRAILER_SIZE))
+        goto archreader_read_runindex_close;
+    if (runindex_trailer_decode(trailer, ai->archid, &offset)!=0)
+    {   msgprintf(MSG_VERB2, "there is no index of the runs at the end of [%s]\n", idx.volpath);
+        goto archreader_read_runindex_close;
+    }
+    if (lseek64(idx.archfd, (off64_t)offset, SEEK_SET)<0)
+    {   sysprintf("lseek64(%lld) failed in volume %s\n", (long long)offset, idx.volpath);
+        goto archreader_read_runindex_close;
+    }
+    
+    // the index headers are followed by the footer of the last volume
+    while (archreader_read_header(&idx, magic, &d, false, &fsid)==FSAERR_SUCCESS)
+    {
+        if (memcmp(magic, FSA_MAGIC_RUNX, FSA_SIZEOF_MAGIC)!=0)
+        {   ret=0;
+            break;
+        }
+        if ((runindex_read_header(ri, d)!=0) || (ri->runs[ri->count-1].curvol > idx.curvol))
+            break;
+        dico_destroy(d);
+        d=NULL;
+    }
+    if (ret!=0)
+        errprintf("cannot read the index of the runs in [%s]\n", idx.volpath);
+    msgprintf(MSG_VERB2, "%lld runs have been found in the index\n", (long long)ri->count);
+    
+archreader_read_runindex_close:
+    dico_destroy(d);
+    archreader_close(&idx);
+archreader_read_runindex_end:
+    archreader_destroy(&idx);
+    if (ret!=0)
+        runindex_destroy(ri);
+    return ret;
+}
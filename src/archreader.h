@@ -19,10 +19,12 @@
 #define __ARCHREADER_H__
 
 #include <limits.h>
+#include <pthread.h>
 
 struct s_blockinfo;
 struct s_headinfo;
 struct s_dico;
+struct s_runindex;
 
 struct s_archreader;
 typedef struct s_archreader carchreader;
@@ -40,12 +42,26 @@ struct s_archreader
     u64    creattime; // archive create time (number of seconds since epoch)
     u64    minfsaver; // minimum fsarchiver version required to restore that archive
     u32    hasdirsinfohead; // true if the archive has a "DiRs" header (introduced in 0.6.7)
+    u32    fsinterleaved; // true if the filesystems have been saved concurrently (introduced in 0.8.6)
+    u32    hasduplicates; // true if identical small files have been saved only once (introduced in 0.8.6)
+    u32    hasreflinks; // true if the shared extents of the files have been saved only once (introduced in 0.8.6)
+    u32    groupsmall; // true if the small files have been packed by type: a pack can be queued long after its files
+    u32    maxblksize; // size of the biggest data block allowed in that archive (larger with --large-blocks in 0.8.6)
     int    filefmtver; // set to 1 for "FsArCh_001" or 2 for "FsArCh_002"
     char   filefmt[FSA_MAX_FILEFMTLEN]; // file format of that archive
     char   creatver[FSA_MAX_PROGVERLEN]; // fsa version used to create archive
     char   label[FSA_MAX_LABELLEN]; // archive label defined by the user
     char   basepath[PATH_MAX]; // path of the first volume of an archive
     char   volpath[PATH_MAX]; // path of the current volume of an archive
+    char   nextpath[PATH_MAX]; // path of the next volume which is being opened in advance
+    int    nextfd; // file descriptor of the next volume opened in advance (-1 if not available)
+    bool   prefetching; // true while prefetchthr is running or has not been joined yet
+    pthread_t prefetchthr; // thread which opens the next volume and reads its beginning
+    bool   stream; // true when the archive is read from stdin (no seek)
+    char   *pushbuf; // data read from stdin which must be read again (NULL if none)
+    u32    pushlen; // size of the data in pushbuf
+    u32    pushpos; // how much of pushbuf has already been read again
+    bool   skipblocks; // only the headers are needed (archlist): the data blocks are skipped
 };
 
 int archreader_init(carchreader *ai);
@@ -53,11 +69,18 @@ int archreader_destroy(carchreader *ai);
 int archreader_open(carchreader *ai);
 int archreader_close(carchreader *ai);
 int archreader_incvolume(carchreader *ai, bool waitkeypress);
+int archreader_prefetch_next(carchreader *ai);
 int archreader_volpath(carchreader *ai);
 int archreader_read_data(carchreader *ai, void *data, u64 size);
+int archreader_unread_data(carchreader *ai, void *data, u32 size);
+int archreader_skip_data(carchreader *ai, u64 size);
 int archreader_read_dico(carchreader *ai, struct s_dico *d);
 int archreader_read_volheader(carchreader *ai);
 int archreader_read_header(carchreader *ai, char *magic, struct s_dico **d, bool allowseek, u16 *fsid);
 int archreader_read_block(carchreader *ai, struct s_dico *in_blkdico, int in_skipblock, int *out_sumok, struct s_blockinfo *out_blkinfo);
+s64 archreader_get_currentpos(carchreader *ai);
+int archreader_is_before(carchreader *ai, u32 curvol, u64 offset);
+int archreader_seek(carchreader *ai, u32 curvol, u64 offset);
+int archreader_read_runindex(carchreader *ai, struct s_runindex *ri);
 
 #endif // __ARCHREADER_H__
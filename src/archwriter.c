@@ -26,6 +26,7 @@
 #include <sys/statvfs.h>
 #include <sys/stat.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "fsarchiver.h"
 #include "dico.h"
@@ -37,6 +38,7 @@
 #include "comp_gzip.h"
 #include "comp_bzip2.h"
 #include "error.h"
+#include "throttle.h"
 
 #define FSA_SMB_SUPER_MAGIC 0x517B
 #define FSA_CIFS_MAGIC_NUMBER 0xFF534D42
@@ -50,13 +52,24 @@ int archwriter_init(carchwriter *ai)
     ai->archfd=-1;
     ai->archid=0;
     ai->curvol=0;
+    ai->runindexpos=-1;
+    runindex_init(&ai->runindex);
     return 0;
 }
 
 int archwriter_destroy(carchwriter *ai)
 {
+    int i;
+    
     assert(ai);
+    archwriter_finalize_wait(ai);
     strlist_destroy(&ai->vollist);
+    for (i=0; i < FSA_MAX_FSPERARCH; i++)
+    {   if (ai->runbuf[i]!=NULL)
+            writebuf_destroy(ai->runbuf[i]);
+        ai->runbuf[i]=NULL;
+    }
+    runindex_destroy(&ai->runindex);
     return 0;
 }
 
@@ -79,6 +92,13 @@ int archwriter_create(carchwriter *ai)
     
     assert(ai);
     
+    if (ai->stream==true) // the archive is piped to another program
+    {   ai->archfd=STDOUT_FILENO;
+        ai->streampos=0;
+        ai->newarch=true;
+        return 0;
+    }
+    
     // init
     memset(&st, 0, sizeof(st));
     archflags=O_RDWR|O_CREAT|O_TRUNC|O_LARGEFILE;
@@ -118,6 +138,10 @@ int archwriter_create(carchwriter *ai)
     }
     ai->newarch=true;
     
+    // reserve the space of the whole volume to reduce the fragmentation (trimmed when the volume is closed)
+    if ((g_options.splitsize>0) && (fallocate(ai->archfd, FALLOC_FL_KEEP_SIZE, 0, g_options.splitsize)!=0))
+        msgprintf(MSG_DEBUG1, "cannot preallocate %s, the filesystem may not support it\n", ai->volpath);
+    
     strlist_add(&ai->vollist, ai->volpath);
     
     /* lockf is causing corruption when the archive is written on a smbfs/cifs filesystem */
@@ -130,14 +154,79 @@ int archwriter_create(carchwriter *ai)
     return 0;
 }
 
+// reopen an archive which was interrupted and truncate it at the position of the checkpoint
+int archwriter_resume(carchwriter *ai)
+{
+    char volpath[PATH_MAX];
+    struct stat64 st;
+    u32 vol;
+    
+    assert(ai);
+    
+    // remove the volumes which have been written after the checkpoint
+    for (vol=ai->ckpt.curvol+1; (get_path_to_volume(volpath, sizeof(volpath), ai->basepath, vol, &g_options.voldirs)==0) && (stat64(volpath, &st)==0); vol++)
+    {
+        if (unlink(volpath)!=0)
+        {   sysprintf("cannot remove %s\n", volpath);
+            return -1;
+        }
+        msgprintf(MSG_VERB2, "removed %s which was written after the checkpoint\n", volpath);
+    }
+    
+    // the archive keeps the volumes which were complete before the checkpoint
+    for (vol=0; vol <= ai->ckpt.curvol; vol++)
+    {
+        get_path_to_volume(volpath, sizeof(volpath), ai->basepath, vol, &g_options.voldirs);
+        if ((stat64(volpath, &st)!=0) || !S_ISREG(st.st_mode))
+        {   errprintf("volume %s is missing, cannot resume the archive\n", volpath);
+            return -1;
+        }
+        strlist_add(&ai->vollist, volpath);
+    }
+    
+    ai->curvol=ai->ckpt.curvol;
+    archwriter_volpath(ai);
+    if ((stat64(ai->volpath, &st)!=0) || ((u64)st.st_size < ai->ckpt.offset))
+    {   errprintf("volume %s is shorter than the checkpoint, cannot resume the archive\n", ai->volpath);
+        return -1;
+    }
+    
+    if ((ai->archfd=open64(ai->volpath, O_RDWR|O_LARGEFILE))<0)
+    {   sysprintf("cannot open archive %s\n", ai->volpath);
+        return -1;
+    }
+    
+    if ((ftruncate64(ai->archfd, ai->ckpt.offset)!=0) || (lseek64(ai->archfd, ai->ckpt.offset, SEEK_SET)!=(off64_t)ai->ckpt.offset))
+    {   sysprintf("cannot truncate archive %s at offset %lld\n", ai->volpath, (long long)ai->ckpt.offset);
+        archwriter_close(ai);
+        return -1;
+    }
+    
+    msgprintf(MSG_VERB1, "Resuming archive %s from volume %ld at offset %lld\n", 
+        ai->basepath, (long)ai->curvol, (long long)ai->ckpt.offset);
+    return 0;
+}
+
+// release the space which has been preallocated after the end of the volume
+static void archwriter_trim(int fd)
+{
+    s64 pos;
+    
+    if ((g_options.splitsize>0) && ((pos=(s64)lseek64(fd, 0, SEEK_CUR))>=0) && (ftruncate64(fd, pos)!=0))
+        sysprintf("cannot trim the volume to its size\n");
+}
+
 int archwriter_close(carchwriter *ai)
 {
     assert(ai);
     
+    archwriter_finalize_wait(ai); // the volumes must be on disk in the same order as they are written
+    
     if (ai->archfd<0)
         return -1;
     
     //res=lockf(ai->archfd, F_ULOCK, 0);
+    archwriter_trim(ai->archfd);
     fsync(ai->archfd); // just in case the user reboots after it exits
     close(ai->archfd);
     ai->archfd=-1;
@@ -145,6 +234,54 @@ int archwriter_close(carchwriter *ai)
     return 0;
 }
 
+static void *archwriter_finalize_fct(void *args)
+{
+    carchwriter *ai=(carchwriter *)args;
+    
+    archwriter_trim(ai->finalfd);
+    fsync(ai->finalfd); // just in case the user reboots after it exits
+    close(ai->finalfd);
+    // the previous volume is on disk: the save can now be resumed from the last checkpoint
+    if ((ai->finalckpt.valid==true) && (checkpoint_write(&ai->finalckpt, ai->basepath)!=0))
+        errprintf("cannot write the checkpoint journal, the save will not be resumable\n");
+    return NULL;
+}
+
+// wait until the volume which has been closed by archwriter_close_async() is on disk
+int archwriter_finalize_wait(carchwriter *ai)
+{
+    assert(ai);
+    
+    if (ai->finalizing==true)
+    {   pthread_join(ai->finalthr, NULL);
+        ai->finalizing=false;
+    }
+    return 0;
+}
+
+// sync and close the current volume in the background while the next one is being written
+int archwriter_close_async(carchwriter *ai)
+{
+    assert(ai);
+    
+    if (ai->archfd<0)
+        return -1;
+    
+    archwriter_finalize_wait(ai);
+    ai->finalfd=ai->archfd;
+    ai->finalckpt=ai->ckpt;
+    ai->archfd=-1;
+    
+    if (pthread_create(&ai->finalthr, NULL, archwriter_finalize_fct, (void*)ai)!=0)
+    {   errprintf("pthread_create(archwriter_finalize_fct) failed\n");
+        archwriter_finalize_fct(ai);
+        return 0;
+    }
+    ai->finalizing=true;
+    
+    return 0;
+}
+
 int archwriter_remove(carchwriter *ai)
 {
     char volpath[PATH_MAX];
@@ -178,6 +315,8 @@ int archwriter_remove(carchwriter *ai)
 s64 archwriter_get_currentpos(carchwriter *ai)
 {
     assert(ai);
+    if (ai->stream==true)
+        return ai->streampos;
     return (s64)lseek64(ai->archfd, 0, SEEK_CUR);
 }
 
@@ -185,6 +324,7 @@ int archwriter_write_buffer(carchwriter *ai, struct s_writebuf *wb)
 {
     struct statvfs64 statvfsbuf;
     char textbuf[128];
+    u64 done;
     long lres;
     
     assert(ai);
@@ -194,6 +334,21 @@ int archwriter_write_buffer(carchwriter *ai, struct s_writebuf *wb)
     {   errprintf("wb->size=%ld\n", (long)wb->size);
         return -1;
     }
+    
+    throttle_write(wb->size);
+    
+    if (ai->stream==true) // a pipe can accept less than requested
+    {
+        for (done=0; done < wb->size; done+=lres)
+        {
+            if ((lres=write(ai->archfd, (char*)wb->data+done, (long)(wb->size-done)))<=0)
+            {   sysprintf("write(size=%ld) to the standard output failed\n", (long)(wb->size-done));
+                return -1;
+            }
+        }
+        ai->streampos+=wb->size;
+        return 0;
+    }
 
     if ((lres=write(ai->archfd, (char*)wb->data, (long)wb->size))!=(long)wb->size)
     {
@@ -225,7 +380,12 @@ int archwriter_write_buffer(carchwriter *ai, struct s_writebuf *wb)
 int archwriter_volpath(carchwriter *ai)
 {
     int res;
-    res=get_path_to_volume(ai->volpath, PATH_MAX, ai->basepath, ai->curvol);
+    if (strcmp(ai->basepath, FSA_STREAM_PATH)==0) // archive written to stdout
+    {   ai->stream=true;
+        snprintf(ai->volpath, PATH_MAX, "%s", FSA_STREAM_PATH);
+        return 0;
+    }
+    res=get_path_to_volume(ai->volpath, PATH_MAX, ai->basepath, ai->curvol, &g_options.voldirs);
     return res;
 }
 
@@ -286,6 +446,7 @@ int archwriter_write_volheader(carchwriter *ai)
 
 int archwriter_write_volfooter(carchwriter *ai, bool lastvol)
 {
+    u8 trailer[RUNINDEX_TRAILER_SIZE];
     struct s_writebuf *wb=NULL;
     cdico *voldico;
     
@@ -312,6 +473,16 @@ int archwriter_write_volfooter(carchwriter *ai, bool lastvol)
         return -1;
     }
     
+    // the readers stop at the last footer: what follows is only read by the restores which look for the index
+    if ((lastvol==true) && (ai->runindexpos>=0))
+    {
+        runindex_trailer_encode(trailer, ai->archid, (u64)ai->runindexpos);
+        if (writebuf_add_data(wb, trailer, RUNINDEX_TRAILER_SIZE)!=0)
+        {   msgprintf(MSG_STACK, "writebuf_add_data() failed\n");
+            return -1;
+        }
+    }
+    
     // write header to file
     if (archwriter_write_buffer(ai, wb)!=0)
     {   msgprintf(MSG_STACK, "archwriter_write_data(size=%ld) failed\n", (long)wb->size);
@@ -354,7 +525,7 @@ int archwriter_split_if_necessary(carchwriter *ai, struct s_writebuf *wb)
         {   msgprintf(MSG_STACK, "cannot write volume footer: archio_write_volfooter() failed\n");
             return -1;
         }
-        archwriter_close(ai);
+        archwriter_close_async(ai); // the writer continues in the next volume while this one is synced
         archwriter_incvolume(ai, false);
         msgprintf(MSG_VERB2, "Creating new volume: [%s]\n", ai->volpath);
         if (archwriter_create(ai)!=0)
@@ -369,6 +540,79 @@ int archwriter_split_if_necessary(carchwriter *ai, struct s_writebuf *wb)
     return 0;
 }
 
+// runs are kept small enough to fit in a volume so that each one can be read with a single seek
+static u64 archwriter_runsize()
+{
+    if ((g_options.splitsize>0) && (g_options.splitsize/16 < FSA_RUN_SIZE))
+        return max(g_options.splitsize/16, 1);
+    return FSA_RUN_SIZE;
+}
+
+// write the run of a filesystem in one piece and remember where it is
+static int archwriter_flush_run(carchwriter *ai, u16 fsid)
+{
+    struct s_writebuf *wb=ai->runbuf[fsid];
+    s64 curpos;
+    
+    if (wb==NULL)
+        return 0;
+    ai->runbuf[fsid]=NULL;
+    
+    if (archwriter_split_if_necessary(ai, wb)!=0)
+    {   msgprintf(MSG_STACK, "archwriter_split_if_necessary() failed\n");
+        writebuf_destroy(wb);
+        return -1;
+    }
+    
+    if (((curpos=archwriter_get_currentpos(ai))<0) || (runindex_add(&ai->runindex, fsid, ai->curvol, (u64)curpos, wb->size)!=0))
+    {   errprintf("cannot record the position of the run of filesystem %d\n", (int)fsid);
+        writebuf_destroy(wb);
+        return -1;
+    }
+    
+    if (archwriter_write_buffer(ai, wb)!=0)
+    {   msgprintf(MSG_STACK, "archwriter_write_buffer() failed\n");
+        writebuf_destroy(wb);
+        return -1;
+    }
+    
+    writebuf_destroy(wb);
+    return 0;
+}
+
+// the headers and blocks of a filesystem are appended to its run when several filesystems are saved concurrently
+static int archwriter_write_item(carchwriter *ai, struct s_writebuf *wb, u16 fsid)
+{
+    if ((ai->runs==true) && (fsid!=FSA_FILESYSID_NULL))
+    {
+        if (fsid >= FSA_MAX_FSPERARCH)
+        {   errprintf("invalid filesystem id: %d\n", (int)fsid);
+            return -1;
+        }
+        if ((ai->runbuf[fsid]!=NULL) && (ai->runbuf[fsid]->size+wb->size > archwriter_runsize()) && (archwriter_flush_run(ai, fsid)!=0))
+        {   msgprintf(MSG_STACK, "archwriter_flush_run() failed\n");
+            return -1;
+        }
+        if ((ai->runbuf[fsid]==NULL) && ((ai->runbuf[fsid]=writebuf_alloc())==NULL))
+        {   msgprintf(MSG_STACK, "writebuf_alloc() failed\n");
+            return -1;
+        }
+        return writebuf_add_data(ai->runbuf[fsid], wb->data, wb->size);
+    }
+    
+    if (archwriter_split_if_necessary(ai, wb)!=0)
+    {   msgprintf(MSG_STACK, "archwriter_split_if_necessary() failed\n");
+        return -1;
+    }
+    
+    if (archwriter_write_buffer(ai, wb)!=0)
+    {   msgprintf(MSG_STACK, "archwriter_write_buffer() failed\n");
+        return -1;
+    }
+    
+    return 0;
+}
+
 int archwriter_dowrite_block(carchwriter *ai, struct s_blockinfo *blkinfo)
 {
     struct s_writebuf *wb=NULL;
@@ -385,13 +629,8 @@ int archwriter_dowrite_block(carchwriter *ai, struct s_blockinfo *blkinfo)
         return -1;
     }
     
-    if (archwriter_split_if_necessary(ai, wb)!=0)
-    {   msgprintf(MSG_STACK, "archwriter_split_if_necessary() failed\n");
-        return -1;
-    }
-    
-    if (archwriter_write_buffer(ai, wb)!=0)
-    {   msgprintf(MSG_STACK, "archwriter_write_buffer() failed\n");
+    if (archwriter_write_item(ai, wb, blkinfo->blkfsid)!=0)
+    {   msgprintf(MSG_STACK, "archwriter_write_item() failed\n");
         return -1;
     }
 
@@ -415,15 +654,73 @@ int archwriter_dowrite_header(carchwriter *ai, struct s_headinfo *headinfo)
         return -1;
     }
     
-    if (archwriter_split_if_necessary(ai, wb)!=0)
-    {   msgprintf(MSG_STACK, "archwriter_split_if_necessary() failed\n");
+    if (archwriter_write_item(ai, wb, headinfo->fsid)!=0)
+    {   msgprintf(MSG_STACK, "archwriter_write_item() failed\n");
         return -1;
     }
     
-    if (archwriter_write_buffer(ai, wb)!=0)
-    {   msgprintf(MSG_STACK, "archwriter_write_buffer() failed\n");
+    writebuf_destroy(wb);
+    return 0;
+}
+
+// remember the current position: all the objects before it are complete in the archive
+int archwriter_checkpoint(carchwriter *ai, struct s_headinfo *headinfo)
+{
+    s64 curpos;
+    
+    assert(ai);
+    
+    if ((curpos=archwriter_get_currentpos(ai))<0)
+    {   sysprintf("cannot get the current position in the archive\n");
+        return -1;
+    }
+    
+    if ((dico_get_u64(headinfo->dico, 0, CHECKPOINTKEY_OBJECTID, &ai->ckpt.objectid)!=0) ||
+        (dico_get_string(headinfo->dico, 0, CHECKPOINTKEY_PATH, ai->ckpt.path, sizeof(ai->ckpt.path))<0))
+    {   errprintf("invalid checkpoint in the queue\n");
+        return -1;
+    }
+    
+    ai->ckpt.archid=ai->archid;
+    ai->ckpt.fsid=headinfo->fsid;
+    ai->ckpt.curvol=ai->curvol;
+    ai->ckpt.offset=curpos;
+    ai->ckpt.valid=true;
+    return 0;
+}
+
+// write the last runs and the index which gives the position of all the runs of each filesystem
+int archwriter_write_runindex(carchwriter *ai)
+{
+    struct s_writebuf *wb=NULL;
+    s64 curpos;
+    int i;
+    
+    assert(ai);
+    
+    for (i=0; i < FSA_MAX_FSPERARCH; i++)
+    {   if (archwriter_flush_run(ai, i)!=0)
+        {   msgprintf(MSG_STACK, "archwriter_flush_run() failed\n");
+            return -1;
+        }
+    }
+    
+    if (ai->runindex.count==0)
+        return 0;
+    
+    if ((wb=writebuf_alloc())==NULL)
+    {   errprintf("writebuf_alloc() failed\n");
+        return -1;
+    }
+    
+    // the whole index is in the last volume as the trailer only gives an offset in that volume
+    if ((runindex_write(&ai->runindex, wb, ai->archid)!=0) || (archwriter_split_if_necessary(ai, wb)!=0) ||
+        ((curpos=archwriter_get_currentpos(ai))<0) || (archwriter_write_buffer(ai, wb)!=0))
+    {   msgprintf(MSG_STACK, "cannot write the index of the runs\n");
+        writebuf_destroy(wb);
         return -1;
     }
+    ai->runindexpos=curpos;
     
     writebuf_destroy(wb);
     return 0;
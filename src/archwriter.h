@@ -19,7 +19,10 @@
 #define __ARCHWRITER_H__
 
 #include <limits.h>
+#include <pthread.h>
 #include "strlist.h"
+#include "checkpoint.h"
+#include "runindex.h"
 
 struct s_writebuf;
 struct s_blockinfo;
@@ -40,12 +43,27 @@ struct s_archwriter
     char   basepath[PATH_MAX]; // path of the first volume of an archive
     char   volpath[PATH_MAX]; // path of the current volume of an archive
     cstrlist vollist; // paths to all volumes of an archive
+    ccheckpoint ckpt; // last position from which the save can be resumed
+    bool   resume; // reopen the archive at ckpt instead of creating it
+    bool   stream; // true when the archive is written to stdout (no seek, no split)
+    s64    streampos; // how many bytes have been written to stdout
+    bool   finalizing; // true until finalthr has been joined
+    int    finalfd; // file descriptor of the previous volume which is being synced by finalthr
+    ccheckpoint finalckpt; // checkpoint which becomes valid once the previous volume is on disk
+    pthread_t finalthr; // thread which syncs and closes the previous volume
+    bool   runs; // the data of each filesystem are written in runs (several filesystems saved concurrently)
+    struct s_writebuf *runbuf[FSA_MAX_FSPERARCH]; // run of each filesystem which is not written yet
+    crunindex runindex; // position of the runs which have been written
+    s64    runindexpos; // offset of the index in the last volume (-1 if it has not been written)
 };
 
 int archwriter_init(carchwriter *ai);
 int archwriter_destroy(carchwriter *ai);
 int archwriter_create(carchwriter *ai);
+int archwriter_resume(carchwriter *ai);
 int archwriter_close(carchwriter *ai);
+int archwriter_close_async(carchwriter *ai);
+int archwriter_finalize_wait(carchwriter *ai);
 int archwriter_remove(carchwriter *ai);
 int archwriter_generate_id(carchwriter *ai);
 s64 archwriter_get_currentpos(carchwriter *ai);
@@ -59,5 +77,7 @@ int archwriter_split_check(carchwriter *ai, struct s_writebuf *wb);
 int archwriter_split_if_necessary(carchwriter *ai, struct s_writebuf *wb);
 int archwriter_dowrite_block(carchwriter *ai, struct s_blockinfo *blkinfo);
 int archwriter_dowrite_header(carchwriter *ai, struct s_headinfo *headinfo);
+int archwriter_checkpoint(carchwriter *ai, struct s_headinfo *headinfo);
+int archwriter_write_runindex(carchwriter *ai);
 
 #endif // __ARCHWRITER_H__
@@ -0,0 +1,349 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "fsarchiver.h"
+#include "catalog.h"
+#include "common.h"
+#include "error.h"
+
+#define CATALOG_MAGIC          "FsAcAt02"
+#define CATALOG_SIZEOF_MAGIC   8
+#define CATALOG_DEF_TABLESIZE  65536
+
+// fixed part of a record: fsid, pathlen, size, mtime, ctime, ino, md5sum, archid
+#define CATALOG_RECFIXEDSIZE   (2+2+8+8+8+8+16+4)
+
+static u32 catalog_hash(u16 fsid, char *path)
+{
+    u32 hash=2166136261U; // fnv-1a
+
+    hash=(hash^fsid)*16777619U;
+    for (; *path; path++)
+        hash=(hash^(u8)*path)*16777619U;
+    return hash;
+}
+
+static u32 catalog_itemhash(void *item)
+{
+    return catalog_hash(((ccatalogitem *)item)->fsid, ((ccatalogitem *)item)->path);
+}
+
+static int catalog_resize(ccatalog *c, u32 newsize)
+{
+    return hashtable_resize((void ***)&c->table, &c->tablesize, newsize, catalog_itemhash);
+}
+
+int catalog_init(ccatalog *c)
+{
+    if (c==NULL)
+    {   errprintf("invalid param\n");
+        return -1;
+    }
+
+    c->count=0;
+    c->tablesize=0;
+    c->table=NULL;
+    return catalog_resize(c, CATALOG_DEF_TABLESIZE);
+}
+
+int catalog_destroy(ccatalog *c)
+{
+    ccatalogitem *item, *next;
+    u32 i;
+
+    if (c==NULL)
+        return -1;
+
+    for (i=0; (c->table!=NULL) && (i < c->tablesize); i++)
+    {
+        for (item=c->table[i]; item!=NULL; item=next)
+        {   next=item->next;
+            free(item->path);
+            free(item);
+        }
+    }
+
+    free(c->table);
+    c->table=NULL;
+    c->tablesize=0;
+    c->count=0;
+    return 0;
+}
+
+ccatalogitem *catalog_get(ccatalog *c, u16 fsid, char *path)
+{
+    ccatalogitem *item;
+
+    if (c==NULL || c->table==NULL || path==NULL)
+        return NULL;
+
+    for (item=c->table[catalog_hash(fsid, path)%c->tablesize]; item!=NULL; item=item->next)
+        if ((item->fsid==fsid) && (strcmp(item->path, path)==0))
+            return item;
+
+    return NULL;
+}
+
+// add an item to the catalog (or update it if this path is already known)
+int catalog_add(ccatalog *c, ccatalogitem *item)
+{
+    ccatalogitem *lnew;
+    u32 pos;
+
+    if (c==NULL || item==NULL || item->path==NULL)
+    {   errprintf("invalid param\n");
+        return -1;
+    }
+
+    if ((lnew=catalog_get(c, item->fsid, item->path))!=NULL)
+    {   lnew->size=item->size;
+        lnew->mtime=item->mtime;
+        lnew->ctime=item->ctime;
+        lnew->ino=item->ino;
+        lnew->archid=item->archid;
+        memcpy(lnew->md5sum, item->md5sum, 16);
+        return 0;
+    }
+
+    if ((c->count >= 2*(u64)c->tablesize) && (catalog_resize(c, 2*c->tablesize)!=0))
+        return -1;
+
+    if ((lnew=malloc(sizeof(ccatalogitem)))==NULL)
+    {   errprintf("malloc(%ld) failed: out of memory\n", (long)sizeof(ccatalogitem));
+        return -1;
+    }
+    memcpy(lnew, item, sizeof(ccatalogitem));
+    if ((lnew->path=strdup(item->path))==NULL)
+    {   errprintf("strdup() failed: out of memory\n");
+        free(lnew);
+        return -1;
+    }
+
+    pos=catalog_hash(lnew->fsid, lnew->path)%c->tablesize;
+    lnew->next=c->table[pos];
+    c->table[pos]=lnew;
+    c->count++;
+    return 0;
+}
+
+int catalog_remove(ccatalog *c, u16 fsid, char *path)
+{
+    ccatalogitem **prev;
+    ccatalogitem *item;
+
+    if (c==NULL || c->table==NULL || path==NULL)
+        return -1;
+
+    for (prev=&c->table[catalog_hash(fsid, path)%c->tablesize]; (item=*prev)!=NULL; prev=&item->next)
+    {
+        if ((item->fsid==fsid) && (strcmp(item->path, path)==0))
+        {   *prev=item->next;
+            free(item->path);
+            free(item);
+            c->count--;
+            return 0;
+        }
+    }
+
+    return -1; // not found
+}
+
+// times are stored in nanoseconds so that a file modified twice in the same second is not missed
+u64 catalog_time(struct timespec *ts)
+{
+    return ((u64)ts->tv_sec*1000000000LL)+(u64)ts->tv_nsec;
+}
+
+// a file is considered as unchanged if its size, times and inode number are all the same
+bool catalog_item_unchanged(ccatalogitem *item, struct stat64 *st)
+{
+    return (item->size==(u64)st->st_size) && (item->mtime==catalog_time(&st->st_mtim)) &&
+        (item->ctime==catalog_time(&st->st_ctim)) && (item->ino==(u64)st->st_ino);
+}
+
+int catalog_write(ccatalog *c, char *filepath)
+{
+    u8 record[CATALOG_RECFIXEDSIZE+PATH_MAX];
+    ccatalogitem *item;
+    u16 pathlen;
+    u32 checksum;
+    u32 reclen;
+    u8 *bufpos;
+    u16 temp16;
+    u32 temp32;
+    u64 temp64;
+    FILE *f;
+    u32 i;
+
+    if (c==NULL || filepath==NULL)
+    {   errprintf("invalid param\n");
+        return -1;
+    }
+
+    if ((f=fopen64(filepath, "wb"))==NULL)
+    {   sysprintf("cannot open catalog [%s] for writing\n", filepath);
+        return -1;
+    }
+
+    if (fwrite(CATALOG_MAGIC, CATALOG_SIZEOF_MAGIC, 1, f)!=1)
+        goto catalog_write_error;
+
+    for (i=0; i < c->tablesize; i++)
+    {
+        for (item=c->table[i]; item!=NULL; item=item->next)
+        {
+            pathlen=strlen(item->path);
+            bufpos=record;
+            temp16=cpu_to_le16(item->fsid);
+            bufpos=mempcpy(bufpos, &temp16, sizeof(temp16));
+            temp16=cpu_to_le16(pathlen);
+            bufpos=mempcpy(bufpos, &temp16, sizeof(temp16));
+            bufpos=mempcpy(bufpos, item->path, pathlen);
+            temp64=cpu_to_le64(item->size);
+            bufpos=mempcpy(bufpos, &temp64, sizeof(temp64));
+            temp64=cpu_to_le64(item->mtime);
+            bufpos=mempcpy(bufpos, &temp64, sizeof(temp64));
+            temp64=cpu_to_le64(item->ctime);
+            bufpos=mempcpy(bufpos, &temp64, sizeof(temp64));
+            temp64=cpu_to_le64(item->ino);
+            bufpos=mempcpy(bufpos, &temp64, sizeof(temp64));
+            bufpos=mempcpy(bufpos, item->md5sum, 16);
+            temp32=cpu_to_le32(item->archid);
+            bufpos=mempcpy(bufpos, &temp32, sizeof(temp32));
+
+            reclen=cpu_to_le32((u32)(bufpos-record));
+            checksum=cpu_to_le32(fletcher32(record, bufpos-record));
+            if ((fwrite(&reclen, sizeof(reclen), 1, f)!=1) || (fwrite(record, bufpos-record, 1, f)!=1) ||
+                (fwrite(&checksum, sizeof(checksum), 1, f)!=1))
+                goto catalog_write_error;
+        }
+    }
+
+    // a zero length record marks the end of the catalog
+    reclen=0;
+    if (fwrite(&reclen, sizeof(reclen), 1, f)!=1)
+        goto catalog_write_error;
+
+    if (fclose(f)!=0)
+    {   sysprintf("cannot close catalog [%s]\n", filepath);
+        return -1;
+    }
+
+    msgprintf(MSG_VERB1, "Catalog [%s] written with %lld files\n", filepath, (long long)c->count);
+    return 0;
+
+catalog_write_error:
+    sysprintf("cannot write catalog [%s]\n", filepath);
+    fclose(f);
+    return -1;
+}
+
+int catalog_read(ccatalog *c, char *filepath)
+{
+    u8 record[CATALOG_RECFIXEDSIZE+PATH_MAX];
+    char magic[CATALOG_SIZEOF_MAGIC];
+    char path[PATH_MAX];
+    ccatalogitem item;
+    u16 pathlen;
+    u32 checksum;
+    u32 reclen;
+    u8 *bufpos;
+    u16 temp16;
+    u32 temp32;
+    u64 temp64;
+    FILE *f;
+
+    if (c==NULL || filepath==NULL)
+    {   errprintf("invalid param\n");
+        return -1;
+    }
+
+    if ((f=fopen64(filepath, "rb"))==NULL)
+    {   sysprintf("cannot open catalog [%s] for reading\n", filepath);
+        return -1;
+    }
+
+    if ((fread(magic, CATALOG_SIZEOF_MAGIC, 1, f)!=1) || (memcmp(magic, CATALOG_MAGIC, CATALOG_SIZEOF_MAGIC)!=0))
+    {   errprintf("[%s] is not a valid fsarchiver catalog\n", filepath);
+        goto catalog_read_error;
+    }
+
+    while (true)
+    {
+        if (fread(&reclen, sizeof(reclen), 1, f)!=1)
+        {   errprintf("catalog [%s] is truncated\n", filepath);
+            goto catalog_read_error;
+        }
+        if ((reclen=le32_to_cpu(reclen))==0) // end of catalog
+            break;
+        if ((reclen < CATALOG_RECFIXEDSIZE) || (reclen > sizeof(record)) ||
+            (fread(record, reclen, 1, f)!=1) || (fread(&checksum, sizeof(checksum), 1, f)!=1))
+        {   errprintf("catalog [%s] is truncated or corrupt\n", filepath);
+            goto catalog_read_error;
+        }
+        if (le32_to_cpu(checksum)!=fletcher32(record, reclen))
+        {   errprintf("catalog [%s] is corrupt: bad checksum\n", filepath);
+            goto catalog_read_error;
+        }
+
+        bufpos=record;
+        memset(&item, 0, sizeof(item));
+        memcpy(&temp16, bufpos, sizeof(temp16)); bufpos+=sizeof(temp16);
+        item.fsid=le16_to_cpu(temp16);
+        memcpy(&temp16, bufpos, sizeof(temp16)); bufpos+=sizeof(temp16);
+        pathlen=le16_to_cpu(temp16);
+        if ((pathlen >= sizeof(path)) || (CATALOG_RECFIXEDSIZE+pathlen!=reclen))
+        {   errprintf("catalog [%s] is corrupt: invalid path length\n", filepath);
+            goto catalog_read_error;
+        }
+        memcpy(path, bufpos, pathlen); bufpos+=pathlen;
+        path[pathlen]=0;
+        item.path=path;
+        memcpy(&temp64, bufpos, sizeof(temp64)); bufpos+=sizeof(temp64);
+        item.size=le64_to_cpu(temp64);
+        memcpy(&temp64, bufpos, sizeof(temp64)); bufpos+=sizeof(temp64);
+        item.mtime=le64_to_cpu(temp64);
+        memcpy(&temp64, bufpos, sizeof(temp64)); bufpos+=sizeof(temp64);
+        item.ctime=le64_to_cpu(temp64);
+        memcpy(&temp64, bufpos, sizeof(temp64)); bufpos+=sizeof(temp64);
+        item.ino=le64_to_cpu(temp64);
+        memcpy(item.md5sum, bufpos, 16); bufpos+=16;
+        memcpy(&temp32, bufpos, sizeof(temp32)); bufpos+=sizeof(temp32);
+        item.archid=le32_to_cpu(temp32);
+
+        if (catalog_add(c, &item)!=0)
+            goto catalog_read_error;
+    }
+
+    fclose(f);
+    msgprintf(MSG_VERB1, "Catalog [%s] loaded with %lld files\n", filepath, (long long)c->count);
+    return 0;
+
+catalog_read_error:
+    fclose(f);
+    return -1;
+}
@@ -0,0 +1,61 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifndef __CATALOG_H__
+#define __CATALOG_H__
+
+#include "types.h"
+
+struct stat64;
+struct timespec;
+
+struct s_catalog;
+typedef struct s_catalog ccatalog;
+
+struct s_catalogitem;
+typedef struct s_catalogitem ccatalogitem;
+
+// metadata about a regular file saved in an archive (used by incremental backups)
+struct s_catalogitem
+{   ccatalogitem  *next; // first field for hashtable_resize()
+    char          *path;
+    u16           fsid;
+    u64           size;
+    u64           mtime; // nanoseconds since the epoch
+    u64           ctime; // nanoseconds since the epoch
+    u64           ino;
+    u8            md5sum[16];
+    u32           archid; // id of the archive which contains the data of that file
+};
+
+struct s_catalog
+{   ccatalogitem  **table;
+    u32           tablesize;
+    u64           count;
+};
+
+int  catalog_init(ccatalog *c);
+int  catalog_destroy(ccatalog *c);
+int  catalog_add(ccatalog *c, ccatalogitem *item);
+int  catalog_remove(ccatalog *c, u16 fsid, char *path);
+ccatalogitem *catalog_get(ccatalog *c, u16 fsid, char *path);
+bool catalog_item_unchanged(ccatalogitem *item, struct stat64 *st);
+u64  catalog_time(struct timespec *ts);
+int  catalog_read(ccatalog *c, char *filepath);
+int  catalog_write(ccatalog *c, char *filepath);
+
+#endif // __CATALOG_H__
@@ -0,0 +1,182 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "fsarchiver.h"
+#include "checkpoint.h"
+#include "common.h"
+#include "error.h"
+
+#define CHECKPOINT_MAGIC          "FsAcKp01"
+#define CHECKPOINT_SIZEOF_MAGIC   8
+
+// fixed part of the record: archid, curvol, offset, fsid, objectid, pathlen
+#define CHECKPOINT_RECFIXEDSIZE   (4+4+8+2+8+2)
+
+// the journal is stored next to the first volume of the archive
+int checkpoint_path(char *buf, int bufsize, char *basepath)
+{
+    if (snprintf(buf, bufsize, "%s.ckpt", basepath) >= bufsize)
+    {   errprintf("path is too long: [%s]\n", basepath);
+        return -1;
+    }
+    return 0;
+}
+
+int checkpoint_write(ccheckpoint *ckpt, char *basepath)
+{
+    u8 record[CHECKPOINT_RECFIXEDSIZE+PATH_MAX];
+    char temppath[PATH_MAX];
+    char path[PATH_MAX];
+    u16 pathlen;
+    u32 checksum;
+    u32 reclen;
+    u8 *bufpos;
+    u16 temp16;
+    u32 temp32;
+    u64 temp64;
+    FILE *f;
+    
+    if ((ckpt==NULL) || (ckpt->valid==false) || (checkpoint_path(path, sizeof(path), basepath)!=0))
+        return -1;
+    if (snprintf(temppath, sizeof(temppath), "%s.tmp", path) >= (int)sizeof(temppath))
+    {   errprintf("path is too long: [%s]\n", path);
+        return -1;
+    }
+    
+    pathlen=strlen(ckpt->path);
+    bufpos=record;
+    temp32=cpu_to_le32(ckpt->archid);
+    bufpos=mempcpy(bufpos, &temp32, sizeof(temp32));
+    temp32=cpu_to_le32(ckpt->curvol);
+    bufpos=mempcpy(bufpos, &temp32, sizeof(temp32));
+    temp64=cpu_to_le64(ckpt->offset);
+    bufpos=mempcpy(bufpos, &temp64, sizeof(temp64));
+    temp16=cpu_to_le16(ckpt->fsid);
+    bufpos=mempcpy(bufpos, &temp16, sizeof(temp16));
+    temp64=cpu_to_le64(ckpt->objectid);
+    bufpos=mempcpy(bufpos, &temp64, sizeof(temp64));
+    temp16=cpu_to_le16(pathlen);
+    bufpos=mempcpy(bufpos, &temp16, sizeof(temp16));
+    bufpos=mempcpy(bufpos, ckpt->path, pathlen);
+    reclen=cpu_to_le32((u32)(bufpos-record));
+    checksum=cpu_to_le32(fletcher32(record, bufpos-record));
+    
+    // write a temporary file and rename it so that the previous journal is never half overwritten
+    if ((f=fopen64(temppath, "wb"))==NULL)
+    {   sysprintf("cannot open checkpoint journal [%s] for writing\n", temppath);
+        return -1;
+    }
+    if ((fwrite(CHECKPOINT_MAGIC, CHECKPOINT_SIZEOF_MAGIC, 1, f)!=1) || (fwrite(&reclen, sizeof(reclen), 1, f)!=1) ||
+        (fwrite(record, bufpos-record, 1, f)!=1) || (fwrite(&checksum, sizeof(checksum), 1, f)!=1) ||
+        (fflush(f)!=0) || (fsync(fileno(f))!=0))
+    {   sysprintf("cannot write checkpoint journal [%s]\n", temppath);
+        fclose(f);
+        unlink(temppath);
+        return -1;
+    }
+    fclose(f);
+    
+    if (rename(temppath, path)!=0)
+    {   sysprintf("cannot rename [%s] to [%s]\n", temppath, path);
+        unlink(temppath);
+        return -1;
+    }
+    
+    msgprintf(MSG_VERB2, "Checkpoint written: volume=%ld, offset=%lld, objectid=%lld, path=[%s]\n", 
+        (long)ckpt->curvol, (long long)ckpt->offset, (long long)ckpt->objectid, ckpt->path);
+    return 0;
+}
+
+int checkpoint_read(ccheckpoint *ckpt, char *basepath)
+{
+    u8 record[CHECKPOINT_RECFIXEDSIZE+PATH_MAX];
+    char magic[CHECKPOINT_SIZEOF_MAGIC];
+    char path[PATH_MAX];
+    u16 pathlen;
+    u32 checksum;
+    u32 reclen;
+    u8 *bufpos;
+    u16 temp16;
+    u32 temp32;
+    u64 temp64;
+    FILE *f;
+    
+    if ((ckpt==NULL) || (checkpoint_path(path, sizeof(path), basepath)!=0))
+        return -1;
+    memset(ckpt, 0, sizeof(ccheckpoint));
+    
+    if ((f=fopen64(path, "rb"))==NULL)
+    {   sysprintf("cannot open checkpoint journal [%s]\n", path);
+        return -1;
+    }
+    
+    if ((fread(magic, CHECKPOINT_SIZEOF_MAGIC, 1, f)!=1) || (memcmp(magic, CHECKPOINT_MAGIC, CHECKPOINT_SIZEOF_MAGIC)!=0) ||
+        (fread(&reclen, sizeof(reclen), 1, f)!=1) || ((reclen=le32_to_cpu(reclen)) < CHECKPOINT_RECFIXEDSIZE) ||
+        (reclen > sizeof(record)) || (fread(record, reclen, 1, f)!=1) || (fread(&checksum, sizeof(checksum), 1, f)!=1) ||
+        (le32_to_cpu(checksum)!=fletcher32(record, reclen)))
+    {   errprintf("[%s] is not a valid checkpoint journal\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    
+    bufpos=record;
+    memcpy(&temp32, bufpos, sizeof(temp32)); bufpos+=sizeof(temp32);
+    ckpt->archid=le32_to_cpu(temp32);
+    memcpy(&temp32, bufpos, sizeof(temp32)); bufpos+=sizeof(temp32);
+    ckpt->curvol=le32_to_cpu(temp32);
+    memcpy(&temp64, bufpos, sizeof(temp64)); bufpos+=sizeof(temp64);
+    ckpt->offset=le64_to_cpu(temp64);
+    memcpy(&temp16, bufpos, sizeof(temp16)); bufpos+=sizeof(temp16);
+    ckpt->fsid=le16_to_cpu(temp16);
+    memcpy(&temp64, bufpos, sizeof(temp64)); bufpos+=sizeof(temp64);
+    ckpt->objectid=le64_to_cpu(temp64);
+    memcpy(&temp16, bufpos, sizeof(temp16)); bufpos+=sizeof(temp16);
+    pathlen=le16_to_cpu(temp16);
+    if ((pathlen >= sizeof(ckpt->path)) || (CHECKPOINT_RECFIXEDSIZE+pathlen!=reclen))
+    {   errprintf("checkpoint journal [%s] is corrupt: invalid path length\n", path);
+        return -1;
+    }
+    memcpy(ckpt->path, bufpos, pathlen);
+    ckpt->path[pathlen]=0;
+    ckpt->valid=true;
+    
+    return 0;
+}
+
+int checkpoint_remove(char *basepath)
+{
+    char path[PATH_MAX];
+    
+    if (checkpoint_path(path, sizeof(path), basepath)!=0)
+        return -1;
+    if ((unlink(path)!=0) && (errno!=ENOENT))
+    {   sysprintf("cannot remove checkpoint journal [%s]\n", path);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <limits.h>
+#include "types.h"
+
+struct s_checkpoint;
+typedef struct s_checkpoint ccheckpoint;
+
+// position in a split archive from which an interrupted save can be resumed
+struct s_checkpoint
+{   bool   valid; // true when a position has been recorded
+    u32    archid; // id of the archive being written
+    u32    curvol; // volume which contains that position
+    u64    offset; // offset in that volume where the archive has to be truncated
+    u16    fsid; // filesystem which was being saved at that position
+    u64    objectid; // id of the first object which is not in the archive yet
+    char   path[PATH_MAX]; // path of that object (to check the filesystem has not changed)
+};
+
+int checkpoint_path(char *buf, int bufsize, char *basepath);
+int checkpoint_write(ccheckpoint *ckpt, char *basepath);
+int checkpoint_read(ccheckpoint *ckpt, char *basepath);
+int checkpoint_remove(char *basepath);
+
+#endif // __CHECKPOINT_H__
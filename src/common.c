@@ -30,7 +30,6 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <wordexp.h>
-#include <fnmatch.h>
 #include <time.h>
 #include <limits.h>
 
@@ -160,6 +159,10 @@ char *get_objtype_name(int objtype)
             return ("REGFILE ");
         case OBJTYPE_REGFILEMULTI:
             return ("REGFILEM");
+        case OBJTYPE_REGFILEBASE:
+            return ("REGFILEB");
+        case OBJTYPE_REGFILEDUP:
+            return ("REGFILED");
         case OBJTYPE_HARDLINK:
             return ("HARDLINK");
         case OBJTYPE_CHARDEV:
@@ -576,26 +579,13 @@ int format_stacktrace(char *buffer, int bufsize)
     return 0;
 }
 
-int exclude_check(cstrlist *patlist, char *string)
-{
-    char pattern[1024];
-    int count;
-    int i;
-    
-    count=strlist_count(patlist);
-    for (i=0; i < count; i++)
-    {
-        strlist_getitem(patlist, i, pattern, sizeof(pattern));
-        if (fnmatch(pattern, string, 0)==0)
-            return true;
-    }
-    return false;
-}
-
-int get_path_to_volume(char *newvolbuf, int bufsize, char *basepath, long curvol)
+int get_path_to_volume(char *newvolbuf, int bufsize, char *basepath, long curvol, cstrlist *voldirs)
 {
     char prefix[PATH_MAX];
+    char dirpath[PATH_MAX];
+    char *filename;
     int pathlen;
+    int count;
     
     if ((pathlen=strlen(basepath))<4) // all archives terminates with ".fsa"
     {   errprintf("archive has an invalid basepath: [%s]\n", basepath);
@@ -611,7 +601,17 @@ int get_path_to_volume(char *newvolbuf, int bufsize, char *basepath, long curvol
     {
         memset(prefix, 0, sizeof(prefix));
         memcpy(prefix, basepath, pathlen-2);
-        snprintf(newvolbuf, bufsize, "%s%.2ld", prefix, (long)curvol);
+        count=(voldirs!=NULL)?(strlist_count(voldirs)):(0);
+        if (count > 0) // the volumes are stored round-robin in the directories given with --voldir
+        {
+            filename=((filename=strrchr(prefix, '/'))!=NULL)?(filename+1):(prefix);
+            strlist_getitem(voldirs, curvol % count, dirpath, sizeof(dirpath));
+            snprintf(newvolbuf, bufsize, "%s/%s%.2ld", dirpath, filename, (long)curvol);
+        }
+        else
+        {
+            snprintf(newvolbuf, bufsize, "%s%.2ld", prefix, (long)curvol);
+        }
     }
     
     return 0;
@@ -630,3 +630,51 @@ s64 get_device_size(char *partition)
 
     return devsize;
 }
+
+// grow an array which is filled one item at a time: its size is doubled when count reaches max
+int array_grow(void **array, u64 *max, u64 count, u64 minmax, size_t itemsize)
+{
+    void *newarray;
+    u64 newmax;
+    
+    if (count < *max)
+        return 0;
+    newmax=(*max < minmax) ? minmax : (*max * 2);
+    if ((newarray=realloc(*array, newmax*itemsize))==NULL)
+    {   errprintf("realloc(%lld) failed: out of memory\n", (long long)(newmax*itemsize));
+        return -1;
+    }
+    *array=newarray;
+    *max=newmax;
+    return 0;
+}
+
+// move the items of a hash table to a new table of newsize slots using the hash of each item
+int hashtable_resize(void ***table, u32 *tablesize, u32 newsize, u32 (*hash)(void *item))
+{
+    chashitem **oldtable=(chashitem **)*table;
+    chashitem **newtable;
+    chashitem *item, *next;
+    u32 pos;
+    u32 i;
+    
+    if ((newtable=calloc(newsize, sizeof(chashitem*)))==NULL)
+    {   errprintf("calloc(%ld) failed: out of memory\n", (long)newsize);
+        return -1;
+    }
+    
+    for (i=0; (oldtable!=NULL) && (i < *tablesize); i++)
+    {
+        for (item=oldtable[i]; item!=NULL; item=next)
+        {   next=item->next;
+            pos=hash(item)%newsize;
+            item->next=newtable[pos];
+            newtable[pos]=item;
+        }
+    }
+    
+    free(oldtable);
+    *table=(void **)newtable;
+    *tablesize=newsize;
+    return 0;
+}
@@ -24,6 +24,14 @@ struct timeval;
 struct s_strlist;
 struct s_stats;
 
+struct s_hashitem;
+typedef struct s_hashitem chashitem;
+
+// the items of the tables of hashtable_resize() start with the link to the next item of their slot
+struct s_hashitem
+{   chashitem     *next;
+};
+
 int exec_command(char *command, int cmdbufsize, int *exitst, char *stdoutbuf, int stdoutsize, char *stderrbuf, int stderrsize, char *format, ...);
 int get_parent_dir_time_attrib(char *filepath, char *parentdirbuf, int bufsize, struct timeval *tv);
 void concatenate_paths(char *buffer, int maxbufsize, char *p1, char *p2);
@@ -48,8 +56,9 @@ char *strlcatf(char *dest, int destbufsize, char *format, ...) __attribute__ ((f
 int format_stacktrace(char *buffer, int bufsize);
 int stats_show(struct s_stats, int fsid);
 u64 stats_errcount(struct s_stats stats);
-int exclude_check(struct s_strlist *patlist, char *string);
-int get_path_to_volume(char *newvolbuf, int bufsize, char *basepath, long curvol);
+int get_path_to_volume(char *newvolbuf, int bufsize, char *basepath, long curvol, struct s_strlist *voldirs);
 s64 get_device_size(char *partition);
+int array_grow(void **array, u64 *max, u64 count, u64 minmax, size_t itemsize);
+int hashtable_resize(void ***table, u32 *tablesize, u32 newsize, u32 (*hash)(void *item));
 
 #endif // __COMMON_H__
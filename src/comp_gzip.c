@@ -19,14 +19,65 @@
 #  include "config.h"
 #endif
 
+#include <string.h>
 #include <zlib.h>
+#ifdef OPTION_LIBDEFLATE_SUPPORT
+#include <libdeflate.h>
+#endif // OPTION_LIBDEFLATE_SUPPORT
 
 #include "fsarchiver.h"
 #include "common.h"
 #include "comp_gzip.h"
 #include "error.h"
 
-int compress_block_gzip(u64 origsize, u64 *compsize, u8 *origbuf, u8 *compbuf, u64 compbufsize, int level)
+#ifdef OPTION_LIBDEFLATE_SUPPORT
+// libdeflate writes zlib streams which older versions read with uncompress(), and reads theirs
+int compress_block_gzip(u64 origsize, u64 *compsize, u8 *origbuf, u8 *compbuf, u64 compbufsize, int level, cgzipctx *ctx)
+{
+    size_t res;
+    
+    if ((ctx->comp!=NULL) && (ctx->level!=level)) // a compressor only works at the level it was allocated for
+    {   libdeflate_free_compressor(ctx->comp);
+        ctx->comp=NULL;
+    }
+    if ((ctx->comp==NULL) && ((ctx->comp=libdeflate_alloc_compressor(level))==NULL))
+        return FSAERR_ENOMEM;
+    ctx->level=level;
+    res=libdeflate_zlib_compress(ctx->comp, origbuf, (size_t)origsize, compbuf, (size_t)compbufsize);
+    
+    if (res==0) // the output buffer is too small: the block is kept uncompressed by the caller
+        return FSAERR_UNKNOWN;
+    *compsize=(u64)res;
+    return FSAERR_SUCCESS;
+}
+
+int uncompress_block_gzip(u64 compsize, u64 *origsize, u8 *origbuf, u64 origbufsize, u8 *compbuf, cgzipctx *ctx)
+{
+    size_t outsize;
+    int res;
+    
+    if ((ctx->decomp==NULL) && ((ctx->decomp=libdeflate_alloc_decompressor())==NULL))
+        return FSAERR_ENOMEM;
+    res=libdeflate_zlib_decompress(ctx->decomp, compbuf, (size_t)compsize, origbuf, (size_t)origbufsize, &outsize);
+    
+    if (res!=LIBDEFLATE_SUCCESS)
+    {   errprintf("libdeflate_zlib_decompress() failed, res=%d\n", res);
+        return FSAERR_UNKNOWN;
+    }
+    *origsize=(u64)outsize;
+    return FSAERR_SUCCESS;
+}
+
+void gzipctx_close(cgzipctx *ctx)
+{
+    if (ctx->comp!=NULL)
+        libdeflate_free_compressor(ctx->comp);
+    if (ctx->decomp!=NULL)
+        libdeflate_free_decompressor(ctx->decomp);
+    memset(ctx, 0, sizeof(cgzipctx));
+}
+#else
+int compress_block_gzip(u64 origsize, u64 *compsize, u8 *origbuf, u8 *compbuf, u64 compbufsize, int level, cgzipctx *ctx)
 {
     uLong gzsize;
     Bytef *gzbuffer;
@@ -48,7 +99,7 @@ int compress_block_gzip(u64 origsize, u64 *compsize, u8 *origbuf, u8 *compbuf, u
     return FSAERR_UNKNOWN;
 }
 
-int uncompress_block_gzip(u64 compsize, u64 *origsize, u8 *origbuf, u64 origbufsize, u8 *compbuf)
+int uncompress_block_gzip(u64 compsize, u64 *origsize, u8 *origbuf, u64 origbufsize, u8 *compbuf, cgzipctx *ctx)
 {
     uLong gzsize=(uLong)origbufsize;
     Bytef *gzbuffer=(Bytef *)origbuf;
@@ -66,3 +117,8 @@ int uncompress_block_gzip(u64 compsize, u64 *origsize, u8 *origbuf, u64 origbufs
             return FSAERR_UNKNOWN;
     }
 }
+
+void gzipctx_close(cgzipctx *ctx)
+{
+}
+#endif // OPTION_LIBDEFLATE_SUPPORT
@@ -18,7 +18,21 @@
 #ifndef __COMPRESS_GZIP_H__
 #define __COMPRESS_GZIP_H__
 
-int compress_block_gzip(u64 origsize, u64 *compsize, u8 *origbuf, u8 *compbuf, u64 compbufsize, int level);
-int uncompress_block_gzip(u64 compsize, u64 *origsize, u8 *origbuf, u64 origbufsize, u8 *compbuf);
+struct libdeflate_compressor;
+struct libdeflate_decompressor;
+
+struct s_gzipctx;
+typedef struct s_gzipctx cgzipctx;
+
+// what a compression thread keeps from one gzip block to the next (only libdeflate has such a state)
+struct s_gzipctx
+{   struct libdeflate_compressor   *comp; // allocated by the first block compressed
+    struct libdeflate_decompressor *decomp; // allocated by the first block decompressed
+    int                            level; // level of comp
+};
+
+int compress_block_gzip(u64 origsize, u64 *compsize, u8 *origbuf, u8 *compbuf, u64 compbufsize, int level, cgzipctx *ctx);
+int uncompress_block_gzip(u64 compsize, u64 *origsize, u8 *origbuf, u64 origbufsize, u8 *compbuf, cgzipctx *ctx);
+void gzipctx_close(cgzipctx *ctx);
 
 #endif // __COMPRESS_GZIP_H__
@@ -20,6 +20,10 @@
 #  include "config.h"
 #endif
 
+#ifdef OPTION_ZSTD_SUPPORT
+#include <zstd_errors.h>
+#endif // OPTION_ZSTD_SUPPORT
+
 #include "fsarchiver.h"
 #include "common.h"
 #include "comp_zstd.h"
@@ -27,31 +31,70 @@
 
 
 #ifdef OPTION_ZSTD_SUPPORT
-int compress_block_zstd(u64 origsize, u64 *compsize, u8 *origbuf, u8 *compbuf, u64 compbufsize, int level)
+// each compression thread creates its context for its first block and reuses it for the next ones
+static int compress_zstd_open(ZSTD_CCtx **cctx, int level, bool longmatch)
 {
-    int res=0;
-
-    if (ZSTD_isError((res=ZSTD_compress((char*)compbuf, compbufsize, (const char*)origbuf, (int)origsize, level))))
-    {   errprintf("ZSTD_compress(): failed: res=%d\n", res);
-        return FSAERR_UNKNOWN;
-    }
-    else
-    {   *compsize=(u64)res;
+#if ZSTD_VERSION_NUMBER >= 10400
+    size_t ret;
+#endif // ZSTD_VERSION_NUMBER >= 10400
+    
+    if (*cctx!=NULL)
         return FSAERR_SUCCESS;
+    if ((*cctx=ZSTD_createCCtx())==NULL)
+    {   errprintf("ZSTD_createCCtx() failed\n");
+        return FSAERR_ENOMEM;
+    }
+    
+#if ZSTD_VERSION_NUMBER >= 10400
+    // window over the whole large blocks and long distance matching (zstd reduces the window to the size of smaller blocks)
+    if (ZSTD_isError((ret=ZSTD_CCtx_setParameter(*cctx, ZSTD_c_compressionLevel, level))) ||
+        ((longmatch==true) && ZSTD_isError((ret=ZSTD_CCtx_setParameter(*cctx, ZSTD_c_windowLog, FSA_ZSTD_LONGWINDOWLOG)))) ||
+        ((longmatch==true) && ZSTD_isError((ret=ZSTD_CCtx_setParameter(*cctx, ZSTD_c_enableLongDistanceMatching, 1)))))
+    {   errprintf("ZSTD_CCtx_setParameter() failed: %s\n", ZSTD_getErrorName(ret));
+        ZSTD_freeCCtx(*cctx);
+        *cctx=NULL;
+        return FSAERR_UNKNOWN;
     }
+#endif // ZSTD_VERSION_NUMBER >= 10400
+    
+    return FSAERR_SUCCESS;
 }
 
-int uncompress_block_zstd(u64 compsize, u64 *origsize, u8 *origbuf, u64 origbufsize, u8 *compbuf)
+int compress_block_zstd(u64 origsize, u64 *compsize, u8 *origbuf, u8 *compbuf, u64 compbufsize, int level, bool longmatch, ZSTD_CCtx **cctx)
 {
-    int res=0;
+    size_t ret;
+    int res;
+    
+    if ((res=compress_zstd_open(cctx, level, longmatch))!=FSAERR_SUCCESS)
+        return res;
+    
+#if ZSTD_VERSION_NUMBER >= 10400
+    ret=ZSTD_compress2(*cctx, (char*)compbuf, compbufsize, (const char*)origbuf, origsize);
+#else
+    ret=ZSTD_compressCCtx(*cctx, (char*)compbuf, compbufsize, (const char*)origbuf, origsize, level);
+#endif // ZSTD_VERSION_NUMBER >= 10400
+    if (ZSTD_isError(ret))
+    {   errprintf("ZSTD_compress(): failed: %s\n", ZSTD_getErrorName(ret));
+        return (ZSTD_getErrorCode(ret)==ZSTD_error_memory_allocation) ? FSAERR_ENOMEM : FSAERR_UNKNOWN;
+    }
+    *compsize=(u64)ret;
+    return FSAERR_SUCCESS;
+}
 
-    if (ZSTD_isError((res=ZSTD_decompress((char*)origbuf, origbufsize, (char*)compbuf, compsize))))
-    {   errprintf("ZSTD_decompress(): failed: res=%d\n", res);
-        return FSAERR_UNKNOWN;
+int uncompress_block_zstd(u64 compsize, u64 *origsize, u8 *origbuf, u64 origbufsize, u8 *compbuf, ZSTD_DCtx **dctx)
+{
+    size_t ret;
+    
+    if ((*dctx==NULL) && ((*dctx=ZSTD_createDCtx())==NULL))
+    {   errprintf("ZSTD_createDCtx() failed\n");
+        return FSAERR_ENOMEM;
     }
-    else
-    {   *origsize=(u64)res;
-        return FSAERR_SUCCESS;
+    
+    if (ZSTD_isError((ret=ZSTD_decompressDCtx(*dctx, (char*)origbuf, origbufsize, (char*)compbuf, compsize))))
+    {   errprintf("ZSTD_decompress(): failed: %s\n", ZSTD_getErrorName(ret));
+        return FSAERR_UNKNOWN;
     }
+    *origsize=(u64)ret;
+    return FSAERR_SUCCESS;
 }
 #endif // OPTION_ZSTD_SUPPORT
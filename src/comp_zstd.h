@@ -23,8 +23,9 @@
 
 #include <zstd.h>
 
-int compress_block_zstd(u64 origsize, u64 *compsize, u8 *origbuf, u8 *compbuf, u64 compbufsize, int level);
-int uncompress_block_zstd(u64 compsize, u64 *origsize, u8 *origbuf, u64 origbufsize, u8 *compbuf);
+// the contexts are created by the first call and freed by the thread with ZSTD_freeCCtx() and ZSTD_freeDCtx()
+int compress_block_zstd(u64 origsize, u64 *compsize, u8 *origbuf, u8 *compbuf, u64 compbufsize, int level, bool longmatch, ZSTD_CCtx **cctx);
+int uncompress_block_zstd(u64 compsize, u64 *origsize, u8 *origbuf, u64 origbufsize, u8 *compbuf, ZSTD_DCtx **dctx);
 
 #endif // OPTION_ZSTD_SUPPORT
 
@@ -22,6 +22,7 @@
 #include <pthread.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "fsarchiver.h"
 #include "common.h"
@@ -110,6 +111,152 @@ int crypto_blowfish(u64 insize, u64 *outsize, u8 *inbuf, u8 *outbuf, u8 *passwor
     return (res==0)?(0):(-1);
 }
 
+#if GCRYPT_VERSION_NUMBER >= 0x010600
+struct s_cipher
+{   gcry_cipher_hd_t hd; // keyed once: only the nonce changes from a block to the next one
+};
+
+static u8 crypto_aeskey[32]; // derived once per archive from the password and the salt of that archive
+static bool crypto_aeskeyset=false;
+static u32 crypto_aesarchid; // id of the archive which is part of all the nonces
+
+int crypto_aes256gcm_setkey(u8 *password, int passlen, u8 *salt, int saltlen, u32 iterations, u32 archid)
+{
+    if ((password==NULL) || (passlen==0))
+        return -1;
+    
+    if (gcry_kdf_derive(password, passlen, GCRY_KDF_PBKDF2, GCRY_MD_SHA256, salt, saltlen, iterations,
+        sizeof(crypto_aeskey), crypto_aeskey)!=0)
+    {   errprintf("gcry_kdf_derive() failed\n");
+        return -1;
+    }
+    
+    crypto_aesarchid=archid;
+    crypto_aeskeyset=true;
+    return 0;
+}
+
+// one handle per thread which encrypts or decrypts blocks, the key schedule is computed here only
+ccipher *crypto_aes256gcm_open()
+{
+    ccipher *c;
+    
+    if (crypto_aeskeyset==false)
+    {   errprintf("the aes key has not been derived from the password\n");
+        return NULL;
+    }
+    
+    if ((c=malloc(sizeof(ccipher)))==NULL)
+    {   errprintf("malloc(%ld) failed: out of memory\n", (long)sizeof(ccipher));
+        return NULL;
+    }
+    
+    if (gcry_cipher_open(&c->hd, GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_GCM, 0)!=0)
+    {   errprintf("gcry_cipher_open() failed\n");
+        free(c);
+        return NULL;
+    }
+    
+    if (gcry_cipher_setkey(c->hd, crypto_aeskey, sizeof(crypto_aeskey))!=0)
+    {   errprintf("gcry_cipher_setkey() failed\n");
+        gcry_cipher_close(c->hd);
+        free(c);
+        return NULL;
+    }
+    
+    return c;
+}
+
+void crypto_aes256gcm_close(ccipher *c)
+{
+    if (c==NULL)
+        return;
+    gcry_cipher_close(c->hd);
+    free(c);
+}
+
+// the nonce of a block comes from its position in the archive: it is never twice the same with a key
+int crypto_aes256gcm_nonce(u8 *nonce, u16 fsid, s64 itemnum, u64 blkoffset)
+{
+    u8 digest[32];
+    u8 buf[22];
+    u32 temp32;
+    u16 temp16;
+    u64 temp64;
+    
+    temp32=cpu_to_le32(crypto_aesarchid);
+    memcpy(buf, &temp32, 4);
+    temp16=cpu_to_le16(fsid);
+    memcpy(buf+4, &temp16, 2);
+    temp64=cpu_to_le64((u64)itemnum);
+    memcpy(buf+6, &temp64, 8);
+    temp64=cpu_to_le64(blkoffset);
+    memcpy(buf+14, &temp64, 8);
+    
+    gcry_md_hash_buffer(GCRY_MD_SHA256, digest, buf, sizeof(buf));
+    memcpy(nonce, digest, FSA_CRYPT_NONCESIZE);
+    return 0;
+}
+
+// aad is authenticated but not encrypted (the fields of the block header)
+int crypto_aes256gcm(ccipher *c, u64 insize, u8 *inbuf, u8 *outbuf, u8 *nonce, u8 *aad, u32 aadsize, u8 *tag, int enc)
+{
+    int res;
+    
+    if ((gcry_cipher_reset(c->hd)!=0) || (gcry_cipher_setiv(c->hd, nonce, FSA_CRYPT_NONCESIZE)!=0))
+    {   errprintf("gcry_cipher_setiv() failed\n");
+        return -1;
+    }
+    
+    if ((aadsize > 0) && (gcry_cipher_authenticate(c->hd, aad, aadsize)!=0))
+    {   errprintf("gcry_cipher_authenticate() failed\n");
+        return -1;
+    }
+    
+    switch(enc)
+    {
+        case 1: // encrypt
+            if ((res=gcry_cipher_encrypt(c->hd, outbuf, insize, inbuf, insize))==0)
+                res=gcry_cipher_gettag(c->hd, tag, FSA_CRYPT_TAGSIZE);
+            break;
+        case 0: // decrypt and check that neither the block nor its header have been modified
+            if ((res=gcry_cipher_decrypt(c->hd, outbuf, insize, inbuf, insize))==0)
+                res=gcry_cipher_checktag(c->hd, tag, FSA_CRYPT_TAGSIZE);
+            break;
+        default: // invalid
+            errprintf("invalid parameter: enc=%d\n", (int)enc);
+            return -1;
+    }
+    
+    return (res==0)?(0):(-1);
+}
+#else
+int crypto_aes256gcm_setkey(u8 *password, int passlen, u8 *salt, int saltlen, u32 iterations, u32 archid)
+{
+    errprintf("aes256gcm requires libgcrypt >= 1.6.0\n");
+    return -1;
+}
+
+ccipher *crypto_aes256gcm_open()
+{
+    return NULL;
+}
+
+void crypto_aes256gcm_close(ccipher *c)
+{
+}
+
+int crypto_aes256gcm_nonce(u8 *nonce, u16 fsid, s64 itemnum, u64 blkoffset)
+{
+    return -1;
+}
+
+int crypto_aes256gcm(ccipher *c, u64 insize, u8 *inbuf, u8 *outbuf, u8 *nonce, u8 *aad, u32 aadsize, u8 *tag, int enc)
+{
+    return -1;
+}
+#endif // GCRYPT_VERSION_NUMBER >= 0x010600
+
 int crypto_random(u8 *buf, int bufsize)
 {
     memset(buf, 0, bufsize);
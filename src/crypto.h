@@ -20,8 +20,16 @@
 
 #include "types.h"
 
+struct s_cipher;
+typedef struct s_cipher ccipher;
+
 int crypto_init();
 int crypto_blowfish(u64 insize, u64 *outsize, u8 *inbuf, u8 *outbuf, u8 *password, int passlen, int enc);
+int crypto_aes256gcm_setkey(u8 *password, int passlen, u8 *salt, int saltlen, u32 iterations, u32 archid);
+ccipher *crypto_aes256gcm_open();
+void crypto_aes256gcm_close(ccipher *c);
+int crypto_aes256gcm_nonce(u8 *nonce, u16 fsid, s64 itemnum, u64 blkoffset);
+int crypto_aes256gcm(ccipher *c, u64 insize, u8 *inbuf, u8 *outbuf, u8 *nonce, u8 *aad, u32 aadsize, u8 *tag, int enc);
 int crypto_random(u8 *buf, int bufsize);
 int crypto_cleanup();
 
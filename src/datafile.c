@@ -27,6 +27,8 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <gcrypt.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
 
 #include "fsarchiver.h"
 #include "datafile.h"
@@ -35,6 +37,8 @@
 
 struct s_datafile 
 {   int  fd; // file descriptor
+    cextfile *ext; // file written with libext2fs (option --ext-direct)
+    cntfsfile *ntfs; // file written with libntfs-3g (option --ntfs-direct)
     bool simul; // simulation: don't write anything if true
     bool open; // true when file is open even if simulation
     bool sparse; // true if that's a sparse file
@@ -49,6 +53,8 @@ cdatafile *datafile_alloc()
         return NULL;
     f->path[0]=0;
     f->fd=-1;
+    f->ext=NULL;
+    f->ntfs=NULL;
     f->simul=false;
     f->open=false;
     f->sparse=false;
@@ -102,6 +108,47 @@ int datafile_open_write(cdatafile *f, char *path, bool simul, bool sparse)
     return 0;
 }
 
+// same as datafile_open_write() but the file is created in an unmounted ext filesystem
+int datafile_open_write_ext(cdatafile *f, cextdirect *ed, char *path, bool simul, bool sparse, u64 size)
+{
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if ((ed!=NULL) && (simul==false))
+    {
+        if (datafile_open_write(f, path, true, sparse)!=0)
+            return -1;
+        if (extdirect_fopen(ed, path, size, sparse, &f->ext)!=0)
+        {   gcry_md_close(f->md5ctx);
+            f->open=false;
+            return -1;
+        }
+        f->simul=false;
+        return 0;
+    }
+#endif
+    return datafile_open_write(f, path, simul, sparse);
+}
+
+// same as datafile_open_write() but the file is created in an unmounted ntfs volume
+int datafile_open_write_ntfs(cdatafile *f, cntfsdirect *nd, char *path, bool simul, bool sparse)
+{
+#ifdef OPTION_NTFS3G_SUPPORT
+    if ((nd!=NULL) && (simul==false))
+    {
+        if (datafile_open_write(f, path, true, sparse)!=0)
+            return -1;
+        if (ntfsdirect_fcreate(nd, path, &f->ntfs)!=0)
+        {   sysprintf("cannot create file [%s] in the ntfs volume\n", path);
+            gcry_md_close(f->md5ctx);
+            f->open=false;
+            return -1;
+        }
+        f->simul=false;
+        return 0;
+    }
+#endif
+    return datafile_open_write(f, path, simul, sparse);
+}
+
 int datafile_is_block_zero(cdatafile *f, char *data, u64 len)
 {
     bool zero=true;
@@ -125,6 +172,30 @@ int datafile_write(cdatafile *f, char *data, u64 len)
         return FSAERR_NOTOPEN;
     }
     
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (f->ext!=NULL)
+    {
+        errno=0;
+        if ((f->sparse==true) && (datafile_is_block_zero(f, data, len)))
+            extdirect_fskip(f->ext, len);
+        else if (extdirect_fwrite(f->ext, data, len)!=0)
+            return (errno==ENOSPC) ? FSAERR_ENOSPC : FSAERR_WRITE;
+    }
+    else
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (f->ntfs!=NULL)
+    {
+        errno=0;
+        if ((f->sparse==true) && (datafile_is_block_zero(f, data, len)))
+            ntfsdirect_fskip(f->ntfs, len);
+        else if (ntfsdirect_fwrite(f->ntfs, data, len)!=0)
+        {   sysprintf("cannot write %s: size=%ld\n", f->path, (long)len);
+            return (errno==ENOSPC) ? FSAERR_ENOSPC : FSAERR_WRITE;
+        }
+    }
+    else
+#endif
     if (f->simul==false)
     {
         if ((f->sparse==true) && (datafile_is_block_zero(f, data, len)))
@@ -156,6 +227,93 @@ int datafile_write(cdatafile *f, char *data, u64 len)
     return FSAERR_SUCCESS;
 }
 
+// the next bytes of the file are in a file already restored: share its extents when the filesystem
+// supports it or copy them, these data are not in the archive but they are part of the md5sum
+int datafile_clone(cdatafile *f, char *srcpath, u64 srcoffset, u64 len)
+{
+    struct file_clone_range fcr;
+    char buffer[65536];
+    s64 destoffset;
+    ssize_t res;
+    u64 pos;
+    int ret=FSAERR_SUCCESS;
+    int srcfd;
+    
+    assert(f);
+    
+    if (!f->open)
+    {   errprintf("File is not open\n");
+        return FSAERR_NOTOPEN;
+    }
+    
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (f->ext!=NULL)
+    {   errprintf("cannot restore the data of [%s] shared with [%s] on a filesystem which is not mounted\n", f->path, srcpath);
+        return FSAERR_WRITE;
+    }
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (f->ntfs!=NULL)
+    {   errprintf("cannot restore the data of [%s] shared with [%s] on a filesystem which is not mounted\n", f->path, srcpath);
+        return FSAERR_WRITE;
+    }
+#endif
+    if (f->simul==true)
+        return FSAERR_SUCCESS;
+    
+    if ((destoffset=lseek64(f->fd, 0, SEEK_CUR))<0)
+    {   sysprintf("Can't lseek64() in file [%s]\n", f->path);
+        return FSAERR_SEEK;
+    }
+    if ((srcfd=open64(srcpath, O_RDONLY|O_LARGEFILE))<0)
+    {   sysprintf("cannot open [%s] which has data shared with [%s]\n", srcpath, f->path);
+        return FSAERR_READ;
+    }
+    
+    fcr.src_fd=srcfd;
+    fcr.src_offset=srcoffset;
+    fcr.src_length=len;
+    fcr.dest_offset=destoffset;
+    if (ioctl(f->fd, FICLONERANGE, &fcr)!=0)
+    {
+        // the filesystem cannot share extents or the range is not aligned on its blocks
+        for (pos=0; pos < len; pos+=res)
+        {
+            if ((res=pread64(srcfd, buffer, min(len-pos, sizeof(buffer)), srcoffset+pos))<=0)
+            {   sysprintf("cannot read [%s] which has data shared with [%s]\n", srcpath, f->path);
+                ret=FSAERR_READ;
+                break;
+            }
+            errno=0;
+            if (pwrite64(f->fd, buffer, res, destoffset+pos)!=res)
+            {   sysprintf("cannot write %s: size=%ld\n", f->path, (long)res);
+                ret=(errno==ENOSPC) ? FSAERR_ENOSPC : FSAERR_WRITE;
+                break;
+            }
+            gcry_md_write(f->md5ctx, buffer, res);
+        }
+    }
+    else // the extents are shared: read them back so that the md5sum covers the whole file
+    {
+        for (pos=0; pos < len; pos+=res)
+        {
+            if ((res=pread64(srcfd, buffer, min(len-pos, sizeof(buffer)), srcoffset+pos))<=0)
+            {   sysprintf("cannot read [%s] which has data shared with [%s]\n", srcpath, f->path);
+                ret=FSAERR_READ;
+                break;
+            }
+            gcry_md_write(f->md5ctx, buffer, res);
+        }
+    }
+    close(srcfd);
+    
+    if ((ret==FSAERR_SUCCESS) && (lseek64(f->fd, destoffset+len, SEEK_SET)<0))
+    {   sysprintf("Can't lseek64() in file [%s]\n", f->path);
+        ret=FSAERR_SEEK;
+    }
+    return ret;
+}
+
 int datafile_close(cdatafile *f, u8 *md5bufdat, int md5bufsize)
 {
     char md5store[16];
@@ -185,6 +343,21 @@ int datafile_close(cdatafile *f, u8 *md5bufdat, int md5bufsize)
         memcpy(md5bufdat, md5store, 16);
     }
     
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (f->ext!=NULL)
+    {   res=extdirect_fclose(f->ext);
+        f->ext=NULL;
+    }
+    else
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (f->ntfs!=NULL)
+    {   if ((res=ntfsdirect_fclose(f->ntfs))!=0)
+            sysprintf("cannot close file [%s] in the ntfs volume\n", f->path);
+        f->ntfs=NULL;
+    }
+    else
+#endif
     if ((f->open==true) && (f->simul==false))
     {
         if ((f->sparse==true) && (ftruncate(f->fd, lseek64(f->fd, 0, SEEK_CUR))<0))
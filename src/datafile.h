@@ -19,6 +19,8 @@
 #define __DATAFILE_H__
 
 #include "types.h"
+#include "extdirect.h"
+#include "ntfsdirect.h"
 
 struct s_datafile;
 typedef struct s_datafile cdatafile;
@@ -26,7 +28,10 @@ typedef struct s_datafile cdatafile;
 cdatafile *datafile_alloc();
 int       datafile_destroy(cdatafile *f);
 int       datafile_open_write(cdatafile *f, char *path, bool simul, bool sparse);
+int       datafile_open_write_ext(cdatafile *f, cextdirect *ed, char *path, bool simul, bool sparse, u64 size);
+int       datafile_open_write_ntfs(cdatafile *f, cntfsdirect *nd, char *path, bool simul, bool sparse);
 int       datafile_write(cdatafile *f, char *data, u64 len);
+int       datafile_clone(cdatafile *f, char *srcpath, u64 srcoffset, u64 len);
 int       datafile_close(cdatafile *f, u8 *md5bufdat, int md5bufsize);
 
 #endif // __DATAFILE_H__
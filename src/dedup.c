@@ -0,0 +1,278 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "fsarchiver.h"
+#include "dedup.h"
+#include "common.h"
+#include "error.h"
+
+#define DEDUP_DEF_TABLESIZE       65536
+#define DEDUPCACHE_TABLESIZE      4096
+
+static u32 dedup_hash(u8 *md5sum, u64 size)
+{
+    u32 hash;
+    
+    // the md5 is already well distributed
+    memcpy(&hash, md5sum, sizeof(hash));
+    return hash^(u32)size;
+}
+
+static u32 dedup_itemhash(void *item)
+{
+    return dedup_hash(((cdedupitem *)item)->md5sum, ((cdedupitem *)item)->size);
+}
+
+static int dedup_resize(cdedup *d, u32 newsize)
+{
+    return hashtable_resize((void ***)&d->table, &d->tablesize, newsize, dedup_itemhash);
+}
+
+int dedup_init(cdedup *d)
+{
+    if (d==NULL)
+    {   errprintf("invalid param\n");
+        return -1;
+    }
+    
+    d->count=0;
+    d->tablesize=0;
+    d->table=NULL;
+    return dedup_resize(d, DEDUP_DEF_TABLESIZE);
+}
+
+int dedup_destroy(cdedup *d)
+{
+    cdedupitem *item, *next;
+    u32 i;
+    
+    if (d==NULL)
+        return -1;
+    
+    for (i=0; (d->table!=NULL) && (i < d->tablesize); i++)
+    {
+        for (item=d->table[i]; item!=NULL; item=next)
+        {   next=item->next;
+            free(item->path);
+            free(item);
+        }
+    }
+    
+    free(d->table);
+    d->table=NULL;
+    d->tablesize=0;
+    d->count=0;
+    return 0;
+}
+
+cdedupitem *dedup_get(cdedup *d, u8 *md5sum, u64 size)
+{
+    cdedupitem *item;
+    
+    if (d==NULL || d->table==NULL)
+        return NULL;
+    
+    for (item=d->table[dedup_hash(md5sum, size)%d->tablesize]; item!=NULL; item=item->next)
+        if ((item->size==size) && (memcmp(item->md5sum, md5sum, 16)==0))
+            return item;
+    
+    return NULL;
+}
+
+// remember the first copy of these contents (the next copies will point to it)
+int dedup_add(cdedup *d, u8 *md5sum, u64 size, u64 packid, char *path)
+{
+    cdedupitem *lnew;
+    u32 pos;
+    
+    if (d==NULL || md5sum==NULL || path==NULL)
+    {   errprintf("invalid param\n");
+        return -1;
+    }
+    
+    if (dedup_get(d, md5sum, size)!=NULL)
+        return 0;
+    
+    if ((d->count >= 2*(u64)d->tablesize) && (dedup_resize(d, 2*d->tablesize)!=0))
+        return -1;
+    
+    if ((lnew=malloc(sizeof(cdedupitem)))==NULL)
+    {   errprintf("malloc(%ld) failed: out of memory\n", (long)sizeof(cdedupitem));
+        return -1;
+    }
+    memcpy(lnew->md5sum, md5sum, 16);
+    lnew->size=size;
+    lnew->packid=packid;
+    if ((lnew->path=strdup(path))==NULL)
+    {   errprintf("strdup() failed: out of memory\n");
+        free(lnew);
+        return -1;
+    }
+    
+    pos=dedup_hash(md5sum, size)%d->tablesize;
+    lnew->next=d->table[pos];
+    d->table[pos]=lnew;
+    d->count++;
+    return 0;
+}
+
+int dedupcache_init(cdedupcache *c, u64 maxsize)
+{
+    if (c==NULL)
+    {   errprintf("invalid param\n");
+        return -1;
+    }
+    
+    memset(c, 0, sizeof(cdedupcache));
+    c->maxsize=maxsize;
+    if ((c->table=calloc(DEDUPCACHE_TABLESIZE, sizeof(cdedupcacheitem*)))==NULL)
+    {   errprintf("calloc(%ld) failed: out of memory\n", (long)DEDUPCACHE_TABLESIZE);
+        return -1;
+    }
+    return 0;
+}
+
+int dedupcache_destroy(cdedupcache *c)
+{
+    cdedupcacheitem *item, *next;
+    
+    if (c==NULL)
+        return -1;
+    
+    for (item=c->newest; item!=NULL; item=next)
+    {   next=item->older;
+        free(item->data);
+        free(item);
+    }
+    
+    free(c->table);
+    memset(c, 0, sizeof(cdedupcache));
+    return 0;
+}
+
+static cdedupcacheitem *dedupcache_find(cdedupcache *c, u8 *md5sum, u64 size, cdedupcacheitem ***prev)
+{
+    cdedupcacheitem **cur;
+    
+    for (cur=&c->table[dedup_hash(md5sum, size)%DEDUPCACHE_TABLESIZE]; *cur!=NULL; cur=&(*cur)->hnext)
+    {
+        if (((*cur)->size==size) && (memcmp((*cur)->md5sum, md5sum, 16)==0))
+        {   if (prev!=NULL)
+                *prev=cur;
+            return *cur;
+        }
+    }
+    return NULL;
+}
+
+static void dedupcache_unlink(cdedupcache *c, cdedupcacheitem *item)
+{
+    if (item->newer!=NULL)
+        item->newer->older=item->older;
+    else
+        c->newest=item->older;
+    if (item->older!=NULL)
+        item->older->newer=item->newer;
+    else
+        c->oldest=item->newer;
+    item->newer=item->older=NULL;
+}
+
+static void dedupcache_push(cdedupcache *c, cdedupcacheitem *item)
+{
+    item->older=c->newest;
+    item->newer=NULL;
+    if (c->newest!=NULL)
+        c->newest->newer=item;
+    c->newest=item;
+    if (c->oldest==NULL)
+        c->oldest=item;
+}
+
+// keep a copy of the contents of a small file, the least recently used ones are dropped
+int dedupcache_add(cdedupcache *c, u8 *md5sum, char *data, u64 size)
+{
+    cdedupcacheitem **prev=NULL;
+    cdedupcacheitem *found;
+    cdedupcacheitem *item;
+    
+    if (c==NULL || c->table==NULL || size > c->maxsize)
+        return -1;
+    
+    if ((item=dedupcache_find(c, md5sum, size, NULL))!=NULL)
+    {   dedupcache_unlink(c, item);
+        dedupcache_push(c, item);
+        return 0;
+    }
+    
+    while ((c->oldest!=NULL) && (c->usedsize+size > c->maxsize))
+    {
+        item=c->oldest;
+        found=dedupcache_find(c, item->md5sum, item->size, &prev);
+        assert((found==item) && (prev!=NULL)); // every item of the lru list is in the table
+        *prev=item->hnext;
+        dedupcache_unlink(c, item);
+        c->usedsize-=item->size;
+        free(item->data);
+        free(item);
+    }
+    
+    if ((item=malloc(sizeof(cdedupcacheitem)))==NULL)
+    {   errprintf("malloc(%ld) failed: out of memory\n", (long)sizeof(cdedupcacheitem));
+        return -1;
+    }
+    if ((item->data=malloc(size))==NULL)
+    {   errprintf("malloc(%ld) failed: out of memory\n", (long)size);
+        free(item);
+        return -1;
+    }
+    memcpy(item->md5sum, md5sum, 16);
+    memcpy(item->data, data, size);
+    item->size=size;
+    item->hnext=c->table[dedup_hash(md5sum, size)%DEDUPCACHE_TABLESIZE];
+    c->table[dedup_hash(md5sum, size)%DEDUPCACHE_TABLESIZE]=item;
+    dedupcache_push(c, item);
+    c->usedsize+=size;
+    return 0;
+}
+
+// copy the contents to data if they are still in the cache
+int dedupcache_get(cdedupcache *c, u8 *md5sum, u64 size, char *data, u64 bufsize)
+{
+    cdedupcacheitem *item;
+    
+    if (c==NULL || c->table==NULL || size > bufsize)
+        return -1;
+    
+    if ((item=dedupcache_find(c, md5sum, size, NULL))==NULL)
+        return -1;
+    
+    dedupcache_unlink(c, item);
+    dedupcache_push(c, item);
+    memcpy(data, item->data, size);
+    return 0;
+}
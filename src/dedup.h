@@ -0,0 +1,80 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifndef __DEDUP_H__
+#define __DEDUP_H__
+
+#include "types.h"
+
+struct s_dedup;
+typedef struct s_dedup cdedup;
+
+struct s_dedupitem;
+typedef struct s_dedupitem cdedupitem;
+
+struct s_dedupcache;
+typedef struct s_dedupcache cdedupcache;
+
+struct s_dedupcacheitem;
+typedef struct s_dedupcacheitem cdedupcacheitem;
+
+// small file already packed in the archive which identical files can point to
+struct s_dedupitem
+{   cdedupitem    *next; // first field for hashtable_resize()
+    u8            md5sum[16];
+    u64           size;
+    u64           packid; // number of the block of small files which contains the data
+    char          *path;
+};
+
+// index of the contents of the small files saved in a filesystem (savefs/savedir)
+struct s_dedup
+{   cdedupitem    **table;
+    u32           tablesize;
+    u64           count;
+};
+
+// contents of a small file recently restored
+struct s_dedupcacheitem
+{   u8               md5sum[16];
+    u64              size;
+    char             *data;
+    cdedupcacheitem  *hnext; // next item in the same bucket of the hash table
+    cdedupcacheitem  *newer;
+    cdedupcacheitem  *older;
+};
+
+// lru cache used to restore the duplicates of small files (restfs/restdir)
+struct s_dedupcache
+{   cdedupcacheitem  **table;
+    cdedupcacheitem  *newest;
+    cdedupcacheitem  *oldest;
+    u64              usedsize;
+    u64              maxsize;
+};
+
+int  dedup_init(cdedup *d);
+int  dedup_destroy(cdedup *d);
+cdedupitem *dedup_get(cdedup *d, u8 *md5sum, u64 size);
+int  dedup_add(cdedup *d, u8 *md5sum, u64 size, u64 packid, char *path);
+
+int  dedupcache_init(cdedupcache *c, u64 maxsize);
+int  dedupcache_destroy(cdedupcache *c);
+int  dedupcache_add(cdedupcache *c, u8 *md5sum, char *data, u64 size);
+int  dedupcache_get(cdedupcache *c, u8 *md5sum, u64 size, char *data, u64 bufsize);
+
+#endif // __DEDUP_H__
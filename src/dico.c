@@ -66,6 +66,28 @@ int dico_add_data(cdico *d, u8 section, u16 key, const void *data, u16 size)
     return dico_add_generic(d, section, key, data, size, DICTYPE_DATA);
 }
 
+// remove an item from the dico, fails if there is no item with that (section,key)
+int dico_del(cdico *d, u8 section, u16 key)
+{
+    cdicoitem **prev;
+    cdicoitem *item;
+    
+    assert(d);
+    
+    for (prev=&d->head; (item=*prev)!=NULL; prev=&item->next)
+    {
+        if (item->section==section && item->key==key)
+        {   *prev=item->next;
+            if (item->data!=NULL)
+                free(item->data);
+            free(item);
+            return 0;
+        }
+    }
+    
+    return -1;
+}
+
 // add an item to the dico, fails if an item with that (section,key) already exists
 int dico_add_generic(cdico *d, u8 section, u16 key, const void *data, u16 size, u8 type)
 {
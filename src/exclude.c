@@ -0,0 +1,331 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include <fnmatch.h>
+
+#include "fsarchiver.h"
+#include "exclude.h"
+#include "strlist.h"
+#include "common.h"
+#include "error.h"
+
+#define EXCLUDE_DEF_DIRSIZE    4096
+#define EXCLUDE_MAX_DIRCOUNT   65536 // the cache of the verdicts is emptied when it reaches that size
+
+cexclude g_exclude;
+cexclude g_include;
+
+static u32 exclude_hash(char *str)
+{
+    u32 hash=2166136261U; // fnv-1a
+    
+    for (; *str; str++)
+        hash=(hash^(u8)*str)*16777619U;
+    return hash;
+}
+
+static cexcludeitem *exclude_table_get(cexcludeitem **table, u32 size, char *str)
+{
+    cexcludeitem *item;
+    
+    for (item=table[exclude_hash(str)%size]; item!=NULL; item=item->next)
+        if (strcmp(item->str, str)==0)
+            return item;
+    return NULL;
+}
+
+static int exclude_table_add(cexcludeitem **table, u32 size, char *str, bool excluded)
+{
+    cexcludeitem *lnew;
+    u32 pos;
+    
+    if ((lnew=malloc(sizeof(cexcludeitem)))==NULL)
+    {   errprintf("malloc(%ld) failed: out of memory\n", (long)sizeof(cexcludeitem));
+        return -1;
+    }
+    if ((lnew->str=strdup(str))==NULL)
+    {   errprintf("strdup() failed: out of memory\n");
+        free(lnew);
+        return -1;
+    }
+    lnew->excluded=excluded;
+    pos=exclude_hash(str)%size;
+    lnew->next=table[pos];
+    table[pos]=lnew;
+    return 0;
+}
+
+static void exclude_table_free(cexcludeitem **table, u32 size)
+{
+    cexcludeitem *item, *next;
+    u32 i;
+    
+    for (i=0; (table!=NULL) && (i < size); i++)
+    {
+        for (item=table[i]; item!=NULL; item=next)
+        {   next=item->next;
+            free(item->str);
+            free(item);
+        }
+    }
+    free(table);
+}
+
+// the objects are restored in the order of the archive so the old verdicts are rarely needed again
+static void exclude_dirs_flush(cexclude *x)
+{
+    cexcludeitem *item, *next;
+    u32 i;
+    
+    for (i=0; i < x->dirsize; i++)
+    {
+        for (item=x->dirs[i]; item!=NULL; item=next)
+        {   next=item->next;
+            free(item->str);
+            free(item);
+        }
+        x->dirs[i]=NULL;
+    }
+    x->dircount=0;
+}
+
+static u32 exclude_itemhash(void *item)
+{
+    return exclude_hash(((cexcludeitem *)item)->str);
+}
+
+static int exclude_dirs_resize(cexclude *x, u32 newsize)
+{
+    return hashtable_resize((void ***)&x->dirs, &x->dirsize, newsize, exclude_itemhash);
+}
+
+static int exclude_trie_add(cexcludenode **root, char *prefix, int len)
+{
+    cexcludenode **cur=root;
+    cexcludenode *node=NULL;
+    int i;
+    
+    for (i=0; i < len; i++)
+    {
+        for (node=*cur; (node!=NULL) && (node->c!=prefix[i]); node=node->next);
+        if (node==NULL)
+        {
+            if ((node=calloc(1, sizeof(cexcludenode)))==NULL)
+            {   errprintf("calloc(%ld) failed: out of memory\n", (long)sizeof(cexcludenode));
+                return -1;
+            }
+            node->c=prefix[i];
+            node->next=*cur;
+            *cur=node;
+        }
+        cur=&node->child;
+    }
+    if (node!=NULL)
+        node->final=true;
+    return 0;
+}
+
+// length of the part of an absolute pattern which is before its first wildcard and ends with a
+// complete name: "/home/*/.ssh" --> "/home". every path it matches is that path or is below it
+static int exclude_anchor_len(char *pattern)
+{
+    int len;
+    
+    if (pattern[0]!='/')
+        return 0;
+    len=strcspn(pattern, "*?[\\");
+    if (pattern[len]!=0)
+        while ((len>0) && (pattern[len]!='/'))
+            len--;
+    return len;
+}
+
+static void exclude_trie_free(cexcludenode *node)
+{
+    cexcludenode *next;
+    
+    for (; node!=NULL; node=next)
+    {   next=node->next;
+        exclude_trie_free(node->child);
+        free(node);
+    }
+}
+
+// compile the patterns passed with option -e
+int exclude_init(cexclude *x, cstrlist *patterns)
+{
+    cstrlistitem *item;
+    char *pattern;
+    int count=0;
+    int len;
+    
+    memset(x, 0, sizeof(cexclude));
+    pthread_mutex_init(&x->dirmutex, NULL);
+    
+    for (item=patterns->head; item!=NULL; item=item->next)
+        count++;
+    x->count=count;
+    for (x->litsize=64; x->litsize < 2*count; x->litsize*=2);
+    if (((x->literals=calloc(x->litsize, sizeof(cexcludeitem*)))==NULL) ||
+        ((x->globs=calloc(count+1, sizeof(char*)))==NULL) ||
+        ((x->anchors=calloc(count+1, sizeof(char*)))==NULL) ||
+        (exclude_dirs_resize(x, EXCLUDE_DEF_DIRSIZE)!=0))
+    {   errprintf("cannot allocate the exclusion patterns\n");
+        return -1;
+    }
+    
+    x->anchored=(count>0);
+    for (item=patterns->head; item!=NULL; item=item->next)
+    {
+        pattern=item->str;
+        if ((len=exclude_anchor_len(pattern))==0)
+            x->anchored=false;
+        else if ((x->anchors[x->anchorcount++]=strndup(pattern, len))==NULL)
+        {   errprintf("strndup() failed: out of memory\n");
+            return -1;
+        }
+        
+        len=strcspn(pattern, "*?[\\");
+        if (pattern[len]==0) // no wildcard: the whole name or path has to be identical
+        {
+            if ((exclude_table_get(x->literals, x->litsize, pattern)==NULL) &&
+                (exclude_table_add(x->literals, x->litsize, pattern, true)!=0))
+                return -1;
+        }
+        else if ((len>0) && (pattern[len]=='*') && (pattern[len+1]==0)) // '*' also matches '/' without FNM_PATHNAME
+        {
+            if (exclude_trie_add(&x->prefixes, pattern, len)!=0)
+                return -1;
+        }
+        else if ((x->globs[x->globcount++]=strdup(pattern))==NULL)
+        {   errprintf("strdup() failed: out of memory\n");
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+int exclude_destroy(cexclude *x)
+{
+    int i;
+    
+    exclude_table_free(x->literals, x->litsize);
+    exclude_table_free(x->dirs, x->dirsize);
+    exclude_trie_free(x->prefixes);
+    for (i=0; (x->globs!=NULL) && (i < x->globcount); i++)
+        free(x->globs[i]);
+    free(x->globs);
+    for (i=0; (x->anchors!=NULL) && (i < x->anchorcount); i++)
+        free(x->anchors[i]);
+    free(x->anchors);
+    pthread_mutex_destroy(&x->dirmutex);
+    memset(x, 0, sizeof(cexclude));
+    return 0;
+}
+
+// same result as fnmatch(pattern, string, 0) on each pattern
+bool exclude_match(cexclude *x, char *string)
+{
+    cexcludenode *level;
+    cexcludenode *node;
+    char *cur;
+    int i;
+    
+    if (x->count==0)
+        return false;
+    if ((x->literals!=NULL) && (exclude_table_get(x->literals, x->litsize, string)!=NULL))
+        return true;
+    
+    for (level=x->prefixes, cur=string; (level!=NULL) && (*cur!=0); cur++)
+    {
+        for (node=level; (node!=NULL) && (node->c!=*cur); node=node->next);
+        if (node==NULL)
+            break;
+        if (node->final==true)
+            return true;
+        level=node->child;
+    }
+    
+    for (i=0; i < x->globcount; i++)
+        if (fnmatch(x->globs[i], string, 0)==0)
+            return true;
+    
+    return false;
+}
+
+// returns true if that directory or one of its parents is excluded (the last verdicts are cached)
+bool exclude_match_dir(cexclude *x, char *dirpath)
+{
+    char basename[PATH_MAX];
+    char parent[PATH_MAX];
+    cexcludeitem *item;
+    bool excluded;
+    
+    if ((x->count==0) || (dirpath[0]==0) || (strcmp(dirpath, "/")==0) || (x->dirs==NULL))
+        return false;
+    
+    assert(pthread_mutex_lock(&x->dirmutex)==0);
+    item=exclude_table_get(x->dirs, x->dirsize, dirpath);
+    excluded=(item!=NULL) && (item->excluded==true);
+    assert(pthread_mutex_unlock(&x->dirmutex)==0);
+    if (item!=NULL)
+        return excluded;
+    
+    extract_basename(dirpath, basename, sizeof(basename));
+    extract_dirpath(dirpath, parent, sizeof(parent));
+    excluded=(exclude_match(x, basename)==true) || (exclude_match(x, dirpath)==true) || (exclude_match_dir(x, parent)==true);
+    
+    assert(pthread_mutex_lock(&x->dirmutex)==0);
+    if (exclude_table_get(x->dirs, x->dirsize, dirpath)==NULL)
+    {
+        if (x->dircount >= EXCLUDE_MAX_DIRCOUNT)
+            exclude_dirs_flush(x);
+        if ((x->dircount < 2*(u64)x->dirsize) || (exclude_dirs_resize(x, 2*x->dirsize)==0))
+            if (exclude_table_add(x->dirs, x->dirsize, dirpath, excluded)==0)
+                x->dircount++;
+    }
+    assert(pthread_mutex_unlock(&x->dirmutex)==0);
+    
+    return excluded;
+}
+
+// returns true if that directory contains the anchor of one of the patterns
+bool exclude_match_parent(cexclude *x, char *dirpath)
+{
+    int len;
+    int i;
+    
+    if ((x->anchorcount > 0) && (strcmp(dirpath, "/")==0))
+        return true;
+    
+    len=strlen(dirpath);
+    for (i=0; i < x->anchorcount; i++)
+        if ((strncmp(x->anchors[i], dirpath, len)==0) && (x->anchors[i][len]=='/'))
+            return true;
+    return false;
+}
@@ -0,0 +1,76 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifndef __EXCLUDE_H__
+#define __EXCLUDE_H__
+
+#include <pthread.h>
+#include "types.h"
+
+struct s_strlist;
+
+struct s_exclude;
+typedef struct s_exclude cexclude;
+
+struct s_excludeitem;
+typedef struct s_excludeitem cexcludeitem;
+
+struct s_excludenode;
+typedef struct s_excludenode cexcludenode;
+
+// literal pattern, or directory verdict in the cache of the restoration
+struct s_excludeitem
+{   cexcludeitem  *next; // first field for hashtable_resize()
+    char          *str;
+    bool          excluded;
+};
+
+// node of the trie of the patterns such as "/usr/share/*"
+struct s_excludenode
+{   char          c;
+    bool          final; // a pattern ends with that character
+    cexcludenode  *child;
+    cexcludenode  *next;
+};
+
+// exclusion patterns compiled once so that each path costs a few lookups
+struct s_exclude
+{   int              count; // number of patterns
+    cexcludeitem     **literals; // patterns without any wildcard
+    u32              litsize;
+    cexcludenode     *prefixes; // patterns where the only wildcard is a final '*'
+    char             **globs; // the other patterns (checked with fnmatch)
+    int              globcount;
+    cexcludeitem     **dirs; // verdict of the last directories checked (restoration)
+    u32              dirsize;
+    u64              dircount;
+    pthread_mutex_t  dirmutex;
+    char             **anchors; // path which contains all the matches of each absolute pattern
+    int              anchorcount;
+    bool             anchored; // all the patterns have an anchor (see exclude_anchor_len)
+};
+
+extern cexclude g_exclude;
+extern cexclude g_include;
+
+int  exclude_init(cexclude *x, struct s_strlist *patterns);
+int  exclude_destroy(cexclude *x);
+bool exclude_match(cexclude *x, char *string);
+bool exclude_match_dir(cexclude *x, char *dirpath);
+bool exclude_match_parent(cexclude *x, char *dirpath);
+
+#endif // __EXCLUDE_H__
@@ -0,0 +1,698 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#ifdef OPTION_EXTDIRECT_SUPPORT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <ext2fs.h>
+
+#include "fsarchiver.h"
+#include "extdirect.h"
+#include "common.h"
+#include "error.h"
+
+// remember the last directory and the last object looked up: the restore works
+// on the entries of one directory at a time and on the object it just created
+struct s_extcache
+{   char        path[PATH_MAX];
+    ext2_ino_t  ino;
+};
+
+struct s_extdirect
+{   ext2_filsys         fs;
+    char                mntpath[PATH_MAX]; // prefix of the paths passed by the restore
+    struct s_extcache   dir;
+    struct s_extcache   obj;
+};
+
+struct s_extfile
+{   cextdirect  *ed;
+    char        path[PATH_MAX];
+    ext2_ino_t  ino;
+    u64         pos;
+    char        *tail; // one block used to write the end of the file
+};
+
+// convert a path under the mount point into a path relative to the root of the filesystem
+static char *extdirect_relpath(cextdirect *ed, char *path)
+{
+    size_t len=strlen(ed->mntpath);
+    
+    if ((strncmp(path, ed->mntpath, len)!=0) || ((path[len]!=0) && (path[len]!='/')))
+        return NULL;
+    return (path[len]==0) ? "/" : path+len;
+}
+
+static void extdirect_remember(struct s_extcache *cache, char *relpath, ext2_ino_t ino)
+{
+    snprintf(cache->path, sizeof(cache->path), "%s", relpath);
+    cache->ino=ino;
+}
+
+static void extdirect_forget(cextdirect *ed)
+{
+    ed->dir.ino=0;
+    ed->obj.ino=0;
+}
+
+// find the inode of a path relative to the root of the filesystem
+static int extdirect_lookup(cextdirect *ed, char *relpath, ext2_ino_t *ino)
+{
+    errcode_t err;
+    
+    if (strcmp(relpath, "/")==0)
+    {   *ino=EXT2_ROOT_INO;
+        return 0;
+    }
+    if ((ed->obj.ino!=0) && (strcmp(ed->obj.path, relpath)==0))
+    {   *ino=ed->obj.ino;
+        return 0;
+    }
+    if ((ed->dir.ino!=0) && (strcmp(ed->dir.path, relpath)==0))
+    {   *ino=ed->dir.ino;
+        return 0;
+    }
+    if ((err=ext2fs_namei(ed->fs, EXT2_ROOT_INO, EXT2_ROOT_INO, relpath, ino))!=0)
+        return -1;
+    extdirect_remember(&ed->obj, relpath, *ino);
+    return 0;
+}
+
+// same as extdirect_lookup() with the full path under the mount point
+static int extdirect_inode(cextdirect *ed, char *path, ext2_ino_t *ino)
+{
+    char *relpath;
+    
+    if (((relpath=extdirect_relpath(ed, path))==NULL) || (extdirect_lookup(ed, relpath, ino)!=0))
+    {   errprintf("cannot find [%s] in the ext filesystem\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// split a path in the inode of its parent directory and the name of the entry
+static int extdirect_parent(cextdirect *ed, char *path, ext2_ino_t *dirino, char **name)
+{
+    char dirpath[PATH_MAX];
+    char *relpath;
+    char *slash;
+    
+    if (((relpath=extdirect_relpath(ed, path))==NULL) || ((slash=strrchr(relpath, '/'))==NULL) || (slash[1]==0))
+    {   errprintf("invalid path [%s]\n", path);
+        return -1;
+    }
+    
+    snprintf(dirpath, sizeof(dirpath), "%.*s", (int)(slash-relpath), relpath);
+    if (dirpath[0]==0)
+        *dirino=EXT2_ROOT_INO;
+    else if ((ed->dir.ino!=0) && (strcmp(ed->dir.path, dirpath)==0))
+        *dirino=ed->dir.ino;
+    else if (ext2fs_namei(ed->fs, EXT2_ROOT_INO, EXT2_ROOT_INO, dirpath, dirino)==0)
+        extdirect_remember(&ed->dir, dirpath, *dirino);
+    else
+    {   errprintf("cannot find the parent directory of [%s] in the ext filesystem\n", path);
+        return -1;
+    }
+    
+    *name=slash+1;
+    return 0;
+}
+
+static int extdirect_filetype(u32 mode)
+{
+    switch (mode & S_IFMT)
+    {
+        case S_IFREG: return EXT2_FT_REG_FILE;
+        case S_IFDIR: return EXT2_FT_DIR;
+        case S_IFLNK: return EXT2_FT_SYMLINK;
+        case S_IFCHR: return EXT2_FT_CHRDEV;
+        case S_IFBLK: return EXT2_FT_BLKDEV;
+        case S_IFIFO: return EXT2_FT_FIFO;
+        case S_IFSOCK: return EXT2_FT_SOCK;
+        default: return EXT2_FT_UNKNOWN;
+    }
+}
+
+// add an entry in a directory and grow the directory when it is full
+static errcode_t extdirect_addlink(cextdirect *ed, ext2_ino_t dirino, char *name, ext2_ino_t ino, int filetype)
+{
+    errcode_t err;
+    
+    if ((err=ext2fs_link(ed->fs, dirino, name, ino, filetype))==EXT2_ET_DIR_NO_SPACE)
+    {   if ((err=ext2fs_expand_dir(ed->fs, dirino))!=0)
+            return err;
+        err=ext2fs_link(ed->fs, dirino, name, ino, filetype);
+    }
+    return err;
+}
+
+// refuse to create an entry twice since ext2fs_link() does not check it
+static bool extdirect_exists(cextdirect *ed, ext2_ino_t dirino, char *name)
+{
+    ext2_ino_t ino;
+    
+    return (ext2fs_lookup(ed->fs, dirino, name, strlen(name), NULL, &ino)==0);
+}
+
+// allocate a new inode which is not a directory nor a symlink and link it in its parent
+static int extdirect_newinode(cextdirect *ed, char *path, u32 mode, struct ext2_inode *inode, ext2_ino_t *ino)
+{
+    ext2_extent_handle_t handle;
+    ext2_ino_t dirino;
+    errcode_t err;
+    char *name;
+    
+    if (extdirect_parent(ed, path, &dirino, &name)!=0)
+        return -1;
+    if (extdirect_exists(ed, dirino, name)==true)
+    {   errprintf("[%s] already exists\n", path);
+        return -1;
+    }
+    
+    if ((err=ext2fs_new_inode(ed->fs, dirino, mode, NULL, ino))!=0)
+    {   errprintf("ext2fs_new_inode(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    if ((err=extdirect_addlink(ed, dirino, name, *ino, extdirect_filetype(mode)))!=0)
+    {   errprintf("ext2fs_link(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    ext2fs_inode_alloc_stats2(ed->fs, *ino, +1, 0);
+    
+    memset(inode, 0, sizeof(struct ext2_inode));
+    inode->i_mode=mode;
+    inode->i_atime=inode->i_ctime=inode->i_mtime=time(NULL);
+    inode->i_links_count=1;
+    
+    // the block map of regular files is an extent tree on ext4
+    if (S_ISREG(mode) && ext2fs_has_feature_extents(ed->fs->super))
+    {   if ((err=ext2fs_extent_open2(ed->fs, *ino, inode, &handle))!=0)
+        {   errprintf("ext2fs_extent_open2(%s) failed: %s\n", path, error_message(err));
+            return -1;
+        }
+        ext2fs_extent_free(handle);
+    }
+    
+    if ((err=ext2fs_write_new_inode(ed->fs, *ino, inode))!=0)
+    {   errprintf("ext2fs_write_new_inode(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    
+    extdirect_remember(&ed->obj, extdirect_relpath(ed, path), *ino);
+    return 0;
+}
+
+int extdirect_open(cextdirect **ed, char *devpath, char *mntpath)
+{
+    cextdirect *e;
+    errcode_t err;
+    size_t len;
+    
+    if ((e=calloc(1, sizeof(cextdirect)))==NULL)
+    {   errprintf("calloc(%ld) failed: out of memory\n", (long)sizeof(cextdirect));
+        return -1;
+    }
+    
+    if ((err=ext2fs_open(devpath, EXT2_FLAG_RW|EXT2_FLAG_64BITS, 0, 0, unix_io_manager, &e->fs))!=0)
+    {   errprintf("ext2fs_open(%s) failed: %s\n", devpath, error_message(err));
+        free(e);
+        return -1;
+    }
+    if ((err=ext2fs_read_bitmaps(e->fs))!=0)
+    {   errprintf("ext2fs_read_bitmaps(%s) failed: %s\n", devpath, error_message(err));
+        ext2fs_close_free(&e->fs);
+        free(e);
+        return -1;
+    }
+    
+    snprintf(e->mntpath, sizeof(e->mntpath), "%s", mntpath);
+    for (len=strlen(e->mntpath); (len>0) && (e->mntpath[len-1]=='/'); len--)
+        e->mntpath[len-1]=0;
+    
+    *ed=e;
+    return 0;
+}
+
+int extdirect_close(cextdirect *ed)
+{
+    errcode_t err;
+    int ret=0;
+    
+    if (ed==NULL)
+        return -1;
+    
+    // writes the bitmaps, the group descriptors and the superblock
+    if ((err=ext2fs_close_free(&ed->fs))!=0)
+    {   errprintf("ext2fs_close() failed: %s\n", error_message(err));
+        ret=-1;
+    }
+    free(ed);
+    return ret;
+}
+
+int extdirect_mkdir(cextdirect *ed, char *path)
+{
+    char curpath[PATH_MAX];
+    ext2_ino_t dirino;
+    ext2_ino_t ino;
+    errcode_t err;
+    char *relpath;
+    char *name;
+    char *next;
+    
+    if ((relpath=extdirect_relpath(ed, path))==NULL)
+    {   errprintf("invalid path [%s]\n", path);
+        return -1;
+    }
+    if ((ed->dir.ino!=0) && (strcmp(ed->dir.path, relpath)==0))
+        return 0;
+    
+    // walk down from the root and create the missing directories
+    snprintf(curpath, sizeof(curpath), "%s", relpath);
+    dirino=EXT2_ROOT_INO;
+    for (name=curpath; *name=='/'; name++);
+    while (*name!=0)
+    {
+        if ((next=strchr(name, '/'))!=NULL)
+            *next=0;
+        
+        if (ext2fs_lookup(ed->fs, dirino, name, strlen(name), NULL, &ino)!=0)
+        {
+            if ((err=ext2fs_mkdir(ed->fs, dirino, 0, name))==EXT2_ET_DIR_NO_SPACE)
+            {   if ((err=ext2fs_expand_dir(ed->fs, dirino))==0)
+                    err=ext2fs_mkdir(ed->fs, dirino, 0, name);
+            }
+            if ((err!=0) || (ext2fs_lookup(ed->fs, dirino, name, strlen(name), NULL, &ino)!=0))
+            {   errprintf("ext2fs_mkdir(%s) failed: %s\n", path, error_message(err));
+                return -1;
+            }
+        }
+        dirino=ino;
+        
+        if (next==NULL)
+            break;
+        *next='/';
+        for (name=next+1; *name=='/'; name++);
+    }
+    
+    extdirect_remember(&ed->dir, relpath, dirino);
+    return 0;
+}
+
+int extdirect_symlink(cextdirect *ed, char *target, char *path)
+{
+    ext2_ino_t dirino;
+    ext2_ino_t ino;
+    errcode_t err;
+    char *name;
+    
+    if (extdirect_parent(ed, path, &dirino, &name)!=0)
+        return -1;
+    if (extdirect_exists(ed, dirino, name)==true)
+    {   errprintf("[%s] already exists\n", path);
+        return -1;
+    }
+    
+    if ((err=ext2fs_symlink(ed->fs, dirino, 0, name, target))==EXT2_ET_DIR_NO_SPACE)
+    {   if ((err=ext2fs_expand_dir(ed->fs, dirino))==0)
+            err=ext2fs_symlink(ed->fs, dirino, 0, name, target);
+    }
+    if (err!=0)
+    {   errprintf("ext2fs_symlink(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    
+    if (ext2fs_lookup(ed->fs, dirino, name, strlen(name), NULL, &ino)==0)
+        extdirect_remember(&ed->obj, extdirect_relpath(ed, path), ino);
+    return 0;
+}
+
+int extdirect_link(cextdirect *ed, char *oldpath, char *newpath)
+{
+    struct ext2_inode inode;
+    ext2_ino_t dirino;
+    ext2_ino_t ino;
+    errcode_t err;
+    char *name;
+    
+    if (extdirect_inode(ed, oldpath, &ino)!=0)
+        return -1;
+    if (extdirect_parent(ed, newpath, &dirino, &name)!=0)
+        return -1;
+    if (extdirect_exists(ed, dirino, name)==true)
+    {   errprintf("[%s] already exists\n", newpath);
+        return -1;
+    }
+    
+    if ((err=ext2fs_read_inode(ed->fs, ino, &inode))!=0)
+    {   errprintf("ext2fs_read_inode(%s) failed: %s\n", oldpath, error_message(err));
+        return -1;
+    }
+    if ((err=extdirect_addlink(ed, dirino, name, ino, extdirect_filetype(inode.i_mode)))!=0)
+    {   errprintf("ext2fs_link(%s) failed: %s\n", newpath, error_message(err));
+        return -1;
+    }
+    inode.i_links_count++;
+    if ((err=ext2fs_write_inode(ed->fs, ino, &inode))!=0)
+    {   errprintf("ext2fs_write_inode(%s) failed: %s\n", newpath, error_message(err));
+        return -1;
+    }
+    return 0;
+}
+
+int extdirect_mknod(cextdirect *ed, char *path, u32 mode, u64 rdev)
+{
+    struct ext2_inode inode;
+    ext2_ino_t ino;
+    errcode_t err;
+    
+    if (extdirect_newinode(ed, path, mode, &inode, &ino)!=0)
+        return -1;
+    
+    // same encoding of the device numbers as the kernel (old format when it fits)
+    if (S_ISCHR(mode) || S_ISBLK(mode))
+    {   if ((major(rdev) < 256) && (minor(rdev) < 256))
+        {   inode.i_block[0]=major(rdev)*256 + minor(rdev);
+            inode.i_block[1]=0;
+        }
+        else
+        {   inode.i_block[0]=0;
+            inode.i_block[1]=(minor(rdev) & 0xff) | (major(rdev) << 8) | ((minor(rdev) & ~0xff) << 12);
+        }
+        if ((err=ext2fs_write_inode(ed->fs, ino, &inode))!=0)
+        {   errprintf("ext2fs_write_inode(%s) failed: %s\n", path, error_message(err));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int extdirect_unlink(cextdirect *ed, char *path)
+{
+    struct ext2_inode inode;
+    ext2_ino_t dirino;
+    ext2_ino_t ino;
+    errcode_t err;
+    char *name;
+    
+    if (extdirect_parent(ed, path, &dirino, &name)!=0)
+        return -1;
+    if (ext2fs_lookup(ed->fs, dirino, name, strlen(name), NULL, &ino)!=0)
+        return -1;
+    
+    extdirect_forget(ed);
+    if ((err=ext2fs_unlink(ed->fs, dirino, name, ino, 0))!=0)
+    {   errprintf("ext2fs_unlink(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    
+    if ((err=ext2fs_read_inode(ed->fs, ino, &inode))!=0)
+    {   errprintf("ext2fs_read_inode(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    if (inode.i_links_count > 0)
+        inode.i_links_count--;
+    if (inode.i_links_count==0)
+    {   // release the blocks and the inode itself
+        if (ext2fs_inode_has_valid_blocks2(ed->fs, &inode))
+            ext2fs_punch(ed->fs, ino, &inode, NULL, 0, ~0ULL);
+        inode.i_dtime=time(NULL);
+        ext2fs_inode_alloc_stats2(ed->fs, ino, -1, LINUX_S_ISDIR(inode.i_mode));
+    }
+    if ((err=ext2fs_write_inode(ed->fs, ino, &inode))!=0)
+    {   errprintf("ext2fs_write_inode(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    return 0;
+}
+
+int extdirect_truncate(cextdirect *ed, char *path)
+{
+    struct ext2_inode inode;
+    ext2_ino_t ino;
+    errcode_t err;
+    
+    if (extdirect_inode(ed, path, &ino)!=0)
+        return -1;
+    if ((err=ext2fs_read_inode(ed->fs, ino, &inode))!=0)
+    {   errprintf("ext2fs_read_inode(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    if ((err=ext2fs_punch(ed->fs, ino, &inode, NULL, 0, ~0ULL))!=0)
+    {   errprintf("ext2fs_punch(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    ext2fs_inode_size_set(ed->fs, &inode, 0);
+    if ((err=ext2fs_write_inode(ed->fs, ino, &inode))!=0)
+    {   errprintf("ext2fs_write_inode(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    return 0;
+}
+
+int extdirect_setattr(cextdirect *ed, char *path, u32 mode, u32 uid, u32 gid, u64 atime, u64 mtime)
+{
+    struct ext2_inode inode;
+    ext2_ino_t ino;
+    errcode_t err;
+    
+    if (extdirect_inode(ed, path, &ino)!=0)
+        return -1;
+    if ((err=ext2fs_read_inode(ed->fs, ino, &inode))!=0)
+    {   errprintf("ext2fs_read_inode(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    
+    // the permissions of symlinks are not restored with the vfs either
+    if (!LINUX_S_ISLNK(inode.i_mode))
+        inode.i_mode=(inode.i_mode & LINUX_S_IFMT) | (mode & 07777);
+    inode.i_uid=uid & 0xffff;
+    ext2fs_set_i_uid_high(inode, uid >> 16);
+    inode.i_gid=gid & 0xffff;
+    ext2fs_set_i_gid_high(inode, gid >> 16);
+    inode.i_atime=(u32)atime;
+    inode.i_mtime=(u32)mtime;
+    inode.i_ctime=time(NULL);
+    
+    if ((err=ext2fs_write_inode(ed->fs, ino, &inode))!=0)
+    {   errprintf("ext2fs_write_inode(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    return 0;
+}
+
+int extdirect_setxattr(cextdirect *ed, char *path, char *name, void *value, u64 size)
+{
+    struct ext2_xattr_handle *handle;
+    ext2_ino_t ino;
+    errcode_t err;
+    
+    if (extdirect_inode(ed, path, &ino)!=0)
+        return -1;
+    
+    if ((err=ext2fs_xattrs_open(ed->fs, ino, &handle))!=0)
+    {   errprintf("ext2fs_xattrs_open(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    if (((err=ext2fs_xattrs_read(handle))!=0) || ((err=ext2fs_xattr_set(handle, name, value, size))!=0))
+    {   errprintf("cannot set xattr [%s] on [%s]: %s\n", name, path, error_message(err));
+        ext2fs_xattrs_close(&handle);
+        return -1;
+    }
+    if ((err=ext2fs_xattrs_close(&handle))!=0)
+    {   errprintf("ext2fs_xattrs_close(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    return 0;
+}
+
+s64 extdirect_readfile(cextdirect *ed, char *path, char *buf, u64 size)
+{
+    unsigned int got=0;
+    ext2_file_t file;
+    ext2_ino_t ino;
+    errcode_t err;
+    
+    if (extdirect_inode(ed, path, &ino)!=0)
+        return -1;
+    if ((err=ext2fs_file_open(ed->fs, ino, 0, &file))!=0)
+    {   errprintf("ext2fs_file_open(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    err=ext2fs_file_read(file, buf, size, &got);
+    ext2fs_file_close(file);
+    if (err!=0)
+    {   errprintf("ext2fs_file_read(%s) failed: %s\n", path, error_message(err));
+        return -1;
+    }
+    return got;
+}
+
+int extdirect_fopen(cextdirect *ed, char *path, u64 size, bool sparse, cextfile **file)
+{
+    struct ext2_inode inode;
+    cextfile *f;
+    blk64_t count;
+    errcode_t err;
+    
+    if ((f=calloc(1, sizeof(cextfile)))==NULL)
+    {   errprintf("calloc(%ld) failed: out of memory\n", (long)sizeof(cextfile));
+        return -1;
+    }
+    if ((f->tail=malloc(ed->fs->blocksize))==NULL)
+    {   errprintf("malloc(%ld) failed: out of memory\n", (long)ed->fs->blocksize);
+        free(f);
+        return -1;
+    }
+    
+    if (extdirect_newinode(ed, path, S_IFREG|S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH, &inode, &f->ino)!=0)
+    {   free(f->tail);
+        free(f);
+        return -1;
+    }
+    
+    // reserve all the blocks at once so that the file gets a few large extents,
+    // the holes of sparse files are allocated on demand when data are written
+    count=(size + ed->fs->blocksize - 1) / ed->fs->blocksize;
+    if ((sparse==false) && (count > 0))
+    {   if ((err=ext2fs_fallocate(ed->fs, EXT2_FALLOCATE_FORCE_INIT, f->ino, &inode, ~0ULL, 0, count))!=0)
+            msgprintf(MSG_DEBUG1, "ext2fs_fallocate(%s) failed: %s\n", path, error_message(err));
+    }
+    
+    snprintf(f->path, sizeof(f->path), "%s", path);
+    f->ed=ed;
+    f->pos=0;
+    *file=f;
+    return 0;
+}
+
+// get the physical block of a logical block and allocate it when it is a hole
+static int extdirect_fmap(cextfile *f, blk64_t lblk, blk64_t *pblk)
+{
+    errcode_t err;
+    
+    if ((err=ext2fs_bmap2(f->ed->fs, f->ino, NULL, NULL, BMAP_ALLOC, lblk, NULL, pblk))!=0)
+    {   errno=(err==EXT2_ET_BLOCK_ALLOC_FAIL) ? ENOSPC : EIO;
+        errprintf("ext2fs_bmap2(%s) failed: %s\n", f->path, error_message(err));
+        return -1;
+    }
+    return 0;
+}
+
+int extdirect_fwrite(cextfile *file, char *data, u64 len)
+{
+    unsigned int blksize=file->ed->fs->blocksize;
+    blk64_t lblk, pblk, next;
+    unsigned int written;
+    ext2_file_t efile;
+    u64 count, i, run;
+    errcode_t err;
+    __u64 pos;
+    
+    // the restore writes the files from the beginning in blocks of a multiple of
+    // the block size so only the end of the file is not aligned: the data of
+    // physically contiguous blocks are written in one single io
+    if ((file->pos % blksize)==0)
+    {
+        lblk=file->pos / blksize;
+        count=len / blksize;
+        for (i=0; i < count; i+=run)
+        {
+            if (extdirect_fmap(file, lblk+i, &pblk)!=0)
+                return -1;
+            for (run=1; (i+run < count) && (extdirect_fmap(file, lblk+i+run, &next)==0) && (next==pblk+run); run++);
+            if ((err=io_channel_write_blk64(file->ed->fs->io, pblk, run, data+(i*blksize)))!=0)
+            {   errno=EIO;
+                errprintf("cannot write [%s]: %s\n", file->path, error_message(err));
+                return -1;
+            }
+        }
+        
+        if ((len % blksize)!=0)
+        {   memset(file->tail, 0, blksize);
+            memcpy(file->tail, data+(count*blksize), len % blksize);
+            if ((extdirect_fmap(file, lblk+count, &pblk)!=0) || (io_channel_write_blk64(file->ed->fs->io, pblk, 1, file->tail)!=0))
+            {   errprintf("cannot write the end of [%s]\n", file->path);
+                return -1;
+            }
+        }
+    }
+    else // unaligned write: let libext2fs read and update the partial block
+    {
+        if ((err=ext2fs_file_open(file->ed->fs, file->ino, EXT2_FILE_WRITE, &efile))!=0)
+        {   errprintf("ext2fs_file_open(%s) failed: %s\n", file->path, error_message(err));
+            return -1;
+        }
+        if (((err=ext2fs_file_llseek(efile, file->pos, EXT2_SEEK_SET, &pos))!=0) ||
+            ((err=ext2fs_file_write(efile, data, len, &written))!=0) || (written!=len))
+        {   errno=(err==EXT2_ET_BLOCK_ALLOC_FAIL) ? ENOSPC : EIO;
+            errprintf("ext2fs_file_write(%s) failed: %s\n", file->path, error_message(err));
+            ext2fs_file_close(efile);
+            return -1;
+        }
+        if ((err=ext2fs_file_close(efile))!=0)
+        {   errprintf("ext2fs_file_close(%s) failed: %s\n", file->path, error_message(err));
+            return -1;
+        }
+    }
+    
+    file->pos+=len;
+    return 0;
+}
+
+int extdirect_fskip(cextfile *file, u64 len)
+{
+    file->pos+=len;
+    return 0;
+}
+
+int extdirect_fclose(cextfile *file)
+{
+    struct ext2_inode inode;
+    cextdirect *ed=file->ed;
+    errcode_t err;
+    int ret=0;
+    
+    if ((err=ext2fs_read_inode(ed->fs, file->ino, &inode))!=0)
+    {   errprintf("ext2fs_read_inode(%s) failed: %s\n", file->path, error_message(err));
+        ret=-1;
+    }
+    else
+    {   ext2fs_inode_size_set(ed->fs, &inode, file->pos);
+        if ((err=ext2fs_write_inode(ed->fs, file->ino, &inode))!=0)
+        {   errprintf("ext2fs_write_inode(%s) failed: %s\n", file->path, error_message(err));
+            ret=-1;
+        }
+    }
+    
+    free(file->tail);
+    free(file);
+    return ret;
+}
+
+#endif // OPTION_EXTDIRECT_SUPPORT
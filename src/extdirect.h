@@ -0,0 +1,47 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifndef __EXTDIRECT_H__
+#define __EXTDIRECT_H__
+
+#include "types.h"
+
+struct s_extdirect;
+typedef struct s_extdirect cextdirect;
+
+struct s_extfile;
+typedef struct s_extfile cextfile;
+
+// the paths passed to these functions are the full paths under the mount point
+// given to extdirect_open() so that they can replace the syscalls in the restore
+int  extdirect_open(cextdirect **ed, char *devpath, char *mntpath); // open an unmounted filesystem read-write
+int  extdirect_close(cextdirect *ed);
+int  extdirect_mkdir(cextdirect *ed, char *path); // creates the parents too, like mkdir_recursive()
+int  extdirect_symlink(cextdirect *ed, char *target, char *path);
+int  extdirect_link(cextdirect *ed, char *oldpath, char *newpath);
+int  extdirect_mknod(cextdirect *ed, char *path, u32 mode, u64 rdev);
+int  extdirect_unlink(cextdirect *ed, char *path);
+int  extdirect_truncate(cextdirect *ed, char *path);
+int  extdirect_setattr(cextdirect *ed, char *path, u32 mode, u32 uid, u32 gid, u64 atime, u64 mtime);
+int  extdirect_setxattr(cextdirect *ed, char *path, char *name, void *value, u64 size);
+s64  extdirect_readfile(cextdirect *ed, char *path, char *buf, u64 size);
+int  extdirect_fopen(cextdirect *ed, char *path, u64 size, bool sparse, cextfile **file);
+int  extdirect_fwrite(cextfile *file, char *data, u64 len);
+int  extdirect_fskip(cextfile *file, u64 len); // leave a hole
+int  extdirect_fclose(cextfile *file);
+
+#endif // __EXTDIRECT_H__
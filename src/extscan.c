@@ -0,0 +1,477 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#ifdef OPTION_EXTDIRECT_SUPPORT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <ext2fs.h>
+
+#include "fsarchiver.h"
+#include "extscan.h"
+#include "common.h"
+#include "syncthread.h"
+#include "error.h"
+
+// attributes of an inode in use (what lstat64 returns)
+typedef struct s_extscaninode
+{   u32         ino;
+    u32         mode;
+    u32         nlink;
+    u32         uid;
+    u32         gid;
+    u64         size; // device number for block and char devices
+    u64         blocks; // in units of 512 bytes
+    s64         atime;
+    s64         mtime;
+    s64         ctime;
+    u32         mtimensec;
+    u32         ctimensec;
+} cextscaninode;
+
+typedef struct s_extscanentry
+{   u32         ino;
+    u64         name; // offset of the name in the names buffer
+} cextscanentry;
+
+// entries of a directory in the entries array
+typedef struct s_extscandirent
+{   u32         ino;
+    u64         first;
+    u32         count;
+} cextscandirent;
+
+struct s_extscan
+{   char            mntpath[PATH_MAX]; // prefix of the paths passed by the walker
+    dev_t           dev;
+    u32             blocksize;
+    cextscaninode   *inodes; // sorted by inode number
+    u64             inodecnt;
+    u64             inodemax;
+    cextscandirent  *dirs; // sorted by inode number
+    u64             dircnt;
+    u64             dirmax;
+    cextscanentry   *entries;
+    u64             entrycnt;
+    u64             entrymax;
+    char            *names;
+    u64             namelen;
+    u64             namemax;
+    cextscandir     *top; // directories opened by the walker (one per level)
+    int             err;
+};
+
+struct s_extscandir
+{   cextscan        *es;
+    char            relpath[PATH_MAX];
+    u32             ino;
+    cextscandirent  *dirent;
+    u32             pos;
+    cextscandir     *prev;
+};
+
+// the extra field of large inodes holds two more bits of seconds (dates after 2038)
+static s64 extscan_time(u32 sec, u32 extra, bool hasextra)
+{
+    s64 res=(s32)sec;
+    
+    if (hasextra)
+        res+=((s64)(extra & 3)) << 32;
+    return res;
+}
+
+static int extscan_cmpinode(const void *key, const void *item)
+{
+    u32 ino=*(const u32 *)key;
+    u32 other=*(const u32 *)item; // ino is the first field of both structures
+    
+    return (ino < other) ? -1 : ((ino > other) ? 1 : 0);
+}
+
+static cextscaninode *extscan_getinode(cextscan *es, u32 ino)
+{
+    return bsearch(&ino, es->inodes, es->inodecnt, sizeof(cextscaninode), extscan_cmpinode);
+}
+
+static cextscandirent *extscan_getdir(cextscan *es, u32 ino)
+{
+    return bsearch(&ino, es->dirs, es->dircnt, sizeof(cextscandirent), extscan_cmpinode);
+}
+
+// first pass: read the inode tables from the beginning to the end of the device
+static int extscan_read_inodes(cextscan *es, ext2_filsys fs)
+{
+    struct ext2_inode_large *inode;
+    ext2_inode_scan scan;
+    cextscaninode *item;
+    int inodesize;
+    bool hasextra;
+    ext2_ino_t ino;
+    errcode_t err;
+    int ret=0;
+    
+    inodesize=EXT2_INODE_SIZE(fs->super);
+    if ((inode=malloc(inodesize))==NULL)
+    {   errprintf("malloc(%d) failed: out of memory\n", inodesize);
+        return -1;
+    }
+    
+    // read the inode table of a whole group at a time
+    if ((err=ext2fs_open_inode_scan(fs, fs->inode_blocks_per_group, &scan))!=0)
+    {   errprintf("ext2fs_open_inode_scan() failed: %s\n", error_message(err));
+        free(inode);
+        return -1;
+    }
+    ext2fs_inode_scan_flags(scan, EXT2_SF_SKIP_MISSING_ITABLE, 0);
+    
+    while (1)
+    {
+        if ((err=ext2fs_get_next_inode_full(scan, &ino, (struct ext2_inode *)inode, inodesize))==EXT2_ET_BAD_BLOCK_IN_INODE_TABLE)
+            continue;
+        if (err!=0)
+        {   errprintf("ext2fs_get_next_inode_full() failed: %s\n", error_message(err));
+            ret=-1;
+            break;
+        }
+        if (ino==0) // end of the scan
+            break;
+        
+        // the inode tables of the groups which are not initialized may contain garbage
+        if ((inode->i_links_count==0) || (ext2fs_test_inode_bitmap2(fs->inode_map, ino)==0))
+            continue;
+        if ((ino < EXT2_FIRST_INODE(fs->super)) && (ino!=EXT2_ROOT_INO))
+            continue;
+        
+        if (array_grow((void**)&es->inodes, &es->inodemax, es->inodecnt, 1024, sizeof(cextscaninode))!=0)
+        {   ret=-1;
+            break;
+        }
+        item=&es->inodes[es->inodecnt++];
+        item->ino=ino;
+        item->mode=inode->i_mode;
+        item->nlink=inode->i_links_count;
+        item->uid=inode_uid(*inode);
+        item->gid=inode_gid(*inode);
+        item->size=EXT2_I_SIZE(inode);
+        item->blocks=ext2fs_get_stat_i_blocks(fs, (struct ext2_inode *)inode);
+        hasextra=(inodesize > EXT2_GOOD_OLD_INODE_SIZE) &&
+            (EXT2_GOOD_OLD_INODE_SIZE + inode->i_extra_isize >= offsetof(struct ext2_inode_large, i_crtime));
+        item->atime=extscan_time(inode->i_atime, inode->i_atime_extra, hasextra);
+        item->mtime=extscan_time(inode->i_mtime, inode->i_mtime_extra, hasextra);
+        item->ctime=extscan_time(inode->i_ctime, inode->i_ctime_extra, hasextra);
+        item->mtimensec=(hasextra) ? (inode->i_mtime_extra >> 2) : 0;
+        item->ctimensec=(hasextra) ? (inode->i_ctime_extra >> 2) : 0;
+        
+        // same encoding of the device numbers as the kernel (old format when i_block[0] is set)
+        if (LINUX_S_ISCHR(inode->i_mode) || LINUX_S_ISBLK(inode->i_mode))
+        {   if (inode->i_block[0]!=0)
+                item->size=makedev((inode->i_block[0] >> 8) & 0xff, inode->i_block[0] & 0xff);
+            else
+                item->size=makedev((inode->i_block[1] & 0xfff00) >> 8, (inode->i_block[1] & 0xff) | ((inode->i_block[1] >> 12) & 0xfff00));
+        }
+    }
+    
+    ext2fs_close_inode_scan(scan);
+    free(inode);
+    return ret;
+}
+
+static int extscan_dir_callback(ext2_ino_t dir, int entry, struct ext2_dir_entry *dirent, int offset, int blocksize, char *buf, void *priv)
+{
+    cextscan *es=(cextscan *)priv;
+    cextscanentry *item;
+    int len;
+    
+    if ((entry==DIRENT_DOT_FILE) || (entry==DIRENT_DOT_DOT_FILE))
+        return 0;
+    
+    len=ext2fs_dirent_name_len(dirent);
+    if ((array_grow((void**)&es->entries, &es->entrymax, es->entrycnt, 1024, sizeof(cextscanentry))!=0) ||
+        (array_grow((void**)&es->names, &es->namemax, es->namelen+len+1, 1024, 1)!=0))
+    {   es->err=-1;
+        return DIRENT_ABORT;
+    }
+    
+    item=&es->entries[es->entrycnt++];
+    item->ino=dirent->inode;
+    item->name=es->namelen;
+    memcpy(es->names+es->namelen, dirent->name, len);
+    es->names[es->namelen+len]=0;
+    es->namelen+=len+1;
+    return 0;
+}
+
+// second pass: read the blocks of the directories in the order of their inodes
+static int extscan_read_dirs(cextscan *es, ext2_filsys fs)
+{
+    cextscandirent *dir;
+    errcode_t err;
+    u64 i;
+    
+    for (i=0; (i < es->inodecnt) && (get_interrupted()==false); i++)
+    {
+        if (!LINUX_S_ISDIR(es->inodes[i].mode))
+            continue;
+        
+        if (array_grow((void**)&es->dirs, &es->dirmax, es->dircnt, 1024, sizeof(cextscandirent))!=0)
+            return -1;
+        dir=&es->dirs[es->dircnt++];
+        dir->ino=es->inodes[i].ino;
+        dir->first=es->entrycnt;
+        
+        es->err=0;
+        if ((err=ext2fs_dir_iterate2(fs, dir->ino, 0, NULL, extscan_dir_callback, es))!=0)
+        {   errprintf("ext2fs_dir_iterate2(%ld) failed: %s\n", (long)dir->ino, error_message(err));
+            return -1;
+        }
+        if (es->err!=0)
+            return -1;
+        dir->count=es->entrycnt - dir->first;
+    }
+    
+    return 0;
+}
+
+int extscan_open(cextscan **es, char *devpath, char *mntpath)
+{
+    struct stat64 st;
+    ext2_filsys fs;
+    errcode_t err;
+    cextscan *e;
+    size_t len;
+    
+    if ((e=calloc(1, sizeof(cextscan)))==NULL)
+    {   errprintf("calloc(%ld) failed: out of memory\n", (long)sizeof(cextscan));
+        return -1;
+    }
+    
+    if ((err=ext2fs_open(devpath, EXT2_FLAG_64BITS, 0, 0, unix_io_manager, &fs))!=0)
+    {   errprintf("ext2fs_open(%s) failed: %s\n", devpath, error_message(err));
+        free(e);
+        return -1;
+    }
+    
+    // the inode tables on the device are not up to date until the journal is replayed
+    if (ext2fs_has_feature_journal_needs_recovery(fs->super))
+    {   errprintf("the journal of the filesystem on %s has to be recovered first\n", devpath);
+        ext2fs_close_free(&fs);
+        free(e);
+        return -1;
+    }
+    
+    if ((err=ext2fs_read_inode_bitmap(fs))!=0)
+    {   errprintf("ext2fs_read_inode_bitmap(%s) failed: %s\n", devpath, error_message(err));
+        ext2fs_close_free(&fs);
+        free(e);
+        return -1;
+    }
+    
+    snprintf(e->mntpath, sizeof(e->mntpath), "%s", mntpath);
+    for (len=strlen(e->mntpath); (len>0) && (e->mntpath[len-1]=='/'); len--)
+        e->mntpath[len-1]=0;
+    e->dev=(stat64(mntpath, &st)==0) ? st.st_dev : 0;
+    e->blocksize=fs->blocksize;
+    
+    if ((extscan_read_inodes(e, fs)!=0) || (extscan_read_dirs(e, fs)!=0))
+    {   ext2fs_close_free(&fs);
+        extscan_close(e);
+        return -1;
+    }
+    ext2fs_close_free(&fs);
+    
+    msgprintf(MSG_VERB1, "%lld inodes and %lld directory entries read from the inode tables of %s\n",
+        (long long)e->inodecnt, (long long)e->entrycnt, devpath);
+    *es=e;
+    return 0;
+}
+
+int extscan_close(cextscan *es)
+{
+    if (es==NULL)
+        return -1;
+    
+    free(es->inodes);
+    free(es->dirs);
+    free(es->entries);
+    free(es->names);
+    free(es);
+    return 0;
+}
+
+// find an entry of a directory, starting with the one which has just been returned by readdir
+static int extscan_child(cextscan *es, cextscandirent *dir, char *name, u32 hint, u32 *ino)
+{
+    u32 i;
+    
+    if ((hint < dir->count) && (strcmp(es->names+es->entries[dir->first+hint].name, name)==0))
+    {   *ino=es->entries[dir->first+hint].ino;
+        return 0;
+    }
+    for (i=0; i < dir->count; i++)
+    {   if (strcmp(es->names+es->entries[dir->first+i].name, name)==0)
+        {   *ino=es->entries[dir->first+i].ino;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// find the inode of a path relative to the root of the filesystem
+static int extscan_resolve(cextscan *es, char *relpath, u32 *ino)
+{
+    char buffer[PATH_MAX];
+    char dirpath[PATH_MAX];
+    cextscandirent *dirent;
+    cextscandir *dir;
+    char *name;
+    char *next;
+    
+    if (strcmp(relpath, "/")==0)
+    {   *ino=EXT2_ROOT_INO;
+        return 0;
+    }
+    
+    // the walker works on the entries of the directories it has opened
+    extract_dirpath(relpath, dirpath, sizeof(dirpath));
+    for (dir=es->top; dir!=NULL; dir=dir->prev)
+    {
+        if (strcmp(dir->relpath, relpath)==0)
+        {   *ino=dir->ino;
+            return 0;
+        }
+        if (strcmp(dir->relpath, dirpath)==0)
+            return extscan_child(es, dir->dirent, strrchr(relpath, '/')+1, dir->pos-1, ino);
+    }
+    
+    // any other path is resolved from the root
+    snprintf(buffer, sizeof(buffer), "%s", relpath);
+    *ino=EXT2_ROOT_INO;
+    for (name=strtok_r(buffer, "/", &next); name!=NULL; name=strtok_r(NULL, "/", &next))
+    {   if (((dirent=extscan_getdir(es, *ino))==NULL) || (extscan_child(es, dirent, name, 0, ino)!=0))
+            return -1;
+    }
+    return 0;
+}
+
+// convert a path under the mount point into a path relative to the root of the filesystem
+static char *extscan_relpath(cextscan *es, char *path)
+{
+    size_t len=strlen(es->mntpath);
+    
+    if ((strncmp(path, es->mntpath, len)!=0) || ((path[len]!=0) && (path[len]!='/')))
+        return NULL;
+    return (path[len]==0) ? "/" : path+len;
+}
+
+int extscan_lstat(cextscan *es, char *path, struct stat64 *st)
+{
+    cextscaninode *inode;
+    char *relpath;
+    u32 ino;
+    
+    if (((relpath=extscan_relpath(es, path))==NULL) || (extscan_resolve(es, relpath, &ino)!=0) ||
+        ((inode=extscan_getinode(es, ino))==NULL))
+    {   errno=ENOENT;
+        return -1;
+    }
+    
+    memset(st, 0, sizeof(struct stat64));
+    st->st_dev=es->dev;
+    st->st_ino=inode->ino;
+    st->st_mode=inode->mode;
+    st->st_nlink=inode->nlink;
+    st->st_uid=inode->uid;
+    st->st_gid=inode->gid;
+    if (S_ISCHR(inode->mode) || S_ISBLK(inode->mode))
+        st->st_rdev=inode->size;
+    else
+        st->st_size=inode->size;
+    st->st_blksize=es->blocksize;
+    st->st_blocks=inode->blocks;
+    st->st_atime=inode->atime;
+    st->st_mtime=inode->mtime;
+    st->st_ctime=inode->ctime;
+    st->st_mtim.tv_nsec=inode->mtimensec;
+    st->st_ctim.tv_nsec=inode->ctimensec;
+    return 0;
+}
+
+int extscan_opendir(cextscan *es, char *path, cextscandir **dir)
+{
+    cextscandirent *dirent;
+    cextscandir *d;
+    char *relpath;
+    u32 ino;
+    
+    if (((relpath=extscan_relpath(es, path))==NULL) || (extscan_resolve(es, relpath, &ino)!=0))
+    {   errno=ENOENT;
+        return -1;
+    }
+    if ((dirent=extscan_getdir(es, ino))==NULL)
+    {   errno=ENOTDIR;
+        return -1;
+    }
+    if ((d=calloc(1, sizeof(cextscandir)))==NULL)
+    {   errno=ENOMEM;
+        return -1;
+    }
+    
+    snprintf(d->relpath, sizeof(d->relpath), "%s", relpath);
+    d->es=es;
+    d->ino=ino;
+    d->dirent=dirent;
+    d->pos=0;
+    d->prev=es->top;
+    es->top=d;
+    *dir=d;
+    return 0;
+}
+
+char *extscan_readdir(cextscandir *dir)
+{
+    cextscan *es=dir->es;
+    
+    if (dir->pos >= dir->dirent->count)
+        return NULL;
+    return es->names+es->entries[dir->dirent->first + dir->pos++].name;
+}
+
+int extscan_closedir(cextscandir *dir)
+{
+    cextscandir **cur;
+    
+    for (cur=&dir->es->top; *cur!=NULL; cur=&(*cur)->prev)
+    {   if (*cur==dir)
+        {   *cur=dir->prev;
+            break;
+        }
+    }
+    free(dir);
+    return 0;
+}
+
+#endif // OPTION_EXTDIRECT_SUPPORT
@@ -0,0 +1,41 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifndef __EXTSCAN_H__
+#define __EXTSCAN_H__
+
+#include "types.h"
+
+struct stat64;
+
+struct s_extscan;
+typedef struct s_extscan cextscan;
+
+struct s_extscandir;
+typedef struct s_extscandir cextscandir;
+
+// the metadata of the whole filesystem are read at once in the order of the
+// inode tables, the paths are the full paths under the mount point given to
+// extscan_open() so that these functions can replace lstat/readdir in the walker
+int  extscan_open(cextscan **es, char *devpath, char *mntpath);
+int  extscan_close(cextscan *es);
+int  extscan_lstat(cextscan *es, char *path, struct stat64 *st);
+int  extscan_opendir(cextscan *es, char *path, cextscandir **dir);
+char *extscan_readdir(cextscandir *dir);
+int  extscan_closedir(cextscandir *dir);
+
+#endif // __EXTSCAN_H__
@@ -20,6 +20,10 @@
 
 #define PROGVER(x, y, z)    (((u64)x)<<16)+(((u64)y)<<8)+(((u64)z)<<0)
 
+// how mkfs and mount prepare a filesystem: the fast restore profile defers the journal and
+// relaxes the mount options until the data have been written (option --fast-restore)
+enum {FSPROFILE_DEFAULT=0, FSPROFILE_FASTRESTORE};
+
 struct s_strlist;
 struct s_dico;
 
@@ -29,12 +33,13 @@ typedef struct s_filesys cfilesys;
 struct s_filesys
 {
     char *name;
-    int (*mount)(char *partition, char *mntbuf, char *fsname, int flags, char *mntinfo);
+    int (*mount)(char *partition, char *mntbuf, char *fsname, int flags, char *mntinfo, int profile);
     int (*umount)(char *partition, char *mntbuf);
     int (*getinfo)(struct s_dico *d, char *devname);
-    int (*mkfs)(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid);
+    int (*mkfs)(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile);
     int (*test)(char *partition);
     int (*reqmntopt)(char *partition, struct s_strlist *reqopt, struct s_strlist *badopt);
+    int (*finalize)(struct s_dico *d, char *partition); // apply what the fast restore profile has deferred (can be NULL)
     bool support_for_xattr;
     bool support_for_acls;
     bool winattr;
@@ -51,7 +51,7 @@ int btrfs_check_compatibility(u64 compat, u64 incompat, u64 ro_compat)
     return 0;
 }
 
-int btrfs_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid)
+int btrfs_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile)
 {
     char command[2048];
     char buffer[2048];
@@ -177,7 +177,7 @@ btrfs_read_sb_return:
     return ret;
 }
 
-int btrfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo)
+int btrfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile)
 {
     return generic_mount(partition, mntbuf, fsbuf, NULL, flags);
 }
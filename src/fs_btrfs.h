@@ -21,9 +21,9 @@
 struct s_dico;
 struct s_strlist;
 
-int btrfs_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid);
+int btrfs_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile);
 int btrfs_getinfo(struct s_dico *d, char *devname);
-int btrfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo);
+int btrfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile);
 int btrfs_umount(char *partition, char *mntbuf);
 int btrfs_check_support_for_features(u64 compat, u64 incompat, u64 ro_compat);
 int btrfs_get_reqmntopt(char *partition, struct s_strlist *reqopt, struct s_strlist *badopt);
@@ -91,19 +91,34 @@ char *format_fstype(int fstype)
     }
 }
 
-int ext2_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid)
+int ext2_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile)
 {
-    return extfs_mkfs(d, partition, EXTFSTYPE_EXT2, fsoptions, mkfslabel, mkfsuuid);
+    return extfs_mkfs(d, partition, EXTFSTYPE_EXT2, fsoptions, mkfslabel, mkfsuuid, profile);
 }
 
-int ext3_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid)
+int ext3_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile)
 {
-    return extfs_mkfs(d, partition, EXTFSTYPE_EXT3, fsoptions, mkfslabel, mkfsuuid);
+    return extfs_mkfs(d, partition, EXTFSTYPE_EXT3, fsoptions, mkfslabel, mkfsuuid, profile);
 }
 
-int ext4_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid)
+int ext4_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile)
 {
-    return extfs_mkfs(d, partition, EXTFSTYPE_EXT4, fsoptions, mkfslabel, mkfsuuid);
+    return extfs_mkfs(d, partition, EXTFSTYPE_EXT4, fsoptions, mkfslabel, mkfsuuid, profile);
+}
+
+int ext2_finalize(cdico *d, char *partition)
+{
+    return extfs_finalize(d, partition, EXTFSTYPE_EXT2);
+}
+
+int ext3_finalize(cdico *d, char *partition)
+{
+    return extfs_finalize(d, partition, EXTFSTYPE_EXT3);
+}
+
+int ext4_finalize(cdico *d, char *partition)
+{
+    return extfs_finalize(d, partition, EXTFSTYPE_EXT4);
 }
 
 int extfs_get_fstype_from_compat_flags(u32 compat, u32 incompat, u32 ro_compat)
@@ -144,7 +159,7 @@ int extfs_check_compatibility(u64 compat, u64 incompat, u64 ro_compat)
     return 0;
 }
 
-int extfs_mkfs(cdico *d, char *partition, int extfstype, char *fsoptions, char *mkfslabel, char *mkfsuuid)
+int extfs_mkfs(cdico *d, char *partition, int extfstype, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile)
 {
     cstrlist strfeatures;
     u64 features_tab[3];
@@ -153,6 +168,7 @@ int extfs_mkfs(cdico *d, char *partition, int extfstype, char *fsoptions, char *
     char buffer[2048];
     char command[2048];
     char options[2048];
+    char extopts[256];
     char uuid[64];
     bool mke2fsuuid=false;
     char temp[1024];
@@ -320,6 +336,12 @@ int extfs_mkfs(cdico *d, char *partition, int extfstype, char *fsoptions, char *
         msgprintf(MSG_VERB2, "device [%s] will have the [uninit_bg] feature enabled\n", partition);
     }
 
+    // fast restore: the journal is only created by extfs_finalize() once all the data have been written
+    if ((profile==FSPROFILE_FASTRESTORE) && (features_tab[E2P_FEATURE_COMPAT] & EXT3_FEATURE_COMPAT_HAS_JOURNAL))
+    {   features_tab[E2P_FEATURE_COMPAT] &= ~EXT3_FEATURE_COMPAT_HAS_JOURNAL;
+        msgprintf(MSG_VERB1, "the journal of [%s] will be created after the data have been restored\n", partition);
+    }
+
     // convert int features to string to be passed to mkfs
     for (i=0; mkfeatures[i].name; i++)
     {
@@ -361,11 +383,16 @@ int extfs_mkfs(cdico *d, char *partition, int extfstype, char *fsoptions, char *
         goto extfs_mkfs_cleanup;
     }
 
-    // ---- extended options
+    // ---- extended options (mke2fs only keeps the last "-E" so they are all passed at once)
+    memset(extopts, 0, sizeof(extopts));
     if (dico_get_u64(d, 0, FSYSHEADKEY_FSEXTEOPTRAIDSTRIDE, &temp64)==0)
-        strlcatf(options, sizeof(options), " -E stride=%ld ", (long)temp64);
+        strlcatf(extopts, sizeof(extopts), ",stride=%ld", (long)temp64);
     if ((dico_get_u64(d, 0, FSYSHEADKEY_FSEXTEOPTRAIDSTRIPEWIDTH, &temp64)==0) && e2fstoolsver>=PROGVER(1,40,7))
-        strlcatf(options, sizeof(options), " -E stripe-width=%ld ", (long)temp64);
+        strlcatf(extopts, sizeof(extopts), ",stripe-width=%ld", (long)temp64);
+    if ((profile==FSPROFILE_FASTRESTORE) && e2fstoolsver>=PROGVER(1,42,0)) // the kernel zeroes the inode tables later
+        strlcatf(extopts, sizeof(extopts), ",lazy_itable_init=1,nodiscard");
+    if (extopts[0])
+        strlcatf(options, sizeof(options), " -E %s ", extopts+1);
 
     // ---- execute mke2fs
     msgprintf(MSG_VERB2, "exec: %s\n", command);
@@ -524,7 +551,7 @@ int extfs_getinfo(cdico *d, char *devname)
     return 0;
 }
 
-int extfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo)
+int extfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile)
 {
     blk_t use_superblock=0;
     int use_blocksize=0;
@@ -546,6 +573,11 @@ int extfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mnt
 
     ext2fs_close(fs);
 
+    // fast restore: ext3 has no journal until extfs_finalize() and is detected as ext2
+    // so it is mounted with the ext4 driver which does not wait for the inode tables
+    if (profile==FSPROFILE_FASTRESTORE)
+        return generic_mount(partition, mntbuf, "ext4", "user_xattr,acl,nobarrier,noinit_itable", flags);
+
     if (strcmp(fsname, fsbuf)!=0)
     {   msgprintf(MSG_DEBUG1, "extfs_mount: the filesystem requested [%s] does not match the filesystem detected [%s]\n", fsbuf, fsname);
         return -1;
@@ -559,6 +591,44 @@ int extfs_umount(char *partition, char *mntbuf)
     return generic_umount(mntbuf);
 }
 
+// same decision as extfs_mkfs(): ext3 and ext4 have a journal unless the original filesystem had none
+bool extfs_journal_required(cdico *d, int extfstype)
+{
+    u64 compat, incompat, rocompat;
+    u64 fsextrevision;
+
+    if (extfstype<EXTFSTYPE_EXT3)
+        return false;
+    if (dico_get_u64(d, 0, FSYSHEADKEY_FSEXTREVISION, &fsextrevision)!=0)
+        fsextrevision=EXT2_DYNAMIC_REV;
+    if (dico_get_u64(d, 0, FSYSHEADKEY_FSEXTFEATURECOMPAT, &compat)!=0 ||
+        dico_get_u64(d, 0, FSYSHEADKEY_FSEXTFEATUREINCOMPAT, &incompat)!=0 ||
+        dico_get_u64(d, 0, FSYSHEADKEY_FSEXTFEATUREROCOMPAT, &rocompat)!=0 ||
+        fsextrevision==EXT2_GOOD_OLD_REV)
+        return true; // default features are those of an ext2 which gets upgraded
+    if (compat & EXT3_FEATURE_COMPAT_HAS_JOURNAL)
+        return true;
+    return (extfs_get_fstype_from_compat_flags(compat, incompat, rocompat)==EXTFSTYPE_EXT2);
+}
+
+// create the journal which extfs_mkfs() has left out with the fast restore profile
+int extfs_finalize(cdico *d, char *partition, int extfstype)
+{
+    char command[2048];
+    int exitst;
+
+    if (extfs_journal_required(d, extfstype)==false)
+        return 0;
+
+    msgprintf(MSG_VERB1, "creating the journal of [%s]\n", partition);
+    if (exec_command(command, sizeof(command), &exitst, NULL, 0, NULL, 0, "tune2fs -O has_journal %s", partition)!=0 || exitst!=0)
+    {   errprintf("command [%s] failed with return status=%d\n", command, exitst);
+        return -1;
+    }
+
+    return 0;
+}
+
 int extfs_test(char *partition, int extfstype) // returns true if it's that sort of filesystem
 {
     blk_t use_superblock=0;
@@ -23,15 +23,20 @@ struct s_strlist;
 
 enum {EXTFSTYPE_EXT2, EXTFSTYPE_EXT3, EXTFSTYPE_EXT4};
 
-int ext2_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid);
-int ext3_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid);
-int ext4_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid);
+int ext2_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile);
+int ext3_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile);
+int ext4_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile);
+int ext2_finalize(struct s_dico *d, char *partition);
+int ext3_finalize(struct s_dico *d, char *partition);
+int ext4_finalize(struct s_dico *d, char *partition);
 int extfs_getinfo(struct s_dico *d, char *devname);
 int extfs_get_fstype_from_compat_flags(u32 compat, u32 incompat, u32 ro_compat);
 int extfs_get_reqmntopt(char *partition, struct s_strlist *reqopt, struct s_strlist *badopt);
-int extfs_mkfs(struct s_dico *d, char *partition, int extfstype, char *fsoptions, char *mkfslabel, char *mkfsuuid);
-int extfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo);
+int extfs_mkfs(struct s_dico *d, char *partition, int extfstype, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile);
+int extfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile);
 int extfs_umount(char *partition, char *mntbuf);
+bool extfs_journal_required(struct s_dico *d, int extfstype);
+int extfs_finalize(struct s_dico *d, char *partition, int extfstype);
 int extfs_test(char *partition, int extfstype);
 int ext2_test(char *partition);
 int ext3_test(char *partition);
@@ -36,7 +36,7 @@
 #include "strlist.h"
 #include "error.h"
 
-int jfs_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid)
+int jfs_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile)
 {
     char command[2048];
     char buffer[2048];
@@ -135,7 +135,7 @@ jfs_getinfo_return:
     return ret;
 }
 
-int jfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo)
+int jfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile)
 {
     return generic_mount(partition, mntbuf, fsbuf, NULL, flags);
 }
@@ -21,9 +21,9 @@
 struct s_dico;
 struct s_strlist;
 
-int jfs_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid);
+int jfs_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile);
 int jfs_getinfo(struct s_dico *d, char *devname);
-int jfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo);
+int jfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile);
 int jfs_get_reqmntopt(char *partition, struct s_strlist *reqopt, struct s_strlist *badopt);
 int jfs_umount(char *partition, char *mntbuf);
 int jfs_test(char *devname);
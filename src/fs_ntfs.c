@@ -34,7 +34,7 @@
 #include "strlist.h"
 #include "error.h"
 
-int ntfs_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid)
+int ntfs_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile)
 {
     char command[2048];
     char buffer[2048];
@@ -131,7 +131,7 @@ int ntfs_getinfo(cdico *d, char *devname)
     return 0;
 }
 
-int ntfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo)
+int ntfs_fuse_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile)
 {
     char minversion[1024];
     char streamif[1024];
@@ -203,7 +203,7 @@ int ntfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mnti
     return 0;
 }
 
-int ntfs_umount(char *partition, char *mntbuf)
+int ntfs_fuse_umount(char *partition, char *mntbuf)
 {
     char command[2048];
     int existst;
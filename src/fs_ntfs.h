@@ -33,12 +33,12 @@ struct s_ntfsinfo
     u64 uuid;
 };
 
-int ntfs_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid);
+int ntfs_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile);
 int ntfs_getinfo(struct s_dico *d, char *devname);
-int ntfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo);
+int ntfs_fuse_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile);
 int ntfs_get_reqmntopt(char *partition, struct s_strlist *reqopt, struct s_strlist *badopt);
 int ntfs_replace_uuid(char *devname, u64 uuid);
-int ntfs_umount(char *partition, char *mntbuf);
+int ntfs_fuse_umount(char *partition, char *mntbuf);
 int ntfs_test(char *devname);
 
 #endif // __FS_NTFS_H__
@@ -36,7 +36,7 @@
 #include "strlist.h"
 #include "error.h"
 
-int reiser4_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid)
+int reiser4_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile)
 {
     char command[2048];
     char buffer[2048];
@@ -148,7 +148,7 @@ reiser4_get_specific_return:
     return ret;
 }
 
-int reiser4_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo)
+int reiser4_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile)
 {
     return generic_mount(partition, mntbuf, fsbuf, NULL, flags);
 }
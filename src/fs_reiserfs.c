@@ -35,7 +35,7 @@
 #include "strlist.h"
 #include "error.h"
 
-int reiserfs_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid)
+int reiserfs_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile)
 {
     char command[2048];
     char buffer[2048];
@@ -141,7 +141,7 @@ reiserfs_read_sb_return:
     return ret;
 }
 
-int reiserfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo)
+int reiserfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile)
 {
     return generic_mount(partition, mntbuf, fsbuf, "user_xattr,acl", flags);
 }
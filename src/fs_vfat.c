@@ -34,7 +34,7 @@
 #include "fs_vfat.h"
 #include "error.h"
 
-int vfat_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid)
+int vfat_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile)
 {
     char stdoutbuf[2048];
     char command[2048];
@@ -152,7 +152,7 @@ vfat_read_sb_return:
     return ret;
 }
 
-int vfat_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo)
+int vfat_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile)
 {
     return generic_mount(partition, mntbuf, fsbuf, "", flags);
 }
@@ -21,9 +21,9 @@
 struct s_dico;
 struct s_strlist;
 
-int vfat_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid);
+int vfat_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile);
 int vfat_getinfo(struct s_dico *d, char *devname);
-int vfat_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo);
+int vfat_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile);
 int vfat_get_reqmntopt(char *partition, struct s_strlist *reqopt, struct s_strlist *badopt);
 int vfat_umount(char *partition, char *mntbuf);
 int vfat_test(char *devname);
@@ -21,7 +21,13 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <uuid.h>
@@ -32,6 +38,7 @@
 #include "fs_xfs.h"
 #include "filesys.h"
 #include "strlist.h"
+#include "syncthread.h"
 #include "error.h"
 
 int xfs_check_compatibility(u64 compat, u64 ro_compat, u64 incompat, u64 log_incompat)
@@ -65,7 +72,7 @@ int xfs_check_compatibility(u64 compat, u64 ro_compat, u64 incompat, u64 log_inc
     }
 }
 
-int xfs_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid)
+int xfs_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile)
 {
     char stdoutbuf[2048];
     char command[2048];
@@ -242,6 +249,10 @@ int xfs_mkfs(cdico *d, char *partition, char *fsoptions, char *mkfslabel, char *
         strlcatf(mkfsopts, sizeof(mkfsopts), " -i sparse=%d ", (int)optval);
     }
 
+    // ---- fast restore: an xfs always has a log, but discarding the whole device can be avoided
+    if (profile==FSPROFILE_FASTRESTORE)
+        strlcatf(mkfsopts, sizeof(mkfsopts), " -K ");
+
     // ---- create the new filesystem using mkfs.xfs
     if (exec_command(command, sizeof(command), &exitst, NULL, 0, NULL, 0, "mkfs.xfs -f %s %s", partition, mkfsopts)!=0 || exitst!=0)
     {   errprintf("command [%s] failed\n", command);
@@ -359,8 +370,10 @@ xfs_read_sb_return:
     return ret;
 }
 
-int xfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo)
+int xfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile)
 {
+    if (profile==FSPROFILE_FASTRESTORE) // larger in-memory log buffers for the metadata intensive population
+        return generic_mount(partition, mntbuf, fsbuf, "nouuid,logbufs=8,logbsize=256k", flags);
     return generic_mount(partition, mntbuf, fsbuf, "nouuid", flags);
 }
 
@@ -405,3 +418,269 @@ int xfs_get_reqmntopt(char *partition, cstrlist *reqopt, cstrlist *badopt)
 
     return 0;
 }
+
+// number of inodes returned by each XFS_IOC_BULKSTAT call
+#define XFS_BULKSTAT_BATCH    4096
+
+// attributes of an inode in use (what lstat64 returns)
+typedef struct s_xfsbulkinode
+{   u64         ino;
+    u64         size; // device number for block and char devices
+    u64         blocks; // in units of 512 bytes
+    s64         atime;
+    s64         mtime;
+    s64         ctime;
+    u32         mtimensec;
+    u32         ctimensec;
+    u32         mode;
+    u32         nlink;
+    u32         uid;
+    u32         gid;
+} cxfsbulkinode;
+
+struct s_xfsbulk
+{   char            mntpath[PATH_MAX]; // prefix of the paths passed by the walker
+    dev_t           dev;
+    u64             rootino;
+    cxfsbulkinode   *inodes; // sorted by inode number
+    u64             inodecnt;
+    u64             inodemax;
+    cxfsbulkdir     *top; // directories opened by the walker (one per level)
+};
+
+struct s_xfsbulkdir
+{   cxfsbulk        *xb;
+    char            path[PATH_MAX];
+    u64             ino;
+    DIR             *dir;
+    char            lastname[NAME_MAX+1]; // entry returned by the last call to readdir
+    u64             lastino;
+    cxfsbulkdir     *prev;
+};
+
+static int xfs_bulkstat_cmpinode(const void *key, const void *item)
+{
+    u64 ino=*(const u64 *)key;
+    u64 other=((const cxfsbulkinode *)item)->ino;
+    
+    return (ino < other) ? -1 : ((ino > other) ? 1 : 0);
+}
+
+static cxfsbulkinode *xfs_bulkstat_getinode(cxfsbulk *xb, u64 ino)
+{
+    return bsearch(&ino, xb->inodes, xb->inodecnt, sizeof(cxfsbulkinode), xfs_bulkstat_cmpinode);
+}
+
+// the kernel returns the inodes in use in the order of their numbers so the array is sorted
+static int xfs_bulkstat_read_inodes(cxfsbulk *xb, int fd)
+{
+    struct xfs_bulkstat_req *req;
+    struct xfs_bulkstat *bs;
+    cxfsbulkinode *inode;
+    u32 i;
+    
+    if ((req=calloc(1, sizeof(struct xfs_bulkstat_req)+XFS_BULKSTAT_BATCH*sizeof(struct xfs_bulkstat)))==NULL)
+    {   errprintf("calloc() failed: out of memory\n");
+        return -1;
+    }
+    
+    req->hdr.ino=0;
+    while (get_interrupted()==false)
+    {
+        req->hdr.icount=XFS_BULKSTAT_BATCH;
+        req->hdr.ocount=0;
+        if (ioctl(fd, XFS_IOC_BULKSTAT, req)!=0)
+        {   sysprintf("ioctl(%s, XFS_IOC_BULKSTAT) failed\n", xb->mntpath);
+            free(req);
+            return -1;
+        }
+        if (req->hdr.ocount==0)
+            break;
+        
+        for (i=0; i < req->hdr.ocount; i++)
+        {   if (array_grow((void**)&xb->inodes, &xb->inodemax, xb->inodecnt, 65536, sizeof(cxfsbulkinode))!=0)
+            {   free(req);
+                return -1;
+            }
+            bs=&req->bulkstat[i];
+            inode=&xb->inodes[xb->inodecnt++];
+            inode->ino=bs->bs_ino;
+            inode->mode=bs->bs_mode;
+            inode->nlink=bs->bs_nlink;
+            inode->uid=bs->bs_uid;
+            inode->gid=bs->bs_gid;
+            if (S_ISCHR(bs->bs_mode) || S_ISBLK(bs->bs_mode))
+                inode->size=makedev(bs->bs_rdev >> 18, bs->bs_rdev & 0x3ffff);
+            else
+                inode->size=bs->bs_size;
+            inode->blocks=bs->bs_blocks * (bs->bs_blksize / 512); // bs_blocks is in filesystem blocks
+            inode->atime=bs->bs_atime;
+            inode->mtime=bs->bs_mtime;
+            inode->ctime=bs->bs_ctime;
+            inode->mtimensec=bs->bs_mtime_nsec;
+            inode->ctimensec=bs->bs_ctime_nsec;
+        }
+    }
+    
+    free(req);
+    return (get_interrupted()==true) ? -1 : 0;
+}
+
+int xfs_bulkstat_open(cxfsbulk **xb, char *mntpath)
+{
+    struct stat64 st;
+    cxfsbulk *x;
+    size_t len;
+    int fd;
+    
+    if ((x=calloc(1, sizeof(cxfsbulk)))==NULL)
+    {   errprintf("calloc(%ld) failed: out of memory\n", (long)sizeof(cxfsbulk));
+        return -1;
+    }
+    
+    snprintf(x->mntpath, sizeof(x->mntpath), "%s", mntpath);
+    for (len=strlen(x->mntpath); (len>1) && (x->mntpath[len-1]=='/'); len--)
+        x->mntpath[len-1]=0;
+    
+    if ((fd=open64(x->mntpath, O_RDONLY|O_DIRECTORY))<0)
+    {   sysprintf("cannot open directory %s\n", x->mntpath);
+        free(x);
+        return -1;
+    }
+    if (fstat64(fd, &st)!=0)
+    {   sysprintf("fstat64(%s) failed\n", x->mntpath);
+        close(fd);
+        free(x);
+        return -1;
+    }
+    x->dev=st.st_dev;
+    x->rootino=st.st_ino;
+    
+    if (xfs_bulkstat_read_inodes(x, fd)!=0)
+    {   close(fd);
+        xfs_bulkstat_close(x);
+        return -1;
+    }
+    close(fd);
+    
+    msgprintf(MSG_VERB1, "%lld inodes read with XFS_IOC_BULKSTAT from %s\n", (long long)x->inodecnt, x->mntpath);
+    *xb=x;
+    return 0;
+}
+
+int xfs_bulkstat_close(cxfsbulk *xb)
+{
+    if (xb==NULL)
+        return -1;
+    
+    free(xb->inodes);
+    free(xb);
+    return 0;
+}
+
+// the walker works on the entries of the directories it has opened so the inode
+// of a path is the one of an open directory or the one of its last entry
+static int xfs_bulkstat_resolve(cxfsbulk *xb, char *path, u64 *ino)
+{
+    char dirpath[PATH_MAX];
+    cxfsbulkdir *dir;
+    
+    if (strcmp(path, xb->mntpath)==0)
+    {   *ino=xb->rootino;
+        return 0;
+    }
+    
+    extract_dirpath(path, dirpath, sizeof(dirpath));
+    for (dir=xb->top; dir!=NULL; dir=dir->prev)
+    {
+        if (strcmp(dir->path, path)==0)
+        {   *ino=dir->ino;
+            return 0;
+        }
+        if ((strcmp(dir->path, dirpath)==0) && (strcmp(dir->lastname, strrchr(path, '/')+1)==0))
+        {   *ino=dir->lastino;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int xfs_bulkstat_lstat(cxfsbulk *xb, char *path, struct stat64 *st)
+{
+    cxfsbulkinode *inode;
+    u64 ino;
+    
+    // paths which are not an entry of an open directory and inodes
+    // which have been created since the scan are read from the kernel
+    if ((xfs_bulkstat_resolve(xb, path, &ino)!=0) || ((inode=xfs_bulkstat_getinode(xb, ino))==NULL))
+        return lstat64(path, st);
+    
+    memset(st, 0, sizeof(struct stat64));
+    st->st_dev=xb->dev;
+    st->st_ino=inode->ino;
+    st->st_mode=inode->mode;
+    st->st_nlink=inode->nlink;
+    st->st_uid=inode->uid;
+    st->st_gid=inode->gid;
+    if (S_ISCHR(inode->mode) || S_ISBLK(inode->mode))
+        st->st_rdev=inode->size;
+    else
+        st->st_size=inode->size;
+    st->st_blocks=inode->blocks;
+    st->st_atime=inode->atime;
+    st->st_mtime=inode->mtime;
+    st->st_ctime=inode->ctime;
+    st->st_mtim.tv_nsec=inode->mtimensec;
+    st->st_ctim.tv_nsec=inode->ctimensec;
+    return 0;
+}
+
+int xfs_bulkstat_opendir(cxfsbulk *xb, char *path, cxfsbulkdir **dir)
+{
+    struct stat64 st;
+    cxfsbulkdir *d;
+    
+    if ((d=calloc(1, sizeof(cxfsbulkdir)))==NULL)
+    {   errno=ENOMEM;
+        return -1;
+    }
+    if ((d->dir=opendir(path))==NULL)
+    {   free(d);
+        return -1;
+    }
+    
+    snprintf(d->path, sizeof(d->path), "%s", path);
+    if (xfs_bulkstat_resolve(xb, d->path, &d->ino)!=0)
+        d->ino=(fstat64(dirfd(d->dir), &st)==0) ? st.st_ino : 0;
+    d->xb=xb;
+    d->prev=xb->top;
+    xb->top=d;
+    *dir=d;
+    return 0;
+}
+
+char *xfs_bulkstat_readdir(cxfsbulkdir *dir)
+{
+    struct dirent64 *entry;
+    
+    if ((entry=readdir64(dir->dir))==NULL)
+        return NULL;
+    snprintf(dir->lastname, sizeof(dir->lastname), "%s", entry->d_name);
+    dir->lastino=entry->d_ino;
+    return entry->d_name;
+}
+
+int xfs_bulkstat_closedir(cxfsbulkdir *dir)
+{
+    cxfsbulkdir **cur;
+    
+    for (cur=&dir->xb->top; *cur!=NULL; cur=&(*cur)->prev)
+    {   if (*cur==dir)
+        {   *cur=dir->prev;
+            break;
+        }
+    }
+    closedir(dir->dir);
+    free(dir);
+    return 0;
+}
@@ -20,6 +20,13 @@
 
 struct s_dico;
 struct s_strlist;
+struct stat64;
+
+struct s_xfsbulk;
+typedef struct s_xfsbulk cxfsbulk;
+
+struct s_xfsbulkdir;
+typedef struct s_xfsbulkdir cxfsbulkdir;
 
 /*
  * Super block
@@ -47,14 +54,23 @@ struct s_strlist;
 #define XFS_SB_VERSION_BORGBIT      0x4000  /* ASCII only case-insens. */
 #define XFS_SB_VERSION_MOREBITSBIT  0x8000
 
-int xfs_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid);
+int xfs_mkfs(struct s_dico *d, char *partition, char *fsoptions, char *mkfslabel, char *mkfsuuid, int profile);
 int xfs_getinfo(struct s_dico *d, char *devname);
-int xfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo);
+int xfs_mount(char *partition, char *mntbuf, char *fsbuf, int flags, char *mntinfo, int profile);
 int xfs_get_reqmntopt(char *partition, struct s_strlist *reqopt, struct s_strlist *badopt);
 int xfs_umount(char *partition, char *mntbuf);
 int xfs_test(char *devname);
 int xfs_check_compatibility(u64 compat, u64 ro_compat, u64 incompat, u64 log_incompat);
 
+// the attributes of all the inodes of a mounted filesystem are read at once in the order of
+// the inode numbers, the directories are read through the mount point to join names and inodes
+int xfs_bulkstat_open(cxfsbulk **xb, char *mntpath);
+int xfs_bulkstat_close(cxfsbulk *xb);
+int xfs_bulkstat_lstat(cxfsbulk *xb, char *path, struct stat64 *st);
+int xfs_bulkstat_opendir(cxfsbulk *xb, char *path, cxfsbulkdir **dir);
+char *xfs_bulkstat_readdir(cxfsbulkdir *dir);
+int xfs_bulkstat_closedir(cxfsbulkdir *dir);
+
 typedef uint32_t      xfs_agblock_t;  /* blockno in alloc. group */
 typedef uint32_t      xfs_extlen_t;   /* extent length in blocks */
 typedef uint32_t      xfs_agnumber_t; /* allocation group number */
@@ -199,4 +215,60 @@ struct xfs_sb
                                                 XFS_SB_FEAT_INCOMPAT_META_UUID)
 #define FSA_XFS_FEATURE_LOG_INCOMPAT_SUPP (u64)(0)
 
+/*
+ * Bulkstat v5 interface (linux >= 5.3), from xfs_fs.h
+ * The layout does not depend on the architecture unlike XFS_IOC_FSBULKSTAT
+ */
+struct xfs_bulkstat
+{
+        uint64_t        bs_ino;         /* inode number */
+        uint64_t        bs_size;        /* file size */
+        uint64_t        bs_blocks;      /* number of blocks */
+        uint64_t        bs_xflags;      /* extended flags */
+        int64_t         bs_atime;       /* access time, seconds */
+        int64_t         bs_mtime;       /* modify time, seconds */
+        int64_t         bs_ctime;       /* inode change time, seconds */
+        int64_t         bs_btime;       /* creation time, seconds */
+        uint32_t        bs_gen;         /* generation count */
+        uint32_t        bs_uid;         /* user id */
+        uint32_t        bs_gid;         /* group id */
+        uint32_t        bs_projectid;   /* project id */
+        uint32_t        bs_atime_nsec;  /* access time, nanoseconds */
+        uint32_t        bs_mtime_nsec;  /* modify time, nanoseconds */
+        uint32_t        bs_ctime_nsec;  /* inode change time, nanoseconds */
+        uint32_t        bs_btime_nsec;  /* creation time, nanoseconds */
+        uint32_t        bs_blksize;     /* block size */
+        uint32_t        bs_rdev;        /* device value (sysv encoding) */
+        uint32_t        bs_cowextsize_blks; /* cow extent size hint, blocks */
+        uint32_t        bs_extsize_blks; /* extent size hint, blocks */
+        uint32_t        bs_nlink;       /* number of links */
+        uint32_t        bs_extents;     /* number of extents */
+        uint32_t        bs_aextents;    /* attribute number of extents */
+        uint16_t        bs_version;     /* structure version */
+        uint16_t        bs_forkoff;     /* inode fork offset in bytes */
+        uint16_t        bs_sick;        /* sick inode metadata */
+        uint16_t        bs_checked;     /* checked inode metadata */
+        uint16_t        bs_mode;        /* type and mode */
+        uint16_t        bs_pad2;        /* zeroed */
+        uint64_t        bs_pad[7];      /* zeroed */
+};
+
+struct xfs_bulk_ireq
+{
+        uint64_t        ino;            /* I/O: start with this inode */
+        uint32_t        flags;          /* I/O: operation flags */
+        uint32_t        icount;         /* I: count of entries in buffer */
+        uint32_t        ocount;         /* O: count of entries filled out */
+        uint32_t        agno;           /* I: see comment for IREQ_AGNO */
+        uint64_t        reserved[5];    /* must be zero */
+};
+
+struct xfs_bulkstat_req
+{
+        struct xfs_bulk_ireq    hdr;
+        struct xfs_bulkstat     bulkstat[];
+};
+
+#define XFS_IOC_BULKSTAT        _IOR ('X', 127, struct xfs_bulkstat_req)
+
 #endif // __FS_XFS_H__
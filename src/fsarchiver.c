@@ -40,10 +40,12 @@
 #include "logfile.h"
 #include "error.h"
 #include "queue.h"
+#include "throttle.h"
+#include "exclude.h"
 
 char *valid_magic[]={FSA_MAGIC_MAIN, FSA_MAGIC_VOLH, FSA_MAGIC_VOLF,
     FSA_MAGIC_FSIN, FSA_MAGIC_FSYB, FSA_MAGIC_DATF, FSA_MAGIC_OBJT,
-    FSA_MAGIC_BLKH, FSA_MAGIC_FILF, FSA_MAGIC_DIRS, NULL};
+    FSA_MAGIC_BLKH, FSA_MAGIC_FILF, FSA_MAGIC_DIRS, FSA_MAGIC_RUNX, NULL};
 
 void usage(char *progname, bool examples)
 {
@@ -78,6 +80,7 @@ void usage(char *progname, bool examples)
     msgprintf(MSG_FORCE, " * savedir: save directories to the archive (similar to a compressed tarball)\n");
     msgprintf(MSG_FORCE, " * restdir: restore data from an archive which is not based on a filesystem\n");
     msgprintf(MSG_FORCE, " * archinfo: show information about an existing archive file and its contents\n");
+    msgprintf(MSG_FORCE, " * archlist: list the files and directories of an archive (reads only their headers)\n");
     msgprintf(MSG_FORCE, " * probe [detailed]: show list of filesystems detected on the disks\n");
     msgprintf(MSG_FORCE, "<options>\n");
     msgprintf(MSG_FORCE, " -o: overwrite the archive if it already exists instead of failing\n");
@@ -87,6 +90,7 @@ void usage(char *progname, bool examples)
     msgprintf(MSG_FORCE, " -a: allow to save a filesystem when acls and xattrs are not supported\n");
     msgprintf(MSG_FORCE, " -x: enable support for experimental features (they are disabled by default)\n");
     msgprintf(MSG_FORCE, " -e <pattern>: exclude files and directories that match that pattern\n");
+    msgprintf(MSG_FORCE, " -i <pattern>: only restore the files and directories that match that pattern\n");
     msgprintf(MSG_FORCE, " -L <label>: set the label of the archive (comment about the contents)\n");
     msgprintf(MSG_FORCE, " -z <level>: legacy compression level from 0 (very fast) to 9 (very good)\n");
 #ifdef OPTION_ZSTD_SUPPORT
@@ -95,6 +99,28 @@ void usage(char *progname, bool examples)
     msgprintf(MSG_FORCE, " -s <mbsize>: split the archive into several files of <mbsize> megabytes each\n");
     msgprintf(MSG_FORCE, " -j <count>: create more than one (de)compression thread. useful on multi-core cpu\n");
     msgprintf(MSG_FORCE, " -c <password>: encrypt/decrypt data in archive, \"-c -\" for interactive password\n");
+    msgprintf(MSG_FORCE, " --catalog=<file>: write the list of saved files to a catalog (savefs/savedir)\n");
+    msgprintf(MSG_FORCE, " --incremental=<file>: only copy files which have changed since that catalog was written\n");
+    msgprintf(MSG_FORCE, " --base=<archive>: archive which contains the files unchanged in an incremental archive\n");
+    msgprintf(MSG_FORCE, " --resume: continue an interrupted savefs/savedir from its last complete volume\n");
+    msgprintf(MSG_FORCE, " --concurrent-fs: save or restore all the filesystems at the same time (savefs/restfs)\n");
+    msgprintf(MSG_FORCE, " --voldir=<dir>: store the volumes of a split archive round-robin in these directories\n");
+    msgprintf(MSG_FORCE, " --dedup: store the contents of identical small files only once (savefs/savedir)\n");
+    msgprintf(MSG_FORCE, " --max-read-rate=<mbps>: read the files to save at most at <mbps> megabytes per second\n");
+    msgprintf(MSG_FORCE, " --max-write-rate=<mbps>: write the archive at most at <mbps> megabytes per second\n");
+    msgprintf(MSG_FORCE, " --cpu-limit=<percent|idle>: limit the cpu used by each compression thread\n");
+    msgprintf(MSG_FORCE, " --throttle-file=<file>: read new limits from this file when it changes (SIGUSR1 removes them)\n");
+    msgprintf(MSG_FORCE, " --ntfs-direct: read and write ntfs filesystems with libntfs-3g instead of a fuse mount (savefs/restfs)\n");
+    msgprintf(MSG_FORCE, " --ext-direct: write the new ext2/3/4 filesystems with libext2fs without mounting them (restfs)\n");
+    msgprintf(MSG_FORCE, " --ext-scan: read the metadata of ext2/3/4 filesystems from their inode tables (savefs)\n");
+    msgprintf(MSG_FORCE, " --xfs-bulkstat: read the attributes of the files of xfs filesystems in large batches (savefs)\n");
+    msgprintf(MSG_FORCE, " --reflink: save the data of the extents shared by several files only once (savefs/savedir)\n");
+    msgprintf(MSG_FORCE, " --fast-restore: create the journal of ext3/ext4 after the data have been written (restfs)\n");
+    msgprintf(MSG_FORCE, " --group-small-files: pack the small files by type of contents (savefs/savedir)\n");
+    msgprintf(MSG_FORCE, " --large-blocks=N: data blocks of N MB (between 1 and 64) which need fsarchiver >= 0.8.6 to restore (savefs/savedir)\n");
+    msgprintf(MSG_FORCE, " --zstd-long: find the repetitions across the whole large blocks with zstd (savefs/savedir)\n");
+    msgprintf(MSG_FORCE, " --cipher=NAME: encryption with -c: \"blowfish\" (default) or \"aes256gcm\" which needs fsarchiver >= 0.8.6 to restore (savefs/savedir)\n");
+    msgprintf(MSG_FORCE, " --image: save the blocks in use of ext2/3/4 filesystems instead of their files (savefs)\n");
     msgprintf(MSG_FORCE, " -h: show help and information about how to use fsarchiver with examples\n");
     msgprintf(MSG_FORCE, " -V: show program version and exit\n");
     msgprintf(MSG_FORCE, "<information>\n");
@@ -108,12 +134,16 @@ void usage(char *progname, bool examples)
         msgprintf(MSG_FORCE, "   fsarchiver savefs /data/myarchive1.fsa /dev/sda1\n");
         msgprintf(MSG_FORCE, " * \e[1msave two filesystems (/dev/sda1 and /dev/sdb1) to an archive:\e[0m\n");
         msgprintf(MSG_FORCE, "   fsarchiver savefs /data/myarchive2.fsa /dev/sda1 /dev/sdb1\n");
+        msgprintf(MSG_FORCE, " * \e[1msave two filesystems at the same time when they are on different disks:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savefs --concurrent-fs /data/myarchive2.fsa /dev/sda1 /dev/sdb1\n");
         msgprintf(MSG_FORCE, " * \e[1mrestore the first filesystem from an archive (first = number 0):\e[0m\n");
         msgprintf(MSG_FORCE, "   fsarchiver restfs /data/myarchive2.fsa id=0,dest=/dev/sda1\n");
         msgprintf(MSG_FORCE, " * \e[1mrestore the second filesystem from an archive (second = number 1):\e[0m\n");
         msgprintf(MSG_FORCE, "   fsarchiver restfs /data/myarchive2.fsa id=1,dest=/dev/sdb1\n");
         msgprintf(MSG_FORCE, " * \e[1mrestore two filesystems from an archive (number 0 and 1):\e[0m\n");
         msgprintf(MSG_FORCE, "   fsarchiver restfs /data/arch2.fsa id=0,dest=/dev/sda1 id=1,dest=/dev/sdb1\n");
+        msgprintf(MSG_FORCE, " * \e[1mrestore two filesystems at the same time:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver restfs --concurrent-fs /data/arch2.fsa id=0,dest=/dev/sda1 id=1,dest=/dev/sdb1\n");
         msgprintf(MSG_FORCE, " * \e[1mrestore a filesystem from an archive and convert it to reiserfs:\e[0m\n");
         msgprintf(MSG_FORCE, "   fsarchiver restfs /data/myarchive1.fsa id=0,dest=/dev/sda1,mkfs=reiserfs\n");
         msgprintf(MSG_FORCE, " * \e[1mrestore a filesystem from an archive and specify extra mkfs options:\e[0m\n");
@@ -124,23 +154,84 @@ void usage(char *progname, bool examples)
         msgprintf(MSG_FORCE, "   fsarchiver savedir /data/linux-sources.fsa /usr/src/linux\n");
         msgprintf(MSG_FORCE, " * \e[1msave a filesystem (/dev/sda1) to an archive split into volumes of 680MB:\e[0m\n");
         msgprintf(MSG_FORCE, "   fsarchiver savefs -s 680 /data/myarchive1.fsa /dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1mwrite an archive to the standard output to pipe it to another program:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savefs - /dev/sda1 | mbuffer -o /dev/st0\n");
+        msgprintf(MSG_FORCE, " * \e[1mrestore a filesystem from an archive read from the standard input:\e[0m\n");
+        msgprintf(MSG_FORCE, "   mbuffer -i /dev/st0 | fsarchiver restfs - id=0,dest=/dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1mspread the volumes of a split archive over two disks (also required to restore it):\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savefs -s 4096 --voldir=/mnt/disk1 --voldir=/mnt/disk2 /mnt/disk1/myarchive.fsa /dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1msave a directory which contains many identical small files only once:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savedir --dedup /data/projects.fsa /home/projects\n");
+        msgprintf(MSG_FORCE, " * \e[1msave a directory on a busy server with low disk and cpu usage:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savedir --max-read-rate=20 --cpu-limit=idle --throttle-file=/etc/fsa.limits /data/db.fsa /var/lib/db\n");
+        msgprintf(MSG_FORCE, " * \e[1msave an ntfs filesystem without mounting it through fuse:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savefs --ntfs-direct /data/windows.fsa /dev/sda2\n");
+        msgprintf(MSG_FORCE, " * \e[1mrestore an ntfs filesystem without mounting it through fuse:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver restfs --ntfs-direct /data/windows.fsa id=0,dest=/dev/sda2\n");
+        msgprintf(MSG_FORCE, " * \e[1mrestore an ext4 filesystem without mounting it:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver restfs --ext-direct /data/myarchive.fsa id=0,dest=/dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1msave an ext4 filesystem which contains many millions of files:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savefs --ext-scan /data/myarchive.fsa /dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1msave the blocks in use of a filesystem which contains millions of tiny files:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savefs --image /data/myarchive.fsa /dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1msave an xfs filesystem which contains many millions of files:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savefs --xfs-bulkstat /data/myarchive.fsa /dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1msave a btrfs filesystem which contains many snapshots:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savefs --reflink /data/myarchive.fsa /dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1mrestore an ext4 filesystem as fast as possible:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver restfs --fast-restore /data/myarchive.fsa id=0,dest=/dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1msave a directory of source code mixed with images and archives:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savedir --group-small-files /data/myarchive.fsa /data/project\n");
+        msgprintf(MSG_FORCE, " * \e[1msave a filesystem with 32 MB blocks compressed with zstd level 19:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savefs -Z19 --large-blocks=32 /data/myarchive.fsa /dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1msave virtual machine images with the long distance matching of zstd:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savedir -Z12 --large-blocks=64 --zstd-long /data/myarchive.fsa /var/lib/libvirt/images\n");
         msgprintf(MSG_FORCE, " * \e[1msave a filesystem and exclude all files/dirs called 'pagefile.*':\e[0m\n");
         msgprintf(MSG_FORCE, "   fsarchiver savefs /data/myarchive.fsa /dev/sda1 --exclude='pagefile.*'\n");
         msgprintf(MSG_FORCE, " * \e[1mgeneric exclude for 'share' such as '/usr/share' and '/usr/local/share':\e[0m\n");
         msgprintf(MSG_FORCE, "   fsarchiver savefs /data/myarchive.fsa --exclude=share\n");
         msgprintf(MSG_FORCE, " * \e[1mabsolute exclude valid for '/usr/share' but not for '/usr/local/share':\e[0m\n");
         msgprintf(MSG_FORCE, "   fsarchiver savefs /data/myarchive.fsa --exclude=/usr/share\n");
+        msgprintf(MSG_FORCE, " * \e[1mrestore only '/home/user' from a filesystem archive:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver restfs /data/myarchive.fsa id=0,dest=/dev/sda1 --include=/home/user\n");
         msgprintf(MSG_FORCE, " * \e[1msave a filesystem (/dev/sda1) to an encrypted archive:\e[0m\n");
         msgprintf(MSG_FORCE, "   fsarchiver savefs -c mypassword /data/myarchive1.fsa /dev/sda1\n");
         msgprintf(MSG_FORCE, " * \e[1msame as before but prompt for password in the terminal:\e[0m\n");
         msgprintf(MSG_FORCE, "   fsarchiver savefs -c - /data/myarchive1.fsa /dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1msame as before but authenticated and faster with the aes instructions of the processor:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savefs -c - --cipher=aes256gcm /data/myarchive1.fsa /dev/sda1\n");
         msgprintf(MSG_FORCE, " * \e[1mextract an archive made of simple files to /tmp/extract:\e[0m\n");
         msgprintf(MSG_FORCE, "   fsarchiver restdir /data/linux-sources.fsa /tmp/extract\n");
+        msgprintf(MSG_FORCE, " * \e[1msave a filesystem and write a catalog to be used by the next incremental backup:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savefs --catalog=/data/full.cat /data/full.fsa /dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1msave only the files which have changed since the previous backup:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savefs --incremental=/data/full.cat --catalog=/data/incr1.cat /data/incr1.fsa /dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1mrestore an incremental archive using the files from its base archive:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver restfs --base=/data/full.fsa /data/incr1.fsa id=0,dest=/dev/sda1\n");
+        msgprintf(MSG_FORCE, " * \e[1mcontinue a split archive which has been interrupted:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver savefs --resume -s 680 /data/myarchive1.fsa /dev/sda1\n");
         msgprintf(MSG_FORCE, " * \e[1mshow information about an archive and its filesystems:\e[0m\n");
         msgprintf(MSG_FORCE, "   fsarchiver archinfo /data/myarchive2.fsa\n");
+        msgprintf(MSG_FORCE, " * \e[1mlist the files and directories of an archive:\e[0m\n");
+        msgprintf(MSG_FORCE, "   fsarchiver archlist /data/myarchive2.fsa\n");
     }
 }
 
+// options which only have a long name
+enum {LONGOPT_CATALOG=256, LONGOPT_INCREMENTAL, LONGOPT_BASE, LONGOPT_RESUME, LONGOPT_CONCURRENTFS, LONGOPT_VOLDIR,
+    LONGOPT_MAXREADRATE, LONGOPT_MAXWRITERATE, LONGOPT_CPULIMIT, LONGOPT_THROTTLEFILE, LONGOPT_DEDUP,
+    LONGOPT_NTFSDIRECT,
+    LONGOPT_EXTDIRECT,
+    LONGOPT_EXTSCAN,
+    LONGOPT_IMAGE,
+    LONGOPT_XFSBULKSTAT,
+    LONGOPT_REFLINK,
+    LONGOPT_FASTRESTORE,
+    LONGOPT_GROUPSMALL,
+    LONGOPT_LARGEBLOCKS,
+    LONGOPT_ZSTDLONG,
+    LONGOPT_CIPHER};
+
 static struct option const long_options[] =
 {
     {"overwrite", no_argument, NULL, 'o'},
@@ -157,7 +248,30 @@ static struct option const long_options[] =
     {"cryptpass", required_argument, NULL, 'c'},
     {"label", required_argument, NULL, 'L'},
     {"exclude", required_argument, NULL, 'e'},
+    {"include", required_argument, NULL, 'i'},
     {"experimental", no_argument, NULL, 'x'},
+    {"catalog", required_argument, NULL, LONGOPT_CATALOG},
+    {"incremental", required_argument, NULL, LONGOPT_INCREMENTAL},
+    {"base", required_argument, NULL, LONGOPT_BASE},
+    {"resume", no_argument, NULL, LONGOPT_RESUME},
+    {"concurrent-fs", no_argument, NULL, LONGOPT_CONCURRENTFS},
+    {"voldir", required_argument, NULL, LONGOPT_VOLDIR},
+    {"max-read-rate", required_argument, NULL, LONGOPT_MAXREADRATE},
+    {"max-write-rate", required_argument, NULL, LONGOPT_MAXWRITERATE},
+    {"cpu-limit", required_argument, NULL, LONGOPT_CPULIMIT},
+    {"throttle-file", required_argument, NULL, LONGOPT_THROTTLEFILE},
+    {"dedup", no_argument, NULL, LONGOPT_DEDUP},
+    {"ntfs-direct", no_argument, NULL, LONGOPT_NTFSDIRECT},
+    {"ext-direct", no_argument, NULL, LONGOPT_EXTDIRECT},
+    {"ext-scan", no_argument, NULL, LONGOPT_EXTSCAN},
+    {"image", no_argument, NULL, LONGOPT_IMAGE},
+    {"xfs-bulkstat", no_argument, NULL, LONGOPT_XFSBULKSTAT},
+    {"reflink", no_argument, NULL, LONGOPT_REFLINK},
+    {"fast-restore", no_argument, NULL, LONGOPT_FASTRESTORE},
+    {"group-small-files", no_argument, NULL, LONGOPT_GROUPSMALL},
+    {"large-blocks", required_argument, NULL, LONGOPT_LARGEBLOCKS},
+    {"zstd-long", no_argument, NULL, LONGOPT_ZSTDLONG},
+    {"cipher", required_argument, NULL, LONGOPT_CIPHER},
     {NULL, 0, NULL, 0}
 };
 
@@ -192,6 +306,7 @@ int process_cmdline(int argc, char **argv)
     g_options.compressjobs=1;
     g_options.datablocksize=FSA_DEF_BLKSIZE;
     g_options.encryptalgo=ENCRYPT_NONE;
+    g_options.cipher=ENCRYPT_BLOWFISH;
     snprintf(g_options.archlabel, sizeof(g_options.archlabel), "<none>");
     g_options.encryptpass[0]=0;
 
@@ -206,7 +321,7 @@ int process_cmdline(int argc, char **argv)
     g_options.compresslevel=FSA_DEF_COMPRESS_LEVEL; // default level for gzip
 #endif // OPTION_ZSTD_SUPPORT
 
-    while ((c = getopt_long(argc, argv, "oaAvdj:hVs:c:L:e:xz:Z:", long_options, NULL)) != EOF)
+    while ((c = getopt_long(argc, argv, "oaAvdj:hVs:c:L:e:i:xz:Z:", long_options, NULL)) != EOF)
     {
         switch (c)
         {
@@ -243,6 +358,9 @@ int process_cmdline(int argc, char **argv)
             case 'e': // exclude files/directories
                 strlist_add(&g_options.exclude, optarg);
                 break;
+            case 'i': // only restore these files/directories
+                strlist_add(&g_options.include, optarg);
+                break;
             case 's': // split archive into several volumes
                 g_options.splitsize=((u64)atoll(optarg))*((u64)1024LL*1024LL);
                 if (g_options.splitsize==0)
@@ -307,6 +425,120 @@ int process_cmdline(int argc, char **argv)
             case 'L': // archive label
                 snprintf(g_options.archlabel, sizeof(g_options.archlabel), "%s", optarg);
                 break;
+            case LONGOPT_CATALOG: // write a catalog of the files saved in the archive
+                g_options.catalog=optarg;
+                break;
+            case LONGOPT_INCREMENTAL: // catalog of the reference archive for an incremental backup
+                g_options.incremental=optarg;
+                break;
+            case LONGOPT_BASE: // archives which contain the files not copied in an incremental archive
+                strlist_add(&g_options.baselist, optarg);
+                break;
+            case LONGOPT_RESUME: // continue an interrupted save from its checkpoint
+                g_options.resume=true;
+                break;
+            case LONGOPT_CONCURRENTFS: // run one walker per filesystem
+                g_options.concurrentfs=true;
+                break;
+            case LONGOPT_VOLDIR: // directories where the volumes are striped
+                strlist_add(&g_options.voldirs, optarg);
+                break;
+            case LONGOPT_MAXREADRATE: // megabytes per second read from the filesystems
+            case LONGOPT_MAXWRITERATE: // megabytes per second written to the archive
+                if (atoll(optarg)<=0)
+                {   errprintf("argument of option --%s is invalid (%s). It must be a positive integer\n",
+                        (c==LONGOPT_MAXREADRATE)?"max-read-rate":"max-write-rate", optarg);
+                    usage(progname, false);
+                    return -1;
+                }
+                if (c==LONGOPT_MAXREADRATE)
+                    g_options.readrate=((u64)atoll(optarg))*((u64)1024LL*1024LL);
+                else
+                    g_options.writerate=((u64)atoll(optarg))*((u64)1024LL*1024LL);
+                break;
+            case LONGOPT_CPULIMIT: // percent of a core per compression thread, or idle scheduling
+                if (strcmp(optarg, "idle")==0)
+                    g_options.cpulimit=THROTTLE_CPUIDLE;
+                else if ((g_options.cpulimit=atoi(optarg))<1 || g_options.cpulimit>100)
+                {   errprintf("argument of option --cpu-limit is invalid (%s). It must be \"idle\" or between 1 and 100\n", optarg);
+                    usage(progname, false);
+                    return -1;
+                }
+                else if (g_options.cpulimit==100)
+                    g_options.cpulimit=0;
+                break;
+            case LONGOPT_THROTTLEFILE: // file which can be changed to adjust the limits at runtime
+                g_options.throttlefile=optarg;
+                break;
+            case LONGOPT_DEDUP: // identical small files point to the first copy
+                g_options.dedup=true;
+                break;
+            case LONGOPT_NTFSDIRECT: // read ntfs volumes in-process instead of through ntfs-3g
+#ifdef OPTION_NTFS3G_SUPPORT
+                g_options.ntfsdirect=true;
+#else
+                errprintf("option --ntfs-direct is not available as the support for libntfs-3g has been disabled at compilation time\n");
+                return -1;
+#endif // OPTION_NTFS3G_SUPPORT
+                break;
+            case LONGOPT_EXTDIRECT: // populate new ext filesystems with libext2fs instead of mounting them
+#ifdef OPTION_EXTDIRECT_SUPPORT
+                g_options.extdirect=true;
+#else
+                errprintf("option --ext-direct is not available as fsarchiver has been compiled with e2fsprogs older than 1.43\n");
+                return -1;
+#endif // OPTION_EXTDIRECT_SUPPORT
+                break;
+            case LONGOPT_EXTSCAN: // enumerate ext filesystems with an inode scan instead of readdir/lstat
+#ifdef OPTION_EXTDIRECT_SUPPORT
+                g_options.extscan=true;
+#else
+                errprintf("option --ext-scan is not available as fsarchiver has been compiled with e2fsprogs older than 1.43\n");
+                return -1;
+#endif // OPTION_EXTDIRECT_SUPPORT
+                break;
+            case LONGOPT_IMAGE: // save the blocks in use instead of the files
+                g_options.image=true;
+                break;
+            case LONGOPT_XFSBULKSTAT: // read the attributes of the xfs inodes in batches instead of lstat
+                g_options.xfsbulkstat=true;
+                break;
+            case LONGOPT_REFLINK: // blocks on a shared extent point to the first copy
+                g_options.reflink=true;
+                break;
+            case LONGOPT_FASTRESTORE: // journal and safe mount options only once the data are written
+                g_options.fastrestore=true;
+                break;
+            case LONGOPT_GROUPSMALL: // text, binary and already compressed small files in different blocks
+                g_options.groupsmall=true;
+                break;
+            case LONGOPT_LARGEBLOCKS: // blocks bigger than what older versions can read
+                if (atoi(optarg)<1 || atoi(optarg)>(FSA_MAX_LARGEBLKSIZE>>20))
+                {   errprintf("argument of option --large-blocks is invalid (%s). It must be between 1 and %d\n", optarg, FSA_MAX_LARGEBLKSIZE>>20);
+                    usage(progname, false);
+                    return -1;
+                }
+                g_options.largeblksize=((u32)atoi(optarg))<<20;
+                break;
+            case LONGOPT_ZSTDLONG: // window over the whole block instead of the one of the compression level
+#ifdef OPTION_ZSTD_SUPPORT
+                g_options.zstdlong=true;
+#else
+                errprintf("zstd compression is not available as its support has been disabled at compilation time\n");
+                return -1;
+#endif // OPTION_ZSTD_SUPPORT
+                break;
+            case LONGOPT_CIPHER: // encryption algorithm used with option -c
+                if (strcmp(optarg, "blowfish")==0)
+                    g_options.cipher=ENCRYPT_BLOWFISH;
+                else if (strcmp(optarg, "aes256gcm")==0)
+                    g_options.cipher=ENCRYPT_AES256GCM;
+                else
+                {   errprintf("argument of option --cipher is invalid (%s). It must be \"blowfish\" or \"aes256gcm\"\n", optarg);
+                    usage(progname, false);
+                    return -1;
+                }
+                break;
             case 'h': // help
                 usage(progname, true);
                 return 0;
@@ -330,6 +562,17 @@ int process_cmdline(int argc, char **argv)
         command=*argv++, argc--;
     }
 
+    // the algorithm of the archive is used when it is restored whatever --cipher says
+    if (g_options.encryptalgo!=ENCRYPT_NONE)
+        g_options.encryptalgo=g_options.cipher;
+    
+    // the size given with --large-blocks wins over the one of the compression level
+    if (g_options.largeblksize>0)
+        g_options.datablocksize=g_options.largeblksize;
+    
+    if ((g_options.zstdlong==true) && ((g_options.compressalgo!=COMPRESS_ZSTD) || (g_options.largeblksize==0)))
+        msgprintf(MSG_FORCE, "option --zstd-long has no effect without zstd compression (-Z) and option --large-blocks\n");
+    
     // calculate threshold for small files that are compressed together
     g_options.smallfilethresh=min(g_options.datablocksize/4, FSA_MAX_SMALLFILESIZE);
     msgprintf(MSG_DEBUG1, "Files smaller than %ld will be packed with other small files\n", (long)g_options.smallfilethresh);
@@ -360,6 +603,11 @@ int process_cmdline(int argc, char **argv)
         runasroot=false;
         argcok=(argc==1);
     }
+    else if (strcmp(command, "archlist")==0)
+    {   cmd=OPER_ARCHLIST;
+        runasroot=false;
+        argcok=(argc==1);
+    }
     else if (strcmp(command, "probe")==0)
     {   cmd=OPER_PROBE;
         runasroot=true;
@@ -422,6 +670,7 @@ int process_cmdline(int argc, char **argv)
         case OPER_SAVEDIR:
         case OPER_RESTDIR:
         case OPER_ARCHINFO:
+        case OPER_ARCHLIST:
             archive=*argv++, argc--;
             break;
         case OPER_PROBE:
@@ -444,10 +693,18 @@ int process_cmdline(int argc, char **argv)
     sigemptyset(&mask_set);
     sigaddset(&mask_set, SIGINT);
     sigaddset(&mask_set, SIGTERM);
+    if ((g_options.readrate>0) || (g_options.writerate>0) || (g_options.cpulimit!=0) || (g_options.throttlefile!=NULL))
+        sigaddset(&mask_set, SIGUSR1); // removes the throttling limits (see throttle.c), else it keeps its default action
     sigprocmask(SIG_SETMASK, &mask_set, NULL);
 
     if (g_options.debuglevel>0)
         logfile_open();
+    
+    // compile the exclusion patterns once for all the files
+    if ((exclude_init(&g_exclude, &g_options.exclude)!=0) || (exclude_init(&g_include, &g_options.include)!=0))
+    {   logfile_close();
+        return -1;
+    }
 
     switch (cmd)
     {
@@ -460,6 +717,7 @@ int process_cmdline(int argc, char **argv)
         case OPER_RESTFS:
         case OPER_RESTDIR:
         case OPER_ARCHINFO:
+        case OPER_ARCHLIST:
             ret=oper_restore(archive, fscount, partition, cmd);
             break;
         case OPER_PROBE:
@@ -472,6 +730,8 @@ int process_cmdline(int argc, char **argv)
             break;
     };
 
+    exclude_destroy(&g_exclude);
+    exclude_destroy(&g_include);
     logfile_close();
 
     return ret;
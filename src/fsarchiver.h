@@ -30,7 +30,7 @@
 #endif
 
 // -------------------------------- fsarchiver commands ---------------------------------------------
-enum {OPER_NULL=0, OPER_SAVEFS, OPER_RESTFS, OPER_SAVEDIR, OPER_RESTDIR, OPER_ARCHINFO, OPER_PROBE};
+enum {OPER_NULL=0, OPER_SAVEFS, OPER_RESTFS, OPER_SAVEDIR, OPER_RESTDIR, OPER_ARCHINFO, OPER_PROBE, OPER_ARCHLIST};
 
 // ----------------------------------- dico sections ------------------------------------------------
 enum {DICO_OBJ_SECTION_STDATTR=0, DICO_OBJ_SECTION_XATTR=1, DICO_OBJ_SECTION_WINATTR=2};
@@ -44,21 +44,24 @@ enum {VOLUMEFOOTKEY_VOLNUM, VOLUMEFOOTKEY_ARCHID, VOLUMEFOOTKEY_LASTVOL};
 
 // ----------------------------------- algorithms used to process data-------------------------------
 enum {COMPRESS_NULL=0, COMPRESS_NONE, COMPRESS_LZO, COMPRESS_GZIP, COMPRESS_BZIP2, COMPRESS_LZMA, COMPRESS_LZ4, COMPRESS_ZSTD};
-enum {ENCRYPT_NULL=0, ENCRYPT_NONE, ENCRYPT_BLOWFISH};
+enum {ENCRYPT_NULL=0, ENCRYPT_NONE, ENCRYPT_BLOWFISH, ENCRYPT_AES256GCM};
 
 // ----------------------------------- dico keys ----------------------------------------------------
 enum {OBJTYPE_NULL=0, OBJTYPE_DIR, OBJTYPE_SYMLINK, OBJTYPE_HARDLINK, OBJTYPE_CHARDEV,
-      OBJTYPE_BLOCKDEV, OBJTYPE_FIFO, OBJTYPE_SOCKET, OBJTYPE_REGFILEUNIQUE, OBJTYPE_REGFILEMULTI};
+      OBJTYPE_BLOCKDEV, OBJTYPE_FIFO, OBJTYPE_SOCKET, OBJTYPE_REGFILEUNIQUE, OBJTYPE_REGFILEMULTI,
+      OBJTYPE_REGFILEBASE, OBJTYPE_REGFILEDUP};
 
 enum {DISKITEMKEY_NULL=0, DISKITEMKEY_OBJECTID, DISKITEMKEY_PATH, DISKITEMKEY_OBJTYPE,
       DISKITEMKEY_SYMLINK, DISKITEMKEY_HARDLINK, DISKITEMKEY_RDEV, DISKITEMKEY_MODE,
       DISKITEMKEY_SIZE, DISKITEMKEY_UID, DISKITEMKEY_GID, DISKITEMKEY_ATIME, DISKITEMKEY_MTIME,
       DISKITEMKEY_MD5SUM, DISKITEMKEY_MULTIFILESCOUNT, DISKITEMKEY_MULTIFILESOFFSET,
-      DISKITEMKEY_LINKTARGETTYPE, DISKITEMKEY_FLAGS};
+      DISKITEMKEY_LINKTARGETTYPE, DISKITEMKEY_FLAGS, DISKITEMKEY_BASEARCHID,
+      DISKITEMKEY_DUPPATH, DISKITEMKEY_REFLINKS};
 
 enum {BLOCKHEADITEMKEY_NULL=0, BLOCKHEADITEMKEY_REALSIZE, BLOCKHEADITEMKEY_BLOCKOFFSET,
       BLOCKHEADITEMKEY_COMPRESSALGO, BLOCKHEADITEMKEY_ENCRYPTALGO, BLOCKHEADITEMKEY_ARSIZE,
-      BLOCKHEADITEMKEY_COMPSIZE, BLOCKHEADITEMKEY_ARCSUM};
+      BLOCKHEADITEMKEY_COMPSIZE, BLOCKHEADITEMKEY_ARCSUM, BLOCKHEADITEMKEY_CRYPTNONCE,
+      BLOCKHEADITEMKEY_CRYPTTAG};
 
 enum {BLOCKFOOTITEMKEY_NULL=0, BLOCKFOOTITEMKEY_MD5SUM};
 
@@ -66,7 +69,10 @@ enum {MAINHEADKEY_NULL=0, MAINHEADKEY_FILEFORMATVER, MAINHEADKEY_PROGVERCREAT, M
       MAINHEADKEY_CREATTIME, MAINHEADKEY_ARCHLABEL, MAINHEADKEY_ARCHTYPE, MAINHEADKEY_FSCOUNT,
       MAINHEADKEY_COMPRESSALGO, MAINHEADKEY_COMPRESSLEVEL, MAINHEADKEY_ENCRYPTALGO,
       MAINHEADKEY_BUFCHECKPASSCLEARMD5, MAINHEADKEY_BUFCHECKPASSCRYPTBUF, MAINHEADKEY_FSACOMPLEVEL,
-      MAINHEADKEY_MINFSAVERSION, MAINHEADKEY_HASDIRSINFOHEAD};
+      MAINHEADKEY_MINFSAVERSION, MAINHEADKEY_HASDIRSINFOHEAD, MAINHEADKEY_FSINTERLEAVED,
+      MAINHEADKEY_HASDUPLICATES, MAINHEADKEY_HASREFLINKS, MAINHEADKEY_LARGEBLKSIZE,
+      MAINHEADKEY_CRYPTSALT, MAINHEADKEY_CRYPTKDFITER, MAINHEADKEY_CRYPTNONCE, MAINHEADKEY_CRYPTTAG,
+      MAINHEADKEY_GROUPSMALL};
 
 enum {FSYSHEADKEY_NULL=0, FSYSHEADKEY_FILESYSTEM, FSYSHEADKEY_MNTPATH, FSYSHEADKEY_BYTESTOTAL,
       FSYSHEADKEY_BYTESUSED, FSYSHEADKEY_FSLABEL, FSYSHEADKEY_FSUUID, FSYSHEADKEY_FSINODESIZE,
@@ -82,10 +88,14 @@ enum {FSYSHEADKEY_NULL=0, FSYSHEADKEY_FILESYSTEM, FSYSHEADKEY_MNTPATH, FSYSHEADK
       FSYSHEADKEY_FSINODEBLOCKSPERGROUP, FSYSHEADKEY_FSXFSVERSION,
       FSYSHEADKEY_FSXFSFEATURECOMPAT, FSYSHEADKEY_FSXFSFEATUREROCOMPAT,
       FSYSHEADKEY_FSXFSFEATUREINCOMPAT, FSYSHEADKEY_FSXFSFEATURELOGINCOMPAT,
-      FSYSHEADKEY_FSVFATTYPE, FSYSHEADKEY_FSVFATSERIAL};
+      FSYSHEADKEY_FSVFATTYPE, FSYSHEADKEY_FSVFATSERIAL, FSYSHEADKEY_IMAGESIZE};
 
 enum {DIRSINFOKEY_NULL=0, DIRSINFOKEY_TOTALCOST};
 
+enum {CHECKPOINTKEY_NULL=0, CHECKPOINTKEY_OBJECTID, CHECKPOINTKEY_PATH};
+
+enum {RUNINDEXKEY_NULL=0, RUNINDEXKEY_FSID, RUNINDEXKEY_CURVOL, RUNINDEXKEY_OFFSET, RUNINDEXKEY_SIZE};
+
 // -------------------------------- fsarchiver errors ---------------------------------------------
 enum {FSAERR_SUCCESS=0,           // success
       FSAERR_UNKNOWN=-1,          // uknown error (default code that means error)
@@ -124,12 +134,20 @@ enum {OLDERR_FATAL=1,
 #define FSA_MAX_QUEUESIZE        32
 #define FSA_MAX_BLKSIZE          921600
 #define FSA_DEF_BLKSIZE          524288
+#define FSA_MAX_LARGEBLKSIZE     67108864       // max size of the data blocks of the archives saved with --large-blocks
 #define FSA_DEF_COMPRESS_ALGO    COMPRESS_GZIP  // legacy compression is using gzip by default
 #define FSA_DEF_COMPRESS_LEVEL   6              // legacy compression is with "gzip -6" by default
 #define FSA_DEF_ZSTD_LEVEL       8              // default compression level when zstd is used
+#define FSA_ZSTD_LONGWINDOWLOG   26             // zstd window which covers the largest blocks (also accepted by the decoders by default)
 #define FSA_MAX_SMALLFILECOUNT   512            // there can be up to FSA_MAX_SMALLFILECOUNT files copied in a single data block
 #define FSA_MAX_SMALLFILESIZE    131072         // files smaller than that will be grouped with other small files in a single data block
 #define FSA_COST_PER_FILE        16384          // how much it cost to copy an empty file/dir/link: used to eval the progress bar
+#define FSA_CHECKPOINT_COST      16777216       // minimum cost between two positions where a savefs/savedir can be resumed
+#define FSA_RUN_SIZE             16777216       // data of a filesystem written contiguously when several filesystems are saved concurrently
+#define FSA_VOLUME_READAHEAD     8388608        // how much of the next volume is read in advance when an archive is restored
+#define FSA_DEDUP_CACHESIZE      33554432       // contents of the small files kept in memory to restore their duplicates
+#define FSA_MAX_REFLINKSIZE      32768          // max size of the list of shared ranges in the header of a file
+#define FSA_STREAM_PATH          "-"            // archive path which means stdout for savefs/savedir and stdin for restfs/restdir
 
 #define FSA_MAX_LABELLEN         512
 #define FSA_MIN_PASSLEN          6
@@ -137,6 +155,10 @@ enum {OLDERR_FATAL=1,
 
 #define FSA_FILESYSID_NULL       0xFFFF
 #define FSA_CHECKPASSBUF_SIZE    4096
+#define FSA_CRYPT_SALTSIZE       16             // random salt of the key derivation, different for each archive
+#define FSA_CRYPT_KDFITER        100000         // iterations of pbkdf2 to derive the aes key from the password
+#define FSA_CRYPT_NONCESIZE      12             // nonce of aes-gcm, unique for each block of an archive
+#define FSA_CRYPT_TAGSIZE        16             // authentication tag of aes-gcm
 
 #define FSA_FILEFLAGS_SPARSE     1<<0           // set when a regfile is a sparse file
 
@@ -152,6 +174,8 @@ enum {OLDERR_FATAL=1,
 #define FSA_MAGIC_BLKH           "BlKh" // datablk header (one per data block, each regfile may have [0-n])
 #define FSA_MAGIC_FILF           "FiLf" // filedat footer (one per regfile, after the list of data blocks)
 #define FSA_MAGIC_DATF           "DaEn" // data footer (one per file system, at the end of its contents, or after the contents of the flatfiles)
+#define FSA_MAGIC_CKPT           "ChKp" // checkpoint (only in the queue, never written: tells the writer where a save can be resumed)
+#define FSA_MAGIC_RUNX           "RuNx" // run index (one per run of a filesystem at the end of an archive saved with --concurrent-fs)
 
 // ------------ global variables ---------------------------
 extern char *valid_magic[];
@@ -0,0 +1,138 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ext2fs.h>
+
+#include "fsarchiver.h"
+#include "fsimage.h"
+#include "common.h"
+#include "error.h"
+
+struct s_fsimage
+{   ext2_filsys fs; // only ext2/3/4 for now: the block bitmap comes from libext2fs
+    int         fd;
+    u32         blocksize;
+    u64         size;
+    u64         usedbytes;
+};
+
+int fsimage_open(cfsimage **img, char *devpath)
+{
+    cfsimage *i;
+    errcode_t err;
+    
+    if ((i=calloc(1, sizeof(cfsimage)))==NULL)
+    {   errprintf("calloc(%ld) failed: out of memory\n", (long)sizeof(cfsimage));
+        return -1;
+    }
+    
+    if ((err=ext2fs_open(devpath, EXT2_FLAG_64BITS, 0, 0, unix_io_manager, &i->fs))!=0)
+    {   errprintf("ext2fs_open(%s) failed: %s\n", devpath, error_message(err));
+        free(i);
+        return -1;
+    }
+    if ((err=ext2fs_read_block_bitmap(i->fs))!=0)
+    {   errprintf("ext2fs_read_block_bitmap(%s) failed: %s\n", devpath, error_message(err));
+        ext2fs_close(i->fs);
+        free(i);
+        return -1;
+    }
+    if ((i->fd=open64(devpath, O_RDONLY|O_LARGEFILE))<0)
+    {   sysprintf("cannot open %s for reading\n", devpath);
+        ext2fs_close(i->fs);
+        free(i);
+        return -1;
+    }
+    
+    i->blocksize=i->fs->blocksize;
+    i->size=ext2fs_blocks_count(i->fs->super) * i->blocksize;
+    i->usedbytes=(ext2fs_blocks_count(i->fs->super) - ext2fs_free_blocks_count(i->fs->super)) * i->blocksize;
+    *img=i;
+    return 0;
+}
+
+int fsimage_close(cfsimage *img)
+{
+    if (img==NULL)
+        return -1;
+    
+    close(img->fd);
+    ext2fs_close(img->fs);
+    free(img);
+    return 0;
+}
+
+u64 fsimage_get_size(cfsimage *img)
+{
+    return img->size;
+}
+
+u64 fsimage_get_usedbytes(cfsimage *img)
+{
+    return img->usedbytes;
+}
+
+static bool fsimage_block_used(cfsimage *img, blk64_t blk)
+{
+    // the blocks before the first data block (boot sector on 1k-block filesystems) are not in the bitmap
+    if (blk < img->fs->super->s_first_data_block)
+        return true;
+    return (ext2fs_test_block_bitmap2(img->fs->block_map, blk)!=0);
+}
+
+int fsimage_read(cfsimage *img, u64 offset, char *buf, u32 size, u32 *readbytes)
+{
+    u64 first, last, blk, run;
+    u64 start, end;
+    s64 res;
+    
+    memset(buf, 0, size);
+    *readbytes=0;
+    
+    // read each run of blocks in use of that part of the device
+    end=min(offset+size, img->size);
+    first=offset / img->blocksize;
+    last=(end + img->blocksize - 1) / img->blocksize;
+    for (blk=first; blk < last; blk+=run)
+    {
+        if (fsimage_block_used(img, blk)==false)
+        {   run=1;
+            continue;
+        }
+        for (run=1; (blk+run < last) && (fsimage_block_used(img, blk+run)==true); run++);
+        
+        start=max(blk*img->blocksize, offset);
+        end=min((blk+run)*img->blocksize, min(offset+size, img->size));
+        if ((res=pread64(img->fd, buf+(start-offset), end-start, start))!=(s64)(end-start))
+        {   sysprintf("cannot read %lld bytes at offset %lld of the device\n", (long long)(end-start), (long long)start);
+            return -1;
+        }
+        *readbytes+=end-start;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifndef __FSIMAGE_H__
+#define __FSIMAGE_H__
+
+#include "types.h"
+
+struct s_fsimage;
+typedef struct s_fsimage cfsimage;
+
+// image of the blocks in use of a filesystem (option --image)
+int  fsimage_open(cfsimage **img, char *devpath);
+int  fsimage_close(cfsimage *img);
+u64  fsimage_get_size(cfsimage *img); // size of the filesystem on the device
+u64  fsimage_get_usedbytes(cfsimage *img);
+int  fsimage_read(cfsimage *img, u64 offset, char *buf, u32 size, u32 *readbytes); // the free blocks are returned as zeros
+
+#endif // __FSIMAGE_H__
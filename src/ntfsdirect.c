@@ -0,0 +1,888 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+
+#ifdef OPTION_NTFS3G_SUPPORT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include <ntfs-3g/types.h>
+#include <ntfs-3g/layout.h>
+#include <ntfs-3g/device.h>
+#include <ntfs-3g/volume.h>
+#include <ntfs-3g/inode.h>
+#include <ntfs-3g/attrib.h>
+#include <ntfs-3g/index.h>
+#include <ntfs-3g/dir.h>
+#include <ntfs-3g/unistr.h>
+#include <ntfs-3g/ntfstime.h>
+#include <ntfs-3g/security.h>
+#include <ntfs-3g/reparse.h>
+#include <ntfs-3g/xattrs.h>
+
+// the u8..u64 types come from libntfs-3g here: don't include "types.h" or "fsarchiver.h"
+#include "ntfsdirect.h"
+#include "common.h"
+#include "error.h"
+
+#ifndef ENOATTR
+#define ENOATTR ENODATA
+#endif
+
+#define NTFSDIRECT_SLOTS    2 // inodes kept open between calls: the current object and its parent
+
+// inode which stays open while the walker calls lstat/getxattr/open on the same path
+struct s_ntfsslot
+{   char        path[PATH_MAX];
+    ntfs_inode  *ni;
+};
+
+struct s_ntfsdirect
+{   ntfs_volume             *vol;
+    struct SECURITY_CONTEXT scx;
+    char                    mntpath[PATH_MAX]; // prefix of the paths passed by the walker
+    dev_t                   dev;
+    struct s_ntfsslot       slot[NTFSDIRECT_SLOTS];
+};
+
+struct s_ntfsdir
+{   char        **names;
+    u64         count;
+    u64         alloc;
+    u64         pos;
+};
+
+struct s_ntfsfile
+{   ntfs_inode  *ni;
+    ntfs_attr   *na;
+    s64         pos;
+    bool        write; // created by ntfsdirect_fcreate(): the size is set when it is closed
+};
+
+enum {NTFSSLOT_OBJECT=0, NTFSSLOT_PARENT=1};
+
+// convert a path under the mount point into a path relative to the root of the volume
+static char *ntfsdirect_relpath(cntfsdirect *nd, char *path)
+{
+    size_t len=strlen(nd->mntpath);
+    
+    if ((strncmp(path, nd->mntpath, len)!=0) || ((path[len]!=0) && (path[len]!='/')))
+        return NULL;
+    return (path[len]==0) ? "/" : path+len;
+}
+
+// open the inode of a path, or return it if it is still open from the previous call
+static ntfs_inode *ntfsdirect_inode(cntfsdirect *nd, char *path, int slotid)
+{
+    struct s_ntfsslot *slot=&nd->slot[slotid];
+    char *relpath;
+    ntfs_inode *ni;
+    int i;
+    
+    if ((relpath=ntfsdirect_relpath(nd, path))==NULL)
+    {   errno=ENOENT;
+        return NULL;
+    }
+    
+    for (i=0; i < NTFSDIRECT_SLOTS; i++)
+        if ((nd->slot[i].ni!=NULL) && (strcmp(nd->slot[i].path, relpath)==0))
+            return nd->slot[i].ni;
+    
+    if ((ni=ntfs_pathname_to_inode(nd->vol, NULL, relpath))==NULL)
+        return NULL;
+    
+    if (slot->ni!=NULL)
+        ntfs_inode_close(slot->ni);
+    snprintf(slot->path, sizeof(slot->path), "%s", relpath);
+    slot->ni=ni;
+    return ni;
+}
+
+// forget an inode which is now owned by the caller
+static void ntfsdirect_detach(cntfsdirect *nd, ntfs_inode *ni)
+{
+    int i;
+    
+    for (i=0; i < NTFSDIRECT_SLOTS; i++)
+        if (nd->slot[i].ni==ni)
+            nd->slot[i].ni=NULL;
+}
+
+static int ntfsdirect_mount(cntfsdirect **nd, char *devpath, char *mntpath, bool rw)
+{
+    struct ntfs_device *dev;
+    struct stat64 st;
+    cntfsdirect *n;
+    size_t len;
+    
+    if ((n=calloc(1, sizeof(cntfsdirect)))==NULL)
+    {   errprintf("calloc(%ld) failed: out of memory\n", (long)sizeof(cntfsdirect));
+        return -1;
+    }
+    
+    if ((dev=ntfs_device_alloc(devpath, 0, &ntfs_device_default_io_ops, NULL))==NULL)
+    {   sysprintf("ntfs_device_alloc(%s) failed\n", devpath);
+        free(n);
+        return -1;
+    }
+    if ((n->vol=ntfs_device_mount(dev, (rw==true) ? 0 : NTFS_MNT_RDONLY))==NULL)
+    {   sysprintf("cannot open the ntfs volume on %s with libntfs-3g\n", devpath);
+        ntfs_device_free(dev);
+        free(n);
+        return -1;
+    }
+    
+    // access the encrypted files as raw data as with "ntfs-3g -o efs_raw"
+    n->vol->efs_raw=TRUE;
+    
+    // the security descriptors are required to read and write system.ntfs_acl
+    if (ntfs_open_secure(n->vol)!=0)
+        msgprintf(MSG_VERB2, "cannot open $Secure on %s: the acl will not be %s\n", devpath, (rw==true) ? "restored" : "saved");
+    n->scx.vol=n->vol;
+    
+    snprintf(n->mntpath, sizeof(n->mntpath), "%s", mntpath);
+    for (len=strlen(n->mntpath); (len>0) && (n->mntpath[len-1]=='/'); len--)
+        n->mntpath[len-1]=0;
+    
+    n->dev=(stat64(devpath, &st)==0) ? st.st_rdev : 0;
+    *nd=n;
+    return 0;
+}
+
+int ntfsdirect_open(cntfsdirect **nd, char *devpath, char *mntpath)
+{
+    return ntfsdirect_mount(nd, devpath, mntpath, false);
+}
+
+int ntfsdirect_open_rw(cntfsdirect **nd, char *devpath, char *mntpath)
+{
+    return ntfsdirect_mount(nd, devpath, mntpath, true);
+}
+
+int ntfsdirect_close(cntfsdirect *nd)
+{
+    int ret=0;
+    int i;
+    
+    if (nd==NULL)
+        return -1;
+    
+    for (i=0; i < NTFSDIRECT_SLOTS; i++)
+        if (nd->slot[i].ni!=NULL)
+            ntfs_inode_close(nd->slot[i].ni);
+    ntfs_close_secure(&nd->scx);
+    // writes the mft records and the bitmaps which are still cached
+    if (ntfs_umount(nd->vol, FALSE)!=0)
+    {   sysprintf("ntfs_umount() failed\n");
+        ret=-1;
+    }
+    free(nd);
+    return ret;
+}
+
+int ntfsdirect_statfs(cntfsdirect *nd, uint64_t *bytestotal, uint64_t *bytesused)
+{
+    if (ntfs_volume_get_free_space(nd->vol)!=0)
+    {   sysprintf("ntfs_volume_get_free_space() failed\n");
+        return -1;
+    }
+    *bytestotal=(uint64_t)nd->vol->nr_clusters * (uint64_t)nd->vol->cluster_size;
+    *bytesused=*bytestotal - ((uint64_t)nd->vol->free_clusters * (uint64_t)nd->vol->cluster_size);
+    return 0;
+}
+
+// fill the stat as ntfs-3g does when the volume is mounted without the permissions option
+int ntfsdirect_lstat(cntfsdirect *nd, char *path, struct stat64 *st)
+{
+    struct timespec ts;
+    ntfs_inode *ni;
+    ntfs_attr *na;
+    char *target;
+    
+    if ((ni=ntfsdirect_inode(nd, path, NTFSSLOT_OBJECT))==NULL)
+        return -1;
+    
+    memset(st, 0, sizeof(struct stat64));
+    st->st_dev=nd->dev;
+    st->st_ino=ni->mft_no;
+    st->st_blksize=nd->vol->cluster_size;
+    
+    if ((ni->flags & FILE_ATTR_REPARSE_POINT) && ((target=ntfs_make_symlink(ni, nd->mntpath))!=NULL))
+    {   st->st_mode=S_IFLNK|0777;
+        st->st_size=strlen(target);
+        st->st_nlink=1;
+        free(target);
+    }
+    else if (ni->mrec->flags & MFT_RECORD_IS_DIRECTORY)
+    {   st->st_mode=S_IFDIR|0777;
+        st->st_nlink=1;
+        if ((na=ntfs_attr_open(ni, AT_INDEX_ALLOCATION, NTFS_INDEX_I30, 4))!=NULL)
+        {   st->st_size=na->data_size;
+            st->st_blocks=na->allocated_size >> 9;
+            ntfs_attr_close(na);
+        }
+    }
+    else
+    {   st->st_mode=S_IFREG|0777;
+        st->st_nlink=le16_to_cpu(ni->mrec->link_count);
+        if ((na=ntfs_attr_open(ni, AT_DATA, AT_UNNAMED, 0))!=NULL)
+        {   st->st_size=na->data_size;
+            if (NAttrCompressed(na) || NAttrSparse(na))
+                st->st_blocks=(na->compressed_size+511) >> 9;
+            else
+                st->st_blocks=(na->allocated_size+511) >> 9;
+            ntfs_attr_close(na);
+        }
+    }
+    
+    ts=ntfs2timespec(ni->last_access_time);
+    st->st_atime=ts.tv_sec;
+    ts=ntfs2timespec(ni->last_data_change_time);
+    st->st_mtim=ts;
+    ts=ntfs2timespec(ni->last_mft_change_time);
+    st->st_ctim=ts;
+    return 0;
+}
+
+ssize_t ntfsdirect_readlink(cntfsdirect *nd, char *path, char *buf, size_t bufsize)
+{
+    ntfs_inode *ni;
+    char *target;
+    size_t len;
+    
+    if ((ni=ntfsdirect_inode(nd, path, NTFSSLOT_OBJECT))==NULL)
+        return -1;
+    if ((target=ntfs_make_symlink(ni, nd->mntpath))==NULL)
+    {   errno=EINVAL;
+        return -1;
+    }
+    len=strlen(target);
+    if (len > bufsize)
+        len=bufsize;
+    memcpy(buf, target, len);
+    free(target);
+    return len;
+}
+
+// the named data streams are exposed as "user.<name>" as with "ntfs-3g -o streams_interface=xattr"
+ssize_t ntfsdirect_listxattr(cntfsdirect *nd, char *path, char *list, size_t size)
+{
+    ntfs_attr_search_ctx *ctx;
+    ntfschar *uname;
+    ntfs_inode *ni;
+    ssize_t total=0;
+    char *name;
+    size_t len;
+    
+    if ((ni=ntfsdirect_inode(nd, path, NTFSSLOT_OBJECT))==NULL)
+        return -1;
+    if ((ctx=ntfs_attr_get_search_ctx(ni, NULL))==NULL)
+        return -1;
+    
+    while (ntfs_attr_lookup(AT_DATA, NULL, 0, CASE_SENSITIVE, 0, NULL, 0, ctx)==0)
+    {
+        if ((ctx->attr->name_length==0) || (ctx->attr->non_resident && sle64_to_cpu(ctx->attr->lowest_vcn)!=0))
+            continue; // the unnamed stream or another extent of the same stream
+        uname=(ntfschar*)((u8*)ctx->attr + le16_to_cpu(ctx->attr->name_offset));
+        name=NULL;
+        if (ntfs_ucstombs(uname, ctx->attr->name_length, &name, 0) < 0)
+            continue; // name cannot be represented in the current locale
+        len=strlen("user.")+strlen(name)+1;
+        if ((size>0) && (total+len <= size))
+            snprintf(list+total, len, "user.%s", name);
+        else if (size>0)
+        {   free(name);
+            ntfs_attr_put_search_ctx(ctx);
+            errno=ERANGE;
+            return -1;
+        }
+        total+=len;
+        free(name);
+    }
+    
+    ntfs_attr_put_search_ctx(ctx);
+    return total;
+}
+
+ssize_t ntfsdirect_getxattr(cntfsdirect *nd, char *path, char *name, void *value, size_t size)
+{
+    char parent[PATH_MAX];
+    ntfschar *uname=NULL;
+    enum SYSTEMXATTRS attr;
+    ntfs_inode *dir_ni=NULL;
+    ntfs_inode *ni;
+    ntfs_attr *na;
+    ssize_t res;
+    int slotid;
+    int ulen;
+    char *sep;
+    
+    if (strncmp(name, "system.ntfs_", 12)==0)
+    {
+        if ((attr=ntfs_xattr_system_type(name, nd->vol))==XATTR_UNMAPPED)
+        {   errno=ENOATTR;
+            return -1;
+        }
+        if ((ni=ntfsdirect_inode(nd, path, NTFSSLOT_OBJECT))==NULL)
+            return -1;
+        // the short name is an entry of the parent directory: open it in the slot which does not hold the object
+        if (attr==XATTR_NTFS_DOS_NAME)
+        {   snprintf(parent, sizeof(parent), "%s", path);
+            if ((sep=strrchr(parent, '/'))!=NULL)
+                *sep=0;
+            slotid=(nd->slot[NTFSSLOT_PARENT].ni==ni) ? NTFSSLOT_OBJECT : NTFSSLOT_PARENT;
+            if ((dir_ni=ntfsdirect_inode(nd, parent, slotid))==NULL)
+                return -1;
+        }
+        if ((res=ntfs_xattr_system_getxattr(&nd->scx, attr, ni, dir_ni, value, size)) < 0)
+        {   errno=-res;
+            return -1;
+        }
+        return res;
+    }
+    
+    if (strncmp(name, "user.", 5)!=0)
+    {   errno=ENOATTR;
+        return -1;
+    }
+    
+    if ((ni=ntfsdirect_inode(nd, path, NTFSSLOT_OBJECT))==NULL)
+        return -1;
+    if ((ulen=ntfs_mbstoucs(name+5, &uname)) < 0)
+        return -1;
+    na=ntfs_attr_open(ni, AT_DATA, uname, ulen);
+    free(uname);
+    if (na==NULL)
+    {   errno=ENOATTR;
+        return -1;
+    }
+    
+    res=na->data_size;
+    if ((size>0) && (size < (size_t)na->data_size))
+    {   errno=ERANGE;
+        res=-1;
+    }
+    else if ((size>0) && (ntfs_attr_pread(na, 0, na->data_size, value)!=na->data_size))
+        res=-1;
+    ntfs_attr_close(na);
+    return res;
+}
+
+// keep the entries which ntfs-3g shows: the short names and the metadata files are hidden
+static int ntfsdirect_filldir(void *dirent, const ntfschar *name, const int name_len, const int name_type,
+    const s64 pos, const MFT_REF mref, const unsigned dt_type)
+{
+    cntfsdir *dir=(cntfsdir*)dirent;
+    char *filename=NULL;
+    
+    if (name_type==FILE_NAME_DOS)
+        return 0;
+    if ((MREF(mref) < FILE_first_user) && (MREF(mref)!=FILE_root))
+        return 0;
+    if (ntfs_ucstombs(name, name_len, &filename, 0) < 0)
+    {   sysprintf("cannot convert the name of inode %lld\n", (long long)MREF(mref));
+        return 0;
+    }
+    
+    if (array_grow((void**)&dir->names, &dir->alloc, dir->count, 64, sizeof(char*))!=0)
+    {   free(filename);
+        return -1;
+    }
+    dir->names[dir->count++]=filename;
+    return 0;
+}
+
+int ntfsdirect_opendir(cntfsdirect *nd, char *path, cntfsdir **dir)
+{
+    ntfs_inode *ni;
+    cntfsdir *d;
+    s64 pos=0;
+    
+    if ((ni=ntfsdirect_inode(nd, path, NTFSSLOT_PARENT))==NULL)
+        return -1;
+    if ((d=calloc(1, sizeof(cntfsdir)))==NULL)
+        return -1;
+    
+    // read all the entries now so that the inode is not kept open during the walk
+    if (ntfs_readdir(ni, &pos, d, ntfsdirect_filldir)!=0)
+    {   ntfsdirect_closedir(d);
+        return -1;
+    }
+    
+    *dir=d;
+    return 0;
+}
+
+char *ntfsdirect_readdir(cntfsdir *dir)
+{
+    if (dir->pos >= dir->count)
+        return NULL;
+    return dir->names[dir->pos++];
+}
+
+int ntfsdirect_closedir(cntfsdir *dir)
+{
+    u64 i;
+    
+    for (i=0; i < dir->count; i++)
+        free(dir->names[i]);
+    free(dir->names);
+    free(dir);
+    return 0;
+}
+
+int ntfsdirect_fopen(cntfsdirect *nd, char *path, cntfsfile **file)
+{
+    ntfs_inode *ni;
+    ntfs_attr *na;
+    cntfsfile *f;
+    
+    if ((ni=ntfsdirect_inode(nd, path, NTFSSLOT_OBJECT))==NULL)
+        return -1;
+    if ((na=ntfs_attr_open(ni, AT_DATA, AT_UNNAMED, 0))==NULL)
+        return -1;
+    if ((f=calloc(1, sizeof(cntfsfile)))==NULL)
+    {   ntfs_attr_close(na);
+        return -1;
+    }
+    
+    // the file owns the inode until ntfsdirect_fclose()
+    ntfsdirect_detach(nd, ni);
+    f->ni=ni;
+    f->na=na;
+    f->pos=0;
+    *file=f;
+    return 0;
+}
+
+ssize_t ntfsdirect_fread(cntfsfile *file, void *buf, size_t size)
+{
+    s64 res;
+    
+    if ((res=ntfs_attr_pread(file->na, file->pos, size, buf)) < 0)
+        return -1;
+    file->pos+=res;
+    return res;
+}
+
+int ntfsdirect_fclose(cntfsfile *file)
+{
+    int ret=0;
+    
+    if (file->write==true)
+    {   // a hole left at the end of a sparse file
+        if ((file->na->data_size < file->pos) && (ntfs_attr_truncate(file->na, file->pos)!=0))
+            ret=-1;
+        // the last compression block is only written when the attribute is closed
+        if (NAttrCompressed(file->na) && (ntfs_attr_pclose(file->na)!=0))
+            ret=-1;
+        ntfs_inode_update_times(file->ni, NTFS_UPDATE_MCTIME);
+    }
+    ntfs_attr_close(file->na);
+    if (ntfs_inode_close(file->ni)!=0)
+        ret=-1;
+    free(file);
+    return ret;
+}
+
+// ---- restore: the volume is written so an inode must never be open twice and the
+// slots are not used, each call opens what it needs and closes it as ntfs-3g does
+
+static ntfs_inode *ntfsdirect_lookup(cntfsdirect *nd, char *path)
+{
+    char *relpath;
+    
+    if ((relpath=ntfsdirect_relpath(nd, path))==NULL)
+    {   errno=ENOENT;
+        return NULL;
+    }
+    return ntfs_pathname_to_inode(nd->vol, NULL, relpath);
+}
+
+// open the parent directory of a path and convert the name of the entry
+static ntfs_inode *ntfsdirect_parent(cntfsdirect *nd, char *path, ntfschar **uname, int *ulen)
+{
+    char dirpath[PATH_MAX];
+    ntfs_inode *dir_ni;
+    char *relpath;
+    char *slash;
+    
+    if (((relpath=ntfsdirect_relpath(nd, path))==NULL) || ((slash=strrchr(relpath, '/'))==NULL) || (slash[1]==0))
+    {   errno=EINVAL;
+        return NULL;
+    }
+    snprintf(dirpath, sizeof(dirpath), "%.*s", (int)(slash-relpath), relpath);
+    if ((dir_ni=ntfs_pathname_to_inode(nd->vol, NULL, (dirpath[0]!=0) ? dirpath : "/"))==NULL)
+        return NULL;
+    
+    *uname=NULL;
+    if ((*ulen=ntfs_mbstoucs(slash+1, uname)) < 0)
+    {   ntfs_inode_close(dir_ni);
+        return NULL;
+    }
+    return dir_ni;
+}
+
+// create an entry in its parent directory with the default security descriptor
+static int ntfsdirect_create_entry(cntfsdirect *nd, char *path, mode_t type, dev_t dev, char *target)
+{
+    ntfschar *utarget=NULL;
+    ntfschar *uname;
+    ntfs_inode *dir_ni;
+    ntfs_inode *ni=NULL;
+    int utargetlen;
+    int ulen;
+    int ret=-1;
+    
+    if ((dir_ni=ntfsdirect_parent(nd, path, &uname, &ulen))==NULL)
+        return -1;
+    
+    if (S_ISCHR(type) || S_ISBLK(type))
+        ni=ntfs_create_device(dir_ni, const_cpu_to_le32(0), uname, ulen, type, dev);
+    else if (S_ISLNK(type))
+    {   if ((utargetlen=ntfs_mbstoucs(target, &utarget)) > 0)
+            ni=ntfs_create_symlink(dir_ni, const_cpu_to_le32(0), uname, ulen, utarget, utargetlen);
+    }
+    else
+        ni=ntfs_create(dir_ni, const_cpu_to_le32(0), uname, ulen, type);
+    
+    if (ni!=NULL)
+    {   ni->flags|=FILE_ATTR_ARCHIVE; // as ntfs-3g does for new files
+        NInoSetDirty(ni);
+        ret=ntfs_inode_close_in_dir(ni, dir_ni);
+    }
+    
+    ntfs_inode_close(dir_ni);
+    free(utarget);
+    free(uname);
+    return ret;
+}
+
+int ntfsdirect_mkdir(cntfsdirect *nd, char *path)
+{
+    char curpath[PATH_MAX];
+    ntfschar *uname;
+    ntfs_inode *dir_ni;
+    ntfs_inode *ni;
+    char *relpath;
+    char *name;
+    char *next;
+    int ulen;
+    
+    if ((relpath=ntfsdirect_relpath(nd, path))==NULL)
+    {   errno=ENOENT;
+        return -1;
+    }
+    if ((dir_ni=ntfs_inode_open(nd->vol, FILE_root))==NULL)
+        return -1;
+    
+    // walk down from the root and create the missing directories
+    snprintf(curpath, sizeof(curpath), "%s", relpath);
+    for (name=curpath; *name=='/'; name++);
+    while (*name!=0)
+    {
+        if ((next=strchr(name, '/'))!=NULL)
+            *next=0;
+        
+        if (((ni=ntfs_pathname_to_inode(nd->vol, dir_ni, name))==NULL) && (errno==ENOENT))
+        {   uname=NULL;
+            if ((ulen=ntfs_mbstoucs(name, &uname)) >= 0)
+            {   if ((ni=ntfs_create(dir_ni, const_cpu_to_le32(0), uname, ulen, S_IFDIR))!=NULL)
+                {   ni->flags|=FILE_ATTR_ARCHIVE;
+                    NInoSetDirty(ni);
+                }
+                free(uname);
+            }
+        }
+        ntfs_inode_close(dir_ni);
+        if ((dir_ni=ni)==NULL)
+            return -1;
+        
+        if (next==NULL)
+            break;
+        *next='/';
+        for (name=next+1; *name=='/'; name++);
+    }
+    
+    return ntfs_inode_close(dir_ni);
+}
+
+int ntfsdirect_create(cntfsdirect *nd, char *path)
+{
+    return ntfsdirect_create_entry(nd, path, S_IFREG, 0, NULL);
+}
+
+int ntfsdirect_symlink(cntfsdirect *nd, char *target, char *path)
+{
+    return ntfsdirect_create_entry(nd, path, S_IFLNK, 0, target);
+}
+
+// the devices, fifos and sockets are stored as interix files as ntfs-3g does
+int ntfsdirect_mknod(cntfsdirect *nd, char *path, mode_t mode, dev_t dev)
+{
+    return ntfsdirect_create_entry(nd, path, mode & S_IFMT, dev, NULL);
+}
+
+int ntfsdirect_link(cntfsdirect *nd, char *oldpath, char *newpath)
+{
+    ntfschar *uname;
+    ntfs_inode *dir_ni;
+    ntfs_inode *ni;
+    int ulen;
+    int ret;
+    
+    if ((ni=ntfsdirect_lookup(nd, oldpath))==NULL)
+        return -1;
+    if ((dir_ni=ntfsdirect_parent(nd, newpath, &uname, &ulen))==NULL)
+    {   ntfs_inode_close(ni);
+        return -1;
+    }
+    
+    if ((ret=ntfs_link(ni, dir_ni, uname, ulen))==0)
+    {   ntfs_inode_update_times(ni, NTFS_UPDATE_CTIME);
+        ntfs_inode_update_times(dir_ni, NTFS_UPDATE_MCTIME);
+    }
+    
+    free(uname);
+    if (ntfs_inode_close(dir_ni)!=0)
+        ret=-1;
+    if (ntfs_inode_close(ni)!=0)
+        ret=-1;
+    return ret;
+}
+
+int ntfsdirect_unlink(cntfsdirect *nd, char *path)
+{
+    ntfschar *uname;
+    ntfs_inode *dir_ni;
+    ntfs_inode *ni;
+    char *relpath;
+    int ulen;
+    int ret;
+    
+    if ((relpath=ntfsdirect_relpath(nd, path))==NULL)
+    {   errno=ENOENT;
+        return -1;
+    }
+    if ((ni=ntfsdirect_lookup(nd, path))==NULL)
+        return -1;
+    if ((dir_ni=ntfsdirect_parent(nd, path, &uname, &ulen))==NULL)
+    {   ntfs_inode_close(ni);
+        return -1;
+    }
+    
+    // ntfs_delete() closes both inodes even when it fails
+    ret=ntfs_delete(nd->vol, relpath, ni, dir_ni, uname, ulen);
+    free(uname);
+    return ret;
+}
+
+int ntfsdirect_truncate(cntfsdirect *nd, char *path)
+{
+    ntfs_inode *ni;
+    ntfs_attr *na;
+    int ret=-1;
+    
+    if ((ni=ntfsdirect_lookup(nd, path))==NULL)
+        return -1;
+    if ((na=ntfs_attr_open(ni, AT_DATA, AT_UNNAMED, 0))!=NULL)
+    {   if ((ret=ntfs_attr_truncate(na, 0))==0)
+            ntfs_inode_update_times(ni, NTFS_UPDATE_MCTIME);
+        ntfs_attr_close(na);
+    }
+    if (ntfs_inode_close(ni)!=0)
+        ret=-1;
+    return ret;
+}
+
+int ntfsdirect_gettimes(cntfsdirect *nd, char *path, uint64_t *atime, uint64_t *mtime)
+{
+    ntfs_inode *ni;
+    
+    if ((ni=ntfsdirect_lookup(nd, path))==NULL)
+        return -1;
+    *atime=ntfs2timespec(ni->last_access_time).tv_sec;
+    *mtime=ntfs2timespec(ni->last_data_change_time).tv_sec;
+    return ntfs_inode_close(ni);
+}
+
+// the owner and the permissions are not stored by ntfs-3g without the permissions option
+int ntfsdirect_settimes(cntfsdirect *nd, char *path, uint64_t atime, uint64_t mtime)
+{
+    struct timespec ts;
+    ntfs_inode *ni;
+    
+    if ((ni=ntfsdirect_lookup(nd, path))==NULL)
+        return -1;
+    
+    ts.tv_nsec=0;
+    ts.tv_sec=atime;
+    ni->last_access_time=timespec2ntfs(ts);
+    ts.tv_sec=mtime;
+    ni->last_data_change_time=timespec2ntfs(ts);
+    ni->last_mft_change_time=ntfs_current_time();
+    NInoFileNameSetDirty(ni);
+    NInoSetDirty(ni);
+    return ntfs_inode_close(ni);
+}
+
+// "system.ntfs_*" go to libntfs-3g and "user.<name>" are the named data streams
+int ntfsdirect_setxattr(cntfsdirect *nd, char *path, char *name, void *value, size_t size)
+{
+    enum SYSTEMXATTRS attr;
+    ntfs_inode *dir_ni;
+    ntfschar *uname;
+    ntfs_inode *ni;
+    ntfs_attr *na;
+    s64 total, part;
+    int ulen;
+    int ret;
+    
+    if (strncmp(name, "system.ntfs_", 12)==0)
+    {
+        if ((attr=ntfs_xattr_system_type(name, nd->vol))==XATTR_UNMAPPED)
+        {   errno=EOPNOTSUPP;
+            return -1;
+        }
+        if ((ni=ntfsdirect_lookup(nd, path))==NULL)
+            return -1;
+        // the short name is changed in the parent directory and libntfs-3g closes both inodes
+        if (attr==XATTR_NTFS_DOS_NAME)
+        {   if ((dir_ni=ntfsdirect_parent(nd, path, &uname, &ulen))==NULL)
+            {   ntfs_inode_close(ni);
+                return -1;
+            }
+            free(uname);
+            return ntfs_xattr_system_setxattr(&nd->scx, attr, ni, dir_ni, value, size, 0);
+        }
+        ret=ntfs_xattr_system_setxattr(&nd->scx, attr, ni, NULL, value, size, 0);
+        if (ntfs_inode_close(ni)!=0)
+            ret=-1;
+        return ret;
+    }
+    
+    if (strncmp(name, "user.", 5)!=0)
+    {   errno=EOPNOTSUPP;
+        return -1;
+    }
+    
+    if ((ni=ntfsdirect_lookup(nd, path))==NULL)
+        return -1;
+    uname=NULL;
+    if ((ulen=ntfs_mbstoucs(name+5, &uname)) < 0)
+    {   ntfs_inode_close(ni);
+        return -1;
+    }
+    
+    // replace the contents of the stream or create it
+    if ((na=ntfs_attr_open(ni, AT_DATA, uname, ulen))!=NULL)
+        ret=ntfs_attr_truncate(na, 0);
+    else if ((ret=ntfs_attr_add(ni, AT_DATA, uname, ulen, NULL, 0))==0)
+    {   ni->flags|=FILE_ATTR_ARCHIVE;
+        NInoFileNameSetDirty(ni);
+        if ((na=ntfs_attr_open(ni, AT_DATA, uname, ulen))==NULL)
+            ret=-1;
+    }
+    free(uname);
+    
+    for (total=0, part=1; (ret==0) && (total < (s64)size) && (part > 0); total+=part)
+        if ((part=ntfs_attr_pwrite(na, total, size-total, (char*)value+total)) <= 0)
+            ret=-1;
+    if ((na!=NULL) && (ret==0) && (ntfs_attr_pclose(na)!=0))
+        ret=-1;
+    
+    if (na!=NULL)
+        ntfs_attr_close(na);
+    if (ntfs_inode_close(ni)!=0)
+        ret=-1;
+    return ret;
+}
+
+ssize_t ntfsdirect_readfile(cntfsdirect *nd, char *path, void *buf, size_t size)
+{
+    ntfs_inode *ni;
+    ntfs_attr *na;
+    ssize_t res=-1;
+    
+    if ((ni=ntfsdirect_lookup(nd, path))==NULL)
+        return -1;
+    if ((na=ntfs_attr_open(ni, AT_DATA, AT_UNNAMED, 0))!=NULL)
+    {   res=ntfs_attr_pread(na, 0, size, buf);
+        ntfs_attr_close(na);
+    }
+    ntfs_inode_close(ni);
+    return res;
+}
+
+// the regular file is created as with creat() and stays open until ntfsdirect_fclose()
+int ntfsdirect_fcreate(cntfsdirect *nd, char *path, cntfsfile **file)
+{
+    ntfs_inode *ni;
+    ntfs_attr *na;
+    cntfsfile *f;
+    
+    if (ntfsdirect_create(nd, path)!=0)
+        return -1;
+    if ((ni=ntfsdirect_lookup(nd, path))==NULL)
+        return -1;
+    if ((na=ntfs_attr_open(ni, AT_DATA, AT_UNNAMED, 0))==NULL)
+    {   ntfs_inode_close(ni);
+        return -1;
+    }
+    if ((f=calloc(1, sizeof(cntfsfile)))==NULL)
+    {   ntfs_attr_close(na);
+        ntfs_inode_close(ni);
+        return -1;
+    }
+    
+    f->ni=ni;
+    f->na=na;
+    f->pos=0;
+    f->write=true;
+    *file=f;
+    return 0;
+}
+
+int ntfsdirect_fwrite(cntfsfile *file, void *data, size_t len)
+{
+    size_t total;
+    s64 part;
+    
+    for (total=0; total < len; total+=part)
+        if ((part=ntfs_attr_pwrite(file->na, file->pos+total, len-total, (char*)data+total)) <= 0)
+            return -1;
+    file->pos+=len;
+    return 0;
+}
+
+int ntfsdirect_fskip(cntfsfile *file, size_t len)
+{
+    file->pos+=len;
+    return 0;
+}
+
+#endif // OPTION_NTFS3G_SUPPORT
@@ -0,0 +1,70 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifndef __NTFSDIRECT_H__
+#define __NTFSDIRECT_H__
+
+// this header is included next to the headers of libntfs-3g which have their
+// own definitions of u8..u64 so it only uses the standard types
+
+#include <sys/types.h>
+#include <stdint.h>
+
+struct stat64;
+
+struct s_ntfsdirect;
+typedef struct s_ntfsdirect cntfsdirect;
+
+struct s_ntfsdir;
+typedef struct s_ntfsdir cntfsdir;
+
+struct s_ntfsfile;
+typedef struct s_ntfsfile cntfsfile;
+
+// the paths passed to these functions are the full paths under the mount point
+// given to ntfsdirect_open() so that they can replace the syscalls in the walker
+// and in the restore (the volume is then opened with ntfsdirect_open_rw())
+int     ntfsdirect_open(cntfsdirect **nd, char *devpath, char *mntpath); // open an unmounted volume read-only
+int     ntfsdirect_open_rw(cntfsdirect **nd, char *devpath, char *mntpath);
+int     ntfsdirect_close(cntfsdirect *nd);
+int     ntfsdirect_statfs(cntfsdirect *nd, uint64_t *bytestotal, uint64_t *bytesused);
+int     ntfsdirect_lstat(cntfsdirect *nd, char *path, struct stat64 *st);
+ssize_t ntfsdirect_readlink(cntfsdirect *nd, char *path, char *buf, size_t bufsize);
+ssize_t ntfsdirect_listxattr(cntfsdirect *nd, char *path, char *list, size_t size);
+ssize_t ntfsdirect_getxattr(cntfsdirect *nd, char *path, char *name, void *value, size_t size);
+int     ntfsdirect_opendir(cntfsdirect *nd, char *path, cntfsdir **dir);
+char    *ntfsdirect_readdir(cntfsdir *dir);
+int     ntfsdirect_closedir(cntfsdir *dir);
+int     ntfsdirect_fopen(cntfsdirect *nd, char *path, cntfsfile **file);
+ssize_t ntfsdirect_fread(cntfsfile *file, void *buf, size_t size);
+int     ntfsdirect_fclose(cntfsfile *file);
+int     ntfsdirect_mkdir(cntfsdirect *nd, char *path); // creates the parents too, like mkdir_recursive()
+int     ntfsdirect_create(cntfsdirect *nd, char *path); // empty regular file
+int     ntfsdirect_symlink(cntfsdirect *nd, char *target, char *path);
+int     ntfsdirect_mknod(cntfsdirect *nd, char *path, mode_t mode, dev_t dev);
+int     ntfsdirect_link(cntfsdirect *nd, char *oldpath, char *newpath);
+int     ntfsdirect_unlink(cntfsdirect *nd, char *path);
+int     ntfsdirect_truncate(cntfsdirect *nd, char *path);
+int     ntfsdirect_gettimes(cntfsdirect *nd, char *path, uint64_t *atime, uint64_t *mtime);
+int     ntfsdirect_settimes(cntfsdirect *nd, char *path, uint64_t atime, uint64_t mtime);
+int     ntfsdirect_setxattr(cntfsdirect *nd, char *path, char *name, void *value, size_t size);
+ssize_t ntfsdirect_readfile(cntfsdirect *nd, char *path, void *buf, size_t size);
+int     ntfsdirect_fcreate(cntfsdirect *nd, char *path, cntfsfile **file); // new file closed with ntfsdirect_fclose()
+int     ntfsdirect_fwrite(cntfsfile *file, void *data, size_t len);
+int     ntfsdirect_fskip(cntfsfile *file, size_t len); // leave a hole
+
+#endif // __NTFSDIRECT_H__
@@ -28,6 +28,7 @@
 #include <errno.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <pthread.h>
 #include <gcrypt.h>
 #include <uuid.h>
 
@@ -55,6 +56,21 @@
 #include "error.h"
 #include "datafile.h"
 #include "queue.h"
+#include "catalog.h"
+#include "dedup.h"
+#include "reflink.h"
+#include "exclude.h"
+#include "extdirect.h"
+#include "ntfsdirect.h"
+
+// times of a directory restored from an incremental archive: set again after each base archive
+typedef struct s_dirtime
+{   struct s_dirtime *next;
+    u16         fsid;
+    u64         atime;
+    u64         mtime;
+    char        relpath[];
+} cdirtime;
 
 typedef struct s_extractar
 {   carchreader ai;
@@ -62,51 +78,142 @@ typedef struct s_extractar
     cstats      stats;
     u64         cost_global;
     u64         cost_current;
+    ccatalog    *pending; // files of an incremental archive which are stored in a base archive
+    cdirtime    **dirtimes; // directories of an incremental archive (only kept when base archives are given)
+    bool        basepass; // true when reading a base archive to complete an incremental restore
+    cqueue      *queue; // where the objects are read from: g_queue or the queue of that filesystem
+    cdedupcache *dedupcache; // contents of the last small files restored (archives saved with --dedup)
+    cextdirect  *ext; // filesystem written with libext2fs instead of being mounted (option --ext-direct)
+    cntfsdirect *ntfs; // volume written with libntfs-3g instead of a fuse mount (option --ntfs-direct)
+    bool        inclstop; // nothing is needed after this filesystem: stop once the include patterns are complete
+    u8          *inclstate; // how far the objects read are from the anchor of each include pattern
+    bool        incldone; // the objects which match the include patterns have all been restored
 } cextractar;
 
+// where the archive is compared to the anchor of an include pattern
+enum {INCLUDE_PENDING=0, INCLUDE_INSIDE, INCLUDE_LEFT, INCLUDE_FLUSHED, INCLUDE_DONE};
+
+// a filesystem restored at the same time as the others (restfs --concurrent-fs)
+typedef struct s_restfsjob
+{   cextractar  exar;
+    cqueue      queue; // headers and blocks of that filesystem routed by the reader
+    cdico       *dicofs;
+    cstrdico    *dicocmdline;
+    pthread_t   thread_decomp[FSA_MAX_COMPJOBS];
+    pthread_t   thread;
+    pthread_t   thread_drain; // empties the queue when that filesystem is not restored
+    int         ret;
+} crestfsjob;
+
+// protects the list of pending files and the directory times when filesystems are restored concurrently
+static pthread_mutex_t g_pendingmutex=PTHREAD_MUTEX_INITIALIZER;
+
+// mkfs, mount and the other hooks of filesys[] run external commands and use static buffers: one at a time
+static pthread_mutex_t g_fsopsmutex=PTHREAD_MUTEX_INITIALIZER;
+
 // returns true if this file of a parent directory has been excluded
 int is_filedir_excluded(char *relpath)
 {
     char dirpath[PATH_MAX];
     char basename[PATH_MAX];
-    int pos;
     
     // check if that particular file has been excluded
     extract_basename(relpath, basename, sizeof(basename));
     
-    if ((exclude_check(&g_options.exclude, basename)==true) // is filename excluded ?
-        || (exclude_check(&g_options.exclude, relpath)==true)) // is filepath excluded ?
+    if ((exclude_match(&g_exclude, basename)==true) // is filename excluded ?
+        || (exclude_match(&g_exclude, relpath)==true)) // is filepath excluded ?
     {
         msgprintf(MSG_VERB2, "file/dir=[%s] excluded because of its own name/path\n", relpath);
         return true;
     }
     
-    // check if that file belongs to a directory which has been excluded
-    snprintf(dirpath, sizeof(dirpath), "%s", relpath);
-    for (pos=0; dirpath[pos]; pos++); // go to the end of the string
-    while (pos>0)
+    // check if that file belongs to a directory which has been excluded (one lookup once the parent is cached)
+    extract_dirpath(relpath, dirpath, sizeof(dirpath));
+    if (exclude_match_dir(&g_exclude, dirpath)==true)
     {
-        // dirpath=parent_directory(dirpath)
-        while ((pos>=0) && (dirpath[pos]!='/'))
-            dirpath[pos--]=0;
-        if ((pos>0) && (dirpath[pos]=='/'))
-            dirpath[pos]=0;
-        extract_basename(dirpath, basename, sizeof(basename));
-        
-        if (strlen(dirpath)>1 && strlen(basename)>0)
-        {
-            if ((exclude_check(&g_options.exclude, basename)==true)
-                || (exclude_check(&g_options.exclude, dirpath)==true))
-            {
-                msgprintf(MSG_VERB2, "file/dir=[%s] excluded because of its parent=[%s]\n", relpath, dirpath);
-                return true; // a parent directory is excluded
-            }
-        }
+        msgprintf(MSG_VERB2, "file/dir=[%s] excluded because of its parent=[%s] or one of its parents\n", relpath, dirpath);
+        return true; // a parent directory is excluded
+    }
+    
+    // with include patterns only what they match and the directories on the way to it are restored
+    if ((g_include.count > 0) && (exclude_match(&g_include, basename)==false) && (exclude_match(&g_include, relpath)==false) &&
+        (exclude_match_dir(&g_include, dirpath)==false) && (exclude_match_parent(&g_include, relpath)==false))
+    {
+        msgprintf(MSG_VERB2, "file/dir=[%s] excluded because it does not match any include pattern\n", relpath);
+        return true;
     }
     
     return false; // no exclusion found for that file
 }
 
+// the objects are written in the order of the walk: a directory and then all what it contains, except the small
+// files which are packed together and written later. once an object read is not in the anchor of a pattern
+// any more, the small files of that anchor which are left are all in the next groups of small files, which
+// are all queued at once (one per type with --group-small-files) before the next object
+void extractar_include_progress(cextractar *exar, char *relpath, u32 objtype)
+{
+    bool inside;
+    char *anchor;
+    int len;
+    int i;
+    
+    if (exar->inclstate==NULL)
+        return;
+    
+    for (i=0; i < g_include.anchorcount; i++)
+    {
+        anchor=g_include.anchors[i];
+        len=strlen(anchor);
+        inside=(strncmp(relpath, anchor, len)==0) && ((relpath[len]==0) || (relpath[len]=='/'));
+        
+        if ((exar->inclstate[i]==INCLUDE_PENDING) && (inside==true) && (relpath[len]==0) && (objtype!=OBJTYPE_DIR))
+            exar->inclstate[i]=INCLUDE_DONE; // the anchor is a file: nothing else can match
+        else if ((exar->inclstate[i]==INCLUDE_PENDING) && (inside==true) && (objtype!=OBJTYPE_REGFILEMULTI))
+            exar->inclstate[i]=INCLUDE_INSIDE;
+        else if ((exar->inclstate[i]==INCLUDE_INSIDE) && (inside==false) && (objtype!=OBJTYPE_REGFILEMULTI))
+            exar->inclstate[i]=INCLUDE_LEFT;
+        else if ((exar->inclstate[i]==INCLUDE_FLUSHED) && (objtype!=OBJTYPE_REGFILEMULTI))
+            exar->inclstate[i]=INCLUDE_DONE;
+    }
+}
+
+// returns true when no object left in the archive can match an include pattern
+bool extractar_include_complete(cextractar *exar, bool multigroup)
+{
+    bool complete=true;
+    int i;
+    
+    if (exar->inclstate==NULL)
+        return false;
+    
+    for (i=0; i < g_include.anchorcount; i++)
+    {
+        if ((multigroup==true) && (exar->inclstate[i]==INCLUDE_LEFT))
+            exar->inclstate[i]=INCLUDE_FLUSHED;
+        if (exar->inclstate[i]!=INCLUDE_DONE)
+            complete=false;
+    }
+    
+    return complete;
+}
+
+// returns true if that regular file must not be restored during the current pass
+int extractar_is_regfile_skipped(cextractar *exar, char *relpath)
+{
+    ccatalogitem *item;
+    int skipped;
+    
+    if (exar->basepass==false)
+        return is_filedir_excluded(relpath);
+    
+    // in a base archive only restore the files which are missing from the incremental archive
+    assert(pthread_mutex_lock(&g_pendingmutex)==0);
+    item=catalog_get(exar->pending, exar->fsid, relpath);
+    skipped=((item==NULL) || (item->archid!=exar->ai.archid));
+    assert(pthread_mutex_unlock(&g_pendingmutex)==0);
+    return skipped;
+}
+
 // convert an array of strings "id=x,dest=/dev/xxx,..." to an array of strdico
 int convert_argv_to_strdicos(cstrdico *dicoargv[], int argc, char *cmdargv[])
 {
@@ -182,6 +289,184 @@ int extractar_listing_print_file(cextractar *exar, int objtype, char *relpath)
     return 0;
 }
 
+// the restore of the objects goes through these functions so that ext filesystems
+// can also be populated with libext2fs without being mounted (option --ext-direct)
+// and ntfs volumes with libntfs-3g without a fuse mount (option --ntfs-direct)
+int extractar_mkdir(cextractar *exar, char *path)
+{
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (exar->ext!=NULL)
+        return extdirect_mkdir(exar->ext, path);
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (exar->ntfs!=NULL)
+        return ntfsdirect_mkdir(exar->ntfs, path);
+#endif
+    return mkdir_recursive(path);
+}
+
+int extractar_get_parent_time(cextractar *exar, char *fullpath, char *parentdir, int size, struct timeval *tv)
+{
+#ifdef OPTION_NTFS3G_SUPPORT
+    uint64_t atime, mtime;
+#endif
+    
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (exar->ext!=NULL) // libext2fs does not update the times of the parent directory
+        return 0;
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (exar->ntfs!=NULL)
+    {   extract_dirpath(fullpath, parentdir, size);
+        if (ntfsdirect_gettimes(exar->ntfs, parentdir, &atime, &mtime)!=0)
+        {   sysprintf("cannot get the times of [%s]\n", parentdir);
+            return -1;
+        }
+        tv[0].tv_usec=0;
+        tv[0].tv_sec=atime;
+        tv[1].tv_usec=0;
+        tv[1].tv_sec=mtime;
+        return 0;
+    }
+#endif
+    return get_parent_dir_time_attrib(fullpath, parentdir, size, tv);
+}
+
+int extractar_set_parent_time(cextractar *exar, char *parentdir, struct timeval *tv)
+{
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (exar->ext!=NULL)
+        return 0;
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (exar->ntfs!=NULL)
+        return ntfsdirect_settimes(exar->ntfs, parentdir, tv[0].tv_sec, tv[1].tv_sec);
+#endif
+    return utimes(parentdir, tv);
+}
+
+int extractar_symlink(cextractar *exar, char *target, char *path)
+{
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (exar->ext!=NULL)
+        return extdirect_symlink(exar->ext, target, path);
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (exar->ntfs!=NULL)
+        return ntfsdirect_symlink(exar->ntfs, target, path);
+#endif
+    return symlink(target, path);
+}
+
+// create an empty regular file
+int extractar_create_file(cextractar *exar, char *path)
+{
+    int fd;
+    
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (exar->ntfs!=NULL)
+        return ntfsdirect_create(exar->ntfs, path);
+#endif
+    if ((fd=creat(path, 0644)) < 0)
+        return -1;
+    close(fd);
+    return 0;
+}
+
+int extractar_link(cextractar *exar, char *oldpath, char *newpath)
+{
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (exar->ext!=NULL)
+        return extdirect_link(exar->ext, oldpath, newpath);
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (exar->ntfs!=NULL)
+        return ntfsdirect_link(exar->ntfs, oldpath, newpath);
+#endif
+    return link(oldpath, newpath);
+}
+
+int extractar_mknod(cextractar *exar, char *path, u32 mode, u64 dev)
+{
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (exar->ext!=NULL)
+        return extdirect_mknod(exar->ext, path, mode, dev);
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (exar->ntfs!=NULL)
+        return ntfsdirect_mknod(exar->ntfs, path, mode, dev);
+#endif
+    return mknod(path, mode, dev);
+}
+
+int extractar_unlink(cextractar *exar, char *path)
+{
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (exar->ext!=NULL)
+        return extdirect_unlink(exar->ext, path);
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (exar->ntfs!=NULL)
+        return ntfsdirect_unlink(exar->ntfs, path);
+#endif
+    return unlink(path);
+}
+
+int extractar_truncate(cextractar *exar, char *path)
+{
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (exar->ext!=NULL)
+        return extdirect_truncate(exar->ext, path);
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (exar->ntfs!=NULL)
+        return ntfsdirect_truncate(exar->ntfs, path);
+#endif
+    return truncate(path, 0);
+}
+
+int extractar_setxattr(cextractar *exar, char *path, char *name, void *value, u64 size)
+{
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (exar->ext!=NULL)
+        return extdirect_setxattr(exar->ext, path, name, value, size);
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (exar->ntfs!=NULL)
+        return ntfsdirect_setxattr(exar->ntfs, path, name, value, size);
+#endif
+    return lsetxattr(path, name, value, size, 0);
+}
+
+int extractar_open_datafile(cextractar *exar, cdatafile *datafile, char *path, bool simul, bool sparse, u64 size)
+{
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (exar->ntfs!=NULL)
+        return datafile_open_write_ntfs(datafile, exar->ntfs, path, simul, sparse);
+#endif
+    return datafile_open_write_ext(datafile, exar->ext, path, simul, sparse, size);
+}
+
+s64 extractar_read_file(cextractar *exar, char *path, char *buf, u64 size)
+{
+    s64 res;
+    int fd;
+    
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (exar->ext!=NULL)
+        return extdirect_readfile(exar->ext, path, buf, size);
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (exar->ntfs!=NULL)
+        return ntfsdirect_readfile(exar->ntfs, path, buf, size);
+#endif
+    if ((fd=open64(path, O_RDONLY|O_LARGEFILE))<0)
+        return -1;
+    res=read(fd, buf, (long)size);
+    close(fd);
+    return res;
+}
+
 int extractar_restore_attr_xattr(cextractar *exar, u32 objtype, char *fullpath, char *relpath, cdico *dicoattr)
 {
     char xattrname[2048];
@@ -211,7 +496,7 @@ int extractar_restore_attr_xattr(cextractar *exar, u32 objtype, char *fullpath,
             continue;
         }
         
-        if ((res=lsetxattr(fullpath, xattrname, xattrvalue, xattrdatasize, 0))!=0)
+        if ((res=extractar_setxattr(exar, fullpath, xattrname, xattrvalue, xattrdatasize))!=0)
         {   sysprintf("xattr:lsetxattr(%s,%s) failed\n", relpath, xattrname);
             ret=-1;
         }
@@ -252,7 +537,7 @@ int extractar_restore_attr_windows(cextractar *exar, u32 objtype, char *fullpath
             continue;
         }
         
-        if ((res=lsetxattr(fullpath, xattrname, xattrvalue, xattrdatasize, 0))!=0)
+        if ((res=extractar_setxattr(exar, fullpath, xattrname, xattrvalue, xattrdatasize))!=0)
         {
             sysprintf("winattr:lsetxattr(%s,%s) failed\n", relpath, xattrname);
             ret=-1;
@@ -283,6 +568,21 @@ int extractar_restore_attr_std(cextractar *exar, u32 objtype, char *fullpath, ch
     if (dico_get_u64(dicoattr, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_MTIME, &mtime)!=0)
         return -5;
     
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (exar->ext!=NULL)
+        return (extdirect_setattr(exar->ext, fullpath, mode, uid, gid, atime, mtime)==0) ? 0 : -6;
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    // the owner and the permissions are ignored by ntfs-3g without the permissions option
+    if (exar->ntfs!=NULL)
+    {   if (ntfsdirect_settimes(exar->ntfs, fullpath, atime, mtime)!=0)
+        {   sysprintf("cannot set the times of [%s]\n", relpath);
+            return -8;
+        }
+        return 0;
+    }
+#endif
+    
     if (lchown(fullpath, (uid_t)uid, (gid_t)gid)!=0)
     {   sysprintf("Cannot lchown(%s) which is %s\n", fullpath, get_objtype_name(objtype));
         return -6;
@@ -342,7 +642,6 @@ int extractar_restore_obj_symlink(cextractar *exar, char *fullpath, char *relpat
     struct timeval tv[2];
     char buffer[PATH_MAX];
     u64 targettype;
-    int fdtemp;
     
     // update cost statistics and progress bar
     exar->cost_current+=FSA_COST_PER_FILE; 
@@ -356,10 +655,10 @@ int extractar_restore_obj_symlink(cextractar *exar, char *fullpath, char *relpat
 
     // create parent directory first
     extract_dirpath(fullpath, parentdir, sizeof(parentdir));
-    mkdir_recursive(parentdir);
+    extractar_mkdir(exar, parentdir);
     
     // backup parent dir atime/mtime
-    get_parent_dir_time_attrib(fullpath, parentdir, sizeof(parentdir), tv);
+    extractar_get_parent_time(exar, fullpath, parentdir, sizeof(parentdir), tv);
     
     if (dico_get_string(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_SYMLINK, buffer, PATH_MAX)<0)
     {   errprintf("Cannot read field=symlink for file=[%s]\n", fullpath);
@@ -374,18 +673,17 @@ int extractar_restore_obj_symlink(cextractar *exar, char *fullpath, char *relpat
         {
             case OBJTYPE_DIR:
                 msgprintf(MSG_DEBUG1, "LINK: mklink=[%s], target=[%s], targettype=DIR\n", relpath, buffer);
-                if (mkdir_recursive(fullpath)!=0)
+                if (extractar_mkdir(exar, fullpath)!=0)
                 {   errprintf("Cannot create directory for ntfs symlink: path=[%s]\n", fullpath);
                     goto extractar_restore_obj_symlink_err;
                 }
                 break;
             case OBJTYPE_REGFILEUNIQUE:
                 msgprintf(MSG_DEBUG1, "LINK: mklink=[%s], target=[%s], targettype=REGFILE\n", relpath, buffer);
-                if ( (fdtemp=creat(fullpath, 0644)) < 0)
+                if (extractar_create_file(exar, fullpath)!=0)
                 {   errprintf("Cannot create file for ntfs symlink: path=[%s]\n", fullpath);
                     goto extractar_restore_obj_symlink_err;
                 }
-                close(fdtemp);
                 break;
             default:
                 msgprintf(MSG_DEBUG1, "LINK: mklink=[%s], target=[%s], targettype=UNKNOWN\n", relpath, buffer);
@@ -397,7 +695,7 @@ int extractar_restore_obj_symlink(cextractar *exar, char *fullpath, char *relpat
     else // normal symbolic link for linux filesystems
     {
         msgprintf(MSG_DEBUG1, "LINK: symlink=[%s], target=[%s] (normal symlink)\n", relpath, buffer);
-        if (symlink(buffer, fullpath)<0)
+        if (extractar_symlink(exar, buffer, fullpath)<0)
         {   sysprintf("symlink(%s, %s) failed\n", buffer, fullpath);
             goto extractar_restore_obj_symlink_err;
         }
@@ -409,7 +707,7 @@ int extractar_restore_obj_symlink(cextractar *exar, char *fullpath, char *relpat
     }
     
     // restore parent dir mtime/atime
-    if (utimes(parentdir, tv)!=0)
+    if (extractar_set_parent_time(exar, parentdir, tv)!=0)
     {   sysprintf("utimes(%s) failed\n", parentdir);
         goto extractar_restore_obj_symlink_err;
     }
@@ -441,10 +739,10 @@ int extractar_restore_obj_hardlink(cextractar *exar, char *fullpath, char *relpa
     
     // create parent directory first
     extract_dirpath(fullpath, parentdir, sizeof(parentdir));
-    mkdir_recursive(parentdir);
+    extractar_mkdir(exar, parentdir);
     
     // backup parent dir atime/mtime
-    get_parent_dir_time_attrib(fullpath, parentdir, sizeof(parentdir), tv);
+    extractar_get_parent_time(exar, fullpath, parentdir, sizeof(parentdir), tv);
     
     // update progress bar
     extractar_listing_print_file(exar, objtype, relpath);
@@ -456,7 +754,7 @@ int extractar_restore_obj_hardlink(cextractar *exar, char *fullpath, char *relpa
     
     concatenate_paths(regfile, PATH_MAX, destdir, buffer);
     
-    if ((res=link(regfile, fullpath))!=0)
+    if ((res=extractar_link(exar, regfile, fullpath))!=0)
     {   sysprintf("link(%s, %s) failed\n", regfile, fullpath);
         goto extractar_restore_obj_hardlink_err;
     }
@@ -467,7 +765,7 @@ int extractar_restore_obj_hardlink(cextractar *exar, char *fullpath, char *relpa
     }
     
     // restore parent dir mtime/atime
-    if (utimes(parentdir, tv)!=0)
+    if (extractar_set_parent_time(exar, parentdir, tv)!=0)
     {   sysprintf("utimes(%s) failed\n", parentdir);
         goto extractar_restore_obj_hardlink_err;
     }
@@ -498,10 +796,10 @@ int extractar_restore_obj_devfile(cextractar *exar, char *fullpath, char *relpat
     
     // create parent directory first
     extract_dirpath(fullpath, parentdir, sizeof(parentdir));
-    mkdir_recursive(parentdir);
+    extractar_mkdir(exar, parentdir);
     
     // backup parent dir atime/mtime
-    get_parent_dir_time_attrib(fullpath, parentdir, sizeof(parentdir), tv);
+    extractar_get_parent_time(exar, fullpath, parentdir, sizeof(parentdir), tv);
     
     // update progress bar
     extractar_listing_print_file(exar, objtype, relpath);
@@ -510,7 +808,7 @@ int extractar_restore_obj_devfile(cextractar *exar, char *fullpath, char *relpat
         goto extractar_restore_obj_devfile_err;
     if (dico_get_u32(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_MODE, &mode)!=0)
         goto extractar_restore_obj_devfile_err;
-    if (mknod(fullpath, mode, dev)!=0)
+    if (extractar_mknod(exar, fullpath, mode, dev)!=0)
     {   sysprintf("mknod failed on [%s]\n", relpath);
         goto extractar_restore_obj_devfile_err;
     }
@@ -520,7 +818,7 @@ int extractar_restore_obj_devfile(cextractar *exar, char *fullpath, char *relpat
     }
     
     // restore parent dir mtime/atime
-    if (utimes(parentdir, tv)!=0)
+    if (extractar_set_parent_time(exar, parentdir, tv)!=0)
     {   sysprintf("utimes(%s) failed\n", parentdir);
         goto extractar_restore_obj_devfile_err;
     }
@@ -535,6 +833,70 @@ extractar_restore_obj_devfile_err:
     return 0; // non fatal error
 }
 
+int extractar_dirtime_add(cextractar *exar, char *relpath, cdico *d)
+{
+    cdirtime *dirtime;
+    
+    if ((dirtime=malloc(sizeof(cdirtime)+strlen(relpath)+1))==NULL)
+    {   errprintf("malloc(%ld) failed: out of memory\n", (long)(sizeof(cdirtime)+strlen(relpath)+1));
+        return -1;
+    }
+    if ((dico_get_u64(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_ATIME, &dirtime->atime)!=0) ||
+        (dico_get_u64(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_MTIME, &dirtime->mtime)!=0))
+    {   free(dirtime);
+        return -1;
+    }
+    dirtime->fsid=exar->fsid;
+    strcpy(dirtime->relpath, relpath);
+    assert(pthread_mutex_lock(&g_pendingmutex)==0);
+    dirtime->next=*exar->dirtimes;
+    *exar->dirtimes=dirtime;
+    assert(pthread_mutex_unlock(&g_pendingmutex)==0);
+    return 0;
+}
+
+// set the times of the directories of that filesystem again once a base archive has been restored in it
+int extractar_dirtime_restore(cextractar *exar, char *destdir)
+{
+    char fullpath[PATH_MAX];
+    struct timeval tv[2];
+    cdirtime *dirtime;
+    int ret=0;
+    
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (exar->ext!=NULL) // libext2fs does not update the times of the parent directory
+        return 0;
+#endif
+    
+    assert(pthread_mutex_lock(&g_pendingmutex)==0);
+    for (dirtime=*exar->dirtimes; dirtime!=NULL; dirtime=dirtime->next)
+    {
+        if (dirtime->fsid!=exar->fsid)
+            continue;
+        concatenate_paths(fullpath, sizeof(fullpath), destdir, dirtime->relpath);
+        tv[0].tv_usec=0;
+        tv[0].tv_sec=dirtime->atime;
+        tv[1].tv_usec=0;
+        tv[1].tv_sec=dirtime->mtime;
+        if (extractar_set_parent_time(exar, fullpath, tv)!=0)
+        {   sysprintf("utimes(%s) failed\n", fullpath);
+            ret=-1;
+        }
+    }
+    assert(pthread_mutex_unlock(&g_pendingmutex)==0);
+    return ret;
+}
+
+void extractar_dirtime_destroy(cdirtime **dirtimes)
+{
+    cdirtime *next;
+    
+    for (; *dirtimes!=NULL; *dirtimes=next)
+    {   next=(*dirtimes)->next;
+        free(*dirtimes);
+    }
+}
+
 int extractar_restore_obj_directory(cextractar *exar, char *fullpath, char *relpath, char *destdir, cdico *d, int objtype, int fstype)
 {
     char parentdir[PATH_MAX];
@@ -549,23 +911,27 @@ int extractar_restore_obj_directory(cextractar *exar, char *fullpath, char *relp
     
     // create parent directory first
     extract_dirpath(fullpath, parentdir, sizeof(parentdir));
-    mkdir_recursive(parentdir);
+    extractar_mkdir(exar, parentdir);
 
     // backup parent dir atime/mtime
-    get_parent_dir_time_attrib(fullpath, parentdir, sizeof(parentdir), tv);
+    extractar_get_parent_time(exar, fullpath, parentdir, sizeof(parentdir), tv);
     
     // update progress bar
     extractar_listing_print_file(exar, objtype, relpath);
 
-    mkdir_recursive(fullpath);
+    extractar_mkdir(exar, fullpath);
     
     if (extractar_restore_attr_everything(exar, objtype, fullpath, relpath, d)!=0)
     {   msgprintf(MSG_STACK, "cannot restore file attributes for file [%s]\n", relpath);
         goto extractar_restore_obj_directory_err;
     }
     
+    // the files restored later from the base archives change the times of that directory
+    if ((exar->basepass==false) && (exar->dirtimes!=NULL) && (extractar_dirtime_add(exar, relpath, d)!=0))
+        goto extractar_restore_obj_directory_err;
+    
     // restore parent dir mtime/atime
-    if (utimes(parentdir, tv)!=0)
+    if (extractar_set_parent_time(exar, parentdir, tv)!=0)
     {   sysprintf("utimes(%s) failed\n", parentdir);
         goto extractar_restore_obj_directory_err;
     }
@@ -606,44 +972,54 @@ int extractar_restore_obj_regfile_multi(cextractar *exar, char *destdir, cdico *
     // init
     errors=0;
     memset(&blkinfo, 0, sizeof(blkinfo));
-    regmulti_init(&regmulti, FSA_MAX_BLKSIZE);
+    if (regmulti_init(&regmulti, exar->ai.maxblksize)!=0)
+    {   errprintf("regmulti_init() failed\n");
+        return -1;
+    }
     datafile=datafile_alloc();
     
     // ---- dequeue header for each small file which is part of that group
     if (dico_get_u32(dicofirstfile, 0, DISKITEMKEY_MULTIFILESCOUNT, &filescount)!=0)
     {   errprintf("cannot read DISKITEMKEY_MULTIFILESCOUNT from header in archive\n");
+        regmulti_destroy(&regmulti);
         return -1;
     }
     if (regmulti_rest_addheader(&regmulti, dicofirstfile)!=0)
     {   errprintf("rest_addheader() failed\n");
+        regmulti_destroy(&regmulti);
         return -1;
     }
     
     for (i=1; i < filescount; i++) // first header was a special case (received from calling function)
     {
-        if (queue_dequeue_header(&g_queue, &filehead, magic, NULL)<=0)
+        if (queue_dequeue_header(exar->queue, &filehead, magic, NULL)<=0)
         {   errprintf("queue_dequeue_header() failed: cannot read multireg object header\n");
             errors++;
+            regmulti_destroy(&regmulti);
             return -1;
         }
         if (memcmp(magic, FSA_MAGIC_OBJT, FSA_SIZEOF_MAGIC)!=0)
         {   errprintf("header is not what we expected: found=[%s] and expected=[%s]\n", magic, FSA_MAGIC_OBJT);
+            regmulti_destroy(&regmulti);
             return -1;
         }
         if (regmulti_rest_addheader(&regmulti, filehead)!=0)
         {   errprintf("rest_addheader() failed for file %d\n", i);
+            regmulti_destroy(&regmulti);
             return -1;
         }
     }
     
     // ---- dequeue the block which contains data for several small files
-    if ((lres=queue_dequeue_block(&g_queue, &blkinfo))<=0)
+    if ((lres=queue_dequeue_block(exar->queue, &blkinfo))<=0)
     {   errprintf("queue_dequeue_block()=%ld=%s failed\n", (long)lres, error_int_to_string(lres));
+        regmulti_destroy(&regmulti);
         return -1;
     }
     
     if (regmulti_rest_setdatablock(&regmulti, blkinfo.blkdata, blkinfo.blkrealsize)!=0)
     {   errprintf("regmulti_rest_setdatablock() failed\n");
+        regmulti_destroy(&regmulti);
         return -1;
     }
     free(blkinfo.blkdata); // free memory allocated by the thread_io_reader
@@ -663,6 +1039,10 @@ int extractar_restore_obj_regfile_multi(cextractar *exar, char *destdir, cdico *
             goto extractar_restore_obj_regfile_multi_err;
         }
         
+        // keep the contents for the duplicates of that file which come later (even if it is excluded)
+        if ((exar->dedupcache!=NULL) && (dico_get_data(filehead, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_MD5SUM, md5sumorig, 16, NULL)==0))
+            dedupcache_add(exar->dedupcache, md5sumorig, databuf, datsize);
+        
         if ((res=dico_get_data(filehead, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_PATH, relpath, sizeof(relpath), NULL))!=0)
         {   errprintf("Cannot read DISKITEMKEY_PATH from header, res=%d, key=%d\n", res, DISKITEMKEY_PATH);
             dico_show(filehead, DICO_OBJ_SECTION_STDATTR, "DISKITEMKEY_PATH");
@@ -670,20 +1050,27 @@ int extractar_restore_obj_regfile_multi(cextractar *exar, char *destdir, cdico *
         }
         concatenate_paths(fullpath, sizeof(fullpath), destdir, relpath);
         extract_basename(fullpath, basename, sizeof(basename));
+        extractar_include_progress(exar, relpath, OBJTYPE_REGFILEMULTI);
         
         // update cost statistics and progress bar
         exar->cost_current+=FSA_COST_PER_FILE; 
         exar->cost_current+=datsize; // filesize
         
         // check the list of excluded files/dirs
-        if (is_filedir_excluded(relpath)!=true)
+        if (extractar_is_regfile_skipped(exar, relpath)!=true)
         {
+            if (exar->basepass==true)
+            {   assert(pthread_mutex_lock(&g_pendingmutex)==0);
+                catalog_remove(exar->pending, exar->fsid, relpath);
+                assert(pthread_mutex_unlock(&g_pendingmutex)==0);
+            }
+            
             // create parent directory if necessary
             extract_dirpath(fullpath, parentdir, sizeof(parentdir));
-            mkdir_recursive(parentdir);
+            extractar_mkdir(exar, parentdir);
             
             // backup parent dir atime/mtime
-            get_parent_dir_time_attrib(fullpath, parentdir, sizeof(parentdir), tv);
+            extractar_get_parent_time(exar, fullpath, parentdir, sizeof(parentdir), tv);
             
             extractar_listing_print_file(exar, tmpobjtype, relpath);
             
@@ -693,7 +1080,7 @@ int extractar_restore_obj_regfile_multi(cextractar *exar, char *destdir, cdico *
                 goto extractar_restore_obj_regfile_multi_err;
             }
             
-            if (datafile_open_write(datafile, fullpath, false, false)<0)
+            if (extractar_open_datafile(exar, datafile, fullpath, false, false, datsize)<0)
                 goto extractar_restore_obj_regfile_multi_err;
             
             res=datafile_write(datafile, databuf, datsize);
@@ -702,13 +1089,14 @@ int extractar_restore_obj_regfile_multi(cextractar *exar, char *destdir, cdico *
             
             if (res!=FSAERR_SUCCESS)
             {   errprintf("removing %s\n", fullpath);
-                unlink(fullpath);
+                extractar_unlink(exar, fullpath);
+                regmulti_destroy(&regmulti);
                 return -1;
             }
             
             if (memcmp(md5sumcalc, md5sumorig, 16)!=0)
             {   errprintf("cannot restore file %s, the data block (which is shared by multiple files) is corrupt\n", relpath);
-                res=truncate(fullpath, 0); // don't leave corrupt data in the file
+                res=extractar_truncate(exar, fullpath); // don't leave corrupt data in the file
                 goto extractar_restore_obj_regfile_multi_err;
             }
                       
@@ -718,7 +1106,7 @@ int extractar_restore_obj_regfile_multi(cextractar *exar, char *destdir, cdico *
             }
             
             // restore parent dir mtime/atime
-            if (utimes(parentdir, tv)!=0)
+            if (extractar_set_parent_time(exar, parentdir, tv)!=0)
             {   sysprintf("utimes(%s) failed\n", parentdir);
                 goto extractar_restore_obj_regfile_multi_err;
             }
@@ -734,17 +1122,117 @@ extractar_restore_obj_regfile_multi_err:
         continue;
     }
     
+    regmulti_destroy(&regmulti);
     datafile_destroy(datafile);
     return 0;
 }
 
+// small file saved with --dedup whose contents are identical to a file which comes earlier in the archive
+int extractar_restore_obj_regfile_dup(cextractar *exar, char *fullpath, char *relpath, char *destdir, cdico *d, int objtype, int fstype)
+{
+    char databuf[FSA_MAX_SMALLFILESIZE];
+    char origpath[PATH_MAX];
+    char duppath[PATH_MAX];
+    char parentdir[PATH_MAX];
+    cdatafile *datafile=NULL;
+    struct timeval tv[2];
+    u8 md5sumcalc[16];
+    u8 md5sumorig[16];
+    u64 filesize;
+    int res;
+    
+    // update cost statistics and progress bar
+    exar->cost_current+=FSA_COST_PER_FILE;
+    
+    // check the list of excluded files/dirs
+    if (extractar_is_regfile_skipped(exar, relpath)==true)
+    {   dico_destroy(d);
+        return 0;
+    }
+    if (exar->basepass==true)
+    {   assert(pthread_mutex_lock(&g_pendingmutex)==0);
+        catalog_remove(exar->pending, exar->fsid, relpath);
+        assert(pthread_mutex_unlock(&g_pendingmutex)==0);
+    }
+    
+    if ((dico_get_u64(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_SIZE, &filesize)!=0) || (filesize > sizeof(databuf)) ||
+        (dico_get_data(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_MD5SUM, md5sumorig, 16, NULL)!=0) ||
+        (dico_get_string(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_DUPPATH, duppath, sizeof(duppath))<0))
+    {   errprintf("cannot read the header of the duplicate file %s\n", relpath);
+        goto extractar_restore_obj_regfile_dup_err;
+    }
+    exar->cost_current+=filesize;
+    
+    // get the contents from the cache or else from the copy which has already been restored
+    if (dedupcache_get(exar->dedupcache, md5sumorig, filesize, databuf, sizeof(databuf))!=0)
+    {
+        concatenate_paths(origpath, sizeof(origpath), destdir, duppath);
+        msgprintf(MSG_DEBUG1, "contents of %s not in the cache: copying them from %s\n", relpath, origpath);
+        if (extractar_read_file(exar, origpath, databuf, filesize)!=(s64)filesize)
+        {   errprintf("cannot read %lld bytes from %s to restore its duplicate %s\n", (long long)filesize, origpath, relpath);
+            goto extractar_restore_obj_regfile_dup_err;
+        }
+    }
+    
+    // create parent directory if necessary
+    extract_dirpath(fullpath, parentdir, sizeof(parentdir));
+    extractar_mkdir(exar, parentdir);
+    
+    // backup parent dir atime/mtime
+    extractar_get_parent_time(exar, fullpath, parentdir, sizeof(parentdir), tv);
+    
+    extractar_listing_print_file(exar, objtype, relpath);
+    
+    datafile=datafile_alloc();
+    if (extractar_open_datafile(exar, datafile, fullpath, false, false, filesize)<0)
+        goto extractar_restore_obj_regfile_dup_err;
+    res=datafile_write(datafile, databuf, filesize);
+    datafile_close(datafile, md5sumcalc, sizeof(md5sumcalc));
+    
+    if ((res!=FSAERR_SUCCESS) || (memcmp(md5sumcalc, md5sumorig, 16)!=0))
+    {   errprintf("cannot restore file %s, the contents of %s have changed\n", relpath, duppath);
+        res=extractar_truncate(exar, fullpath); // don't leave corrupt data in the file
+        goto extractar_restore_obj_regfile_dup_err;
+    }
+    
+    if (extractar_restore_attr_everything(exar, objtype, fullpath, relpath, d)!=0)
+    {   msgprintf(MSG_STACK, "cannot restore file attributes for file [%s]\n", relpath);
+        goto extractar_restore_obj_regfile_dup_err;
+    }
+    
+    // restore parent dir mtime/atime
+    if (extractar_set_parent_time(exar, parentdir, tv)!=0)
+    {   sysprintf("utimes(%s) failed\n", parentdir);
+        goto extractar_restore_obj_regfile_dup_err;
+    }
+    
+    datafile_destroy(datafile);
+    dico_destroy(d);
+    exar->stats.cnt_regfile++;
+    return 0; // success
+    
+extractar_restore_obj_regfile_dup_err:
+    if (datafile!=NULL)
+        datafile_destroy(datafile);
+    dico_destroy(d);
+    exar->stats.err_regfile++;
+    return 0; // non fatal error
+}
+
 int extractar_restore_obj_regfile_unique(cextractar *exar, char *fullpath, char *relpath, char *destdir, cdico *d, int objtype, int fstype) // large or empty files
 {
     char magic[FSA_SIZEOF_MAGIC+1];
     struct s_blockinfo blkinfo;
     char parentdir[PATH_MAX];
+    char srcpath[PATH_MAX];
+    char refbuf[FSA_MAX_REFLINKSIZE];
     cdatafile *datafile=NULL;
     cdico *footerdico=NULL;
+    creflinkrange *range;
+    creflinklist refs;
+    u16 refsize;
+    u64 curblocksize;
+    int res;
     bool fatalerr=false; // error for restoration globally
     bool minorerr=false; // error for current file only
     bool delfile=false;
@@ -762,12 +1250,20 @@ int extractar_restore_obj_regfile_unique(cextractar *exar, char *fullpath, char
     memset(&blkinfo, 0, sizeof(blkinfo));
     memset(magic, 0, sizeof(magic));
     datafile=datafile_alloc();
+    reflinklist_init(&refs);
     
     if (dico_get_u64(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_SIZE, &filesize)!=0)
     {   errprintf("Cannot read filesize DISKITEMKEY_SIZE from archive for file=[%s]\n", relpath);
         minorerr=true;
     }
     
+    // DISKITEMKEY_REFLINKS is only present when parts of the file are shared with files restored before
+    if ((dico_get_data(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_REFLINKS, refbuf, sizeof(refbuf), &refsize)==0) &&
+        (reflinklist_decode(&refs, refbuf, refsize)!=0))
+    {   errprintf("Cannot read the shared ranges DISKITEMKEY_REFLINKS from archive for file=[%s]\n", relpath);
+        minorerr=true;
+    }
+    
     sparse=((dico_get_u64(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_FLAGS, &flags)==0) && (flags&FSA_FILEFLAGS_SPARSE));
     
     // update cost statistics and progress bar
@@ -775,7 +1271,7 @@ int extractar_restore_obj_regfile_unique(cextractar *exar, char *fullpath, char
     exar->cost_current+=filesize;
     
     // check the list of excluded files/dirs
-    if (is_filedir_excluded(relpath)==true)
+    if (extractar_is_regfile_skipped(exar, relpath)==true)
     {
         excluded=true;
     }
@@ -783,22 +1279,36 @@ int extractar_restore_obj_regfile_unique(cextractar *exar, char *fullpath, char
     {
         // create parent directory first
         extract_dirpath(fullpath, parentdir, sizeof(parentdir));
-        mkdir_recursive(parentdir);
+        extractar_mkdir(exar, parentdir);
         
         // backup parent dir atime/mtime
-        get_parent_dir_time_attrib(fullpath, parentdir, sizeof(parentdir), tv);
+        extractar_get_parent_time(exar, fullpath, parentdir, sizeof(parentdir), tv);
         
         // show progress bar
         extractar_listing_print_file(exar, objtype, relpath);
     }
     
-    if ((minorerr==false) && (datafile_open_write(datafile, fullpath, excluded, sparse)<0))
+    if ((minorerr==false) && (extractar_open_datafile(exar, datafile, fullpath, excluded, sparse, filesize)<0))
         minorerr=true;
     
     msgprintf(MSG_DEBUG2, "restore_obj_regfile_unique(file=%s, size=%lld)\n", relpath, (long long)filesize);
-    for (filepos=0; (minorerr==false) && (filesize>0) && (filepos < filesize) && (get_interrupted()==false); filepos+=blkinfo.blkrealsize)
+    for (filepos=0; (minorerr==false) && (filesize>0) && (filepos < filesize) && (get_interrupted()==false); filepos+=curblocksize)
     {
-        if ((lres=queue_dequeue_block(&g_queue, &blkinfo))<=0)
+        // that part of the file is shared with a file restored before: its data are not in the archive
+        if ((range=reflinklist_find(&refs, filepos))!=NULL)
+        {
+            curblocksize=range->offset+range->length-filepos;
+            concatenate_paths(srcpath, sizeof(srcpath), destdir, range->srcpath);
+            if ((res=datafile_clone(datafile, srcpath, range->srcoffset+(filepos-range->offset), curblocksize))!=FSAERR_SUCCESS)
+            {   delfile=true;
+                minorerr=true;
+                fatalerr=(res==FSAERR_ENOSPC);
+                break;
+            }
+            continue;
+        }
+        
+        if ((lres=queue_dequeue_block(exar->queue, &blkinfo))<=0)
         {   errprintf("queue_dequeue_block()=%ld=%s for file(%s) failed\n", (long)lres, error_int_to_string(lres), relpath);
             delfile=true;
             minorerr=true;
@@ -822,6 +1332,7 @@ int extractar_restore_obj_regfile_unique(cextractar *exar, char *fullpath, char
             break;
         }
         
+        curblocksize=blkinfo.blkrealsize;
         free(blkinfo.blkdata);
     }
     
@@ -836,7 +1347,7 @@ int extractar_restore_obj_regfile_unique(cextractar *exar, char *fullpath, char
         }
     
         // restore parent dir mtime/atime
-        if (utimes(parentdir, tv)!=0)
+        if (extractar_set_parent_time(exar, parentdir, tv)!=0)
         {   sysprintf("utimes(%s) failed\n", parentdir);
             minorerr=true;
         }
@@ -845,7 +1356,7 @@ int extractar_restore_obj_regfile_unique(cextractar *exar, char *fullpath, char
     // empty files have no footer (no need for a checksum)
     if ((fatalerr==false) && (filesize>0))
     {
-        if (queue_dequeue_header(&g_queue, &footerdico, magic, NULL)<=0)
+        if (queue_dequeue_header(exar->queue, &footerdico, magic, NULL)<=0)
         {   errprintf("queue_dequeue_header() failed: cannot read footer dico\n");
             minorerr=true;
             goto restore_obj_regfile_unique_end;
@@ -877,7 +1388,7 @@ int extractar_restore_obj_regfile_unique(cextractar *exar, char *fullpath, char
 restore_obj_regfile_unique_end:
     if (delfile==true)
     {   errprintf("removing %s\n", fullpath);
-        unlink(fullpath);
+        extractar_unlink(exar, fullpath);
     }
     
     if (excluded!=true)
@@ -886,17 +1397,66 @@ restore_obj_regfile_unique_end:
             exar->stats.err_regfile++;
         else
             exar->stats.cnt_regfile++;
+        if (exar->basepass==true)
+        {   assert(pthread_mutex_lock(&g_pendingmutex)==0);
+            catalog_remove(exar->pending, exar->fsid, relpath);
+            assert(pthread_mutex_unlock(&g_pendingmutex)==0);
+        }
     }
 
     if (get_interrupted()==true)
         errprintf("operation has been interrupted\n");
 
+    reflinklist_destroy(&refs);
     dico_destroy(footerdico);
     dico_destroy(d);
     datafile_destroy(datafile);
     return (fatalerr==false)?(0):(-1);
 }
 
+int extractar_restore_obj_regfile_base(cextractar *exar, char *relpath, cdico *d)
+{
+    ccatalogitem *pending;
+    ccatalogitem item;
+    int res;
+    
+    memset(&item, 0, sizeof(item));
+    if ((dico_get_u64(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_SIZE, &item.size)!=0)
+        || (dico_get_u32(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_BASEARCHID, &item.archid)!=0)
+        || (dico_get_data(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_MD5SUM, item.md5sum, 16, NULL)!=0))
+    {   errprintf("cannot read the reference to the base archive for file=[%s]\n", relpath);
+        exar->stats.err_regfile++;
+        dico_destroy(d);
+        return 0; // non fatal error
+    }
+    
+    if (exar->basepass==true) // the base archive is itself incremental: look in an older archive
+    {
+        assert(pthread_mutex_lock(&g_pendingmutex)==0);
+        if (((pending=catalog_get(exar->pending, exar->fsid, relpath))!=NULL) && (pending->archid==exar->ai.archid))
+            pending->archid=item.archid;
+        assert(pthread_mutex_unlock(&g_pendingmutex)==0);
+    }
+    else if (is_filedir_excluded(relpath)!=true) // the contents will be restored from a base archive
+    {
+        item.path=relpath;
+        item.fsid=exar->fsid;
+        assert(pthread_mutex_lock(&g_pendingmutex)==0);
+        res=catalog_add(exar->pending, &item);
+        assert(pthread_mutex_unlock(&g_pendingmutex)==0);
+        if (res!=0)
+        {   errprintf("catalog_add(%s) failed\n", relpath);
+            dico_destroy(d);
+            return -1;
+        }
+        exar->cost_current+=FSA_COST_PER_FILE;
+        extractar_listing_print_file(exar, OBJTYPE_REGFILEBASE, relpath);
+    }
+    
+    dico_destroy(d);
+    return 0;
+}
+
 int extractar_restore_object(cextractar *exar, int *errors, char *destdir, cdico *dicoattr, int fstype)
 {
     char relpath[PATH_MAX];
@@ -916,6 +1476,13 @@ int extractar_restore_object(cextractar *exar, int *errors, char *destdir, cdico
         return -3;
     concatenate_paths(fullpath, sizeof(fullpath), destdir, relpath);
     
+    // the other objects have already been restored from the incremental archive
+    if ((exar->basepass==true) && (objtype!=OBJTYPE_REGFILEUNIQUE) && (objtype!=OBJTYPE_REGFILEMULTI) &&
+        (objtype!=OBJTYPE_REGFILEBASE) && (objtype!=OBJTYPE_REGFILEDUP))
+    {   dico_destroy(dicoattr);
+        return 0;
+    }
+    
     // ---- recreate specific object on the filesystem
     switch (objtype)
     {
@@ -961,6 +1528,14 @@ int extractar_restore_object(cextractar *exar, int *errors, char *destdir, cdico
                 return -1;
             }
             break;
+        case OBJTYPE_REGFILEBASE:
+            msgprintf(MSG_DEBUG2, "objtype=OBJTYPE_REGFILEBASE, path=[%s]\n", relpath);
+            res=extractar_restore_obj_regfile_base(exar, relpath, dicoattr);
+            break;
+        case OBJTYPE_REGFILEDUP:
+            msgprintf(MSG_DEBUG2, "objtype=OBJTYPE_REGFILEDUP, path=[%s]\n", relpath);
+            res=extractar_restore_obj_regfile_dup(exar, fullpath, relpath, destdir, dicoattr, objtype, fstype);
+            break;
         default:
             errprintf("Unknown objtype %d\n", objtype);
             return -3;
@@ -976,11 +1551,15 @@ int extractar_restore_object(cextractar *exar, int *errors, char *destdir, cdico
 int extractar_extract_read_objects(cextractar *exar, int *errors, char *destdir, int fstype)
 {
     char magic[FSA_SIZEOF_MAGIC+1];
+    char relpath[PATH_MAX];
     cdico *dicoattr=NULL;
     int headerisend;
     int headerisobj;
     u16 checkfsid;
+    u32 objtype;
     int curerr;
+    cdedupcache dedupcache;
+    int ret=0;
     int type;
     int res;
     
@@ -988,13 +1567,29 @@ int extractar_extract_read_objects(cextractar *exar, int *errors, char *destdir,
     memset(magic, 0, sizeof(magic));
     *errors=0;
     
+    // the rest of the archive can be skipped once all the anchors of the include patterns have been restored
+    // unless the small files are packed by type: they can then be anywhere until the end of the filesystem
+    exar->inclstate=NULL;
+    exar->incldone=false;
+    if ((exar->inclstop==true) && (exar->basepass==false) && (g_include.anchored==true) && (exar->ai.groupsmall==false) &&
+        ((exar->inclstate=calloc(g_include.anchorcount, sizeof(u8)))==NULL))
+    {   errprintf("calloc(%ld) failed: out of memory\n", (long)g_include.anchorcount);
+        return -1;
+    }
+    
+    // duplicates of small files are restored from the contents of the files restored before them
+    exar->dedupcache=NULL;
+    if ((exar->ai.hasduplicates==true) && (dedupcache_init(&dedupcache, FSA_DEDUP_CACHESIZE)==0))
+        exar->dedupcache=&dedupcache;
+    
     do
     {   // skip the garbage (just ignore everything until the next FSA_MAGIC_OBJT)
         // in case the archive is corrupt and random data has been added / removed in the archive
         do
-        {   if (queue_check_next_item(&g_queue, &type, magic)!=0)
+        {   if (queue_check_next_item(exar->queue, &type, magic)!=0)
             {   errprintf("queue_check_next_item() failed: cannot read object from archive\n");
-                return -1;
+                ret=-1;
+                goto extractar_extract_read_objects_end;
             }
             
             headerisobj=(memcmp(magic, FSA_MAGIC_OBJT, FSA_SIZEOF_MAGIC)==0);
@@ -1004,9 +1599,10 @@ int extractar_extract_read_objects(cextractar *exar, int *errors, char *destdir,
             {
                 errprintf("unexpected header found in archive, skipping it: type=%d, magic=[%s]\n", 
                     type, (type==QITEM_TYPE_HEADER)?(magic):"-block-");
-                if (queue_destroy_first_item(&g_queue)!=0)
+                if (queue_destroy_first_item(exar->queue)!=0)
                 {   errprintf("queue_destroy_first_item() failed: cannot read object from archive\n");
-                    return -1;
+                    ret=-1;
+                    goto extractar_extract_read_objects_end;
                 }
             }
         } while ((headerisobj!=true) && (headerisend!=true));
@@ -1014,17 +1610,30 @@ int extractar_extract_read_objects(cextractar *exar, int *errors, char *destdir,
         if (headerisobj==true) // if it's an object header
         {
             // read object header from archive
-            while (queue_dequeue_header(&g_queue, &dicoattr, magic, &checkfsid)<=0)
+            while (queue_dequeue_header(exar->queue, &dicoattr, magic, &checkfsid)<=0)
             {   errprintf("queue_dequeue_header() failed\n");
                 (*errors)++;
             }
             
             if (checkfsid==exar->fsid) // if filesystem-id is correct
             {
+                // the small files of a group are checked one by one in extractar_restore_obj_regfile_multi()
+                objtype=OBJTYPE_NULL;
+                if ((exar->inclstate!=NULL) && (dico_get_u32(dicoattr, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_OBJTYPE, &objtype)==0) &&
+                    (objtype!=OBJTYPE_REGFILEMULTI) && (dico_get_data(dicoattr, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_PATH, relpath, sizeof(relpath), NULL)==0))
+                    extractar_include_progress(exar, relpath, objtype);
+                
                 if ((res=extractar_restore_object(exar, &curerr, destdir, dicoattr, fstype))!=0)
                 {   msgprintf(MSG_STACK, "restore_object() failed with res=%d\n", res);
                     //dico_destroy(dicoattr);
-                    return -1; // fatal error
+                    ret=-1; // fatal error
+                    goto extractar_extract_read_objects_end;
+                }
+                
+                if (extractar_include_complete(exar, (objtype==OBJTYPE_REGFILEMULTI))==true)
+                {   msgprintf(MSG_VERB1, "all the objects which match the include patterns have been restored: the rest of the archive is skipped\n");
+                    exar->incldone=true;
+                    goto extractar_extract_read_objects_end;
                 }
             }
             else // wrong filesystem-id
@@ -1036,7 +1645,17 @@ int extractar_extract_read_objects(cextractar *exar, int *errors, char *destdir,
         }
     } while ((headerisend!=true) && (get_abort()==false));
     
-    return 0;
+    // the directories have been restored with the incremental archive, before the files written in this pass
+    if ((ret==0) && (exar->basepass==true) && (exar->dirtimes!=NULL) && (extractar_dirtime_restore(exar, destdir)!=0))
+        (*errors)++;
+    
+extractar_extract_read_objects_end:
+    free(exar->inclstate);
+    exar->inclstate=NULL;
+    if (exar->dedupcache!=NULL)
+        dedupcache_destroy(exar->dedupcache);
+    exar->dedupcache=NULL;
+    return ret;
 }
 
 int extractar_read_mainhead(cextractar *exar, cdico **dicomainhead)
@@ -1045,6 +1664,9 @@ int extractar_read_mainhead(cextractar *exar, cdico **dicomainhead)
     u8 bufcheckcrypt[FSA_CHECKPASSBUF_SIZE+8];
     char magic[FSA_SIZEOF_MAGIC+1];
     u16 cryptbufsize;
+    u8 cryptnonce[FSA_CRYPT_NONCESIZE];
+    ccipher *cipher;
+    u8 crypttag[FSA_CRYPT_TAGSIZE];
     u8 md5sumar[16];
     u8 md5sumnew[16];
     u64 clearsize;
@@ -1126,6 +1748,22 @@ int extractar_read_mainhead(cextractar *exar, cdico **dicomainhead)
     if (dico_get_u32(*dicomainhead, 0, MAINHEADKEY_HASDIRSINFOHEAD, &temp32)==0)
         exar->ai.hasdirsinfohead=temp32;
     
+    // MAINHEADKEY_FSINTERLEAVED is only present when the filesystems have been saved concurrently
+    if (dico_get_u32(*dicomainhead, 0, MAINHEADKEY_FSINTERLEAVED, &temp32)==0)
+        exar->ai.fsinterleaved=temp32;
+    
+    // MAINHEADKEY_HASDUPLICATES is only present when the archive has been saved with option --dedup
+    if (dico_get_u32(*dicomainhead, 0, MAINHEADKEY_HASDUPLICATES, &temp32)==0)
+        exar->ai.hasduplicates=temp32;
+    
+    // MAINHEADKEY_HASREFLINKS is only present when the archive has been saved with option --reflink
+    if (dico_get_u32(*dicomainhead, 0, MAINHEADKEY_HASREFLINKS, &temp32)==0)
+        exar->ai.hasreflinks=temp32;
+    
+    // MAINHEADKEY_GROUPSMALL is only present when the archive has been saved with option --group-small-files
+    if (dico_get_u32(*dicomainhead, 0, MAINHEADKEY_GROUPSMALL, &temp32)==0)
+        exar->ai.groupsmall=temp32;
+    
     // check the file format. New versions based on "FsArCh_002" also understand "FsArCh_001" which is very close (and "FsArCh_00Y"=="FsArCh_001")
     if (strcmp(exar->ai.filefmt, FSA_FILEFORMAT)!=0 && strcmp(exar->ai.filefmt, "FsArCh_00Y")!=0 && strcmp(exar->ai.filefmt, "FsArCh_001")!=0)
     {
@@ -1159,7 +1797,19 @@ int extractar_read_mainhead(cextractar *exar, cdico **dicomainhead)
             return -1;
         }
         
-        if (crypto_blowfish(cryptbufsize, &clearsize, bufcheckcrypt, bufcheckclear, g_options.encryptpass, strlen((char*)g_options.encryptpass), false)==0)
+        if (exar->ai.cryptalgo==ENCRYPT_AES256GCM) // the key has been derived by the reader thread
+        {
+            if ((dico_get_data(*dicomainhead, 0, MAINHEADKEY_CRYPTNONCE, cryptnonce, sizeof(cryptnonce), NULL)!=0) ||
+                (dico_get_data(*dicomainhead, 0, MAINHEADKEY_CRYPTTAG, crypttag, sizeof(crypttag), NULL)!=0))
+            {   errprintf("cannot find MAINHEADKEY_CRYPTNONCE or MAINHEADKEY_CRYPTTAG in main-header\n");
+                return -1;
+            }
+            if (((cipher=crypto_aes256gcm_open())!=NULL) &&
+                (crypto_aes256gcm(cipher, cryptbufsize, bufcheckcrypt, bufcheckclear, cryptnonce, NULL, 0, crypttag, false)==0))
+                gcry_md_hash_buffer(GCRY_MD_MD5, md5sumnew, bufcheckclear, cryptbufsize);
+            crypto_aes256gcm_close(cipher);
+        }
+        else if (crypto_blowfish(cryptbufsize, &clearsize, bufcheckcrypt, bufcheckclear, g_options.encryptpass, strlen((char*)g_options.encryptpass), false)==0)
             gcry_md_hash_buffer(GCRY_MD_MD5, md5sumnew, bufcheckclear, clearsize);
         
         if (memcmp(md5sumar, md5sumnew, 16)!=0)
@@ -1171,6 +1821,72 @@ int extractar_read_mainhead(cextractar *exar, cdico **dicomainhead)
     return 0;
 }
 
+// write back the blocks of a filesystem saved with option --image at their offset on the device
+int extractar_restore_image(cextractar *exar, char *partition, u64 imagesize)
+{
+    char magic[FSA_SIZEOF_MAGIC+1];
+    struct s_blockinfo blkinfo;
+    cdico *dico=NULL;
+    s64 devsize;
+    int ret=0;
+    int type;
+    int fd;
+    
+    memset(magic, 0, sizeof(magic));
+    if ((fd=open64(partition, O_WRONLY|O_LARGEFILE))<0)
+    {   sysprintf("cannot open %s for writing\n", partition);
+        return -1;
+    }
+    if ((devsize=lseek64(fd, 0, SEEK_END)) < (s64)imagesize)
+    {   errprintf("partition [%s] is too small: the filesystem requires %lld bytes and the partition has %lld bytes\n",
+            partition, (long long)imagesize, (long long)devsize);
+        close(fd);
+        return -1;
+    }
+    
+    if ((queue_dequeue_header(exar->queue, &dico, magic, NULL)<=0) || (memcmp(magic, FSA_MAGIC_FSYB, FSA_SIZEOF_MAGIC)!=0))
+    {   errprintf("cannot read the header of the filesystem: found=[%s] and expected=[%s]\n", magic, FSA_MAGIC_FSYB);
+        close(fd);
+        return -1;
+    }
+    dico_destroy(dico);
+    
+    // the blocks come in the order of the device until the end of the filesystem
+    while ((ret==0) && (get_interrupted()==false) && (queue_check_next_item(exar->queue, &type, magic)==0) && (type==QITEM_TYPE_BLOCK))
+    {
+        if (queue_dequeue_block(exar->queue, &blkinfo)<=0)
+        {   errprintf("queue_dequeue_block() failed\n");
+            ret=-1;
+            break;
+        }
+        if (pwrite64(fd, blkinfo.blkdata, blkinfo.blkrealsize, blkinfo.blkoffset)!=(s64)blkinfo.blkrealsize)
+        {   sysprintf("cannot write %ld bytes at offset %lld of %s\n", (long)blkinfo.blkrealsize, (long long)blkinfo.blkoffset, partition);
+            ret=-1;
+        }
+        exar->cost_current+=blkinfo.blkrealsize;
+        free(blkinfo.blkdata);
+    }
+    
+    if ((ret==0) && (get_interrupted()==false))
+    {
+        if ((queue_dequeue_header(exar->queue, &dico, magic, NULL)<=0) || (memcmp(magic, FSA_MAGIC_DATF, FSA_SIZEOF_MAGIC)!=0))
+        {   errprintf("header is not what we expected: found=[%s] and expected=[%s]\n", magic, FSA_MAGIC_DATF);
+            ret=-1;
+        }
+        dico_destroy(dico);
+    }
+    
+    if (fsync(fd)!=0)
+    {   sysprintf("fsync(%s) failed\n", partition);
+        ret=-1;
+    }
+    close(fd);
+    
+    if ((ret==0) && (devsize > (s64)imagesize))
+        msgprintf(MSG_FORCE, "the filesystem on %s is smaller than the partition: it can be grown with resize2fs\n", partition);
+    return ret;
+}
+
 int extractar_filesystem_extract(cextractar *exar, cdico *dicofs, cstrdico *dicocmdline)
 {
     char filesystem[FSA_MAX_FSNAMELEN];
@@ -1188,11 +1904,13 @@ int extractar_filesystem_extract(cextractar *exar, cdico *dicofs, cstrdico *dico
     char mntbuf[PATH_MAX];
     u64 fsbytestotal;
     u64 fsbytesused;
+    u64 imagesize;
     char optbuf[128];
     int readwrite;
     int errors=0;
     u64 minver;
     u64 curver;
+    int profile;
     int fstype;
     int ret=0;
     int res;
@@ -1232,16 +1950,13 @@ int extractar_filesystem_extract(cextractar *exar, cdico *dicofs, cstrdico *dico
         return -1;
     }
     
-    // ---- read filesystem-header from archive
-    if (queue_dequeue_header(&g_queue, &dicobegin, magic, NULL)<=0)
-    {   errprintf("queue_dequeue_header() failed: cannot read file system dico\n");
-        return -1;
-    }
-    dico_destroy(dicobegin);
-    
-    if (memcmp(magic, FSA_MAGIC_FSYB, FSA_SIZEOF_MAGIC)!=0)
-    {   errprintf("header is not what we expected: found=[%s] and expected=[%s]\n", magic, FSA_MAGIC_FSYB);
-        return -1;
+    // filesystems saved with option --image are written back block by block: no mkfs and no mount
+    if (dico_get_u64(dicofs, 0, FSYSHEADKEY_IMAGESIZE, &imagesize)==0)
+    {   if ((exar->basepass==true) || (strdico_get_string(dicocmdline, tempbuf, sizeof(tempbuf), "mkfs")==0))
+        {   errprintf("the filesystem was saved as an image: it can only be restored as it is\n");
+            return -1;
+        }
+        return extractar_restore_image(exar, partition, imagesize);
     }
     
     // if a filesystem to use was specified: overwrite the default one
@@ -1291,24 +2006,77 @@ int extractar_filesystem_extract(cextractar *exar, cdico *dicofs, cstrdico *dico
         return -1;
     }
     
-    // ---- make the filesystem
-    if (filesys[fstype].mkfs(dicofs, partition, mkfsoptions, mkfslabel, mkfsuuid)!=0)
+    // ---- a fast restore defers the journal and the safe mount options until the data have been written
+    profile=((g_options.fastrestore==true) && (exar->basepass==false)) ? FSPROFILE_FASTRESTORE : FSPROFILE_DEFAULT;
+    
+    // ---- make the filesystem (unless the files of a base archive are added to an existing one)
+    assert(pthread_mutex_lock(&g_fsopsmutex)==0);
+    if ((exar->basepass==false) && (filesys[fstype].mkfs(dicofs, partition, mkfsoptions, mkfslabel, mkfsuuid, profile)!=0))
     {   errprintf("cannot make filesystem %s on partition %s\n", filesystem, partition);
+        assert(pthread_mutex_unlock(&g_fsopsmutex)==0);
         return -1;
     }
 
     // ---- mount the new filesystem
     mkdir_recursive(mntbuf);
-    generate_random_tmpdir(mntbuf, sizeof(mntbuf), 0);
+    generate_random_tmpdir(mntbuf, sizeof(mntbuf), exar->fsid);
     mkdir_recursive(mntbuf);
     
     if ((dico_get_string(dicofs, 0, FSYSHEADKEY_MOUNTINFO, mountinfo, sizeof(mountinfo)))<0)
         memset(mountinfo, 0, sizeof(mountinfo));
     msgprintf(MSG_VERB1, "Mount information: [%s]\n", mountinfo);
-    if (filesys[fstype].mount(partition, mntbuf, filesys[fstype].name, 0, mountinfo)!=0)
+#ifdef OPTION_NTFS3G_SUPPORT
+    // the named streams are only written as "user.*" xattrs (streams_interface=xattr)
+    if ((g_options.ntfsdirect==true) && (strcmp(filesys[fstype].name, "ntfs")==0) && (strstr(mountinfo, "streams_interface=windows")!=NULL))
+        msgprintf(MSG_FORCE, "option --ntfs-direct is ignored as the archive has been saved with streams_interface=windows\n");
+    else if ((g_options.ntfsdirect==true) && (strcmp(filesys[fstype].name, "ntfs")==0) && (exar->ai.hasreflinks==true))
+        msgprintf(MSG_FORCE, "option --ntfs-direct is ignored as the files of that archive share data with other files\n");
+#endif
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    // the shared data are read from the files already restored so the filesystem has to be mounted
+    if ((g_options.extdirect==true) && (strncmp(filesys[fstype].name, "ext", 3)==0) && (exar->ai.hasreflinks==true))
+        msgprintf(MSG_FORCE, "option --ext-direct is ignored as the files of that archive share data with other files\n");
+    if ((g_options.extdirect==true) && (strncmp(filesys[fstype].name, "ext", 3)==0) && (exar->ai.hasreflinks==false))
+    {   if (extdirect_open(&exar->ext, partition, mntbuf)!=0)
+        {   errprintf("cannot open the ext filesystem on partition [%s] with libext2fs. cannot continue.\n", partition);
+            assert(pthread_mutex_unlock(&g_fsopsmutex)==0);
+            return -1;
+        }
+        msgprintf(MSG_VERB1, "Filesystem on %s populated with libext2fs without being mounted\n", partition);
+    }
+    else
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if ((g_options.ntfsdirect==true) && (strcmp(filesys[fstype].name, "ntfs")==0) && (exar->ai.hasreflinks==false) && (strstr(mountinfo, "streams_interface=windows")==NULL))
+    {   if (ntfsdirect_open_rw(&exar->ntfs, partition, mntbuf)!=0)
+        {   errprintf("cannot open the ntfs volume on partition [%s] with libntfs-3g. cannot continue.\n", partition);
+            assert(pthread_mutex_unlock(&g_fsopsmutex)==0);
+            return -1;
+        }
+        msgprintf(MSG_VERB1, "Filesystem on %s populated with libntfs-3g without a fuse mount\n", partition);
+    }
+    else
+#endif
+    if (filesys[fstype].mount(partition, mntbuf, filesys[fstype].name, 0, mountinfo, profile)!=0)
     {   errprintf("partition [%s] cannot be mounted on %s. cannot continue.\n", partition, mntbuf);
+        assert(pthread_mutex_unlock(&g_fsopsmutex)==0);
         return -1;
     }
+    assert(pthread_mutex_unlock(&g_fsopsmutex)==0);
+    
+    // ---- read filesystem-header from archive (after mkfs so that concurrent restores don't wait for the data)
+    if (queue_dequeue_header(exar->queue, &dicobegin, magic, NULL)<=0)
+    {   errprintf("queue_dequeue_header() failed: cannot read file system dico\n");
+        ret=-1;
+        goto filesystem_extract_umount;
+    }
+    dico_destroy(dicobegin);
+    
+    if (memcmp(magic, FSA_MAGIC_FSYB, FSA_SIZEOF_MAGIC)!=0)
+    {   errprintf("header is not what we expected: found=[%s] and expected=[%s]\n", magic, FSA_MAGIC_FSYB);
+        ret=-1;
+        goto filesystem_extract_umount;
+    }
     
     if (extractar_extract_read_objects(exar, &errors, mntbuf, fstype)!=0)
     {   msgprintf(MSG_STACK, "extract_read_objects(%s) failed\n", mntbuf);
@@ -1321,8 +2089,12 @@ int extractar_filesystem_extract(cextractar *exar, cdico *dicofs, cstrdico *dico
         goto filesystem_extract_umount;
     }
     
+    // the reader is stopped before the end of that filesystem when all the included files are restored
+    if (exar->incldone==true)
+        goto filesystem_extract_umount;
+    
     // read "end of file-system" header from archive
-    if (queue_dequeue_header(&g_queue, &dicoend, magic, NULL)<=0)
+    if (queue_dequeue_header(exar->queue, &dicoend, magic, NULL)<=0)
     {   errprintf("queue_dequeue_header() failed\n");
         ret=-1;
         goto filesystem_extract_umount;
@@ -1335,6 +2107,25 @@ int extractar_filesystem_extract(cextractar *exar, cdico *dicofs, cstrdico *dico
     }
     
 filesystem_extract_umount:
+    assert(pthread_mutex_lock(&g_fsopsmutex)==0);
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (exar->ext!=NULL)
+    {   if (extdirect_close(exar->ext)!=0)
+            ret=-1;
+        exar->ext=NULL;
+        rmdir(mntbuf);
+    }
+    else
+#endif
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (exar->ntfs!=NULL)
+    {   if (ntfsdirect_close(exar->ntfs)!=0)
+            ret=-1;
+        exar->ntfs=NULL;
+        rmdir(mntbuf);
+    }
+    else
+#endif
     if (filesys[fstype].umount(partition, mntbuf)!=0)
     {   sysprintf("cannot umount %s\n", mntbuf);
         ret=-1;
@@ -1342,32 +2133,233 @@ filesystem_extract_umount:
     else
     {   rmdir(mntbuf); // remove temp dir created by fsarchiver
     }
+    
+    // ---- create what the fast restore profile has left out (even after errors: the filesystem must be usable)
+    if ((profile==FSPROFILE_FASTRESTORE) && (filesys[fstype].finalize!=NULL) && (filesys[fstype].finalize(dicofs, partition)!=0))
+    {   errprintf("cannot finalize filesystem %s on partition %s\n", filesystem, partition);
+        ret=-1;
+    }
+    assert(pthread_mutex_unlock(&g_fsopsmutex)==0);
     return ret;
 }
 
-int oper_restore(char *archive, int argc, char **argv, int oper)
+// create the queue and the decompression threads of each filesystem restored concurrently
+int extractar_concurrent_init(crestfsjob *fsjob[], cstrdico *dicoargv[], int fscount)
+{
+    int jobs;
+    int i, j;
+    
+    // share the decompression threads between the filesystems
+    jobs=(g_options.compressjobs > fscount)?(g_options.compressjobs/fscount):(1);
+    
+    for (i=0; i<FSA_MAX_FSPERARCH; i++)
+    {
+        if (dicoargv[i]==NULL)
+            continue;
+        if ((fsjob[i]=calloc(1, sizeof(crestfsjob)))==NULL)
+        {   errprintf("calloc(%ld) failed: out of memory\n", (long)sizeof(crestfsjob));
+            return -1;
+        }
+        queue_init(&fsjob[i]->queue, FSA_MAX_QUEUESIZE);
+        g_fsqueue[i]=&fsjob[i]->queue;
+        for (j=0; (j<jobs) && (j<FSA_MAX_COMPJOBS); j++)
+        {
+            if (pthread_create(&fsjob[i]->thread_decomp[j], NULL, thread_decomp_fct, (void*)&fsjob[i]->queue) != 0)
+            {   errprintf("pthread_create(thread_decomp_fct) failed\n");
+                return -1;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+void *thread_drain_fct(void *args)
+{
+    cqueue *queue=(cqueue *)args;
+    
+    // waits on the condition of the queue until the reader marks its end
+    while (queue_destroy_first_item(queue)==FSAERR_SUCCESS);
+    return NULL;
+}
+
+// empty the queues that nobody reads until the reader has terminated so that it is never blocked on a full queue
+// each queue is emptied by its own thread as the reader may be waiting for room in any of them
+void extractar_concurrent_drain(crestfsjob *fsjob[], bool all)
+{
+    int i;
+    
+    for (i=0; i<FSA_MAX_FSPERARCH; i++)
+    {
+        if ((fsjob[i]!=NULL) && ((all==true) || (fsjob[i]->thread==0)) &&
+            (pthread_create(&fsjob[i]->thread_drain, NULL, thread_drain_fct, (void*)&fsjob[i]->queue)!=0))
+        {   errprintf("pthread_create(thread_drain_fct) failed\n");
+            fsjob[i]->thread_drain=0;
+        }
+    }
+    
+    if (all==true)
+        while (queue_destroy_first_item(&g_queue)==FSAERR_SUCCESS);
+    
+    for (i=0; i<FSA_MAX_FSPERARCH; i++)
+    {
+        if ((fsjob[i]!=NULL) && (fsjob[i]->thread_drain!=0))
+        {   if (pthread_join(fsjob[i]->thread_drain, NULL)!=0)
+                errprintf("pthread_join(thread_drain_fct) failed\n");
+            fsjob[i]->thread_drain=0;
+        }
+    }
+}
+
+// must be called once the reader has terminated
+void extractar_concurrent_destroy(crestfsjob *fsjob[])
+{
+    int i, j;
+    
+    for (i=0; i<FSA_MAX_FSPERARCH; i++)
+    {
+        if (fsjob[i]==NULL)
+            continue;
+        queue_set_end_of_queue(&fsjob[i]->queue, true);
+        while (queue_destroy_first_item(&fsjob[i]->queue)==FSAERR_SUCCESS);
+        for (j=0; j<FSA_MAX_COMPJOBS; j++)
+            if (fsjob[i]->thread_decomp[j] && pthread_join(fsjob[i]->thread_decomp[j], NULL) != 0)
+                errprintf("pthread_join(thread_decomp) failed\n");
+        g_fsqueue[i]=NULL;
+        queue_destroy(&fsjob[i]->queue);
+        free(fsjob[i]);
+        fsjob[i]=NULL;
+    }
+}
+
+void *thread_restfs_fct(void *args)
+{
+    crestfsjob *job=(crestfsjob *)args;
+    
+    job->ret=extractar_filesystem_extract(&job->exar, job->dicofs, job->dicocmdline);
+    if (job->ret!=0)
+    {
+        msgprintf(MSG_STACK, "extract_filesystem(%d) failed\n", job->exar.fsid);
+        set_stopfillqueue(); // the restoration stops as when filesystems are restored one after the other
+        while (queue_get_end_of_queue(&job->queue)==false)
+            queue_destroy_first_item(&job->queue);
+    }
+    return NULL;
+}
+
+// restore all the filesystems requested at the same time, each one in its own thread
+int extractar_concurrent_extract(cextractar *exar, crestfsjob *fsjob[], cdico *dicofsinfo[], cstrdico *dicoargv[], u64 *totalerr)
+{
+    u64 fscost;
+    int ret=0;
+    int i;
+    
+    for (i=0; (i < exar->ai.fscount) && (i < FSA_MAX_FSPERARCH) && (ret==0); i++)
+    {
+        if (fsjob[i]==NULL)
+            continue;
+        memcpy(&fsjob[i]->exar, exar, sizeof(cextractar));
+        fsjob[i]->exar.fsid=i;
+        fsjob[i]->exar.queue=&fsjob[i]->queue;
+        fsjob[i]->exar.cost_current=0;
+        if (dico_get_u64(dicofsinfo[i], 0, FSYSHEADKEY_TOTALCOST, &fscost)==0)
+            fsjob[i]->exar.cost_global=fscost;
+        memset(&fsjob[i]->exar.stats, 0, sizeof(fsjob[i]->exar.stats)); // init stats to zero
+        fsjob[i]->dicofs=dicofsinfo[i];
+        fsjob[i]->dicocmdline=dicoargv[i];
+        msgprintf(MSG_VERB1, "============= extracting filesystem %d =============\n", i);
+        if (pthread_create(&fsjob[i]->thread, NULL, thread_restfs_fct, (void*)fsjob[i]) != 0)
+        {   errprintf("pthread_create(thread_restfs_fct) failed\n");
+            fsjob[i]->thread=0;
+            set_stopfillqueue();
+            ret=-1;
+        }
+    }
+    
+    // the filesystems which have not been started must not block the reader
+    if (ret!=0)
+        extractar_concurrent_drain(fsjob, false);
+    
+    for (i=0; i<FSA_MAX_FSPERARCH; i++)
+    {
+        if ((fsjob[i]==NULL) || (fsjob[i]->thread==0))
+            continue;
+        if (pthread_join(fsjob[i]->thread, NULL) != 0)
+            errprintf("pthread_join(thread_restfs_fct) failed\n");
+        if (fsjob[i]->ret!=0)
+            ret=-1;
+        else if (get_abort()==false)
+            stats_show(fsjob[i]->exar.stats, i);
+        *totalerr+=stats_errcount(fsjob[i]->exar.stats);
+    }
+    
+    return ret;
+}
+
+// show the objects of an archive from their headers: the reader skips all the data blocks
+int extractar_list_objects(cextractar *exar)
+{
+    char magic[FSA_SIZEOF_MAGIC+1];
+    char relpath[PATH_MAX];
+    cdico *dico=NULL;
+    u32 objtype;
+    u64 filesize;
+    u16 fsid;
+    s64 lres=0;
+    
+    memset(magic, 0, sizeof(magic));
+    while ((get_abort()==false) && ((lres=queue_dequeue_header(exar->queue, &dico, magic, &fsid))>0))
+    {
+        if ((memcmp(magic, FSA_MAGIC_OBJT, FSA_SIZEOF_MAGIC)==0) &&
+            (dico_get_data(dico, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_PATH, relpath, sizeof(relpath), NULL)==0) &&
+            (dico_get_u32(dico, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_OBJTYPE, &objtype)==0))
+        {
+            if (dico_get_u64(dico, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_SIZE, &filesize)!=0)
+                filesize=0;
+            msgprintf(MSG_FORCE, "-[%.2d][%s] %12lld %s\n", (int)fsid, get_objtype_name(objtype), (long long)filesize, relpath);
+        }
+        dico_destroy(dico);
+    }
+    
+    if ((get_abort()==false) && (lres!=FSAERR_ENDOFFILE))
+    {   errprintf("queue_dequeue_header()=%ld=%s failed\n", (long)lres, error_int_to_string(lres));
+        return -1;
+    }
+    return 0;
+}
+
+int extractar_restore_archive(char *archive, int argc, char **argv, int oper, ccatalog *pending, cdirtime **dirtimes, bool basepass)
 {
     cdico *dicofsinfo[FSA_MAX_FSPERARCH];
     cstrdico *dicoargv[FSA_MAX_FSPERARCH];
+    crestfsjob *fsjob[FSA_MAX_FSPERARCH];
     pthread_t thread_decomp[FSA_MAX_COMPJOBS];
     char magic[FSA_SIZEOF_MAGIC+1];
     cdico *dicomainhead=NULL;
     cdico *dirsinfo=NULL;
     pthread_t thread_reader;
     struct stat64 st;
+    bool concurrent=false;
     char *destdir;
     cextractar exar;
     u64 totalerr=0;
     u64 fscost;
     u64 curver;
     int errors=0;
+    int fscount=0;
     int ret=0;
-    int i;
+    int i, j;
     
     // init
+    queue_set_end_of_queue(&g_queue, false);
+    clear_stopfillqueue();
     memset(&exar, 0, sizeof(exar));
     exar.cost_global=0;
     exar.cost_current=0;
+    exar.pending=pending;
+    exar.dirtimes=dirtimes;
+    exar.basepass=basepass;
+    exar.queue=&g_queue;
     archreader_init(&exar.ai);
     
     // init misc data struct to zero
@@ -1375,6 +2367,8 @@ int oper_restore(char *archive, int argc, char **argv, int oper)
         dicoargv[i]=NULL;
     for (i=0; i<FSA_MAX_FSPERARCH; i++)
         dicofsinfo[i]=NULL;
+    for (i=0; i<FSA_MAX_FSPERARCH; i++)
+        fsjob[i]=NULL;
     for (i=0; i<FSA_MAX_COMPJOBS; i++)
         thread_decomp[i]=0;
     for (i=0; i<FSA_MAX_FSPERARCH; i++)
@@ -1396,15 +2390,30 @@ int oper_restore(char *archive, int argc, char **argv, int oper)
             // say to the threadio_readarch thread which filesystems have to be read in archive
             for (i=0; i<FSA_MAX_FSPERARCH; i++)
                 g_fsbitmap[i]=!!(dicoargv[i]!=NULL);
+            for (i=0; i<FSA_MAX_FSPERARCH; i++)
+                fscount+=g_fsbitmap[i];
+            concurrent=((g_options.concurrentfs==true) && (fscount > 1));
             break;
             
         case OPER_RESTDIR: // the files are all considered as belonging to fsid==0
             g_fsbitmap[0]=1;
             break;
+            
+        case OPER_ARCHLIST: // the headers of all the filesystems are read but none of their data blocks
+            for (i=0; i<FSA_MAX_FSPERARCH; i++)
+                g_fsbitmap[i]=1;
+            exar.ai.skipblocks=true;
+            break;
     }
 
-    // create decompression threads
-    for (i=0; (i<g_options.compressjobs) && (i<FSA_MAX_COMPJOBS); i++)
+    // the reader sends the data of each filesystem to its own queue when they are restored concurrently
+    if ((concurrent==true) && (extractar_concurrent_init(fsjob, dicoargv, fscount)!=0))
+    {   msgprintf(MSG_STACK, "extractar_concurrent_init() failed\n");
+        goto do_extract_error;
+    }
+    
+    // create decompression threads (there is nothing to decompress when listing the contents)
+    for (i=0; (concurrent==false) && (oper!=OPER_ARCHLIST) && (i<g_options.compressjobs) && (i<FSA_MAX_COMPJOBS); i++)
     {
         if (pthread_create(&thread_decomp[i], NULL, thread_decomp_fct, NULL) != 0)
         {   errprintf("pthread_create(thread_decomp_fct) failed\n");
@@ -1440,6 +2449,20 @@ int oper_restore(char *archive, int argc, char **argv, int oper)
         goto do_extract_error;
     }
     
+    // a duplicate is restored from the first copy of its contents which may be excluded from the restoration
+    if (((oper==OPER_RESTFS) || (oper==OPER_RESTDIR)) && (exar.ai.hasduplicates==true) &&
+        ((strlist_count(&g_options.exclude)>0) || (strlist_count(&g_options.include)>0)))
+    {   errprintf("this archive has been saved with option --dedup, options -e and -i cannot be used to restore it\n");
+        goto do_extract_error;
+    }
+    
+    // the ranges shared with other files are cloned from these files which must have been restored too
+    if (((oper==OPER_RESTFS) || (oper==OPER_RESTDIR)) && (exar.ai.hasreflinks==true) &&
+        ((strlist_count(&g_options.exclude)>0) || (strlist_count(&g_options.include)>0)))
+    {   errprintf("this archive has been saved with option --reflink, options -e and -i cannot be used to restore it\n");
+        goto do_extract_error;
+    }
+    
     // show archive information if command is OPER_ARCHINFO
     if (oper==OPER_ARCHINFO && archinfo_show_mainhead(&exar.ai, dicomainhead)!=0)
     {   errprintf("archinfo_show_mainhead(%s) failed\n", archive);
@@ -1519,14 +2542,26 @@ int oper_restore(char *archive, int argc, char **argv, int oper)
         }
     }
     
+    if ((oper==OPER_ARCHLIST) && (extractar_list_objects(&exar)!=0))
+    {   msgprintf(MSG_STACK, "extractar_list_objects() failed\n");
+        goto do_extract_error;
+    }
+    
     if ((oper==OPER_RESTFS) || (oper==OPER_RESTDIR))
     {
-        if ((exar.ai.cryptalgo!=ENCRYPT_NONE) && (g_options.encryptalgo!=ENCRYPT_BLOWFISH))
+        if ((exar.ai.cryptalgo!=ENCRYPT_NONE) && (g_options.encryptalgo==ENCRYPT_NONE))
         {   errprintf("this archive has been encrypted, you have to provide a password on the command line using option '-c'\n");
             goto do_extract_error;
         }
     
-        if (exar.ai.archtype==ARCHTYPE_FILESYSTEMS)
+        if ((exar.ai.archtype==ARCHTYPE_FILESYSTEMS) && (concurrent==true))
+        {
+            if (extractar_concurrent_extract(&exar, fsjob, dicofsinfo, dicoargv, &totalerr)!=0)
+            {   msgprintf(MSG_STACK, "extractar_concurrent_extract() failed\n");
+                goto do_extract_error;
+            }
+        }
+        else if (exar.ai.archtype==ARCHTYPE_FILESYSTEMS)
         {
             // extract filesystem contents
             for (i=0; (i < exar.ai.fscount) && (i < FSA_MAX_FSPERARCH) && (get_abort()==false); i++)
@@ -1534,6 +2569,9 @@ int oper_restore(char *archive, int argc, char **argv, int oper)
                 if (dicoargv[i]!=NULL) // that filesystem has been requested on the command line
                 {
                     exar.fsid=i;
+                    for (exar.inclstop=true, j=i+1; j < FSA_MAX_FSPERARCH; j++)
+                        if (dicoargv[j]!=NULL) // the next filesystems are still to be read
+                            exar.inclstop=false;
                     memset(&exar.stats, 0, sizeof(exar.stats)); // init stats to zero
                     msgprintf(MSG_VERB1, "============= extracting filesystem %d =============\n", i);
                     if (extractar_filesystem_extract(&exar, dicofsinfo[i], dicoargv[i])!=0)
@@ -1571,6 +2609,7 @@ int oper_restore(char *archive, int argc, char **argv, int oper)
             }
             
             memset(&exar.stats, 0, sizeof(exar.stats)); // init stats to zero
+            exar.inclstop=true;
             if (extractar_extract_read_objects(&exar, &errors, destdir, 0)!=0) // TODO: get the right fstype
             {   errprintf("extract_read_objects(%s) failed\n", destdir);
                 goto do_extract_error;
@@ -1603,9 +2642,13 @@ do_extract_success:
         usleep(10000);
     }
     msgprintf(MSG_DEBUG2, "queue_count_items_todo(&g_queue)=%d\n", (int)queue_count_items_todo(&g_queue));
+    if (thread_reader==0) // nothing would mark the end of the queues of the filesystems
+        extractar_concurrent_destroy(fsjob);
     // now we are sure that thread_compress is not working on an item in the queue so we can empty the queue
-    while (get_secthreads()>0 && queue_get_end_of_queue(&g_queue)==false)
+    while (concurrent==false && get_secthreads()>0 && queue_get_end_of_queue(&g_queue)==false)
         queue_destroy_first_item(&g_queue);
+    if (concurrent==true && thread_reader!=0 && get_secthreads()>0) // the reader marks the end of all the queues
+        extractar_concurrent_drain(fsjob, true);
     msgprintf(MSG_DEBUG1, "THREAD-MAIN2: queue is now empty\n");
     // the queue is empty, so thread_compress should now exit
     
@@ -1616,6 +2659,8 @@ do_extract_success:
     if (thread_reader && pthread_join(thread_reader, NULL) != 0)
         errprintf("pthread_join(thread_reader) failed\n");
     
+    extractar_concurrent_destroy(fsjob);
+    
     for (i=0; i<FSA_MAX_FSPERARCH; i++)
         if (dicoargv[i]!=NULL)
             strdico_destroy(dicoargv[i]);
@@ -1637,3 +2682,116 @@ do_extract_success:
     archreader_destroy(&exar.ai);
     return ret;
 }
+
+// read the main header of an archive to know whether the filesystems are interleaved
+int extractar_is_interleaved(char *archive, bool *interleaved)
+{
+    char magic[FSA_SIZEOF_MAGIC+1];
+    cdico *dico=NULL;
+    carchreader ai;
+    u32 temp32;
+    u16 fsid;
+    int ret=-1;
+    
+    *interleaved=false;
+    memset(magic, 0, sizeof(magic));
+    archreader_init(&ai);
+    snprintf(ai.basepath, PATH_MAX, "%s", archive);
+    
+    if (archreader_volpath(&ai)!=0 || archreader_open(&ai)!=0)
+    {   errprintf("cannot open archive %s\n", archive);
+        goto extractar_is_interleaved_end;
+    }
+    if (archreader_read_volheader(&ai)!=0)
+    {   errprintf("archreader_read_volheader() failed\n");
+        goto extractar_is_interleaved_close;
+    }
+    if (archreader_read_header(&ai, magic, &dico, false, &fsid)!=FSAERR_SUCCESS)
+    {   errprintf("archreader_read_header() failed to read the archive header\n");
+        goto extractar_is_interleaved_close;
+    }
+    if (memcmp(magic, FSA_MAGIC_MAIN, FSA_SIZEOF_MAGIC)!=0)
+    {   errprintf("header is not what we expected: found=[%s] and expected=[%s]\n", magic, FSA_MAGIC_MAIN);
+        goto extractar_is_interleaved_close;
+    }
+    if (dico_get_u32(dico, 0, MAINHEADKEY_FSINTERLEAVED, &temp32)==0)
+        *interleaved=temp32;
+    ret=0;
+    
+extractar_is_interleaved_close:
+    dico_destroy(dico);
+    archreader_close(&ai);
+extractar_is_interleaved_end:
+    archreader_destroy(&ai);
+    return ret;
+}
+
+// the runs of an interleaved archive are mixed so each filesystem is restored in its own pass, which only reads its runs
+int extractar_restore_passes(char *archive, int argc, char **argv, int oper, ccatalog *pending, cdirtime **dirtimes, bool basepass)
+{
+    bool interleaved;
+    int ret=0;
+    int i;
+    
+    if ((oper!=OPER_RESTFS) || (argc<2) || (g_options.concurrentfs==true)) // concurrent restores route the data by filesystem
+        return extractar_restore_archive(archive, argc, argv, oper, pending, dirtimes, basepass);
+    
+    if (strcmp(archive, FSA_STREAM_PATH)==0) // stdin can only be read once: all the filesystems are restored in the same pass
+    {   msgprintf(MSG_VERB1, "the archive is read from the standard input, restoring the filesystems concurrently\n");
+        g_options.concurrentfs=true;
+        return extractar_restore_archive(archive, argc, argv, oper, pending, dirtimes, basepass);
+    }
+    
+    if (extractar_is_interleaved(archive, &interleaved)!=0)
+        return -1;
+    if (interleaved==false)
+        return extractar_restore_archive(archive, argc, argv, oper, pending, dirtimes, basepass);
+    
+    msgprintf(MSG_VERB1, "the filesystems of %s are interleaved, restoring them one after the other\n", archive);
+    for (i=0; (ret==0) && (i < argc) && (get_abort()==false); i++)
+        ret=extractar_restore_archive(archive, 1, &argv[i], oper, pending, dirtimes, basepass);
+    
+    return ret;
+}
+
+int oper_restore(char *archive, int argc, char **argv, int oper)
+{
+    char basearchive[PATH_MAX];
+    cdirtime *dirtimes=NULL;
+    ccatalogitem *item;
+    ccatalog pending;
+    int count;
+    int ret;
+    int i;
+    u32 j;
+    
+    if (catalog_init(&pending)!=0)
+    {   errprintf("catalog_init() failed\n");
+        return -1;
+    }
+    
+    // the times of the directories are only needed if files are restored from base archives
+    count=strlist_count(&g_options.baselist);
+    ret=extractar_restore_passes(archive, argc, argv, oper, &pending, (count>0)?(&dirtimes):(NULL), false);
+    
+    // restore the files of an incremental archive which are stored in its base archives
+    for (i=0; (ret==0) && (pending.count>0) && (i < count) && (get_abort()==false); i++)
+    {
+        strlist_getitem(&g_options.baselist, i, basearchive, sizeof(basearchive));
+        msgprintf(MSG_VERB1, "============= restoring files from base archive %s =============\n", basearchive);
+        ret=extractar_restore_passes(basearchive, argc, argv, oper, &pending, &dirtimes, true);
+    }
+    
+    if ((ret==0) && (pending.count>0))
+    {
+        for (j=0; j < pending.tablesize; j++)
+            for (item=pending.table[j]; item!=NULL; item=item->next)
+                msgprintf(MSG_VERB1, "file [%s] is stored in base archive %.8x\n", item->path, (unsigned int)item->archid);
+        errprintf("%lld files have not been restored because they are stored in base archives, use option --base to provide these archives\n", (long long)pending.count);
+        ret=-1;
+    }
+    
+    extractar_dirtime_destroy(&dirtimes);
+    catalog_destroy(&pending);
+    return ret;
+}
@@ -35,6 +35,7 @@
 #include <assert.h>
 #include <gcrypt.h>
 #include <uuid.h>
+#include <pthread.h>
 
 #include "fsarchiver.h"
 #include "dico.h"
@@ -56,6 +57,15 @@
 #include "thread_archio.h"
 #include "syncthread.h"
 #include "regmulti.h"
+#include "catalog.h"
+#include "checkpoint.h"
+#include "throttle.h"
+#include "dedup.h"
+#include "reflink.h"
+#include "exclude.h"
+#include "ntfsdirect.h"
+#include "extscan.h"
+#include "fsimage.h"
 #include "crypto.h"
 #include "error.h"
 #include "queue.h"
@@ -65,15 +75,28 @@
 #endif
 
 typedef struct s_savear
-{   carchwriter ai;
-    cregmulti   regmulti;
+{   carchwriter *ai; // single writer shared by the walkers of all the filesystems
+    cregmulti   *regmulti[REGMULTI_MAXPACKS]; // small files waiting to be queued (one pack per type with --group-small-files)
+    int         packs; // how many packs are used
     cdichl      *dichardlinks;
+    cdedup      *dedup; // contents of the small files already saved (option --dedup)
+    creflink    *reflink; // shared extents already saved (option --reflink)
+    u64         packid; // id given to the next block of small files of that filesystem
+    u64         packids[REGMULTI_MAXPACKS]; // id of the block being filled in each pack
+    ccatalog    *catalog; // files saved in this archive (written if option --catalog is used)
+    ccatalog    *reference; // files saved in the reference archive (incremental backup)
+    ccheckpoint *resume; // position of an interrupted save until it has been reached again
     cstats      stats;
     int         fstype;
     int         fsid;
     u64         objectid;
     u64         cost_global;
     u64         cost_current;
+    u64         ckptcost; // cost of the objects queued since the last checkpoint
+    cntfsdirect *ntfs; // volume read with libntfs-3g instead of the files under the mount point
+    cextscan    *extscan; // metadata of an ext filesystem read from its inode tables
+    cxfsbulk    *xfsbulk; // attributes of the inodes of an xfs filesystem read in batches
+    cfsimage    *image; // blocks in use of the device saved instead of the files (option --image)
 } csavear;
 
 typedef struct s_devinfo
@@ -81,26 +104,253 @@ typedef struct s_devinfo
     char        partmount[PATH_MAX];
     bool        mountedbyfsa;
     int         fstype;
+    cntfsdirect *ntfs; // set when the volume is read in-process (option --ntfs-direct)
+    cextscan    *extscan; // set when the inode tables have been read (option --ext-scan)
+    cxfsbulk    *xfsbulk; // set when the inodes have been read with bulkstat (option --xfs-bulkstat)
+    cfsimage    *image; // set when the blocks in use are saved (option --image)
 } cdevinfo;
 
-int createar_obj_regfile_multi(csavear *save, cdico *header, char *relpath, char *fullpath, u64 filesize)
+// file being saved: either a descriptor or a file read with libntfs-3g
+typedef struct s_srcfile
+{   int         fd;
+    cntfsfile   *nf;
+} csrcfile;
+
+// directory being walked
+typedef struct s_srcdir
+{   DIR         *dir;
+    cntfsdir    *nd;
+    cextscandir *ed;
+    cxfsbulkdir *xd;
+} csrcdir;
+
+typedef struct s_savefsjob
+{   csavear     save; // private copy of the save state for that filesystem
+    cdevinfo    *devinfo;
+    pthread_t   thread;
+    int         ret;
+} csavefsjob;
+
+// the catalog is shared by the walkers when several filesystems are saved at the same time
+static pthread_mutex_t g_catalogmutex=PTHREAD_MUTEX_INITIALIZER;
+
+// tell the writer that all the objects before this one are complete when they reach the archive
+int createar_checkpoint(csavear *save, u64 objectid, char *relpath)
+{
+    cdico *d;
+    
+    // checkpoints are only saved at volume boundaries so they are useless without split
+    // and there is no single position to resume from when several walkers are running
+    if ((g_options.splitsize==0) || (g_options.concurrentfs==true) || (save->ckptcost < FSA_CHECKPOINT_COST))
+        return 0;
+    
+    if ((d=dico_alloc())==NULL)
+    {   errprintf("dico_alloc() failed\n");
+        return -1;
+    }
+    dico_add_u64(d, 0, CHECKPOINTKEY_OBJECTID, objectid);
+    dico_add_string(d, 0, CHECKPOINTKEY_PATH, relpath);
+    if (queue_add_header(&g_queue, d, FSA_MAGIC_CKPT, save->fsid)!=0)
+    {   errprintf("queue_add_header(FSA_MAGIC_CKPT) failed\n");
+        return -1;
+    }
+    save->ckptcost=0;
+    return 0;
+}
+
+// the walker goes through these functions so that an unmounted ntfs volume can be read with libntfs-3g
+// and so that the metadata of an ext or xfs filesystem can come from a scan of its inodes
+int createar_lstat(csavear *save, char *path, struct stat64 *st)
+{
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (save->extscan!=NULL)
+        return extscan_lstat(save->extscan, path, st);
+#endif // OPTION_EXTDIRECT_SUPPORT
+    if (save->xfsbulk!=NULL)
+        return xfs_bulkstat_lstat(save->xfsbulk, path, st);
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (save->ntfs!=NULL)
+        return ntfsdirect_lstat(save->ntfs, path, st);
+#endif // OPTION_NTFS3G_SUPPORT
+    return lstat64(path, st);
+}
+
+ssize_t createar_readlink(csavear *save, char *path, char *buf, size_t bufsize)
+{
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (save->ntfs!=NULL)
+        return ntfsdirect_readlink(save->ntfs, path, buf, bufsize);
+#endif // OPTION_NTFS3G_SUPPORT
+    return readlink(path, buf, bufsize);
+}
+
+ssize_t createar_listxattr(csavear *save, char *path, char *list, size_t size)
+{
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (save->ntfs!=NULL)
+        return ntfsdirect_listxattr(save->ntfs, path, list, size);
+#endif // OPTION_NTFS3G_SUPPORT
+    return llistxattr(path, list, size);
+}
+
+ssize_t createar_getxattr(csavear *save, char *path, char *name, void *value, size_t size)
+{
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (save->ntfs!=NULL)
+        return ntfsdirect_getxattr(save->ntfs, path, name, value, size);
+#endif // OPTION_NTFS3G_SUPPORT
+    return lgetxattr(path, name, value, size);
+}
+
+int createar_open(csavear *save, char *path, csrcfile *file)
+{
+    file->fd=-1;
+    file->nf=NULL;
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (save->ntfs!=NULL)
+        return ntfsdirect_fopen(save->ntfs, path, &file->nf);
+#endif // OPTION_NTFS3G_SUPPORT
+    return ((file->fd=open64(path, O_RDONLY|O_LARGEFILE))<0) ? -1 : 0;
+}
+
+ssize_t createar_read(csrcfile *file, void *buf, size_t size)
+{
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (file->nf!=NULL)
+        return ntfsdirect_fread(file->nf, buf, size);
+#endif // OPTION_NTFS3G_SUPPORT
+    return read(file->fd, buf, size);
+}
+
+void createar_close(csrcfile *file)
+{
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (file->nf!=NULL)
+        ntfsdirect_fclose(file->nf);
+#endif // OPTION_NTFS3G_SUPPORT
+    if (file->fd>=0)
+        close(file->fd);
+}
+
+int createar_opendir(csavear *save, char *path, csrcdir *dir)
+{
+    dir->dir=NULL;
+    dir->nd=NULL;
+    dir->ed=NULL;
+    dir->xd=NULL;
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (save->extscan!=NULL)
+        return extscan_opendir(save->extscan, path, &dir->ed);
+#endif // OPTION_EXTDIRECT_SUPPORT
+    if (save->xfsbulk!=NULL)
+        return xfs_bulkstat_opendir(save->xfsbulk, path, &dir->xd);
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (save->ntfs!=NULL)
+        return ntfsdirect_opendir(save->ntfs, path, &dir->nd);
+#endif // OPTION_NTFS3G_SUPPORT
+    return ((dir->dir=opendir(path))==NULL) ? -1 : 0;
+}
+
+char *createar_readdir(csrcdir *dir)
+{
+    struct dirent *entry;
+    
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (dir->ed!=NULL)
+        return extscan_readdir(dir->ed);
+#endif // OPTION_EXTDIRECT_SUPPORT
+    if (dir->xd!=NULL)
+        return xfs_bulkstat_readdir(dir->xd);
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (dir->nd!=NULL)
+        return ntfsdirect_readdir(dir->nd);
+#endif // OPTION_NTFS3G_SUPPORT
+    return ((entry=readdir(dir->dir))!=NULL) ? entry->d_name : NULL;
+}
+
+void createar_closedir(csrcdir *dir)
+{
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    if (dir->ed!=NULL)
+        extscan_closedir(dir->ed);
+#endif // OPTION_EXTDIRECT_SUPPORT
+    if (dir->xd!=NULL)
+        xfs_bulkstat_closedir(dir->xd);
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (dir->nd!=NULL)
+        ntfsdirect_closedir(dir->nd);
+#endif // OPTION_NTFS3G_SUPPORT
+    if (dir->dir!=NULL)
+        closedir(dir->dir);
+}
+
+// number of small files which have not been queued yet
+u32 createar_regmulti_count(csavear *save)
+{
+    u32 count=0;
+    int i;
+    
+    for (i=0; i < save->packs; i++)
+        count+=save->regmulti[i]->count;
+    return count;
+}
+
+// queue the block of small files of a pack and start a new one
+int createar_regmulti_enqueue_pack(csavear *save, int pack)
+{
+    if (save->regmulti[pack]->count==0)
+        return 0;
+    if (regmulti_save_enqueue(save->regmulti[pack], &g_queue, save->fsid)!=0)
+    {   errprintf("Cannot queue block of small-files\n");
+        return -1;
+    }
+    regmulti_empty(save->regmulti[pack]);
+    save->packids[pack]=save->packid++;
+    return 0;
+}
+
+// queue the packs which are not empty at the end of the filesystem
+int createar_regmulti_enqueue(csavear *save)
+{
+    int i;
+    
+    for (i=0; i < save->packs; i++)
+        if (createar_regmulti_enqueue_pack(save, i)!=0)
+            return -1;
+    return 0;
+}
+
+// true if the block of small files with that id has been queued (it is not being filled in any pack)
+bool createar_regmulti_queued(csavear *save, u64 packid)
+{
+    int i;
+    
+    for (i=0; i < save->packs; i++)
+        if (save->packids[i]==packid)
+            return false;
+    return true;
+}
+
+int createar_obj_regfile_multi(csavear *save, cdico *header, char *relpath, char *fullpath, u64 filesize, u8 *md5sum)
 {
     char databuf[FSA_MAX_SMALLFILESIZE];
-    u8 md5sum[16];
+    cdedupitem *dupitem;
+    csrcfile file;
     int ret=0;
+    int pack;
     int res;
-    int fd;
     
     // The checksum will be in the obj-header not in a file footer
-    if ((fd=open64(fullpath, O_RDONLY|O_LARGEFILE))<0)
+    if (createar_open(save, fullpath, &file)!=0)
     {   sysprintf("Cannot open small file %s for reading\n", relpath);
         return -1;
     }
     
     msgprintf(MSG_DEBUG1, "backup_obj_regfile_multi(file=%s, size=%lld)\n", relpath, (long long)filesize);
     
-    res=read(fd, databuf, (long)filesize);
-    close(fd);
+    res=createar_read(&file, databuf, (long)filesize);
+    createar_close(&file);
+    throttle_read(filesize);
     if (res!=filesize)
     {   
         if (res>=0 && res<filesize) // file has been truncated: pad with zeros
@@ -118,53 +368,97 @@ int createar_obj_regfile_multi(csavear *save, cdico *header, char *relpath, char
     gcry_md_hash_buffer(GCRY_MD_MD5, md5sum, databuf, filesize);
     dico_add_data(header, 0, DISKITEMKEY_MD5SUM, md5sum, 16);
     
-    // if shared-block with many small files is full, push it to queue and make a new one
-    if (regmulti_save_enough_space_for_new_file(&save->regmulti, filesize)==false)
+    // the same contents are in a block of small files already queued: only write a header which points to it
+    if ((save->dedup!=NULL) && ((dupitem=dedup_get(save->dedup, md5sum, filesize))!=NULL) && (createar_regmulti_queued(save, dupitem->packid)==true))
     {
-        if (regmulti_save_enqueue(&save->regmulti, &g_queue, save->fsid)!=0)
-        {   errprintf("Cannot queue last block of small-files\n");
+        msgprintf(MSG_DEBUG1, "small file %s is a duplicate of %s\n", relpath, dupitem->path);
+        if ((dico_del(header, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_OBJTYPE)!=0) ||
+            (dico_add_u32(header, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_OBJTYPE, OBJTYPE_REGFILEDUP)!=0) ||
+            (dico_add_string(header, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_DUPPATH, dupitem->path)!=0))
+        {   errprintf("cannot write the header of the duplicate small file %s\n", relpath);
+            return -1;
+        }
+        if (queue_add_header(&g_queue, header, FSA_MAGIC_OBJT, save->fsid)!=0)
+        {   errprintf("queue_add_header(%s) failed\n", relpath);
             return -1;
         }
+        return ret;
+    }
+    
+    // similar contents are packed together (and the contents already compressed are not compressed again)
+    pack=(save->packs > 1) ? regmulti_save_classify(relpath, databuf, filesize) : REGMULTI_PACK_TEXT;
+    
+    // if shared-block with many small files is full, push it to queue and make a new one (the other packs keep filling)
+    if (regmulti_save_enough_space_for_new_file(save->regmulti[pack], filesize)==false)
+    {
+        if (createar_regmulti_enqueue_pack(save, pack)!=0)
+            return -1;
         
-        regmulti_empty(&save->regmulti);
+        // the previous small files have all been queued if the other packs are empty too
+        if ((createar_regmulti_count(save)==0) && (createar_checkpoint(save, save->objectid-1, relpath)!=0))
+            return -1;
     }
     
     // copy current small file to the shared-block
-    if (regmulti_save_addfile(&save->regmulti, header, databuf, filesize)!=0)
+    if (regmulti_save_addfile(save->regmulti[pack], header, databuf, filesize)!=0)
     {   errprintf("Cannot add small-file %s to regmulti structure\n", relpath);
         return -1;
     }
     
+    // the next files with the same contents will point to this one
+    if ((save->dedup!=NULL) && (ret==0) && (dedup_add(save->dedup, md5sum, filesize, save->packids[pack], relpath)!=0))
+        return -1;
+    
     return ret;
 }
 
-int createar_obj_regfile_unique(csavear *save, cdico *header, char *relpath, char *fullpath, u64 filesize) // large or empty files
+int createar_obj_regfile_unique(csavear *save, cdico *header, char *relpath, char *fullpath, u64 filesize, u8 *md5sum) // large or empty files
 {
     cdico *footerdico=NULL;
     struct s_blockinfo blkinfo;
+    creflinkrange *range;
+    creflinklist refs;
     gcry_md_hd_t md5ctx;
     u32 curblocksize;
+    char *refbuf;
+    u16 refsize;
     bool eof=false;
     u64 remaining;
     char text[256];
     u8 *origblock;
     u8 *md5tmp;
-    u8 md5sum[16];
     u64 filepos;
+    csrcfile file;
     int ret=0;
     int res;
-    int fd;
     
     if (gcry_md_open(&md5ctx, GCRY_MD_MD5, 0) != GPG_ERR_NO_ERROR)
     {   errprintf("gcry_md_open() failed\n");
         return -1;
     }
     
-    if ((fd=open64(fullpath, O_RDONLY|O_LARGEFILE))<0)
+    if (createar_open(save, fullpath, &file)!=0)
     {   sysprintf("Cannot open %s for reading\n", relpath);
         return -1;
     }
     
+    // the blocks on a shared extent which is already in the archive are saved as references in the header
+    reflinklist_init(&refs);
+    if ((save->reflink!=NULL) && (file.fd>=0) && (filesize>0) &&
+        (reflink_scan(save->reflink, file.fd, filesize, g_options.datablocksize, &refs)==0) && (refs.count > 0))
+    {
+        if ((refbuf=malloc(FSA_MAX_REFLINKSIZE))==NULL)
+        {   errprintf("malloc(%ld) failed: out of memory\n", (long)FSA_MAX_REFLINKSIZE);
+            ret=-1;
+            goto backup_obj_regfile_unique_error;
+        }
+        reflinklist_encode(&refs, refbuf, FSA_MAX_REFLINKSIZE, &refsize);
+        if ((refs.count > 0) && (dico_add_data(header, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_REFLINKS, refbuf, refsize)!=0))
+            refs.count=0;
+        msgprintf(MSG_DEBUG1, "file %s has %ld ranges shared with files already saved\n", relpath, (long)refs.count);
+        free(refbuf);
+    }
+    
     // write header with file attributes (only if open64() works)
     queue_add_header(&g_queue, header, FSA_MAGIC_OBJT, save->fsid);
     
@@ -175,6 +469,27 @@ int createar_obj_regfile_unique(csavear *save, cdico *header, char *relpath, cha
         curblocksize=min(remaining, g_options.datablocksize);
         msgprintf(MSG_DEBUG2, "----> filepos=%lld, remaining=%lld, curblocksize=%lld\n", (long long)filepos, (long long)remaining, (long long)curblocksize);
         
+        // the data of that block are already in the archive: they are not queued but they are part of the md5sum
+        if ((range=reflinklist_find(&refs, filepos))!=NULL)
+        {   curblocksize=min(range->offset+range->length-filepos, g_options.datablocksize);
+            if ((origblock=malloc(curblocksize))==NULL)
+            {   errprintf("malloc(%ld) failed: cannot allocate data block\n", (long)curblocksize);
+                ret=-1;
+                goto backup_obj_regfile_unique_error;
+            }
+            memset(origblock, 0, curblocksize);
+            throttle_read(curblocksize);
+            if ((eof==false) && (createar_read(&file, origblock, (long)curblocksize)!=curblocksize))
+            {   sysprintf("Cannot read the shared data of %s\n", relpath);
+                free(origblock);
+                ret=-1;
+                goto backup_obj_regfile_unique_error;
+            }
+            gcry_md_write(md5ctx, origblock, curblocksize);
+            free(origblock);
+            continue;
+        }
+        
         origblock=malloc(curblocksize);
         if (!origblock)
         {   errprintf("malloc(%ld) failed: cannot allocate data block\n", (long)origblock);
@@ -184,7 +499,8 @@ int createar_obj_regfile_unique(csavear *save, cdico *header, char *relpath, cha
         
         if (eof==false) // file has not been truncated: read the next block
         {
-            if ((res=read(fd, origblock, (long)curblocksize))!=curblocksize)
+            throttle_read(curblocksize);
+            if ((res=createar_read(&file, origblock, (long)curblocksize))!=curblocksize)
             {   ret=-1;
                 if (res>=0 && res<curblocksize) // file has been truncated: pad with zeros
                 {   errprintf("file [%s] has been truncated to %lld bytes (original size: %lld): padding with zeros\n", 
@@ -234,6 +550,12 @@ int createar_obj_regfile_unique(csavear *save, cdico *header, char *relpath, cha
     memcpy(md5sum, md5tmp, 16);
     gcry_md_close(md5ctx);
     
+    // the next files which share the extents of that one will point to its data
+    if ((save->reflink!=NULL) && (ret==0) && (reflink_commit(save->reflink, &refs, relpath)!=0))
+    {   ret=-1;
+        goto backup_obj_regfile_unique_error;
+    }
+    
     msgprintf(MSG_DEBUG1, "--> finished loop for file=%s, size=%lld, md5=[%s]\n", relpath, (long long)filesize, format_md5(text, sizeof(text), md5sum));
     
     // don't write the footer for empty files (checksum does not make sense --> don't waste space in the archive)
@@ -254,7 +576,8 @@ int createar_obj_regfile_unique(csavear *save, cdico *header, char *relpath, cha
     }
     
 backup_obj_regfile_unique_error:
-    close(fd);
+    reflinklist_destroy(&refs);
+    createar_close(&file);
     return ret;
 }
 
@@ -276,13 +599,13 @@ int createar_item_xattr(csavear *save, char *root, char *relpath, struct stat64
     attrcnt=0;
     
     memset(buffer, 0, sizeof(buffer));
-    listlen=llistxattr(fullpath, buffer, sizeof(buffer)-1);
+    listlen=createar_listxattr(save, fullpath, buffer, sizeof(buffer)-1);
     msgprintf(MSG_DEBUG2, "xattr:llistxattr(%s)=%d\n", relpath, listlen);
     
     for (pos=0; (pos<listlen) && (pos<sizeof(buffer)); pos+=len)
     {
         len=strlen(buffer+pos)+1;
-        attrsize=lgetxattr(fullpath, buffer+pos, NULL, 0);
+        attrsize=createar_getxattr(save, fullpath, buffer+pos, NULL, 0);
         msgprintf(MSG_VERB2, "            xattr:file=[%s], attrid=%d, name=[%s], size=%ld\n", relpath, (int)attrcnt, buffer+pos, (long)attrsize);
         if (attrsize>65535LL)
         {   errprintf("file [%s] has an xattr [%s] with data too big (size=%ld, maxsize=64k)\n", relpath, buffer+pos, (long)attrsize);
@@ -296,7 +619,7 @@ int createar_item_xattr(csavear *save, char *root, char *relpath, struct stat64
             continue; // ignore the current xattr
         }
         errno=0;
-        valsize=lgetxattr(fullpath, buffer+pos, valbuf, attrsize);
+        valsize=createar_getxattr(save, fullpath, buffer+pos, valbuf, attrsize);
         msgprintf(MSG_VERB2, "            xattr:lgetxattr(%s,%s)=%d\n", relpath, buffer+pos, valsize);
         if (valsize>=0)
         {
@@ -348,7 +671,7 @@ int createar_item_winattr(csavear *save, char *root, char *relpath, struct stat6
             continue;
         
         errno=0;
-        if ((attrsize=lgetxattr(fullpath, winattr[i], NULL, 0)) < 0) // get the size of the attribute
+        if ((attrsize=createar_getxattr(save, fullpath, winattr[i], NULL, 0)) < 0) // get the size of the attribute
         {
             if (errno!=ENOATTR)
             {
@@ -371,7 +694,7 @@ int createar_item_winattr(csavear *save, char *root, char *relpath, struct stat6
             ret=-1;
             continue; // ignore the current xattr
         }
-        valsize=lgetxattr(fullpath, winattr[i], valbuf, attrsize);
+        valsize=createar_getxattr(save, fullpath, winattr[i], valbuf, attrsize);
         msgprintf(MSG_VERB2, "            winattr:lgetxattr-win(%s,%s)=%d\n", relpath, winattr[i], valsize);
         if (valsize>=0)
         {
@@ -401,6 +724,7 @@ int createar_item_winattr(csavear *save, char *root, char *relpath, struct stat6
 
 int createar_item_stdattr(csavear *save, char *root, char *relpath, struct stat64 *statbuf, cdico *d, int *objtype, u64 *filecost)
 {
+    ccatalogitem *refitem;
     struct stat64 stattarget;
     char fullpath[PATH_MAX];
     char buffer[PATH_MAX];
@@ -462,7 +786,7 @@ int createar_item_stdattr(csavear *save, char *root, char *relpath, struct stat6
             *objtype=OBJTYPE_SYMLINK;
             memset(buffer, 0, sizeof(buffer));
             memset(buffer2, 0, sizeof(buffer2));
-            if ((readlink(fullpath, buffer, sizeof(buffer)))<0)
+            if ((createar_readlink(save, fullpath, buffer, sizeof(buffer)))<0)
             {   sysprintf("readlink(%s) failed\n", fullpath);
                 return -1;
             }
@@ -495,7 +819,7 @@ int createar_item_stdattr(csavear *save, char *root, char *relpath, struct stat6
                     concatenate_paths(buffer2, sizeof(buffer2), directory, linktarget);
                     msgprintf(MSG_DEBUG1, "relative-symlink: fullpath=[%s] --> lstat64=[%s]\n", fullpath, buffer2);
                 }
-                if (lstat64(buffer2, &stattarget)==0)
+                if (createar_lstat(save, buffer2, &stattarget)==0)
                 {
                     switch (stattarget.st_mode & S_IFMT)
                     {
@@ -545,6 +869,17 @@ int createar_item_stdattr(csavear *save, char *root, char *relpath, struct stat6
                 if (((u64)statbuf->st_blocks) * ((u64)DEV_BSIZE) < ((u64)statbuf->st_size))
                     flags|=FSA_FILEFLAGS_SPARSE;
             }
+            // incremental backup: don't copy the contents of files which have not changed since the reference archive
+            // files having hardlinks are always copied so that the first link is restored before the others
+            if ((save->reference!=NULL) && (statbuf->st_nlink==1) && (statbuf->st_size>0) &&
+                ((refitem=catalog_get(save->reference, save->fsid, relpath))!=NULL) &&
+                (catalog_item_unchanged(refitem, statbuf)==true))
+            {
+                *objtype=OBJTYPE_REGFILEBASE;
+                *filecost-=statbuf->st_size;
+                dico_add_u32(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_BASEARCHID, refitem->archid);
+                dico_add_data(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_MD5SUM, refitem->md5sum, 16);
+            }
             break;
         case S_IFCHR:
             dico_add_u64(d, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_RDEV, statbuf->st_rdev);
@@ -575,12 +910,38 @@ int createar_item_stdattr(csavear *save, char *root, char *relpath, struct stat6
     return 0;
 }
 
+// remember where the contents of a regular file are stored (used by the next incremental backup)
+int createar_catalog_add(csavear *save, char *relpath, struct stat64 *statbuf, u8 *md5sum, u32 archid)
+{
+    ccatalogitem item;
+    int res;
+    
+    if (save->catalog==NULL)
+        return 0;
+    
+    memset(&item, 0, sizeof(item));
+    item.path=relpath;
+    item.fsid=save->fsid;
+    item.size=(u64)statbuf->st_size;
+    item.mtime=catalog_time(&statbuf->st_mtim);
+    item.ctime=catalog_time(&statbuf->st_ctim);
+    item.ino=(u64)statbuf->st_ino;
+    item.archid=archid;
+    memcpy(item.md5sum, md5sum, 16);
+    assert(pthread_mutex_lock(&g_catalogmutex)==0);
+    res=catalog_add(save->catalog, &item);
+    assert(pthread_mutex_unlock(&g_catalogmutex)==0);
+    return res;
+}
+
 int createar_save_file(csavear *save, char *root, char *relpath, struct stat64 *statbuf, u64 *costeval)
 {
     char fullpath[PATH_MAX];
     char strprogress[256];
     cdico *dicoattr;
     int attrerrors=0;
+    u32 basearchid;
+    u8 md5sum[16];
     u64 filecost;
     s64 progress;
     int objtype;
@@ -590,7 +951,7 @@ int createar_save_file(csavear *save, char *root, char *relpath, struct stat64 *
     concatenate_paths(fullpath, sizeof(fullpath), root, relpath);
     
     // don't backup the archive file itself
-    if (archwriter_is_path_to_curvol(&save->ai, fullpath)==true)
+    if (archwriter_is_path_to_curvol(save->ai, fullpath)==true)
     {   errprintf("file [%s] ignored: it's the current archive file\n", fullpath);
         save->stats.err_regfile++;
         return 0; // not a fatal error, oper must continue
@@ -614,6 +975,31 @@ int createar_save_file(csavear *save, char *root, char *relpath, struct stat64 *
         return 0;
     }
     
+    // ---- resumed save: the objects before the checkpoint are already in the archive
+    if (save->resume!=NULL)
+    {
+        if (save->objectid-1 < save->resume->objectid)
+        {   save->cost_current+=filecost;
+            dico_destroy(dicoattr);
+            return 0;
+        }
+        if ((save->fsid!=save->resume->fsid) || (strcmp(relpath, save->resume->path)!=0))
+        {   errprintf("found [%s] instead of [%s] at the checkpoint: the filesystem has changed "
+                "since the save was interrupted, it cannot be resumed\n", relpath, save->resume->path);
+            dico_destroy(dicoattr);
+            return -1; // fatal error
+        }
+        msgprintf(MSG_VERB1, "Resuming the save from [%s]\n", relpath);
+        save->resume=NULL;
+    }
+    
+    // ---- all the previous objects are complete if there is no small file waiting in the shared-block
+    if ((createar_regmulti_count(save)==0) && (createar_checkpoint(save, save->objectid-1, relpath)!=0))
+    {   dico_destroy(dicoattr);
+        return -1; // fatal error
+    }
+    save->ckptcost+=filecost;
+    
     // ---- backup other file attributes (xattr + winattr)
     if (createar_item_xattr(save, root, relpath, statbuf, dicoattr)!=0)
     {   msgprintf(MSG_STACK, "backup_item_xattr() failed: cannot prepare xattr-dico for item %s\n", relpath);
@@ -701,13 +1087,15 @@ int createar_save_file(csavear *save, char *root, char *relpath, struct stat64 *
                 dico_destroy(dicoattr);
                 return 0; // error is not fatal, operation must continue
             }
-            if ((res=createar_obj_regfile_unique(save, dicoattr, relpath, fullpath, statbuf->st_size))!=0)
+            if ((res=createar_obj_regfile_unique(save, dicoattr, relpath, fullpath, statbuf->st_size, md5sum))!=0)
             {   msgprintf(MSG_STACK, "backup_obj_regfile_unique(%s)=%d failed\n", relpath, res);
                 save->stats.err_regfile++;
                 return 0; // not a fatal error, oper must continue
             }
             else
             {   save->stats.cnt_regfile++;
+                if (createar_catalog_add(save, relpath, statbuf, md5sum, save->ai->archid)!=0)
+                    return -1; // fatal error
             }
             break;
         case OBJTYPE_REGFILEMULTI:
@@ -716,14 +1104,36 @@ int createar_save_file(csavear *save, char *root, char *relpath, struct stat64 *
                 dico_destroy(dicoattr);
                 return 0; // error is not fatal, operation must continue
             }
-            if ((res=createar_obj_regfile_multi(save, dicoattr, relpath, fullpath, statbuf->st_size))!=0)
+            if ((res=createar_obj_regfile_multi(save, dicoattr, relpath, fullpath, statbuf->st_size, md5sum))!=0)
             {   msgprintf(MSG_STACK, "backup_obj_regfile_multi(%s)=%d failed\n", relpath, res);
                 save->stats.err_regfile++;
                 return 0; // not a fatal error, oper must continue
             }
             else
             {   save->stats.cnt_regfile++;
+                if (createar_catalog_add(save, relpath, statbuf, md5sum, save->ai->archid)!=0)
+                    return -1; // fatal error
+            }
+            break;
+        case OBJTYPE_REGFILEBASE:
+            if (attrerrors>0)
+            {   save->stats.err_regfile++;
+                dico_destroy(dicoattr);
+                return 0; // error is not fatal, operation must continue
+            }
+            // the contents are still in the reference archive: the new catalog has to point to the same archive
+            if ((dico_get_u32(dicoattr, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_BASEARCHID, &basearchid)!=0) ||
+                (dico_get_data(dicoattr, DICO_OBJ_SECTION_STDATTR, DISKITEMKEY_MD5SUM, md5sum, 16, NULL)!=0))
+            {   errprintf("cannot read the reference to the base archive for file %s\n", relpath);
+                return -1; // fatal error
+            }
+            if (queue_add_header(&g_queue, dicoattr, FSA_MAGIC_OBJT, save->fsid)!=0)
+            {   errprintf("queue_add_header(%s) failed\n", relpath);
+                return -1; // fatal error
             }
+            if (createar_catalog_add(save, relpath, statbuf, md5sum, basearchid)!=0)
+                return -1; // fatal error
+            save->stats.cnt_regfile++;
             break;
         default: // unknown type
             errprintf("invalid object type: %ld for file %s\n", (long)objtype, relpath);
@@ -740,20 +1150,20 @@ int createar_save_directory(csavear *save, char *root, char *path, u64 *costeval
     char fullpath[PATH_MAX];
     char relpath[PATH_MAX];
     struct stat64 statbuf;
-    struct dirent *dir;
-    DIR *dirdesc;
+    csrcdir dirdesc;
+    char *name;
     int ret=0;
     
     // init
     concatenate_paths(fulldirpath, sizeof(fulldirpath), root, path);
     
-    if (!(dirdesc=opendir(fulldirpath)))
+    if (createar_opendir(save, fulldirpath, &dirdesc)!=0)
     {   sysprintf("cannot open directory %s\n", fulldirpath);
         return 0; // not a fatal error, oper must continue
     }
     
     // backup the directory itself (important for the root of the filesystem)
-    if (lstat64(fulldirpath, &statbuf)!=0)
+    if (createar_lstat(save, fulldirpath, &statbuf)!=0)
     {   sysprintf("cannot lstat64(%s)\n", fulldirpath);
         ret=-1;
         goto backup_dir_err;
@@ -766,26 +1176,26 @@ int createar_save_directory(csavear *save, char *root, char *path, u64 *costeval
         goto backup_dir_err;
     }
     
-    while (((dir = readdir(dirdesc)) != NULL) && (get_interrupted()==false))
+    while (((name = createar_readdir(&dirdesc)) != NULL) && (get_interrupted()==false))
     {
         // ---- ignore "." and ".." and ignore mount-points
-        if (strcmp(dir->d_name,".")==0 || strcmp(dir->d_name,"..")==0)
+        if (strcmp(name,".")==0 || strcmp(name,"..")==0)
             continue; // ignore "." and ".."
         
         // ---- calculate paths
-        concatenate_paths(relpath, sizeof(relpath), path, dir->d_name);
-        concatenate_paths(fullpath, sizeof(fullpath), fulldirpath, dir->d_name);
+        concatenate_paths(relpath, sizeof(relpath), path, name);
+        concatenate_paths(fullpath, sizeof(fullpath), fulldirpath, name);
         
         // ---- get details about current file
-        if (lstat64(fullpath, &statbuf)!=0)
+        if (createar_lstat(save, fullpath, &statbuf)!=0)
         {   sysprintf("cannot lstat64(%s)\n", fullpath);
             ret=-1;
             goto backup_dir_err;
         }
         
         // check the list of excluded files/dirs
-        if ((exclude_check(&g_options.exclude, dir->d_name)==true) // is filename excluded ?
-            || (exclude_check(&g_options.exclude, relpath)==true)) // is filepath excluded ?
+        if ((exclude_match(&g_exclude, name)==true) // is filename excluded ?
+            || (exclude_match(&g_exclude, relpath)==true)) // is filepath excluded ?
         {
             if (costeval==NULL) // dont log twice (eval + real)
                 msgprintf(MSG_VERB2, "file/dir=[%s] excluded\n", relpath);
@@ -812,45 +1222,142 @@ int createar_save_directory(csavear *save, char *root, char *path, u64 *costeval
     }
     
 backup_dir_err:
-    closedir(dirdesc);
+    createar_closedir(&dirdesc);
     return ret;
 }
 
 int createar_save_directory_wrapper(csavear *save, char *root, char *path, u64 *costeval)
 {
     int ret;
+    int i;
     
     if ((save->dichardlinks=dichl_alloc())==NULL)
     {   errprintf("dichardlinks=dichl_alloc() failed\n");
         return -1;
     }
     
-    if (regmulti_init(&save->regmulti, g_options.datablocksize)!=0)
-    {   errprintf("regmulti_init failed\n");
-        return -1;
+    save->packs=(g_options.groupsmall==true) ? REGMULTI_MAXPACKS : 1;
+    for (i=0; i < save->packs; i++)
+    {
+        if (((save->regmulti[i]=calloc(1, sizeof(cregmulti)))==NULL) || (regmulti_init(save->regmulti[i], g_options.datablocksize)!=0))
+        {   errprintf("cannot allocate the block of the small files\n");
+            return -1;
+        }
+    }
+    if (save->packs==REGMULTI_MAXPACKS)
+        save->regmulti[REGMULTI_PACK_STORED]->nocompress=true;
+    
+    save->dedup=NULL;
+    for (i=0; i < save->packs; i++)
+        save->packids[i]=i;
+    save->packid=save->packs;
+    if (g_options.dedup==true)
+    {
+        if (((save->dedup=malloc(sizeof(cdedup)))==NULL) || (dedup_init(save->dedup)!=0))
+        {   errprintf("cannot allocate the index of the small files\n");
+            free(save->dedup);
+            return -1;
+        }
+    }
+    
+    save->reflink=NULL;
+    if (g_options.reflink==true)
+    {
+        if (((save->reflink=malloc(sizeof(creflink)))==NULL) || (reflink_init(save->reflink)!=0))
+        {   errprintf("cannot allocate the index of the shared extents\n");
+            free(save->reflink);
+            return -1;
+        }
     }
     
     ret=createar_save_directory(save, root, path, costeval);
     
     // put all small files that are in the last block to the queue
-    if (regmulti_save_enqueue(&save->regmulti, &g_queue, save->fsid)!=0)
-    {   errprintf("Cannot queue last block of small-files\n");
+    if (createar_regmulti_enqueue(save)!=0)
         return -1;
+    for (i=0; i < save->packs; i++)
+    {   regmulti_destroy(save->regmulti[i]);
+        free(save->regmulti[i]);
     }
     
     // dico for hard links not required anymore
     dichl_destroy(save->dichardlinks);
     
+    if (save->dedup!=NULL)
+    {   msgprintf(MSG_VERB1, "%lld different contents in the small files of that filesystem\n", (long long)save->dedup->count);
+        dedup_destroy(save->dedup);
+        free(save->dedup);
+        save->dedup=NULL;
+    }
+    
+    if (save->reflink!=NULL)
+    {   msgprintf(MSG_VERB1, "%lld shared extents saved in the archive for that filesystem\n", (long long)save->reflink->count);
+        reflink_destroy(save->reflink);
+        free(save->reflink);
+        save->reflink=NULL;
+    }
+    
     return ret;
 }
 
+// save the blocks in use of the device in large blocks at their offset on the device
+int createar_save_image(csavear *save, cfsimage *img)
+{
+    struct s_blockinfo blkinfo;
+    u64 offset, size;
+    u32 readbytes;
+    u64 total=0;
+    char *buffer;
+    
+    size=fsimage_get_size(img);
+    for (offset=0; (offset < size) && (get_interrupted()==false); offset+=blkinfo.blkrealsize)
+    {
+        memset(&blkinfo, 0, sizeof(blkinfo));
+        blkinfo.blkrealsize=min(size-offset, g_options.datablocksize);
+        if ((buffer=malloc(blkinfo.blkrealsize))==NULL)
+        {   errprintf("malloc(%ld) failed: cannot allocate data block\n", (long)blkinfo.blkrealsize);
+            return -1;
+        }
+        
+        if (fsimage_read(img, offset, buffer, blkinfo.blkrealsize, &readbytes)!=0)
+        {   free(buffer);
+            return -1;
+        }
+        throttle_read(readbytes);
+        
+        // the parts of the device which are not used are not in the archive
+        if (readbytes==0)
+        {   free(buffer);
+            continue;
+        }
+        
+        blkinfo.blkdata=buffer;
+        blkinfo.blkoffset=offset;
+        blkinfo.blkfsid=save->fsid;
+        if (queue_add_block(&g_queue, &blkinfo, QITEM_STATUS_TODO)!=0)
+        {   errprintf("queue_add_block() failed\n");
+            return -1;
+        }
+        save->cost_current+=readbytes;
+        total+=readbytes;
+    }
+    
+    msgprintf(MSG_VERB1, "%lld bytes in use saved out of %lld bytes\n", (long long)total, (long long)size);
+    return (get_interrupted()==true) ? -1 : 0;
+}
+
 int createar_write_mainhead(csavear *save, int archtype, int fscount)
 {
     u8 bufcheckclear[FSA_CHECKPASSBUF_SIZE+8];
     u8 bufcheckcrypt[FSA_CHECKPASSBUF_SIZE+8];
+    u8 cryptsalt[FSA_CRYPT_SALTSIZE];
+    u8 cryptnonce[FSA_CRYPT_NONCESIZE];
+    ccipher *cipher=NULL;
+    u8 crypttag[FSA_CRYPT_TAGSIZE];
     u64 cryptsize;
     u8 md5sum[16];
     struct timeval now;
+    bool needs086;
     cdico *d;
     
     if (!save)
@@ -869,20 +1376,34 @@ int createar_write_mainhead(csavear *save, int archtype, int fscount)
     dico_add_string(d, 0, MAINHEADKEY_PROGVERCREAT, FSA_VERSION);
     dico_add_string(d, 0, MAINHEADKEY_ARCHLABEL, g_options.archlabel);
     dico_add_u64(d, 0, MAINHEADKEY_CREATTIME, now.tv_sec);
-    dico_add_u32(d, 0, MAINHEADKEY_ARCHIVEID, save->ai.archid);
+    dico_add_u32(d, 0, MAINHEADKEY_ARCHIVEID, save->ai->archid);
     dico_add_u32(d, 0, MAINHEADKEY_ARCHTYPE, archtype);
     dico_add_u32(d, 0, MAINHEADKEY_COMPRESSALGO, g_options.compressalgo);
     dico_add_u32(d, 0, MAINHEADKEY_COMPRESSLEVEL, g_options.compresslevel);
     dico_add_u32(d, 0, MAINHEADKEY_ENCRYPTALGO, g_options.encryptalgo);
     dico_add_u32(d, 0, MAINHEADKEY_FSACOMPLEVEL, g_options.fsacomplevel);
     dico_add_u32(d, 0, MAINHEADKEY_HASDIRSINFOHEAD, true);
-    
-    // minimum fsarchiver version required to restore that archive
-    dico_add_u64(d, 0, MAINHEADKEY_MINFSAVERSION, FSA_VERSION_BUILD(0, 6, 4, 0));
+    if (g_options.dedup==true)
+        dico_add_u32(d, 0, MAINHEADKEY_HASDUPLICATES, true);
+    if (g_options.reflink==true)
+        dico_add_u32(d, 0, MAINHEADKEY_HASREFLINKS, true);
+    if (g_options.groupsmall==true)
+        dico_add_u32(d, 0, MAINHEADKEY_GROUPSMALL, true);
+    if (g_options.largeblksize>0)
+        dico_add_u32(d, 0, MAINHEADKEY_LARGEBLKSIZE, g_options.largeblksize);
+    
+    // minimum fsarchiver version required to restore that archive: older versions do not know
+    // incremental objects, interleaved filesystems, duplicates, references to other files,
+    // device blocks, blocks bigger than FSA_MAX_BLKSIZE and aes-gcm
+    needs086=(save->reference!=NULL) || ((g_options.concurrentfs==true) && (fscount > 1)) || (g_options.dedup==true) ||
+        (g_options.reflink==true) || (g_options.image==true) || (g_options.largeblksize>0) || (g_options.encryptalgo==ENCRYPT_AES256GCM);
+    dico_add_u64(d, 0, MAINHEADKEY_MINFSAVERSION, needs086 ? FSA_VERSION_BUILD(0, 8, 6, 0) : FSA_VERSION_BUILD(0, 6, 4, 0));
     
     if (archtype==ARCHTYPE_FILESYSTEMS)
     {   
         dico_add_u64(d, 0, MAINHEADKEY_FSCOUNT, fscount);
+        if ((g_options.concurrentfs==true) && (fscount > 1))
+            dico_add_u32(d, 0, MAINHEADKEY_FSINTERLEAVED, true);
     }
     
     // if encryption is enabled, save the md5sum of a random buffer to check the password
@@ -890,8 +1411,29 @@ int createar_write_mainhead(csavear *save, int archtype, int fscount)
     {
         memset(md5sum, 0, sizeof(md5sum));
         crypto_random(bufcheckclear, FSA_CHECKPASSBUF_SIZE);
-        crypto_blowfish(FSA_CHECKPASSBUF_SIZE, &cryptsize, bufcheckclear, bufcheckcrypt, 
-            g_options.encryptpass, strlen((char*)g_options.encryptpass), true);
+        if (g_options.encryptalgo==ENCRYPT_AES256GCM) // the key is derived once for all the blocks of that archive
+        {
+            crypto_random(cryptsalt, FSA_CRYPT_SALTSIZE);
+            if ((crypto_aes256gcm_setkey(g_options.encryptpass, strlen((char*)g_options.encryptpass), cryptsalt, FSA_CRYPT_SALTSIZE, FSA_CRYPT_KDFITER, save->ai->archid)!=0) ||
+                (crypto_aes256gcm_nonce(cryptnonce, FSA_FILESYSID_NULL, 0, 0)!=0) ||
+                ((cipher=crypto_aes256gcm_open())==NULL) ||
+                (crypto_aes256gcm(cipher, FSA_CHECKPASSBUF_SIZE, bufcheckclear, bufcheckcrypt, cryptnonce, NULL, 0, crypttag, true)!=0))
+            {   errprintf("cannot encrypt the buffer which checks the password\n");
+                crypto_aes256gcm_close(cipher);
+                dico_destroy(d);
+                return -1;
+            }
+            crypto_aes256gcm_close(cipher);
+            assert(dico_add_data(d, 0, MAINHEADKEY_CRYPTSALT, cryptsalt, FSA_CRYPT_SALTSIZE)==0);
+            assert(dico_add_u32(d, 0, MAINHEADKEY_CRYPTKDFITER, FSA_CRYPT_KDFITER)==0);
+            assert(dico_add_data(d, 0, MAINHEADKEY_CRYPTNONCE, cryptnonce, FSA_CRYPT_NONCESIZE)==0);
+            assert(dico_add_data(d, 0, MAINHEADKEY_CRYPTTAG, crypttag, FSA_CRYPT_TAGSIZE)==0);
+        }
+        else
+        {
+            crypto_blowfish(FSA_CHECKPASSBUF_SIZE, &cryptsize, bufcheckclear, bufcheckcrypt, 
+                g_options.encryptpass, strlen((char*)g_options.encryptpass), true);
+        }
         
         gcry_md_hash_buffer(GCRY_MD_MD5, md5sum, bufcheckclear, FSA_CHECKPASSBUF_SIZE);
         
@@ -1022,13 +1564,25 @@ int filesystem_mount_partition(cdevinfo *devinfo, cdico *dicofsinfo, u16 fsid)
         }
         devinfo->mountedbyfsa=true;
     }
+#ifdef OPTION_NTFS3G_SUPPORT
+    else if ((g_options.ntfsdirect==true) && (ntfs_test(devinfo->devpath)==true)) // read the volume with libntfs-3g: nothing to mount
+    {
+        msgprintf(MSG_DEBUG1, "partition %s is not mounted: reading it with libntfs-3g\n", devinfo->devpath);
+        if (ntfsdirect_open(&devinfo->ntfs, devinfo->devpath, devinfo->partmount)!=0)
+        {   errprintf("cannot open the ntfs filesystem on [%s] with libntfs-3g\n", devinfo->devpath);
+            return -1;
+        }
+        generic_get_fstype("ntfs", &devinfo->fstype);
+        devinfo->mountedbyfsa=false;
+    }
+#endif // OPTION_NTFS3G_SUPPORT
     else // partition not yet mounted
     {
         mkdir_recursive(devinfo->partmount);
         msgprintf(MSG_DEBUG1, "partition %s is not mounted\n", devinfo->devpath);
         for (tmptype=-1, i=0; (filesys[i].name) && (tmptype==-1); i++)
         {
-            if ((filesys[i].test(devinfo->devpath)==true) && (filesys[i].mount(devinfo->devpath, devinfo->partmount, filesys[i].name, MS_RDONLY, NULL)==0))
+            if ((filesys[i].test(devinfo->devpath)==true) && (filesys[i].mount(devinfo->devpath, devinfo->partmount, filesys[i].name, MS_RDONLY, NULL, FSPROFILE_DEFAULT)==0))
             {   tmptype=i;
                 msgprintf(MSG_DEBUG1, "partition %s successfully mounted on [%s] as [%s]\n", devinfo->devpath, devinfo->partmount, filesys[i].name);
             }
@@ -1047,8 +1601,50 @@ int filesystem_mount_partition(cdevinfo *devinfo, cdico *dicofsinfo, u16 fsid)
         return -1;
     }
 
+#ifdef OPTION_EXTDIRECT_SUPPORT
+    // read the metadata of an ext filesystem from its inode tables instead of calling lstat on each file,
+    // the data on the device may be out of date when the filesystem is mounted read-write
+    if ((g_options.extscan==true) && (strncmp(filesys[devinfo->fstype].name, "ext", 3)==0))
+    {
+        if ((res==0) && (readwrite==1))
+            errprintf("partition [%s] is mounted read/write: option --ext-scan is ignored\n", devinfo->devpath);
+        else if (extscan_open(&devinfo->extscan, devinfo->devpath, devinfo->partmount)!=0)
+        {   errprintf("cannot read the inode tables of [%s] with libext2fs\n", devinfo->devpath);
+            return -1;
+        }
+    }
+#endif // OPTION_EXTDIRECT_SUPPORT
+    
+    // read the attributes of all the inodes of an xfs filesystem in large batches in the order of the inode
+    // numbers instead of calling lstat on each file, the names still come from the directories
+    if ((g_options.xfsbulkstat==true) && (strcmp(filesys[devinfo->fstype].name, "xfs")==0))
+    {
+        if (xfs_bulkstat_open(&devinfo->xfsbulk, devinfo->partmount)!=0)
+        {   errprintf("cannot read the inodes of [%s] with XFS_IOC_BULKSTAT (linux >= 5.3 is required)\n", devinfo->devpath);
+            return -1;
+        }
+    }
+    
+    // save the blocks in use of the device instead of the files (the data must not change during the save)
+    if (g_options.image==true)
+    {
+        if (strncmp(filesys[devinfo->fstype].name, "ext", 3)!=0)
+        {   errprintf("option --image only supports ext2, ext3 and ext4 filesystems and [%s] is %s\n",
+                devinfo->devpath, filesys[devinfo->fstype].name);
+            return -1;
+        }
+        if ((res==0) && (readwrite==1))
+        {   errprintf("partition [%s] must not be mounted read/write to be saved with option --image\n", devinfo->devpath);
+            return -1;
+        }
+        if (fsimage_open(&devinfo->image, devinfo->devpath)!=0)
+        {   errprintf("cannot read the block bitmap of [%s]\n", devinfo->devpath);
+            return -1;
+        }
+    }
+    
     // Make sure support for extended attributes is enabled if this filesystem supports it
-    if (g_options.dontcheckmountopts==false)
+    if ((g_options.dontcheckmountopts==false) && (devinfo->ntfs==NULL))
     {
         errorattr=false;
 
@@ -1082,12 +1678,24 @@ int filesystem_mount_partition(cdevinfo *devinfo, cdico *dicofsinfo, u16 fsid)
     }
 
     // get space statistics
-    if (statvfs64(devinfo->partmount, &statfsbuf)!=0)
-    {   errprintf("statvfs64(%s) failed\n", devinfo->partmount);
-        return -1;
+#ifdef OPTION_NTFS3G_SUPPORT
+    if (devinfo->ntfs!=NULL)
+    {
+        if (ntfsdirect_statfs(devinfo->ntfs, &fsbytestotal, &fsbytesused)!=0)
+        {   errprintf("cannot get the space statistics of [%s]\n", devinfo->devpath);
+            return -1;
+        }
+    }
+    else
+#endif // OPTION_NTFS3G_SUPPORT
+    {
+        if (statvfs64(devinfo->partmount, &statfsbuf)!=0)
+        {   errprintf("statvfs64(%s) failed\n", devinfo->partmount);
+            return -1;
+        }
+        fsbytestotal=(u64)statfsbuf.f_frsize*(u64)statfsbuf.f_blocks;
+        fsbytesused=fsbytestotal-((u64)statfsbuf.f_frsize*(u64)statfsbuf.f_bfree);
     }
-    fsbytestotal=(u64)statfsbuf.f_frsize*(u64)statfsbuf.f_blocks;
-    fsbytesused=fsbytestotal-((u64)statfsbuf.f_frsize*(u64)statfsbuf.f_bfree);
     
     dico_add_string(dicofsinfo, 0, FSYSHEADKEY_FILESYSTEM, filesys[devinfo->fstype].name);
     dico_add_string(dicofsinfo, 0, FSYSHEADKEY_MNTPATH, devinfo->partmount);
@@ -1100,6 +1708,14 @@ int filesystem_mount_partition(cdevinfo *devinfo, cdico *dicofsinfo, u16 fsid)
         return -1;
     }
     
+    // the restoration writes the blocks back to a device which is large enough
+    if (devinfo->image!=NULL)
+    {
+        dico_add_u64(dicofsinfo, 0, FSYSHEADKEY_IMAGESIZE, fsimage_get_size(devinfo->image));
+        dico_del(dicofsinfo, 0, FSYSHEADKEY_MINFSAVERSION);
+        dico_add_u64(dicofsinfo, 0, FSYSHEADKEY_MINFSAVERSION, FSA_VERSION_BUILD(0, 8, 6, 0));
+    }
+    
     return 0;
 }
 
@@ -1109,18 +1725,31 @@ int createar_oper_savefs(csavear *save, cdevinfo *devinfo)
     cdico *dicoend=NULL;
     int ret=0;
     
-    // write "begin of filesystem" header
-    if ((dicobegin=dico_alloc())==NULL)
-    {   errprintf("dicostart=dico_alloc() failed\n");
-        return -1;
+    // write "begin of filesystem" header (unless this filesystem was started before the save was interrupted)
+    if ((save->resume==NULL) || (save->fsid > save->resume->fsid))
+    {
+        if ((dicobegin=dico_alloc())==NULL)
+        {   errprintf("dicostart=dico_alloc() failed\n");
+            return -1;
+        }
+        queue_add_header(&g_queue, dicobegin, FSA_MAGIC_FSYB, save->fsid);
     }
-    queue_add_header(&g_queue, dicobegin, FSA_MAGIC_FSYB, save->fsid);
     
     // init filesystem data struct
     save->fstype=devinfo->fstype;
+    save->ntfs=devinfo->ntfs;
+    save->extscan=devinfo->extscan;
+    save->xfsbulk=devinfo->xfsbulk;
     
     // main task
-    ret=createar_save_directory_wrapper(save, devinfo->partmount, "/", NULL);
+    if (devinfo->image!=NULL)
+        ret=createar_save_image(save, devinfo->image);
+    else
+        ret=createar_save_directory_wrapper(save, devinfo->partmount, "/", NULL);
+    
+    // the contents of that filesystem were complete before the save was interrupted
+    if (save->resume!=NULL)
+        return ret;
     
     // write "end of filesystem" header
     if ((dicoend=dico_alloc())==NULL)
@@ -1134,6 +1763,63 @@ int createar_oper_savefs(csavear *save, cdevinfo *devinfo)
     return ret;
 }
 
+void *createar_savefs_thread(void *args)
+{
+    csavefsjob *job=(csavefsjob *)args;
+    
+    msgprintf(MSG_VERB1, "============= archiving filesystem %s =============\n", job->devinfo->devpath);
+    if ((job->ret=createar_oper_savefs(&job->save, job->devinfo))!=0)
+    {   errprintf("archive_filesystem(%s) failed\n", job->devinfo->devpath);
+        set_stopfillqueue(); // the other walkers must stop too
+    }
+    return NULL;
+}
+
+// save all the filesystems at the same time: each walker queues the objects of its own
+// filesystem and the writer interleaves them in the archive in the order they arrive
+int createar_oper_savefs_concurrent(csavear *save, cdevinfo *devinfo, u64 *fscost, int fscount, u64 *totalerr)
+{
+    csavefsjob *jobs;
+    int ret=0;
+    int i;
+    
+    if ((jobs=calloc(fscount, sizeof(csavefsjob)))==NULL)
+    {   errprintf("calloc(%ld) failed: out of memory\n", (long)(fscount*sizeof(csavefsjob)));
+        return -1;
+    }
+    
+    for (i=0; i < fscount; i++)
+    {
+        memcpy(&jobs[i].save, save, sizeof(csavear)); // the copies share the writer through save->ai
+        jobs[i].save.fsid=i;
+        jobs[i].save.objectid=0;
+        jobs[i].save.cost_global=fscost[i];
+        jobs[i].save.cost_current=0;
+        memset(&jobs[i].save.stats, 0, sizeof(jobs[i].save.stats));
+        jobs[i].devinfo=&devinfo[i];
+        if (pthread_create(&jobs[i].thread, NULL, createar_savefs_thread, (void*)&jobs[i])!=0)
+        {   errprintf("pthread_create(createar_savefs_thread) failed\n");
+            set_stopfillqueue();
+            ret=-1;
+            break;
+        }
+    }
+    
+    for (i=0; i < fscount; i++)
+    {
+        if (jobs[i].thread && pthread_join(jobs[i].thread, NULL)!=0)
+            errprintf("pthread_join(createar_savefs_thread) failed\n");
+        if (jobs[i].ret!=0)
+            ret=-1;
+        if (get_interrupted()==false)
+            stats_show(jobs[i].save.stats, i);
+        *totalerr+=stats_errcount(jobs[i].save.stats);
+    }
+    
+    free(jobs);
+    return ret;
+}
+
 int createar_oper_savedir(csavear *save, char *rootdir)
 {
     char fullpath[PATH_MAX];
@@ -1158,26 +1844,43 @@ int oper_save(char *archive, int argc, char **argv, int archtype)
     pthread_t thread_comp[FSA_MAX_COMPJOBS];
     cdico *dicofsinfo[FSA_MAX_FSPERARCH];
     cdevinfo devinfo[FSA_MAX_FSPERARCH];
+    u64 fscost[FSA_MAX_FSPERARCH];
     pthread_t thread_writer;
     u64 cost_evalfs=0;
     u64 totalerr=0;
     cdico *dicoend=NULL;
     cdico *dirsinfo=NULL;
+    char journal[PATH_MAX];
+    ccheckpoint resume;
+    bool stream;
+    ccatalog reference;
+    ccatalog catalog;
     struct stat64 st;
+    carchwriter ai;
     csavear save;
     int ret=0;
     int i;
     
     // init
     memset(&save, 0, sizeof(save));
+    save.ai=&ai;
+    memset(&reference, 0, sizeof(reference));
+    memset(&catalog, 0, sizeof(catalog));
     save.cost_global=0;
+    throttle_init();
     
     // init archive
-    archwriter_init(&save.ai);
-    archwriter_generate_id(&save.ai);
+    archwriter_init(save.ai);
+    archwriter_generate_id(save.ai);
     
     // pass options to archive
-    path_force_extension(save.ai.basepath, PATH_MAX, archive, ".fsa");
+    memset(journal, 0, sizeof(journal));
+    if ((stream=(strcmp(archive, FSA_STREAM_PATH)==0))==true) // the archive is written to stdout
+        snprintf(save.ai->basepath, PATH_MAX, "%s", FSA_STREAM_PATH);
+    else
+        path_force_extension(save.ai->basepath, PATH_MAX, archive, ".fsa");
+    if (stream==false)
+        checkpoint_path(journal, sizeof(journal), save.ai->basepath);
     
     // init misc data struct to zero
     thread_writer=0;
@@ -1213,6 +1916,89 @@ int oper_save(char *archive, int argc, char **argv, int archtype)
         }
     }
     
+    // the archive always contains all the files: only the restoration can select some of them
+    if (strlist_count(&g_options.include)>0)
+    {   errprintf("option -i can only be used with restfs and restdir, use option -e to exclude files from the archive\n");
+        ret=-1;
+        goto do_create_error;
+    }
+    
+    // there is only one volume which cannot be read again when the archive is written to stdout
+    if ((stream==true) && ((g_options.splitsize>0) || (g_options.resume==true) || (strlist_count(&g_options.voldirs)>0)))
+    {   errprintf("options -s, --resume and --voldir cannot be used when the archive is written to the standard output\n");
+        ret=-1;
+        goto do_create_error;
+    }
+    
+    // continue an interrupted save from its last checkpoint
+    if (g_options.resume==true)
+    {
+        if (g_options.splitsize==0)
+        {   errprintf("option --resume requires the same split size (option -s) as the interrupted save\n");
+            ret=-1;
+            goto do_create_error;
+        }
+        if (g_options.catalog!=NULL)
+        {   errprintf("options --resume and --catalog cannot be used together\n");
+            ret=-1;
+            goto do_create_error;
+        }
+        if (g_options.concurrentfs==true)
+        {   errprintf("options --resume and --concurrent-fs cannot be used together\n");
+            ret=-1;
+            goto do_create_error;
+        }
+        if (g_options.encryptalgo==ENCRYPT_AES256GCM)
+        {   errprintf("option --resume cannot be used with --cipher=aes256gcm as the key depends on the archive\n");
+            ret=-1;
+            goto do_create_error;
+        }
+        if (g_options.image==true)
+        {   errprintf("options --resume and --image cannot be used together\n");
+            ret=-1;
+            goto do_create_error;
+        }
+        if (checkpoint_read(&resume, save.ai->basepath)!=0)
+        {   errprintf("cannot find where the save of %s was interrupted, it cannot be resumed\n", save.ai->basepath);
+            ret=-1;
+            goto do_create_error;
+        }
+        save.ai->archid=resume.archid;
+        save.ai->ckpt=resume;
+        save.ai->resume=true;
+        save.resume=&resume;
+    }
+    else if (regfile_exists(journal)==true)
+    {
+        if (g_options.overwrite==0)
+        {   errprintf("the save of %s was interrupted: use option --resume to continue it or -o to start again\n", save.ai->basepath);
+            ret=-1;
+            goto do_create_error;
+        }
+        checkpoint_remove(save.ai->basepath);
+    }
+    
+    // load the catalog of the reference archive for an incremental backup
+    if (g_options.incremental!=NULL)
+    {
+        if ((catalog_init(&reference)!=0) || (catalog_read(&reference, g_options.incremental)!=0))
+        {   errprintf("cannot load the catalog of the reference archive: [%s]\n", g_options.incremental);
+            ret=-1;
+            goto do_create_error;
+        }
+        save.reference=&reference;
+    }
+    
+    if (g_options.catalog!=NULL)
+    {
+        if (catalog_init(&catalog)!=0)
+        {   errprintf("catalog_init() failed\n");
+            ret=-1;
+            goto do_create_error;
+        }
+        save.catalog=&catalog;
+    }
+    
     // create compression threads
     for (i=0; (i<g_options.compressjobs) && (i<FSA_MAX_COMPJOBS); i++)
     {
@@ -1223,15 +2009,18 @@ int oper_save(char *archive, int argc, char **argv, int archtype)
         }
     }
     
+    // the walkers of the filesystems saved concurrently all queue their objects: the writer groups them in runs
+    save.ai->runs=((archtype==ARCHTYPE_FILESYSTEMS) && (g_options.concurrentfs==true) && (argc > 1));
+    
     // create archive-writer thread
-    if (pthread_create(&thread_writer, NULL, thread_writer_fct, (void*)&save.ai) != 0)
+    if (pthread_create(&thread_writer, NULL, thread_writer_fct, (void*)save.ai) != 0)
     {   errprintf("pthread_create(thread_writer_fct) failed\n");
         ret=-1;
         goto do_create_error;
     }
     
-    // write archive main header
-    if (createar_write_mainhead(&save, archtype, argc)!=0)
+    // write archive main header (a resumed archive already has all the global headers)
+    if ((save.resume==NULL) && (createar_write_mainhead(&save, archtype, argc)!=0))
     {   errprintf("archive_write_mainhead(%s) failed\n", archive);
         ret=-1;
         goto do_create_error;
@@ -1263,8 +2052,14 @@ int oper_save(char *archive, int argc, char **argv, int archtype)
         {
             // evaluate the cost of the operation
             cost_evalfs=0;
+            save.fsid=i;
+            save.ntfs=devinfo[i].ntfs;
+            save.extscan=devinfo[i].extscan;
+            save.xfsbulk=devinfo[i].xfsbulk;
             msgprintf(MSG_VERB1, "Analysing filesystem on %s...\n", devinfo[i].devpath);
-            if (createar_save_directory_wrapper(&save, devinfo[i].partmount, "/", &cost_evalfs)!=0)
+            if (devinfo[i].image!=NULL)
+                cost_evalfs=fsimage_get_usedbytes(devinfo[i].image);
+            else if (createar_save_directory_wrapper(&save, devinfo[i].partmount, "/", &cost_evalfs)!=0)
             {   sysprintf("cannot run evaluation createar_save_directory(%s)\n", devinfo[i].partmount);
                 goto do_create_error;
             }
@@ -1273,9 +2068,13 @@ int oper_save(char *archive, int argc, char **argv, int archtype)
                 goto do_create_error;
             }
             save.cost_global+=cost_evalfs;
+            fscost[i]=cost_evalfs;
             
             // write filesystem header
-            if (queue_add_header(&g_queue, dicofsinfo[i], FSA_MAGIC_FSIN, FSA_FILESYSID_NULL)!=0)
+            if (save.resume!=NULL)
+            {   dico_destroy(dicofsinfo[i]);
+            }
+            else if (queue_add_header(&g_queue, dicofsinfo[i], FSA_MAGIC_FSIN, FSA_FILESYSID_NULL)!=0)
             {   errprintf("queue_add_header(FSA_MAGIC_FSIN, %s) failed\n", devinfo[i].devpath);
                 goto do_create_error;
             }
@@ -1308,7 +2107,10 @@ int oper_save(char *archive, int argc, char **argv, int archtype)
             goto do_create_error;
         }
         
-        if (queue_add_header(&g_queue, dirsinfo, FSA_MAGIC_DIRS, FSA_FILESYSID_NULL)!=0)
+        if (save.resume!=NULL)
+        {   dico_destroy(dirsinfo);
+        }
+        else if (queue_add_header(&g_queue, dirsinfo, FSA_MAGIC_DIRS, FSA_FILESYSID_NULL)!=0)
         {   errprintf("queue_add_header(FSA_MAGIC_DIRS) failed\n");
             goto do_create_error;
         }
@@ -1323,6 +2125,12 @@ int oper_save(char *archive, int argc, char **argv, int archtype)
     switch (archtype)
     {
         case ARCHTYPE_FILESYSTEMS:// write contents of each filesystem
+            if ((g_options.concurrentfs==true) && (argc > 1))
+            {
+                if (createar_oper_savefs_concurrent(&save, devinfo, fscost, argc, &totalerr)!=0)
+                    goto do_create_error;
+                break;
+            }
             for (i=0; (i < argc) && (devinfo[i].devpath!=NULL) && (get_interrupted()==false); i++)
             {
                 msgprintf(MSG_VERB1, "============= archiving filesystem %s =============\n", devinfo[i].devpath);
@@ -1355,6 +2163,8 @@ int oper_save(char *archive, int argc, char **argv, int archtype)
             if (get_interrupted()==false)
                 stats_show(save.stats, 0);
             totalerr+=stats_errcount(save.stats);
+            if (save.resume!=NULL)
+                break; // reported below
             // write "end of archive" header
             if ((dicoend=dico_alloc())==NULL)
             {   errprintf("dicoend=dico_alloc() failed\n");
@@ -1370,6 +2180,13 @@ int oper_save(char *archive, int argc, char **argv, int archtype)
             goto do_create_error;
     }
     
+    // the object where the save was interrupted has not been found
+    if ((get_interrupted()==false) && (save.resume!=NULL))
+    {   errprintf("[%s] which is where the save was interrupted has not been found: "
+            "the filesystem has changed, the save cannot be resumed\n", save.resume->path);
+        goto do_create_error;
+    }
+    
     if (get_interrupted()==false)
         goto do_create_success;
     if (get_abort()==true)
@@ -1384,6 +2201,18 @@ do_create_success:
     
     for (i=0; i < FSA_MAX_FSPERARCH; i++)
     {
+#ifdef OPTION_NTFS3G_SUPPORT
+        if (devinfo[i].ntfs!=NULL)
+            ntfsdirect_close(devinfo[i].ntfs);
+#endif // OPTION_NTFS3G_SUPPORT
+#ifdef OPTION_EXTDIRECT_SUPPORT
+        if (devinfo[i].extscan!=NULL)
+            extscan_close(devinfo[i].extscan);
+#endif // OPTION_EXTDIRECT_SUPPORT
+        if (devinfo[i].xfsbulk!=NULL)
+            xfs_bulkstat_close(devinfo[i].xfsbulk);
+        if (devinfo[i].image!=NULL)
+            fsimage_close(devinfo[i].image);
         if (devinfo[i].mountedbyfsa==true)
         {
             msgprintf(MSG_VERB2, "unmounting [%s] which is mounted on [%s]\n", devinfo[i].devpath, devinfo[i].partmount);
@@ -1403,13 +2232,26 @@ do_create_success:
     if (thread_writer && pthread_join(thread_writer, NULL) != 0)
         errprintf("pthread_join(thread_writer) failed\n");
     
-    if (ret!=0)
-        archwriter_remove(&save.ai);
+    // keep the volumes of an interrupted save which can be resumed
+    if ((ret!=0) && (g_options.splitsize>0) && (regfile_exists(journal)==true))
+        msgprintf(MSG_FORCE, "the archive is incomplete: run the same command with option --resume to continue the save\n");
+    else if (ret!=0)
+        archwriter_remove(save.ai);
+    else if (stream==false)
+        checkpoint_remove(save.ai->basepath);
+    
+    // the catalog is only written when the archive is complete
+    if ((ret==0) && (save.catalog!=NULL) && (catalog_write(save.catalog, g_options.catalog)!=0))
+        ret=-1;
     
     // change the status if there were non-fatal errors
     if (totalerr>0)
         ret=-1;
     
-    archwriter_destroy(&save.ai);
+    catalog_destroy(&catalog);
+    catalog_destroy(&reference);
+    
+    archwriter_destroy(save.ai);
+    throttle_destroy();
     return ret;
 }
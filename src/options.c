@@ -32,6 +32,12 @@ int options_init()
     memset(&g_options, 0, sizeof(coptions));
     if (strlist_init(&g_options.exclude)!=0)
         return -1;
+    if (strlist_init(&g_options.include)!=0)
+        return -1;
+    if (strlist_init(&g_options.baselist)!=0)
+        return -1;
+    if (strlist_init(&g_options.voldirs)!=0)
+        return -1;
     return 0;
 }
 
@@ -39,6 +45,12 @@ int options_destroy()
 {
     if (strlist_destroy(&g_options.exclude)!=0)
         return -1;
+    if (strlist_destroy(&g_options.include)!=0)
+        return -1;
+    if (strlist_destroy(&g_options.baselist)!=0)
+        return -1;
+    if (strlist_destroy(&g_options.voldirs)!=0)
+        return -1;
     memset(&g_options, 0, sizeof(coptions));
     return 0;
 }
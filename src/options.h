@@ -42,6 +42,29 @@ struct s_options
 	char     archlabel[FSA_MAX_LABELLEN];
     u8       encryptpass[FSA_MAX_PASSLEN+1];
     cstrlist exclude;
+    cstrlist include;
+    char     *catalog;
+    char     *incremental;
+    cstrlist baselist;
+    bool     resume;
+    bool     concurrentfs;
+    bool     dedup;
+    bool     reflink;
+    cstrlist voldirs;
+    u64      readrate;
+    u64      writerate;
+    int      cpulimit;
+    char     *throttlefile;
+    bool     ntfsdirect;
+    bool     extdirect;
+    bool     extscan;
+    bool     xfsbulkstat;
+    bool     image;
+    bool     fastrestore;
+    bool     groupsmall;
+    u32      largeblksize;
+    bool     zstdlong;
+    u16      cipher;
 };
 
 extern coptions g_options;
@@ -48,6 +48,9 @@ struct s_blockinfo // used when (type==QITEM_TYPE_BLOCK)
     u16                  blkcryptalgo; // algo used to compressed the block
     u16                  blkfsid; // id of filesystem to which the block belongs
     bool                 blklocked; // true if locked (being processed in the compress/crypt thread)
+    bool                 blknocomp; // stored without trying to compress it (small files already compressed)
+    u8                   blkcryptnonce[FSA_CRYPT_NONCESIZE]; // nonce used to encrypt that block (aes-gcm only)
+    u8                   blkcrypttag[FSA_CRYPT_TAGSIZE]; // authentication tag of that block (aes-gcm only)
 };
 
 struct s_headinfo // used when (type==QITEM_TYPE_HEADER)
@@ -0,0 +1,349 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+
+#include "fsarchiver.h"
+#include "reflink.h"
+#include "common.h"
+#include "error.h"
+
+#define REFLINK_DEF_TABLESIZE     65536
+#define REFLINK_FIEMAP_EXTENTS    256
+
+// extents whose physical address does not identify the data of the file
+#define REFLINK_FIEMAP_BADFLAGS   (FIEMAP_EXTENT_UNKNOWN|FIEMAP_EXTENT_DELALLOC|FIEMAP_EXTENT_ENCODED|\
+                                   FIEMAP_EXTENT_DATA_ENCRYPTED|FIEMAP_EXTENT_NOT_ALIGNED|\
+                                   FIEMAP_EXTENT_DATA_INLINE|FIEMAP_EXTENT_DATA_TAIL|FIEMAP_EXTENT_UNWRITTEN)
+
+// size of a range in the object header: offset, length, srcoffset and the length of the path
+#define REFLINK_RANGE_HEADSIZE    (3*sizeof(u64)+sizeof(u16))
+
+static u32 reflink_hash(u64 physical, u64 length)
+{
+    return (u32)(physical>>12)^(u32)(physical>>44)^(u32)length;
+}
+
+static u32 reflink_itemhash(void *item)
+{
+    return reflink_hash(((creflinkitem *)item)->physical, ((creflinkitem *)item)->length);
+}
+
+static int reflink_resize(creflink *r, u32 newsize)
+{
+    return hashtable_resize((void ***)&r->table, &r->tablesize, newsize, reflink_itemhash);
+}
+
+int reflink_init(creflink *r)
+{
+    if (r==NULL)
+    {   errprintf("invalid param\n");
+        return -1;
+    }
+    
+    memset(r, 0, sizeof(creflink));
+    return reflink_resize(r, REFLINK_DEF_TABLESIZE);
+}
+
+int reflink_destroy(creflink *r)
+{
+    creflinkitem *item, *next;
+    u32 i;
+    
+    if (r==NULL)
+        return -1;
+    
+    for (i=0; (r->table!=NULL) && (i < r->tablesize); i++)
+    {
+        for (item=r->table[i]; item!=NULL; item=next)
+        {   next=item->next;
+            free(item);
+        }
+    }
+    for (i=0; i < r->pathcnt; i++)
+        free(r->paths[i]);
+    
+    free(r->paths);
+    free(r->table);
+    memset(r, 0, sizeof(creflink));
+    return 0;
+}
+
+static creflinkitem *reflink_get(creflink *r, u64 physical, u64 length)
+{
+    creflinkitem *item;
+    
+    for (item=r->table[reflink_hash(physical, length)%r->tablesize]; item!=NULL; item=item->next)
+        if ((item->physical==physical) && (item->length==length))
+            return item;
+    
+    return NULL;
+}
+
+static int reflinklist_add_range(creflinklist *l, u64 offset, u64 length, creflinkitem *item)
+{
+    creflinkrange *last=(l->count > 0) ? &l->ranges[l->count-1] : NULL;
+    
+    // extend the last range when the data follows in both files
+    if ((last!=NULL) && (last->srcpath==item->path) && (last->offset+last->length==offset) &&
+        (last->srcoffset+last->length==item->offset))
+    {   last->length+=length;
+        return 0;
+    }
+    
+    if (array_grow((void**)&l->ranges, &l->max, l->count, 64, sizeof(creflinkrange))!=0)
+        return -1;
+    l->ranges[l->count].offset=offset;
+    l->ranges[l->count].length=length;
+    l->ranges[l->count].srcoffset=item->offset;
+    l->ranges[l->count].srcpath=item->path;
+    l->count++;
+    return 0;
+}
+
+static int reflinklist_add_extent(creflinklist *l, u64 physical, u64 length, u64 offset)
+{
+    if (array_grow((void**)&l->newext, &l->newmax, l->newcnt, 64, sizeof(creflinkextent))!=0)
+        return -1;
+    l->newext[l->newcnt].physical=physical;
+    l->newext[l->newcnt].length=length;
+    l->newext[l->newcnt].offset=offset;
+    l->newcnt++;
+    return 0;
+}
+
+// look at the extents of the file for each block of data which will be saved: the blocks which
+// are on a shared extent already in the archive become ranges, the other shared ones are new
+int reflink_scan(creflink *r, int fd, u64 filesize, u32 blocksize, creflinklist *l)
+{
+    struct fiemap *fm;
+    struct fiemap_extent *fe=NULL;
+    creflinkitem *item;
+    u64 physical;
+    u64 filepos;
+    u64 length;
+    bool done=false;
+    u32 i=0;
+    int ret=0;
+    
+    if ((fm=malloc(sizeof(struct fiemap)+REFLINK_FIEMAP_EXTENTS*sizeof(struct fiemap_extent)))==NULL)
+    {   errprintf("malloc() failed: out of memory\n");
+        return -1;
+    }
+    memset(fm, 0, sizeof(struct fiemap));
+    fm->fm_start=0;
+    fm->fm_length=FIEMAP_MAX_OFFSET;
+    fm->fm_flags=FIEMAP_FLAG_SYNC;
+    fm->fm_extent_count=REFLINK_FIEMAP_EXTENTS;
+    fm->fm_mapped_extents=0;
+    
+    for (filepos=0; filepos < filesize; filepos+=length)
+    {
+        length=min(filesize-filepos, blocksize);
+        
+        // move to the extent which contains that block and get the next extents from the filesystem when required
+        while ((fe==NULL) || (fe->fe_logical+fe->fe_length <= filepos))
+        {
+            if ((fe!=NULL) && (i+1 < fm->fm_mapped_extents))
+            {   fe=&fm->fm_extents[++i];
+                continue;
+            }
+            if (done==true) // no more extents: the data of the end of the file are saved
+            {   fe=NULL;
+                break;
+            }
+            if (fe!=NULL)
+                fm->fm_start=fe->fe_logical+fe->fe_length;
+            fm->fm_length=FIEMAP_MAX_OFFSET-fm->fm_start;
+            fm->fm_mapped_extents=0;
+            if ((ioctl(fd, FS_IOC_FIEMAP, fm)!=0) || (fm->fm_mapped_extents==0))
+            {   done=true;
+                fe=NULL;
+                break;
+            }
+            i=0;
+            fe=&fm->fm_extents[0];
+            done=((fm->fm_extents[fm->fm_mapped_extents-1].fe_flags & FIEMAP_EXTENT_LAST)!=0);
+        }
+        
+        // only blocks which are entirely on one shared extent can point to data already saved
+        if ((fe==NULL) || (fe->fe_logical > filepos) || (fe->fe_logical+fe->fe_length < filepos+length) ||
+            ((fe->fe_flags & FIEMAP_EXTENT_SHARED)==0) || ((fe->fe_flags & REFLINK_FIEMAP_BADFLAGS)!=0))
+            continue;
+        
+        physical=fe->fe_physical+(filepos-fe->fe_logical);
+        if ((item=reflink_get(r, physical, length))!=NULL)
+            ret=reflinklist_add_range(l, filepos, length, item);
+        else
+            ret=reflinklist_add_extent(l, physical, length, filepos);
+        if (ret!=0)
+            break;
+    }
+    
+    free(fm);
+    return ret;
+}
+
+// the shared extents which the file has saved in the archive can be used by the next files
+int reflink_commit(creflink *r, creflinklist *l, char *path)
+{
+    creflinkitem *item;
+    char *newpath;
+    u32 pos;
+    u32 i;
+    
+    if (l->newcnt==0)
+        return 0;
+    
+    if (array_grow((void**)&r->paths, &r->pathmax, r->pathcnt, 64, sizeof(char*))!=0)
+        return -1;
+    if ((newpath=strdup(path))==NULL)
+    {   errprintf("strdup(%s) failed: out of memory\n", path);
+        return -1;
+    }
+    r->paths[r->pathcnt++]=newpath;
+    
+    for (i=0; i < l->newcnt; i++)
+    {
+        if (reflink_get(r, l->newext[i].physical, l->newext[i].length)!=NULL)
+            continue; // the same extent is used twice in that file
+        if ((item=malloc(sizeof(creflinkitem)))==NULL)
+        {   errprintf("malloc(%ld) failed: out of memory\n", (long)sizeof(creflinkitem));
+            return -1;
+        }
+        item->physical=l->newext[i].physical;
+        item->length=l->newext[i].length;
+        item->offset=l->newext[i].offset;
+        item->path=newpath;
+        pos=reflink_hash(item->physical, item->length)%r->tablesize;
+        item->next=r->table[pos];
+        r->table[pos]=item;
+        r->count++;
+    }
+    
+    if ((r->count > 4*(u64)r->tablesize) && (reflink_resize(r, r->tablesize*4)!=0))
+        return -1;
+    
+    return 0;
+}
+
+int reflinklist_init(creflinklist *l)
+{
+    memset(l, 0, sizeof(creflinklist));
+    return 0;
+}
+
+int reflinklist_destroy(creflinklist *l)
+{
+    u32 i;
+    
+    for (i=0; (l->ownpaths==true) && (i < l->count); i++)
+        free(l->ranges[i].srcpath);
+    free(l->ranges);
+    free(l->newext);
+    memset(l, 0, sizeof(creflinklist));
+    return 0;
+}
+
+creflinkrange *reflinklist_find(creflinklist *l, u64 offset)
+{
+    u32 i;
+    
+    for (i=0; i < l->count; i++)
+        if ((l->ranges[i].offset <= offset) && (offset < l->ranges[i].offset+l->ranges[i].length))
+            return &l->ranges[i];
+    
+    return NULL;
+}
+
+// the ranges which do not fit in the object header are removed from the list (their data are saved)
+int reflinklist_encode(creflinklist *l, char *buf, u16 bufsize, u16 *size)
+{
+    u64 temp64;
+    u16 temp16;
+    u16 pathlen;
+    u32 pos=0;
+    u32 i;
+    
+    for (i=0; i < l->count; i++)
+    {
+        pathlen=strlen(l->ranges[i].srcpath);
+        if (pos+REFLINK_RANGE_HEADSIZE+pathlen > bufsize)
+            break;
+        temp64=cpu_to_le64(l->ranges[i].offset);
+        memcpy(buf+pos, &temp64, sizeof(temp64));
+        pos+=sizeof(temp64);
+        temp64=cpu_to_le64(l->ranges[i].length);
+        memcpy(buf+pos, &temp64, sizeof(temp64));
+        pos+=sizeof(temp64);
+        temp64=cpu_to_le64(l->ranges[i].srcoffset);
+        memcpy(buf+pos, &temp64, sizeof(temp64));
+        pos+=sizeof(temp64);
+        temp16=cpu_to_le16(pathlen);
+        memcpy(buf+pos, &temp16, sizeof(temp16));
+        pos+=sizeof(temp16);
+        memcpy(buf+pos, l->ranges[i].srcpath, pathlen);
+        pos+=pathlen;
+    }
+    
+    l->count=i;
+    *size=pos;
+    return 0;
+}
+
+int reflinklist_decode(creflinklist *l, char *buf, u16 size)
+{
+    creflinkrange *range;
+    u64 temp64;
+    u16 temp16;
+    u32 pos=0;
+    
+    l->ownpaths=true;
+    while (pos < size)
+    {
+        if ((pos+REFLINK_RANGE_HEADSIZE > size) || (array_grow((void**)&l->ranges, &l->max, l->count, 64, sizeof(creflinkrange))!=0))
+            return -1;
+        range=&l->ranges[l->count];
+        memcpy(&temp64, buf+pos, sizeof(temp64));
+        range->offset=le64_to_cpu(temp64);
+        pos+=sizeof(temp64);
+        memcpy(&temp64, buf+pos, sizeof(temp64));
+        range->length=le64_to_cpu(temp64);
+        pos+=sizeof(temp64);
+        memcpy(&temp64, buf+pos, sizeof(temp64));
+        range->srcoffset=le64_to_cpu(temp64);
+        pos+=sizeof(temp64);
+        memcpy(&temp16, buf+pos, sizeof(temp16));
+        temp16=le16_to_cpu(temp16);
+        pos+=sizeof(temp16);
+        if ((pos+temp16 > size) || ((range->srcpath=strndup(buf+pos, temp16))==NULL))
+            return -1;
+        pos+=temp16;
+        l->count++;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifndef __REFLINK_H__
+#define __REFLINK_H__
+
+#include "types.h"
+
+struct s_reflink;
+typedef struct s_reflink creflink;
+
+struct s_reflinkitem;
+typedef struct s_reflinkitem creflinkitem;
+
+struct s_reflinkrange;
+typedef struct s_reflinkrange creflinkrange;
+
+struct s_reflinkextent;
+typedef struct s_reflinkextent creflinkextent;
+
+struct s_reflinklist;
+typedef struct s_reflinklist creflinklist;
+
+// shared extent of the device whose data is already in the archive
+struct s_reflinkitem
+{   creflinkitem  *next; // first field for hashtable_resize()
+    u64           physical;
+    u64           length;
+    u64           offset; // position of the data in the file which has been saved
+    char          *path;
+};
+
+// index of the shared extents saved in a filesystem (savefs/savedir)
+struct s_reflink
+{   creflinkitem  **table;
+    u32           tablesize;
+    u64           count;
+    char          **paths; // paths of the files which contain the extents of the table
+    u64           pathcnt;
+    u64           pathmax;
+};
+
+// range of a file whose data is the same as a range of a file which comes earlier in the archive
+struct s_reflinkrange
+{   u64           offset;
+    u64           length;
+    u64           srcoffset;
+    char          *srcpath;
+};
+
+// shared extent read by a file which is not in the index yet
+struct s_reflinkextent
+{   u64           physical;
+    u64           length;
+    u64           offset;
+};
+
+// shared ranges of the file being saved or restored
+struct s_reflinklist
+{   creflinkrange   *ranges;
+    u64             count;
+    u64             max;
+    creflinkextent  *newext;
+    u64             newcnt;
+    u64             newmax;
+    bool            ownpaths; // true when the paths have been allocated by reflinklist_decode()
+};
+
+int  reflink_init(creflink *r);
+int  reflink_destroy(creflink *r);
+int  reflink_scan(creflink *r, int fd, u64 filesize, u32 blocksize, creflinklist *l);
+int  reflink_commit(creflink *r, creflinklist *l, char *path);
+
+int  reflinklist_init(creflinklist *l);
+int  reflinklist_destroy(creflinklist *l);
+creflinkrange *reflinklist_find(creflinklist *l, u64 offset);
+int  reflinklist_encode(creflinklist *l, char *buf, u16 bufsize, u16 *size);
+int  reflinklist_decode(creflinklist *l, char *buf, u16 size);
+
+#endif // __REFLINK_H__
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 
 #include "fsarchiver.h"
@@ -30,6 +31,19 @@
 #include "queue.h"
 #include "error.h"
 
+// extensions of the formats which are already compressed
+static char *regmulti_stored_ext[]={"7z", "apk", "avi", "bz2", "deb", "docx", "flac", "gif", "gz", "jar",
+    "jpeg", "jpg", "lz4", "lzma", "lzo", "m4a", "mkv", "mov", "mp3", "mp4", "odp", "ods", "odt", "ogg",
+    "png", "pptx", "rar", "rpm", "tbz2", "tgz", "txz", "webm", "webp", "woff", "woff2", "xlsx", "xz",
+    "zip", "zst", NULL};
+
+// signatures of the formats which are already compressed
+static struct {char *magic; int len;} regmulti_stored_magic[]=
+{   {"\x89PNG", 4}, {"\xff\xd8\xff", 3}, {"GIF8", 4}, {"PK\x03\x04", 4}, {"\x1f\x8b", 2}, {"BZh", 3},
+    {"\xfd" "7zXZ", 5}, {"\x28\xb5\x2f\xfd", 4}, {"\x04\x22\x4d\x18", 4}, {"7z\xbc\xaf\x27\x1c", 6},
+    {"Rar!", 4}, {"OggS", 4}, {"fLaC", 4}, {"ID3", 3}, {NULL, 0}
+};
+
 int regmulti_empty(cregmulti *m)
 {
     int i;
@@ -55,11 +69,34 @@ int regmulti_init(cregmulti *m, u32 maxblksize)
         return -1;
     }
     
-    m->maxitems=FSA_MAX_SMALLFILECOUNT;
-    m->maxblksize=min(maxblksize, FSA_MAX_BLKSIZE);
+    // the large blocks hold proportionally more small files
+    m->maxblksize=min(maxblksize, FSA_MAX_LARGEBLKSIZE);
+    m->maxitems=max(FSA_MAX_SMALLFILECOUNT, (u32)(((u64)FSA_MAX_SMALLFILECOUNT*m->maxblksize)/FSA_DEF_BLKSIZE));
+    m->nocompress=false;
+    m->objhead=malloc(m->maxitems*sizeof(cdico *));
+    m->data=malloc(m->maxblksize);
+    if ((m->objhead==NULL) || (m->data==NULL))
+    {   errprintf("malloc(%ld) failed: out of memory\n", (long)m->maxblksize);
+        regmulti_destroy(m);
+        return -1;
+    }
     return regmulti_empty(m);
 }
 
+int regmulti_destroy(cregmulti *m)
+{
+    if (!m)
+    {   errprintf("invalid param\n");
+        return -1;
+    }
+    
+    free(m->objhead);
+    free(m->data);
+    m->objhead=NULL;
+    m->data=NULL;
+    return 0;
+}
+
 int regmulti_count(cregmulti *m, cdico *header, char *data, u32 datsize)
 {
     if (!m)
@@ -170,6 +207,7 @@ int regmulti_save_enqueue(cregmulti *m, cqueue *q, int fsid)
     blkinfo.blkdata=(char*)dynblock;
     blkinfo.blkoffset=0; // no meaning for multi-regfiles
     blkinfo.blkfsid=fsid;
+    blkinfo.blknocomp=m->nocompress;
     if (queue_add_block(q, &blkinfo, QITEM_STATUS_TODO)!=0)
     {   errprintf("queue_add_block() failed\n");
         return -1;
@@ -178,6 +216,30 @@ int regmulti_save_enqueue(cregmulti *m, cqueue *q, int fsid)
      return 0;
 }
 
+// pack of a small file: from its extension or its first bytes (cheap enough for each file)
+int regmulti_save_classify(char *path, char *data, u32 datsize)
+{
+    char *name;
+    char *ext;
+    int i;
+    
+    name=((name=strrchr(path, '/'))!=NULL) ? (name+1) : (path);
+    if (((ext=strrchr(name, '.'))!=NULL) && (ext!=name))
+        for (i=0; regmulti_stored_ext[i]!=NULL; i++)
+            if (strcasecmp(ext+1, regmulti_stored_ext[i])==0)
+                return REGMULTI_PACK_STORED;
+    
+    for (i=0; regmulti_stored_magic[i].magic!=NULL; i++)
+        if ((datsize >= regmulti_stored_magic[i].len) && (memcmp(data, regmulti_stored_magic[i].magic, regmulti_stored_magic[i].len)==0))
+            return REGMULTI_PACK_STORED;
+    
+    // text files do not contain any null byte
+    if (memchr(data, 0, min(datsize, 1024))!=NULL)
+        return REGMULTI_PACK_BINARY;
+    
+    return REGMULTI_PACK_TEXT;
+}
+
 int regmulti_rest_addheader(cregmulti *m, cdico *header)
 {
     if (!m)
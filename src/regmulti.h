@@ -24,27 +24,33 @@ struct s_queue;
 struct s_regmulti;
 typedef struct s_regmulti cregmulti;
 
+// small files are packed by type of contents with option --group-small-files
+enum {REGMULTI_PACK_TEXT=0, REGMULTI_PACK_BINARY, REGMULTI_PACK_STORED, REGMULTI_MAXPACKS};
+
 struct s_regmulti
 {
     // common
     u32            count; // how many small files are in this struct
     u32            maxitems; // how many small files that struct can contains
     u32            maxblksize; // maximum size of a data block
+    bool           nocompress; // the contents are already compressed: the block is stored as it is
     
     // linked list of headers
-    struct s_dico  *objhead[FSA_MAX_SMALLFILECOUNT]; // worst case: each file is just one byte: this is how many files we can store in the block
+    struct s_dico  **objhead; // worst case: each file is just one byte: this is how many files we can store in the block
     
     // common block to be compressed
-    char           data[FSA_MAX_BLKSIZE];
+    char           *data; // maxblksize bytes
     u32            usedsize; // how many bytes are used in data
 };
 
 int  regmulti_empty(cregmulti *m);
 int  regmulti_init(cregmulti *m, u32 maxblksize);
+int  regmulti_destroy(cregmulti *m);
 int  regmulti_count(cregmulti *m, struct s_dico *header, char *data, u32 datsize);
 bool regmulti_save_enough_space_for_new_file(cregmulti *m, u32 filesize);
 int  regmulti_save_addfile(cregmulti *m, struct s_dico *header, char *data, u32 datsize);
 int  regmulti_save_enqueue(cregmulti *m, struct s_queue *q, int fsid);
+int  regmulti_save_classify(char *path, char *data, u32 datsize);
 int  regmulti_rest_addheader(cregmulti *m, struct s_dico *header);
 int  regmulti_rest_setdatablock(cregmulti *m, char *data, u32 datsize);
 int  regmulti_rest_getfile(cregmulti *m, int index, struct s_dico **filehead, char *data, u64 *datsize, u32 bufsize);
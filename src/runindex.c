@@ -0,0 +1,131 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsarchiver.h"
+#include "runindex.h"
+#include "writebuf.h"
+#include "common.h"
+#include "error.h"
+#include "dico.h"
+
+int runindex_init(crunindex *ri)
+{
+    memset(ri, 0, sizeof(crunindex));
+    return 0;
+}
+
+int runindex_destroy(crunindex *ri)
+{
+    free(ri->runs);
+    memset(ri, 0, sizeof(crunindex));
+    return 0;
+}
+
+int runindex_add(crunindex *ri, u16 fsid, u32 curvol, u64 offset, u64 size)
+{
+    crun *run;
+    
+    if (array_grow((void**)&ri->runs, &ri->max, ri->count, 256, sizeof(crun))!=0)
+        return -1;
+    run=&ri->runs[ri->count++];
+    run->fsid=fsid;
+    run->curvol=curvol;
+    run->offset=offset;
+    run->size=size;
+    return 0;
+}
+
+// one global header per run: they are read again in the same order by runindex_read_header()
+int runindex_write(crunindex *ri, cwritebuf *wb, u32 archid)
+{
+    cdico *d;
+    u64 i;
+    
+    for (i=0; i < ri->count; i++)
+    {
+        if ((d=dico_alloc())==NULL)
+        {   errprintf("dico_alloc() failed\n");
+            return -1;
+        }
+        dico_add_u16(d, 0, RUNINDEXKEY_FSID, ri->runs[i].fsid);
+        dico_add_u32(d, 0, RUNINDEXKEY_CURVOL, ri->runs[i].curvol);
+        dico_add_u64(d, 0, RUNINDEXKEY_OFFSET, ri->runs[i].offset);
+        dico_add_u64(d, 0, RUNINDEXKEY_SIZE, ri->runs[i].size);
+        if (writebuf_add_header(wb, d, FSA_MAGIC_RUNX, archid, FSA_FILESYSID_NULL)!=0)
+        {   errprintf("writebuf_add_header(FSA_MAGIC_RUNX) failed\n");
+            dico_destroy(d);
+            return -1;
+        }
+        dico_destroy(d);
+    }
+    return 0;
+}
+
+int runindex_read_header(crunindex *ri, cdico *d)
+{
+    u16 fsid;
+    u32 curvol;
+    u64 offset;
+    u64 size;
+    
+    if ((dico_get_u16(d, 0, RUNINDEXKEY_FSID, &fsid)!=0) || (dico_get_u32(d, 0, RUNINDEXKEY_CURVOL, &curvol)!=0) ||
+        (dico_get_u64(d, 0, RUNINDEXKEY_OFFSET, &offset)!=0) || (dico_get_u64(d, 0, RUNINDEXKEY_SIZE, &size)!=0))
+    {   errprintf("the index of the runs is invalid\n");
+        return -1;
+    }
+    if ((fsid >= FSA_MAX_FSPERARCH) || (size==0))
+    {   errprintf("the index of the runs is invalid: fsid=%d, size=%lld\n", (int)fsid, (long long)size);
+        return -1;
+    }
+    return runindex_add(ri, fsid, curvol, offset, size);
+}
+
+// the trailer has a fixed size after the last volume footer so that the index can be found from the end
+int runindex_trailer_encode(u8 *trailer, u32 archid, u64 offset)
+{
+    u32 temp32;
+    u64 temp64;
+    
+    memcpy(trailer, RUNINDEX_TRAILER_MAGIC, FSA_SIZEOF_MAGIC);
+    temp32=cpu_to_le32(archid);
+    memcpy(trailer+4, &temp32, sizeof(temp32));
+    temp64=cpu_to_le64(offset);
+    memcpy(trailer+8, &temp64, sizeof(temp64));
+    return 0;
+}
+
+int runindex_trailer_decode(u8 *trailer, u32 archid, u64 *offset)
+{
+    u32 temp32;
+    u64 temp64;
+    
+    if (memcmp(trailer, RUNINDEX_TRAILER_MAGIC, FSA_SIZEOF_MAGIC)!=0)
+        return -1;
+    memcpy(&temp32, trailer+4, sizeof(temp32));
+    if (le32_to_cpu(temp32)!=archid)
+        return -1;
+    memcpy(&temp64, trailer+8, sizeof(temp64));
+    *offset=le64_to_cpu(temp64);
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifndef __RUNINDEX_H__
+#define __RUNINDEX_H__
+
+#include "types.h"
+
+struct s_writebuf;
+struct s_dico;
+
+struct s_run;
+typedef struct s_run crun;
+
+struct s_runindex;
+typedef struct s_runindex crunindex;
+
+#define RUNINDEX_TRAILER_MAGIC    "RuNt"
+#define RUNINDEX_TRAILER_SIZE     16 // magic, archid, offset of the first index header in the last volume
+
+// contiguous data of a single filesystem when several filesystems are saved concurrently
+struct s_run
+{   u16    fsid; // filesystem to which all the headers and blocks of the run belong
+    u32    curvol; // volume which contains the whole run
+    u64    offset; // offset of the run in that volume
+    u64    size; // size of the run in bytes
+};
+
+struct s_runindex
+{   crun   *runs; // runs in the order they have been written
+    u64    count; // how many runs are used
+    u64    max; // how many runs have been allocated
+};
+
+int runindex_init(crunindex *ri);
+int runindex_destroy(crunindex *ri);
+int runindex_add(crunindex *ri, u16 fsid, u32 curvol, u64 offset, u64 size);
+int runindex_write(crunindex *ri, struct s_writebuf *wb, u32 archid);
+int runindex_read_header(crunindex *ri, struct s_dico *d);
+int runindex_trailer_encode(u8 *trailer, u32 archid, u64 offset);
+int runindex_trailer_decode(u8 *trailer, u32 archid, u64 *offset);
+
+#endif // __RUNINDEX_H__
@@ -29,6 +29,9 @@
 // queue use to share data between the three sort of threads
 cqueue g_queue;
 
+// when filesystems are restored concurrently the reader sends their data to these queues
+cqueue *g_fsqueue[FSA_MAX_FSPERARCH];
+
 // filesystem bitmap used by do_extract() to say to threadio_readimg which filesystems to skip
 // eg: "g_fsbitmap[0]=1,g_fsbitmap[1]=0" means that we want to read filesystem 0 and skip fs 1
 u8 g_fsbitmap[FSA_MAX_FSPERARCH];
@@ -48,6 +51,11 @@ bool get_stopfillqueue()
     return atomic_read(&g_stopfillqueue);
 }
 
+void clear_stopfillqueue()
+{
+    atomic_set(&g_stopfillqueue, false);
+}
+
 // how many secondary threads are running (compression/decompression and archio threads)
 atomic_t g_secthreads={ (0) };
 
@@ -20,6 +20,7 @@
 
 // global threads sync data
 extern struct s_queue g_queue; // queue use to share data between the three sort of threads
+extern struct s_queue *g_fsqueue[FSA_MAX_FSPERARCH]; // queues of the filesystems restored concurrently
 
 // global threads sync functions
 int get_abort(); // returns true if threads must exit because an error or signal received
@@ -29,6 +30,7 @@ bool get_interrupted(); // returns true if either abort is true of stopfillqueue
 // say to the thread that is filling the queue to stop
 void set_stopfillqueue();
 bool get_stopfillqueue();
+void clear_stopfillqueue(); // before the queue is filled again by a new reader thread
 
 // secondary threads counter
 void inc_secthreads();
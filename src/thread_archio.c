@@ -31,6 +31,9 @@
 #include "error.h"
 #include "syncthread.h"
 #include "queue.h"
+#include "options.h"
+#include "crypto.h"
+#include "runindex.h"
 
 void *thread_writer_fct(void *args)
 {
@@ -51,13 +54,23 @@ void *thread_writer_fct(void *args)
     {   msgprintf(MSG_STACK, "archwriter_volpath() failed\n");
         goto thread_writer_fct_error;
     }
-    if (archwriter_create(ai)!=0)
-    {   msgprintf(MSG_STACK, "archwriter_create(%s) failed\n", ai->basepath);
-        goto thread_writer_fct_error;
+    if (ai->resume==true) // continue an interrupted save
+    {
+        if (archwriter_resume(ai)!=0)
+        {   msgprintf(MSG_STACK, "archwriter_resume(%s) failed\n", ai->basepath);
+            goto thread_writer_fct_error;
+        }
     }
-    if (archwriter_write_volheader(ai)!=0)
-    {   msgprintf(MSG_STACK, "cannot write volume header: archwriter_write_volheader() failed\n");
-        goto thread_writer_fct_error;
+    else
+    {
+        if (archwriter_create(ai)!=0)
+        {   msgprintf(MSG_STACK, "archwriter_create(%s) failed\n", ai->basepath);
+            goto thread_writer_fct_error;
+        }
+        if (archwriter_write_volheader(ai)!=0)
+        {   msgprintf(MSG_STACK, "cannot write volume header: archwriter_write_volheader() failed\n");
+            goto thread_writer_fct_error;
+        }
     }
     
     while (queue_get_end_of_queue(&g_queue)==false)
@@ -78,7 +91,14 @@ void *thread_writer_fct(void *args)
                     free(blkinfo.blkdata);
                     break;
                 case QITEM_TYPE_HEADER:
-                    if (archwriter_dowrite_header(ai, &headinfo)!=0)
+                    if (memcmp(headinfo.magic, FSA_MAGIC_CKPT, FSA_SIZEOF_MAGIC)==0) // not written to the archive
+                    {
+                        if (archwriter_checkpoint(ai, &headinfo)!=0)
+                        {   msgprintf(MSG_STACK, "archwriter_checkpoint() failed\n");
+                            goto thread_writer_fct_error;
+                        }
+                    }
+                    else if (archwriter_dowrite_header(ai, &headinfo)!=0)
                     {   msgprintf(MSG_STACK, "archive_write_header() failed\n");
                         goto thread_writer_fct_error;
                     }
@@ -91,6 +111,12 @@ void *thread_writer_fct(void *args)
         }
     }
     
+    // the runs of the filesystems saved concurrently are indexed at the end of the last volume
+    if ((ai->runs==true) && (archwriter_write_runindex(ai)!=0))
+    {   msgprintf(MSG_STACK, "archwriter_write_runindex() failed\n");
+        goto thread_writer_fct_error;
+    }
+    
     // write last volume footer
     if (archwriter_write_volfooter(ai, true)!=0)
     {   msgprintf(MSG_STACK, "cannot write volume footer: archio_write_volfooter() failed\n");
@@ -111,23 +137,88 @@ thread_writer_fct_error:
     return NULL;
 }
 
+// send a header or a data block read from the archive to the thread which restores its filesystem
+static int thread_reader_item(carchreader *ai, char *magic, cdico *dico, u16 fsid, u64 *errors)
+{
+    struct s_blockinfo blkinfo;
+    cqueue *queue;
+    int skipblock;
+    int status;
+    int sumok;
+    s64 lres;
+    
+    if (strncmp(magic, FSA_MAGIC_BLKH, FSA_SIZEOF_MAGIC)==0) // header starts a data block
+    {
+        skipblock=((g_fsbitmap[fsid]==0) || (ai->skipblocks==true));
+        //errprintf("DEBUG: skipblock=%d g_fsbitmap[fsid=%d]=%d\n", skipblock, (int)fsid, (int)g_fsbitmap[fsid]);
+        if (archreader_read_block(ai, dico, skipblock, &sumok, &blkinfo)!=0)
+        {   msgprintf(MSG_STACK, "archreader_read_block() failed\n");
+            dico_destroy(dico);
+            return -1;
+        }
+        
+        if (skipblock==false)
+        {
+            blkinfo.blkfsid=fsid; // part of what aes-gcm authenticates
+            status=((sumok==true)?QITEM_STATUS_TODO:QITEM_STATUS_DONE);
+            queue=(g_fsqueue[fsid]!=NULL)?(g_fsqueue[fsid]):(&g_queue);
+            if ((lres=queue_add_block(queue, &blkinfo, status))!=FSAERR_SUCCESS)
+            {   if (lres!=FSAERR_NOTOPEN)
+                    errprintf("queue_add_block()=%ld=%s failed\n", (long)lres, error_int_to_string(lres));
+                dico_destroy(dico);
+                return -1;
+            }
+            if (sumok==false) (*errors)++;
+        }
+        dico_destroy(dico);
+    }
+    else if (strncmp(magic, FSA_MAGIC_RUNX, FSA_SIZEOF_MAGIC)==0) // the index of the runs is only used to seek
+    {
+        dico_destroy(dico);
+    }
+    else // another higher level header
+    {
+        // if it's a global header or a if this local header belongs to a filesystem that the main thread needs
+        if (fsid==FSA_FILESYSID_NULL || g_fsbitmap[fsid]==1)
+        {
+            queue=((fsid!=FSA_FILESYSID_NULL) && (g_fsqueue[fsid]!=NULL))?(g_fsqueue[fsid]):(&g_queue);
+            if ((lres=queue_add_header(queue, dico, magic, fsid))!=FSAERR_SUCCESS)
+            {   msgprintf(MSG_STACK, "queue_add_header()=%ld=%s failed\n", (long)lres, error_int_to_string(lres));
+                return -1;
+            }
+        }
+        else // header not used: remove data strucutre in dynamic memory
+        {
+            dico_destroy(dico);
+        }
+    }
+    
+    return 0;
+}
+
 void *thread_reader_fct(void *args)
 {
     char magic[FSA_SIZEOF_MAGIC];
-    struct s_blockinfo blkinfo;
+    u8 cryptsalt[FSA_CRYPT_SALTSIZE];
+    u16 saltsize;
+    u32 kdfiter;
+    u32 largeblksize;
+    u32 interleaved=false;
     u32 endofarchive=false;
     carchreader *ai=NULL;
+    crunindex runindex;
     cdico *dico=NULL;
-    int skipblock;
+    crun *run;
     u16 fsid;
-    int sumok;
-    int status;
+    int i;
     u64 errors;
+    u64 r;
     s64 lres;
     int res;
     
     // init
     errors=0;
+    runindex_init(&runindex);
     inc_secthreads();
 
     if ((ai=(carchreader *)args)==NULL)
@@ -151,6 +242,7 @@ void *thread_reader_fct(void *args)
     {   errprintf("archio_read_volheader() failed\n");
         goto thread_reader_fct_error;
     }
+    archreader_prefetch_next(ai);
     
     // ---- read main archive header
     if ((res=archreader_read_header(ai, magic, &dico, false, &fsid))!=FSAERR_SUCCESS)
@@ -163,13 +255,41 @@ void *thread_reader_fct(void *args)
         goto thread_reader_fct_error;
     }
     
+    // MAINHEADKEY_LARGEBLKSIZE is only present when the archive has been saved with option --large-blocks
+    // (dico_get_u32() sets its result to zero when the key is missing so it is not read into ai directly)
+    if (dico_get_u32(dico, 0, MAINHEADKEY_LARGEBLKSIZE, &largeblksize)==0)
+    {
+        if ((largeblksize < FSA_MAX_BLKSIZE) || (largeblksize > FSA_MAX_LARGEBLKSIZE))
+        {   errprintf("the size of the data blocks of that archive is invalid: %ld\n", (long)largeblksize);
+            goto thread_reader_fct_error;
+        }
+        ai->maxblksize=largeblksize;
+    }
+    
+    // the key of aes-gcm is derived once, before the blocks are decrypted by the compression threads
+    if ((g_options.encryptpass[0]!=0) && (dico_get_data(dico, 0, MAINHEADKEY_CRYPTSALT, cryptsalt, sizeof(cryptsalt), &saltsize)==0))
+    {
+        if (dico_get_u32(dico, 0, MAINHEADKEY_CRYPTKDFITER, &kdfiter)!=0)
+            kdfiter=FSA_CRYPT_KDFITER;
+        if (crypto_aes256gcm_setkey(g_options.encryptpass, strlen((char*)g_options.encryptpass), cryptsalt, saltsize, kdfiter, ai->archid)!=0)
+        {   errprintf("cannot derive the key of the archive from the password\n");
+            goto thread_reader_fct_error;
+        }
+    }
+    
+    // the filesystems saved concurrently are read from their runs when the archive has an index of the runs
+    if ((dico_get_u32(dico, 0, MAINHEADKEY_FSINTERLEAVED, &interleaved)==0) && (interleaved==true) &&
+        (ai->stream==false) && (ai->skipblocks==false) && (archreader_read_runindex(ai, &runindex)==0))
+        msgprintf(MSG_VERB1, "the archive has an index of %lld runs: only the runs of the filesystems restored are read\n", (long long)runindex.count);
+    
     if ((lres=queue_add_header(&g_queue, dico, magic, fsid))!=FSAERR_SUCCESS)
     {   errprintf("queue_add_header()=%ld=%s failed to add the archive header\n", (long)lres, error_int_to_string(lres));
         goto thread_reader_fct_error;
     }
     
-    // read all other data from file (filesys-header, normal objects headers, ...)
-    while (endofarchive==false && get_stopfillqueue()==false)
+    // read all other data from file (filesys-header, normal objects headers, ...), only up to the first run if there is an index
+    while (endofarchive==false && get_stopfillqueue()==false &&
+        ((runindex.count==0) || (archreader_is_before(ai, runindex.runs[0].curvol, runindex.runs[0].offset)==true)))
     {
         if ((res=archreader_read_header(ai, magic, &dico, true, &fsid))!=FSAERR_SUCCESS)
         {   dico_destroy(dico);
@@ -197,6 +317,10 @@ void *thread_reader_fct(void *args)
                 goto thread_reader_fct_error;
             }
             msgprintf(MSG_VERB2, "End of volume [%s]\n", ai->volpath);
+            if ((endofarchive!=true) && (ai->stream==true))
+            {   errprintf("an archive read from the standard input must have a single volume\n");
+                goto thread_reader_fct_error;
+            }
             if (endofarchive!=true)
             {
                 archreader_incvolume(ai, false);
@@ -221,53 +345,50 @@ void *thread_reader_fct(void *args)
                 {      msgprintf(MSG_STACK, "archio_read_volheader() failed\n");
                     goto thread_reader_fct_error;
                 }
+                archreader_prefetch_next(ai);
             }
             dico_destroy(dico);
         }
-        else // high-level archive (not involved in volume management)
+        else if (thread_reader_item(ai, magic, dico, fsid, &errors)!=0) // high-level archive (not involved in volume management)
+        {   msgprintf(MSG_STACK, "thread_reader_item() failed\n");
+            goto thread_reader_fct_error;
+        }
+    }
+    
+    // each run only contains complete headers and blocks of a single filesystem
+    for (r=0; (r < runindex.count) && (get_stopfillqueue()==false); r++)
+    {
+        run=&runindex.runs[r];
+        if (g_fsbitmap[run->fsid]==0)
+            continue;
+        if (archreader_seek(ai, run->curvol, run->offset)!=0)
+        {   errprintf("cannot go to the run at offset %lld of volume %ld\n", (long long)run->offset, (long)run->curvol);
+            goto thread_reader_fct_error;
+        }
+        while ((archreader_is_before(ai, run->curvol, run->offset+run->size)==true) && (get_stopfillqueue()==false))
         {
-            if (strncmp(magic, FSA_MAGIC_BLKH, FSA_SIZEOF_MAGIC)==0) // header starts a data block
-            {
-                skipblock=(g_fsbitmap[fsid]==0);
-                //errprintf("DEBUG: skipblock=%d g_fsbitmap[fsid=%d]=%d\n", skipblock, (int)fsid, (int)g_fsbitmap[fsid]);
-                if (archreader_read_block(ai, dico, skipblock, &sumok, &blkinfo)!=0)
-                {   msgprintf(MSG_STACK, "archreader_read_block() failed\n");
+            if ((res=archreader_read_header(ai, magic, &dico, true, &fsid))!=FSAERR_SUCCESS)
+            {   dico_destroy(dico);
+                msgprintf(MSG_STACK, "archreader_read_header() failed to read next header\n");
+                if (res!=OLDERR_MINOR) // fatal error (eg: cannot read archive from disk)
                     goto thread_reader_fct_error;
-                }
-                
-                if (skipblock==false)
-                {
-                    status=((sumok==true)?QITEM_STATUS_TODO:QITEM_STATUS_DONE);
-                    if ((lres=queue_add_block(&g_queue, &blkinfo, status))!=FSAERR_SUCCESS)
-                    {   if (lres!=FSAERR_NOTOPEN)
-                            errprintf("queue_add_block()=%ld=%s failed\n", (long)lres, error_int_to_string(lres));
-                        goto thread_reader_fct_error;
-                    }
-                    if (sumok==false) errors++;
-                    dico_destroy(dico);
-                }
+                errors++;
+                continue;
             }
-            else // another higher level header
-            {
-                // if it's a global header or a if this local header belongs to a filesystem that the main thread needs
-                if (fsid==FSA_FILESYSID_NULL || g_fsbitmap[fsid]==1)
-                {
-                    if ((lres=queue_add_header(&g_queue, dico, magic, fsid))!=FSAERR_SUCCESS)
-                    {   msgprintf(MSG_STACK, "queue_add_header()=%ld=%s failed\n", (long)lres, error_int_to_string(lres));
-                        goto thread_reader_fct_error;
-                    }
-                }
-                else // header not used: remove data strucutre in dynamic memory
-                {
-                    dico_destroy(dico);
-                }
+            if (thread_reader_item(ai, magic, dico, fsid, &errors)!=0)
+            {   msgprintf(MSG_STACK, "thread_reader_item() failed\n");
+                goto thread_reader_fct_error;
             }
         }
     }
     
 thread_reader_fct_error:
+    runindex_destroy(&runindex);
     msgprintf(MSG_DEBUG1, "THREAD-READER: queue_set_end_of_queue(&g_queue, true)\n");
     queue_set_end_of_queue(&g_queue, true); // don't wait for more data from this thread
+    for (i=0; i<FSA_MAX_FSPERARCH; i++)
+        if (g_fsqueue[i]!=NULL)
+            queue_set_end_of_queue(g_fsqueue[i], true);
     dec_secthreads();
     msgprintf(MSG_DEBUG1, "THREAD-READER: exit\n");
     return NULL;
@@ -39,9 +39,57 @@
 #include "thread_comp.h"
 #include "error.h"
 #include "queue.h"
+#include "throttle.h"
 
-int compress_block_generic(struct s_blockinfo *blkinfo)
+// what a compression thread keeps from one block to the next
+struct s_compctx
+{   ccipher     *cipher; // opened by the first block encrypted with aes-gcm
+    cgzipctx    gzip; // libdeflate state of the gzip blocks
+#ifdef OPTION_ZSTD_SUPPORT
+    ZSTD_CCtx   *zstdcctx; // created by the first block compressed with zstd
+    ZSTD_DCtx   *zstddctx; // created by the first block decompressed with zstd
+#endif // OPTION_ZSTD_SUPPORT
+};
+
+typedef struct s_compctx ccompctx;
+
+static void compctx_close(ccompctx *ctx)
+{
+    crypto_aes256gcm_close(ctx->cipher);
+    gzipctx_close(&ctx->gzip);
+#ifdef OPTION_ZSTD_SUPPORT
+    ZSTD_freeCCtx(ctx->zstdcctx);
+    ZSTD_freeDCtx(ctx->zstddctx);
+#endif // OPTION_ZSTD_SUPPORT
+    memset(ctx, 0, sizeof(ccompctx));
+}
+
+// fields of the block header which are authenticated with the contents of a block encrypted with aes-gcm
+static u32 blockinfo_aad(struct s_blockinfo *blkinfo, u8 *aad)
 {
+    u64 temp64;
+    u32 temp32;
+    u16 temp16;
+    
+    temp64=cpu_to_le64(blkinfo->blkoffset);
+    memcpy(aad, &temp64, 8);
+    temp32=cpu_to_le32(blkinfo->blkrealsize);
+    memcpy(aad+8, &temp32, 4);
+    temp32=cpu_to_le32(blkinfo->blkcompsize);
+    memcpy(aad+12, &temp32, 4);
+    temp16=cpu_to_le16(blkinfo->blkcompalgo);
+    memcpy(aad+16, &temp16, 2);
+    temp16=cpu_to_le16(blkinfo->blkcryptalgo);
+    memcpy(aad+18, &temp16, 2);
+    temp16=cpu_to_le16(blkinfo->blkfsid);
+    memcpy(aad+20, &temp16, 2);
+    return 22;
+}
+
+int compress_block_generic(struct s_blockinfo *blkinfo, s64 itemnum, ccompctx *ctx)
+{
+    u8 aad[32];
+    u32 aadsize;
     char *bufcomp=NULL;
     int attempt=0;
     int compalgo;
@@ -63,6 +111,12 @@ int compress_block_generic(struct s_blockinfo *blkinfo)
     // compress the block
     do
     {
+        if (blkinfo->blknocomp==true) // it would only cost time: the block is kept as it is below
+        {   res=FSAERR_SUCCESS;
+            compsize=blkinfo->blkrealsize;
+            break;
+        }
+        
         switch (compalgo)
         {
 #ifdef OPTION_LZO_SUPPORT
@@ -72,7 +126,7 @@ int compress_block_generic(struct s_blockinfo *blkinfo)
                 break;
 #endif // OPTION_LZO_SUPPORT
             case COMPRESS_GZIP:
-                res=compress_block_gzip(blkinfo->blkrealsize, &compsize, (u8*)blkinfo->blkdata, (void*)bufcomp, bufsize, complevel);
+                res=compress_block_gzip(blkinfo->blkrealsize, &compsize, (u8*)blkinfo->blkdata, (void*)bufcomp, bufsize, complevel, &ctx->gzip);
                 blkinfo->blkcompalgo=COMPRESS_GZIP;
                 break;
             case COMPRESS_BZIP2:
@@ -93,7 +147,7 @@ int compress_block_generic(struct s_blockinfo *blkinfo)
 #endif // OPTION_LZ4_SUPPORT
 #ifdef OPTION_ZSTD_SUPPORT
             case COMPRESS_ZSTD:
-                res=compress_block_zstd(blkinfo->blkrealsize, &compsize, (u8*)blkinfo->blkdata, (void*)bufcomp, bufsize, complevel);
+                res=compress_block_zstd(blkinfo->blkrealsize, &compsize, (u8*)blkinfo->blkdata, (void*)bufcomp, bufsize, complevel, g_options.zstdlong, &ctx->zstdcctx);
                 blkinfo->blkcompalgo=COMPRESS_ZSTD;
                 break;
 #endif // OPTION_ZSTD_SUPPORT
@@ -149,6 +203,27 @@ int compress_block_generic(struct s_blockinfo *blkinfo)
         blkinfo->blkarsize=cryptsize;
         blkinfo->blkcryptalgo=ENCRYPT_BLOWFISH;
     }
+    else if (g_options.encryptalgo==ENCRYPT_AES256GCM)
+    {
+        if ((ctx->cipher==NULL) && ((ctx->cipher=crypto_aes256gcm_open())==NULL))
+            return -1;
+        if ((bufcrypt=malloc(blkinfo->blkcompsize))==NULL)
+        {   errprintf("malloc(%ld) failed: out of memory\n", (long)blkinfo->blkcompsize);
+            return -1;
+        }
+        blkinfo->blkcryptalgo=ENCRYPT_AES256GCM;
+        blkinfo->blkarsize=blkinfo->blkcompsize;
+        crypto_aes256gcm_nonce(blkinfo->blkcryptnonce, blkinfo->blkfsid, itemnum, blkinfo->blkoffset);
+        aadsize=blockinfo_aad(blkinfo, aad);
+        if ((res=crypto_aes256gcm(ctx->cipher, blkinfo->blkcompsize, (u8*)bufcomp, (u8*)bufcrypt, blkinfo->blkcryptnonce,
+            aad, aadsize, blkinfo->blkcrypttag, 1))!=0)
+        {   errprintf("crypto_aes256gcm() failed with res=%d\n", res);
+            free(bufcrypt);
+            return -1;
+        }
+        free(bufcomp);
+        blkinfo->blkdata=bufcrypt;
+    }
     else
     {
         blkinfo->blkcryptalgo=ENCRYPT_NONE;
@@ -160,8 +235,10 @@ int compress_block_generic(struct s_blockinfo *blkinfo)
     return 0;
 }
 
-int decompress_block_generic(struct s_blockinfo *blkinfo)
+int decompress_block_generic(struct s_blockinfo *blkinfo, ccompctx *ctx)
 {
+    u8 aad[32];
+    u32 aadsize;
     u64 checkorigsize;
     char *bufcomp=NULL;
     int res;
@@ -179,7 +256,7 @@ int decompress_block_generic(struct s_blockinfo *blkinfo)
     }
     else // data not corrupted, decompresses the block
     {
-        if ((blkinfo->blkcryptalgo!=ENCRYPT_NONE) && (g_options.encryptalgo!=ENCRYPT_BLOWFISH))
+        if ((blkinfo->blkcryptalgo!=ENCRYPT_NONE) && (g_options.encryptalgo==ENCRYPT_NONE))
         {   msgprintf(MSG_DEBUG1, "this archive has been encrypted, you have to provide a password "
                 "on the command line using option '-c'\n");
             free (bufcomp);
@@ -210,6 +287,30 @@ int decompress_block_generic(struct s_blockinfo *blkinfo)
             free(blkinfo->blkdata);
             blkinfo->blkdata=bufcrypt;
         }
+        else if (blkinfo->blkcryptalgo==ENCRYPT_AES256GCM)
+        {
+            if ((ctx->cipher==NULL) && ((ctx->cipher=crypto_aes256gcm_open())==NULL))
+            {   free(bufcomp);
+                return -1;
+            }
+            if ((blkinfo->blkarsize!=blkinfo->blkcompsize) || ((bufcrypt=malloc(blkinfo->blkarsize))==NULL))
+            {   errprintf("cannot allocate the decrypted block: arsize=%ld and blkcompsize=%ld\n",
+                    (long)blkinfo->blkarsize, (long)blkinfo->blkcompsize);
+                free(bufcomp);
+                return -1;
+            }
+            aadsize=blockinfo_aad(blkinfo, aad);
+            if (crypto_aes256gcm(ctx->cipher, blkinfo->blkarsize, (u8*)blkinfo->blkdata, (u8*)bufcrypt, blkinfo->blkcryptnonce,
+                aad, aadsize, blkinfo->blkcrypttag, 0)!=0)
+            {   errprintf("block at blockoffset=%ld cannot be decrypted: the password is wrong or the block has been modified\n",
+                    (long)blkinfo->blkoffset);
+                free(bufcrypt);
+                free(bufcomp);
+                return -1;
+            }
+            free(blkinfo->blkdata);
+            blkinfo->blkdata=bufcrypt;
+        }
 
         switch (blkinfo->blkcompalgo)
         {
@@ -228,7 +329,7 @@ int decompress_block_generic(struct s_blockinfo *blkinfo)
                 break;
 #endif // OPTION_LZO_SUPPORT
             case COMPRESS_GZIP:
-                if ((res=uncompress_block_gzip(blkinfo->blkcompsize, &checkorigsize, (void*)bufcomp, blkinfo->blkrealsize, (u8*)blkinfo->blkdata))!=0)
+                if ((res=uncompress_block_gzip(blkinfo->blkcompsize, &checkorigsize, (void*)bufcomp, blkinfo->blkrealsize, (u8*)blkinfo->blkdata, &ctx->gzip))!=0)
                 {   errprintf("uncompress_block_gzip()=%d failed: finalsize=%ld and checkorigsize=%ld\n",
                         res, (long)blkinfo->blkarsize, (long)checkorigsize);
                     memset(bufcomp, 0, blkinfo->blkrealsize);
@@ -265,7 +366,7 @@ int decompress_block_generic(struct s_blockinfo *blkinfo)
 #endif // OPTION_LZ4_SUPPORT
 #ifdef OPTION_ZSTD_SUPPORT
             case COMPRESS_ZSTD:
-                if ((res=uncompress_block_zstd(blkinfo->blkcompsize, &checkorigsize, (void*)bufcomp, blkinfo->blkrealsize, (u8*)blkinfo->blkdata))!=0)
+                if ((res=uncompress_block_zstd(blkinfo->blkcompsize, &checkorigsize, (void*)bufcomp, blkinfo->blkrealsize, (u8*)blkinfo->blkdata, &ctx->zstddctx))!=0)
                 {   errprintf("uncompress_block_zstd()=%d failed: finalsize=%ld and checkorigsize=%ld\n",
                         res, (long)blkinfo->blkarsize, (long)checkorigsize);
                     memset(bufcomp, 0, blkinfo->blkrealsize);
@@ -283,23 +384,30 @@ int decompress_block_generic(struct s_blockinfo *blkinfo)
     return 0;
 }
 
-int compression_function(int oper)
+int compression_function(cqueue *q, int oper)
 {
     struct s_blockinfo blkinfo;
+    ccputhrottle cputhrottle;
+    ccompctx ctx;
     s64 blknum;
     int res;
+    
+    memset(&cputhrottle, 0, sizeof(cputhrottle));
+    memset(&ctx, 0, sizeof(ctx));
 
-    while (queue_get_end_of_queue(&g_queue)==false)
+    while (queue_get_end_of_queue(q)==false)
     {
-        if ((blknum=queue_get_first_block_todo(&g_queue, &blkinfo))>0) // block found
+        if ((blknum=queue_get_first_block_todo(q, &blkinfo))>0) // block found
         {
             switch (oper)
             {
                 case COMPTHR_COMPRESS:
-                    res=compress_block_generic(&blkinfo);
+                    throttle_cpu_begin(&cputhrottle);
+                    res=compress_block_generic(&blkinfo, blknum, &ctx);
+                    throttle_cpu_end(&cputhrottle);
                     break;
                 case COMPTHR_DECOMPRESS:
-                    res=decompress_block_generic(&blkinfo);
+                    res=decompress_block_generic(&blkinfo, &ctx);
                     break;
                 default:
                     errprintf("oper is invalid: %d\n", oper);
@@ -310,14 +418,16 @@ int compression_function(int oper)
                 goto thread_comp_fct_error;
             }
             // don't check for errors: it's normal to fail when we terminate after a problem
-            queue_replace_block(&g_queue, blknum, &blkinfo, QITEM_STATUS_DONE);
+            queue_replace_block(q, blknum, &blkinfo, QITEM_STATUS_DONE);
         }
     }
 
+    compctx_close(&ctx);
     msgprintf(MSG_DEBUG1, "THREAD-COMP: exit success\n");
     return 0;
 
 thread_comp_fct_error:
+    compctx_close(&ctx);
     get_stopfillqueue();
     msgprintf(MSG_DEBUG1, "THREAD-COMP: exit error\n");
     return 0;
@@ -326,7 +436,7 @@ thread_comp_fct_error:
 void *thread_comp_fct(void *args)
 {
     inc_secthreads();
-    compression_function(COMPTHR_COMPRESS);
+    compression_function(&g_queue, COMPTHR_COMPRESS);
     dec_secthreads();
     return NULL;
 }
@@ -334,7 +444,7 @@ void *thread_comp_fct(void *args)
 void *thread_decomp_fct(void *args)
 {
     inc_secthreads();
-    compression_function(COMPTHR_DECOMPRESS);
+    compression_function((args!=NULL)?((cqueue *)args):(&g_queue), COMPTHR_DECOMPRESS); // args is the queue of a filesystem restored concurrently
     dec_secthreads();
     return NULL;
 }
@@ -0,0 +1,253 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <assert.h>
+#include <signal.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "fsarchiver.h"
+#include "throttle.h"
+#include "options.h"
+#include "error.h"
+
+struct s_bucket;
+typedef struct s_bucket cbucket;
+
+// token bucket which limits a number of bytes per second
+struct s_bucket
+{   u64    rate; // bytes per second (0 means unlimited)
+    double tokens; // bytes which can be transferred now (negative when in debt)
+    double last; // time when the tokens were updated
+};
+
+static pthread_mutex_t g_throttlemutex=PTHREAD_MUTEX_INITIALIZER;
+static cbucket g_readbucket;
+static cbucket g_writebucket;
+static int     g_cpulimit; // percent of a core per compression thread, 0 or THROTTLE_CPUIDLE
+static double  g_nextpoll; // next time the signal and the control file are checked
+static time_t  g_ctlmtime; // mtime of the control file when it was last read
+
+static double throttle_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec/1000000000.0;
+}
+
+static void throttle_sleep(double secs)
+{
+    struct timespec ts;
+    ts.tv_sec=(time_t)secs;
+    ts.tv_nsec=(long)((secs-(double)ts.tv_sec)*1000000000.0);
+    while (nanosleep(&ts, &ts)!=0 && errno==EINTR);
+}
+
+static void bucket_set_rate(cbucket *b, u64 rate)
+{
+    b->rate=rate;
+    b->tokens=0;
+    b->last=throttle_now();
+}
+
+// parse a line of the control file such as "write-rate=20" (MB/s) or "cpu-limit=idle"
+static int throttle_parse_line(char *line)
+{
+    char *value;
+    long long num;
+    
+    if ((value=strchr(line, '='))==NULL)
+        return -1;
+    *value++=0;
+    num=atoll(value);
+    if (num<0)
+        return -1;
+    
+    if (strcmp(line, "read-rate")==0)
+        bucket_set_rate(&g_readbucket, (u64)num*1024LL*1024LL);
+    else if (strcmp(line, "write-rate")==0)
+        bucket_set_rate(&g_writebucket, (u64)num*1024LL*1024LL);
+    else if (strcmp(line, "cpu-limit")==0 && strncmp(value, "idle", 4)==0)
+        g_cpulimit=THROTTLE_CPUIDLE;
+    else if (strcmp(line, "cpu-limit")==0 && num<=100)
+        g_cpulimit=(num==100)?0:(int)num;
+    else
+        return -1;
+    return 0;
+}
+
+// nothing to limit and nothing can change the limits but SIGUSR1
+static bool throttle_idle()
+{
+    return (g_readbucket.rate==0 && g_writebucket.rate==0 && g_cpulimit==0 && g_options.throttlefile==NULL);
+}
+
+// called with the mutex held: SIGUSR1 lifts all the limits, the control file sets new ones
+static void throttle_poll_locked()
+{
+    const struct timespec nowait={0, 0};
+    char line[256];
+    struct stat64 st;
+    sigset_t sigs;
+    double now;
+    FILE *f;
+    
+    if ((now=throttle_now()) < g_nextpoll)
+        return;
+    g_nextpoll=now+1.0;
+    
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGUSR1);
+    if (sigtimedwait(&sigs, NULL, &nowait)==SIGUSR1)
+    {   msgprintf(MSG_FORCE, "received SIGUSR1: the read, write and cpu limits have been removed\n");
+        bucket_set_rate(&g_readbucket, 0);
+        bucket_set_rate(&g_writebucket, 0);
+        g_cpulimit=0;
+    }
+    
+    if (g_options.throttlefile==NULL || stat64(g_options.throttlefile, &st)!=0 || st.st_mtime==g_ctlmtime)
+        return;
+    g_ctlmtime=st.st_mtime;
+    if ((f=fopen(g_options.throttlefile, "r"))==NULL)
+    {   sysprintf("cannot open the throttle control file %s\n", g_options.throttlefile);
+        return;
+    }
+    while (fgets(line, sizeof(line), f)!=NULL)
+    {
+        line[strcspn(line, "\r\n")]=0;
+        if (line[0]!=0 && line[0]!='#' && throttle_parse_line(line)!=0)
+            errprintf("invalid line in the throttle control file %s: [%s]\n", g_options.throttlefile, line);
+    }
+    fclose(f);
+    msgprintf(MSG_VERB1, "throttle: read-rate=%lld write-rate=%lld cpu-limit=%d\n",
+        (long long)g_readbucket.rate, (long long)g_writebucket.rate, g_cpulimit);
+}
+
+void throttle_poll()
+{
+    if (throttle_idle()==true)
+        return;
+    assert(pthread_mutex_lock(&g_throttlemutex)==0);
+    throttle_poll_locked();
+    assert(pthread_mutex_unlock(&g_throttlemutex)==0);
+}
+
+static void throttle_bucket(cbucket *b, u64 bytes)
+{
+    double wait=0;
+    double now;
+    
+    if (throttle_idle()==true)
+        return;
+    
+    assert(pthread_mutex_lock(&g_throttlemutex)==0);
+    throttle_poll_locked();
+    if (b->rate>0)
+    {
+        now=throttle_now();
+        b->tokens=min(b->tokens+(now-b->last)*(double)b->rate, (double)b->rate); // burst of one second at most
+        b->last=now;
+        b->tokens-=(double)bytes;
+        if (b->tokens<0)
+            wait=-b->tokens/(double)b->rate;
+    }
+    assert(pthread_mutex_unlock(&g_throttlemutex)==0);
+    
+    if (wait>0)
+        throttle_sleep(wait);
+}
+
+int throttle_init()
+{
+    bucket_set_rate(&g_readbucket, g_options.readrate);
+    bucket_set_rate(&g_writebucket, g_options.writerate);
+    g_cpulimit=g_options.cpulimit;
+    g_nextpoll=0;
+    g_ctlmtime=0;
+    return 0;
+}
+
+int throttle_destroy()
+{
+    memset(&g_readbucket, 0, sizeof(g_readbucket));
+    memset(&g_writebucket, 0, sizeof(g_writebucket));
+    g_cpulimit=0;
+    return 0;
+}
+
+void throttle_read(u64 bytes)
+{
+    throttle_bucket(&g_readbucket, bytes);
+}
+
+void throttle_write(u64 bytes)
+{
+    throttle_bucket(&g_writebucket, bytes);
+}
+
+static u64 throttle_cputime()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)!=0)
+        return 0;
+    return (u64)ts.tv_sec*1000000000LL + (u64)ts.tv_nsec;
+}
+
+void throttle_cpu_begin(ccputhrottle *ct)
+{
+    struct sched_param param;
+    bool idle;
+    
+    throttle_poll();
+    idle=(g_cpulimit==THROTTLE_CPUIDLE);
+    if (idle!=ct->idle)
+    {
+        memset(&param, 0, sizeof(param));
+        if (pthread_setschedparam(pthread_self(), idle?SCHED_IDLE:SCHED_OTHER, &param)!=0)
+        {   // SCHED_IDLE may be refused (old kernel, seccomp): fall back to the lowest nice value
+            if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), idle?19:0)!=0)
+                msgprintf(MSG_DEBUG1, "cannot change the scheduling of the compression thread\n");
+        }
+        ct->idle=idle;
+    }
+    ct->cputime=throttle_cputime();
+}
+
+void throttle_cpu_end(ccputhrottle *ct)
+{
+    int limit=g_cpulimit;
+    u64 busy;
+    
+    if (limit<=0)
+        return;
+    busy=throttle_cputime()-ct->cputime;
+    throttle_sleep(((double)busy*(double)(100-limit)/(double)limit)/1000000000.0);
+}
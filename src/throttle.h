@@ -0,0 +1,42 @@
+/*
+ * fsarchiver: Filesystem Archiver
+ *
+ * Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Homepage: http://www.fsarchiver.org
+ */
+
+#ifndef __THROTTLE_H__
+#define __THROTTLE_H__
+
+#include "types.h"
+
+#define THROTTLE_CPUIDLE     -1 // value of the cpu limit that means idle scheduling
+
+struct s_cputhrottle;
+typedef struct s_cputhrottle ccputhrottle;
+
+// scheduling state of a compression thread
+struct s_cputhrottle
+{   bool   idle; // true when the thread runs with SCHED_IDLE
+    u64    cputime; // cpu time used by the thread when the current block started
+};
+
+int  throttle_init(); // set the limits from the options
+int  throttle_destroy();
+void throttle_read(u64 bytes); // wait until the read limit allows these bytes
+void throttle_write(u64 bytes); // wait until the write limit allows these bytes
+void throttle_poll(); // check the signal and the control file (at most once per second)
+void throttle_cpu_begin(ccputhrottle *ct); // before a compression thread processes a block
+void throttle_cpu_end(ccputhrottle *ct); // after it: sleep to keep the thread under the cpu limit
+
+#endif // __THROTTLE_H__
@@ -255,6 +255,10 @@ int writebuf_add_block(cwritebuf *wb, struct s_blockinfo *blkinfo, u32 archid, u
     dico_add_u32(blkdico, 0, BLOCKHEADITEMKEY_ARCSUM, blkinfo->blkarcsum);
     dico_add_u16(blkdico, 0, BLOCKHEADITEMKEY_COMPRESSALGO, blkinfo->blkcompalgo);
     dico_add_u16(blkdico, 0, BLOCKHEADITEMKEY_ENCRYPTALGO, blkinfo->blkcryptalgo);
+    if (blkinfo->blkcryptalgo==ENCRYPT_AES256GCM)
+    {   dico_add_data(blkdico, 0, BLOCKHEADITEMKEY_CRYPTNONCE, blkinfo->blkcryptnonce, FSA_CRYPT_NONCESIZE);
+        dico_add_data(blkdico, 0, BLOCKHEADITEMKEY_CRYPTTAG, blkinfo->blkcrypttag, FSA_CRYPT_TAGSIZE);
+    }
     
     // write block header
     res=writebuf_add_header(wb, blkdico, FSA_MAGIC_BLKH, archid, fsid);
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Round trip of an archive encrypted with --cipher=aes256gcm, and check that a
+# wrong password and altered data are refused
+
+. "$(dirname "$0")/common.sh"
+
+make_tree "$WORK/src"
+RESTOPTS="-c goodpassword"
+roundtrip_dir aes256gcm -c goodpassword --cipher=aes256gcm
+RESTOPTS=""
+
+new_rest
+if run restdir -c badpassword "$WORK/aes256gcm.fsa" "$WORK/rest"; then
+    fail "aes256gcm refuses a wrong password"
+else
+    pass "aes256gcm refuses a wrong password"
+fi
+
+size=$(stat -c %s "$WORK/aes256gcm.fsa")
+printf '\377' | dd of="$WORK/aes256gcm.fsa" bs=1 seek=$((size/2)) conv=notrunc 2>/dev/null
+new_rest
+if run restdir -c goodpassword "$WORK/aes256gcm.fsa" "$WORK/rest" && same_tree "$WORK/src" "$WORK/rest$WORK/src"; then
+    fail "aes256gcm detects altered data"
+else
+    pass "aes256gcm detects altered data"
+fi
+finish
@@ -0,0 +1,46 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Save and restoration times of an ext4 filesystem encrypted with blowfish and
+# with aes256gcm, compressed with lz4 and with zstd, and without encryption as
+# a reference.
+#
+# usage: sudo [BENCHSRC=/path/to/dir] tests/bench-cipher.sh
+
+. "$(dirname "$0")/common.sh"
+
+if ! command -v mkfs.ext4 >/dev/null; then
+    echo "SKIP: there is no mkfs.ext4"
+    exit 77
+fi
+bench_init "savefs/restfs on ext4"
+srcdev=$(bench_loop ciphersrc 4G mkfs.ext4 -q -F) && destdev=$(new_loop cipherdest 4G) || { echo "cannot create the loop devices"; exit 1; }
+
+for comp in -z0 -Z3; do
+    for cipher in none blowfish aes256gcm; do
+        [ $cipher = none ] && opts="" || opts="-c benchpassword --cipher=$cipher"
+        name="${comp#-},$cipher"
+        rm -f "$WORK/cipher.fsa"
+        sync
+        if tsave=$(timed "$FSA" savefs -j$(nproc) $comp $opts "$WORK/cipher.fsa" "$srcdev") &&
+           trest=$(timed "$FSA" restfs -j$(nproc) ${opts%% --cipher=*} "$WORK/cipher.fsa" id=0,dest="$destdev")
+        then bench_print "$name" $(stat -c %s "$WORK/cipher.fsa") "$tsave" "$trest"
+        else fail "$name"
+        fi
+    done
+done
+finish
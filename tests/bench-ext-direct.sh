@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Restoration times of an ext4 filesystem through the mounted filesystem and
+# with --ext-direct, which writes it with libext2fs. Each restored filesystem
+# is checked with e2fsck.
+#
+# usage: sudo [BENCHSRC=/path/to/dir] tests/bench-ext-direct.sh
+
+. "$(dirname "$0")/common.sh"
+
+if ! command -v mkfs.ext4 >/dev/null || ! command -v e2fsck >/dev/null; then
+    echo "SKIP: there is no mkfs.ext4 or e2fsck"
+    exit 77
+fi
+bench_init "restfs of ext4"
+srcdev=$(bench_loop extsrc 4G mkfs.ext4 -q -F) && destdev=$(new_loop extdest 4G) || { echo "cannot create the loop devices"; exit 1; }
+echo "$(find "$BENCHSRC" | wc -l) files and directories"
+tsave=$(timed "$FSA" savefs -j$(nproc) "$WORK/ext.fsa" "$srcdev") || { echo "savefs failed"; cat "$WORK/log"; exit 1; }
+
+for mode in mounted ext-direct; do
+    [ $mode = mounted ] && opts="" || opts="--$mode"
+    dd if=/dev/zero of="$destdev" bs=1M count=16 2>/dev/null
+    sync
+    if trest=$(timed "$FSA" restfs -j$(nproc) $opts "$WORK/ext.fsa" id=0,dest="$destdev") &&
+       e2fsck -fn "$destdev" >>"$WORK/log" 2>&1
+    then bench_print "$mode" $(stat -c %s "$WORK/ext.fsa") "$tsave" "$trest"
+    else fail "$mode"
+    fi
+done
+finish
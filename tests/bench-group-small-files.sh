@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Ratio and speed of savedir with and without --group-small-files on a tree
+# which mixes executables, headers and documentation
+#
+# usage: sudo [BENCHSRC=/path/to/dir] tests/bench-group-small-files.sh
+
+. "$(dirname "$0")/common.sh"
+
+if [ -z "$BENCHSRC" ]; then
+    BENCHSRC="$WORK/src"
+    mkdir -p "$BENCHSRC"
+    cp -a /usr/bin /usr/include "$BENCHSRC/"
+    [ -d /usr/share/doc ] && cp -a /usr/share/doc "$BENCHSRC/"
+fi
+bench_init "small files"
+echo "$(find "$BENCHSRC" -type f | wc -l) files"
+bench_dir "lz4" -z0
+bench_dir "lz4,group-small-files" -z0 --group-small-files
+bench_dir "gzip-6" -z3
+bench_dir "gzip-6,group-small-files" -z3 --group-small-files
+if has_compress zstd; then
+    bench_dir "zstd-3" -Z3
+    bench_dir "zstd-3,group-small-files" -Z3 --group-small-files
+fi
+finish
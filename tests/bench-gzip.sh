@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Save and restoration times of the gzip blocks (-z2 to -z4) with zlib and with
+# libdeflate. $FSA must be built with zlib and $FSA_LIBDEFLATE with the option
+# --enable-libdeflate of configure. Both restore the archive written by zlib,
+# as it is the case of the archives saved by older versions.
+#
+# usage: sudo FSA_LIBDEFLATE=/path/to/fsarchiver [BENCHSRC=/path/to/dir] [LEVEL=3] tests/bench-gzip.sh
+
+. "$(dirname "$0")/common.sh"
+
+LEVEL=${LEVEL:-3}
+if [ ! -x "$FSA_LIBDEFLATE" ] || ! command -v mkfs.ext4 >/dev/null; then
+    echo "SKIP: FSA_LIBDEFLATE is not set or there is no mkfs.ext4"
+    exit 77
+fi
+bench_init "gzip -z$LEVEL on ext4"
+srcdev=$(bench_loop gzipsrc 4G mkfs.ext4 -q -F) && destdev=$(new_loop gzipdest 4G) || { echo "cannot create the loop devices"; exit 1; }
+
+for lib in zlib libdeflate; do
+    [ $lib = zlib ] && fsa=$FSA || fsa=$FSA_LIBDEFLATE
+    rm -f "$WORK/$lib.fsa"
+    sync
+    if tsave=$(timed "$fsa" savefs -j$(nproc) -z$LEVEL "$WORK/$lib.fsa" "$srcdev") &&
+       trest=$(timed "$fsa" restfs -j$(nproc) "$WORK/zlib.fsa" id=0,dest="$destdev")
+    then bench_print "$lib" $(stat -c %s "$WORK/$lib.fsa") "$tsave" "$trest"
+    else fail "$lib"
+    fi
+done
+finish
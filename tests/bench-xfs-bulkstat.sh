@@ -0,0 +1,57 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Times of savefs on an xfs filesystem with many empty files, with the
+# attributes read by stat() on each file and read in batches with
+# --xfs-bulkstat. The filesystem is only created once as it takes a while.
+#
+# usage: sudo [FILES=10000000] tests/bench-xfs-bulkstat.sh
+
+. "$(dirname "$0")/common.sh"
+
+FILES=${FILES:-10000000}
+PERDIR=10000
+if ! command -v mkfs.xfs >/dev/null; then
+    echo "SKIP: there is no mkfs.xfs"
+    exit 77
+fi
+dev=$(new_loop xfs 64G) && mkfs.xfs -q -f -i maxpct=50 "$dev" || { echo "cannot create the xfs filesystem"; exit 1; }
+mkdir -p "$WORK/mnt"
+mount "$dev" "$WORK/mnt" && MOUNTS="$MOUNTS $WORK/mnt" || { echo "cannot mount $dev"; exit 1; }
+echo "creating $FILES files"
+d=0
+while [ $((d*PERDIR)) -lt $FILES ]; do
+    mkdir "$WORK/mnt/$d"
+    (cd "$WORK/mnt/$d" && seq 1 $PERDIR | xargs touch)
+    d=$((d+1))
+done
+umount "$WORK/mnt"
+
+echo "savefs of $((d*PERDIR)) files             archive      save"
+for mode in stat xfs-bulkstat; do
+    [ $mode = stat ] && opts="" || opts="--$mode"
+    rm -f "$WORK/xfs.fsa"
+    sync; echo 3 >/proc/sys/vm/drop_caches
+    if tsave=$(timed "$FSA" savefs $opts "$WORK/xfs.fsa" "$dev"); then
+        echo "$mode $(stat -c %s "$WORK/xfs.fsa") $tsave" |
+            awk '{ printf "%-32s %7.1f MB %7.2f s\n", $1, $2/1048576, $3 }'
+        PASS=$((PASS+1))
+    else
+        fail "$mode"
+    fi
+done
+finish
@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Ratio and speed of zstd with the default blocks, with --large-blocks and with
+# --zstd-long. Besides the tree of bench_init() it saves a file which contains
+# the same 48 MB twice, as in a disk image with copies of the same files.
+#
+# usage: sudo [BENCHSRC=/path/to/dir] [LEVEL=3] tests/bench-zstd.sh
+
+. "$(dirname "$0")/common.sh"
+
+LEVEL=${LEVEL:-3}
+has_compress zstd || { echo "SKIP: built without zstd"; exit 77; }
+bench_init "zstd level $LEVEL"
+if [ "$BENCHSRC" = "$WORK/src" ]; then
+    head -c 48000000 /dev/urandom >"$WORK/half.bin"
+    cat "$WORK/half.bin" "$WORK/half.bin" >"$BENCHSRC/image.bin"
+    rm -f "$WORK/half.bin"
+    SRCSIZE=$(du -sb "$BENCHSRC" | cut -f1)
+fi
+bench_dir "blocks" -Z$LEVEL
+bench_dir "large-blocks=16" -Z$LEVEL --large-blocks=16
+bench_dir "large-blocks=64" -Z$LEVEL --large-blocks=64
+bench_dir "large-blocks=64,zstd-long" -Z$LEVEL --large-blocks=64 --zstd-long
+finish
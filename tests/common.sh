@@ -0,0 +1,190 @@
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Helpers which are shared by the round-trip tests: each test saves a tree
+# with the options of one archive feature, restores it and checks that the
+# restored files are identical to the original ones. The tests are run by
+# "make check" or one at a time with:
+#
+#   sudo FSA=/path/to/fsarchiver tests/<test>.sh
+#
+# They must run as root (savefs/savedir/restfs/restdir require it) and they
+# exit with 77 so that automake reports them as skipped when they cannot run.
+
+FSA=${FSA:-$(dirname "$0")/../src/fsarchiver}
+PASS=0
+FAIL=0
+SKIP=0
+MOUNTS=""
+
+if [ "$(id -u)" != "0" ]; then
+    echo "SKIP: the round-trip tests must be run as root"
+    exit 77
+fi
+if [ ! -x "$FSA" ]; then
+    echo "cannot find fsarchiver: $FSA"
+    exit 1
+fi
+WORK=$(mktemp -d /tmp/fsa-test.XXXXXX) || exit 1
+
+cleanup()
+{
+    for mnt in $MOUNTS; do umount "$mnt" 2>/dev/null; done
+    for img in "$WORK"/*.img; do
+        for dev in $(losetup -l -n -O NAME -j "$img" 2>/dev/null); do losetup -d "$dev"; done
+    done
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+pass() { echo "PASS: $1"; PASS=$((PASS+1)); }
+fail() { echo "FAIL: $1"; FAIL=$((FAIL+1)); }
+skip() { echo "SKIP: $1 ($2)"; SKIP=$((SKIP+1)); }
+
+run()
+{
+    "$FSA" "$@" >>"$WORK/log" 2>&1
+}
+
+# compare the contents, names, types, modes and sizes of two trees
+same_tree()
+{
+    diff -r --no-dereference -x fifo "$1" "$2" >/dev/null 2>&1 || return 1 # the fifo is checked by find
+    a=$(cd "$1" && find . \( -type d -printf '%p d %m\n' \) -o -printf '%p %y %m %s\n' | sort)
+    b=$(cd "$2" && find . \( -type d -printf '%p d %m\n' \) -o -printf '%p %y %m %s\n' | sort)
+    [ "$a" = "$b" ]
+}
+
+# directory with small, large, empty, identical, sparse and special files
+make_tree()
+{
+    mkdir -p "$1/dir1/sub" "$1/dir2" "$1/empty"
+    head -c 300000 /dev/urandom >"$1/dir1/random.bin"
+    seq 1 200000 >"$1/dir1/sub/numbers.txt"
+    : >"$1/dir2/empty.txt"
+    for i in $(seq 1 50); do echo "same contents" >"$1/dir2/same$i.txt"; done
+    for i in $(seq 1 50); do echo "file $i" >"$1/dir2/file$i.txt"; done
+    truncate -s 5M "$1/dir1/sparse.img"
+    echo "middle" | dd of="$1/dir1/sparse.img" bs=1 seek=2000000 conv=notrunc 2>/dev/null
+    ln -s ../dir2/file1.txt "$1/dir1/link"
+    ln "$1/dir2/file2.txt" "$1/dir1/hardlink"
+    mkfifo "$1/dir2/fifo"
+    chmod 0750 "$1/dir1/sub"
+}
+
+# empty directory where an archive is restored
+new_rest()
+{
+    rm -rf "$WORK/rest"
+    mkdir "$WORK/rest"
+}
+
+# savedir of $WORK/src with options "$2..." and restdir with $RESTOPTS, then
+# compare with the original tree (restdir restores the absolute saved path)
+roundtrip_dir()
+{
+    name=$1; shift
+    rm -f "$WORK/$name.fsa"
+    new_rest
+    if run savedir "$@" "$WORK/$name.fsa" "$WORK/src" &&
+       run restdir $RESTOPTS "$WORK/$name.fsa" "$WORK/rest" &&
+       same_tree "$WORK/src" "$WORK/rest$WORK/src"
+    then pass "$name"
+    else fail "$name"
+    fi
+}
+
+# prints the name of a new loop device backed by a sparse file of that size
+new_loop()
+{
+    truncate -s "$2" "$WORK/$1.img"
+    losetup -f --show "$WORK/$1.img" 2>/dev/null
+}
+
+# true when fsarchiver has been built with that compression library
+has_compress()
+{
+    "$FSA" -h 2>&1 | grep -q "$1=yes"
+}
+
+# prints the seconds taken by a command whose output goes to the log
+timed()
+{
+    start=$(date +%s.%N)
+    "$@" >>"$WORK/log" 2>&1 || return 1
+    echo "$start $(date +%s.%N)" | awk '{ printf "%.2f", $2-$1 }'
+}
+
+# the benchmarks save $BENCHSRC, or a copy of /usr/bin and /usr/include by default
+bench_init()
+{
+    if [ -z "$BENCHSRC" ]; then
+        BENCHSRC="$WORK/src"
+        mkdir -p "$BENCHSRC"
+        cp -a /usr/bin /usr/include "$BENCHSRC/"
+    fi
+    SRCSIZE=$(du -sb "$BENCHSRC" | cut -f1)
+    printf "%-32s %10s %7s %9s %9s\n" "$1" "archive" "ratio" "save" "restore"
+}
+
+# savedir of $BENCHSRC with options "$2..." and restdir with $RESTOPTS: prints
+# the size of the archive, the ratio and the times of the save and restoration
+bench_dir()
+{
+    name=$1; shift
+    rm -f "$WORK/$name.fsa"
+    new_rest
+    sync
+    if ! tsave=$(timed "$FSA" savedir -j$(nproc) "$@" "$WORK/$name.fsa" "$BENCHSRC") ||
+       ! trest=$(timed "$FSA" restdir -j$(nproc) $RESTOPTS "$WORK/$name.fsa" "$WORK/rest")
+    then fail "$name"; return
+    fi
+    bench_print "$name" $(stat -c %s "$WORK/$name.fsa") "$tsave" "$trest"
+    rm -rf "$WORK/rest" "$WORK/$name.fsa"
+}
+
+# prints a line of the table of bench_init(): name, size of the archive, time of the save and restoration
+bench_print()
+{
+    echo "$1 $2 $SRCSIZE $3 $4" |
+        awk '{ printf "%-32s %7.1f MB %7.3f %7.2f s %7.2f s\n", $1, $2/1048576, $2/$3, $4, $5 }'
+    PASS=$((PASS+1))
+}
+
+# prints the name of a new loop device with a filesystem made by "$3..." which contains a copy of $BENCHSRC
+bench_loop()
+{
+    name=$1; size=$2; shift 2
+    dev=$(new_loop "$name" "$size") && "$@" "$dev" >/dev/null 2>&1 || return 1
+    mkdir -p "$WORK/mnt-$name"
+    mount "$dev" "$WORK/mnt-$name" || return 1
+    cp -a "$BENCHSRC/." "$WORK/mnt-$name/"
+    umount "$WORK/mnt-$name"
+    echo "$dev"
+}
+
+# report the results with the exit codes of the automake test harness
+finish()
+{
+    echo "passed: $PASS, failed: $FAIL, skipped: $SKIP"
+    if [ $FAIL -gt 0 ]; then
+        echo "output of fsarchiver:"
+        cat "$WORK/log"
+        exit 1
+    fi
+    [ $PASS -gt 0 ] || exit 77
+    exit 0
+}
@@ -0,0 +1,78 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Filesystems saved with --concurrent-fs: each one is restored alone from its
+# runs, also from a split archive, and from the whole archive when the index
+# at its end is missing
+
+. "$(dirname "$0")/common.sh"
+
+# restore filesystem $2 of archive $1 to $dev3 and compare it with the tree in $3
+restore_one()
+{
+    dd if=/dev/zero of="$dev3" bs=1M count=4 2>/dev/null
+    run restfs -v "$1" id=$2,dest="$dev3" &&
+    mount -o ro "$dev3" "$WORK/mnt3" && MOUNTS="$MOUNTS $WORK/mnt3" &&
+    same_tree "$3" "$WORK/mnt3/src"
+    res=$?
+    umount "$WORK/mnt3" 2>/dev/null
+    return $res
+}
+
+make_tree "$WORK/src"
+if command -v mkfs.ext4 >/dev/null && dev1=$(new_loop ext4a 128M) && dev2=$(new_loop ext4b 128M) &&
+   dev3=$(new_loop ext4c 128M) && dev4=$(new_loop ext4d 128M)
+then
+    mkdir -p "$WORK/mnt1" "$WORK/mnt2" "$WORK/mnt3" "$WORK/mnt4" "$WORK/src2"
+    cp -a "$WORK/src/dir2" "$WORK/src2/"
+    head -c 40000000 /dev/urandom >"$WORK/src/dir1/large.bin" # several runs in the archive
+    for dev in "$dev1" "$dev2"; do mkfs.ext4 -q -F "$dev"; done
+    mount "$dev1" "$WORK/mnt1" && cp -a "$WORK/src" "$WORK/mnt1/" && umount "$WORK/mnt1"
+    mount "$dev2" "$WORK/mnt2" && cp -a "$WORK/src2" "$WORK/mnt2/src" && umount "$WORK/mnt2"
+    
+    if run savefs --concurrent-fs "$WORK/conc.fsa" "$dev1" "$dev2" &&
+       restore_one "$WORK/conc.fsa" 1 "$WORK/src2" && grep -q "only the runs of the filesystems restored are read" "$WORK/log" &&
+       restore_one "$WORK/conc.fsa" 0 "$WORK/src"
+    then pass concurrent-fs
+    else fail concurrent-fs
+    fi
+    
+    if run savefs --concurrent-fs -s 8 "$WORK/split.fsa" "$dev1" "$dev2" &&
+       restore_one "$WORK/split.fsa" 1 "$WORK/src2" && restore_one "$WORK/split.fsa" 0 "$WORK/src"
+    then pass concurrent-fs-split
+    else fail concurrent-fs-split
+    fi
+    
+    # both filesystems restored at the same time from their runs
+    if run restfs --concurrent-fs "$WORK/conc.fsa" id=0,dest="$dev3" id=1,dest="$dev4" &&
+       mount -o ro "$dev3" "$WORK/mnt3" && mount -o ro "$dev4" "$WORK/mnt4" && MOUNTS="$MOUNTS $WORK/mnt3 $WORK/mnt4" &&
+       same_tree "$WORK/src" "$WORK/mnt3/src" && same_tree "$WORK/src2" "$WORK/mnt4/src"
+    then pass concurrent-fs-restore
+    else fail concurrent-fs-restore
+    fi
+    umount "$WORK/mnt3" "$WORK/mnt4" 2>/dev/null
+    
+    # older archives have no index: the reader goes through all the runs
+    truncate -s -16 "$WORK/conc.fsa"
+    if restore_one "$WORK/conc.fsa" 1 "$WORK/src2"
+    then pass concurrent-fs-noindex
+    else fail concurrent-fs-noindex
+    fi
+else
+    skip concurrent-fs "no mkfs.ext4 or loop device"
+fi
+finish
@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Dedup of identical small files: round trip, and check that an archive saved
+# with --dedup cannot be partially restored
+
+. "$(dirname "$0")/common.sh"
+
+make_tree "$WORK/src"
+mkdir "$WORK/src/copies"
+head -c 100000 /dev/urandom >"$WORK/copy.bin"
+for i in $(seq 1 20); do cp "$WORK/copy.bin" "$WORK/src/copies/copy$i.bin"; done
+roundtrip_dir dedup --dedup
+
+# the copies in the blocks which have already been queued are not stored again
+if run savedir "$WORK/nodedup.fsa" "$WORK/src" &&
+   [ $(stat -c %s "$WORK/dedup.fsa") -lt $(( $(stat -c %s "$WORK/nodedup.fsa") - 100000 )) ]
+then pass "dedup removes the copies"
+else fail "dedup removes the copies"
+fi
+
+new_rest
+if run restdir -i /dir2 "$WORK/dedup.fsa" "$WORK/rest"; then
+    fail "dedup refuses -i"
+else
+    pass "dedup refuses -i"
+fi
+finish
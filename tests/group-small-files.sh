@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Small files grouped by type of contents in their blocks (--group-small-files)
+
+. "$(dirname "$0")/common.sh"
+
+make_tree "$WORK/src"
+for i in $(seq 1 100); do head -c $((i*97)) /dev/urandom >"$WORK/src/dir2/rand$i.bin"; done
+for i in $(seq 1 100); do seq $i $((i*20)) >"$WORK/src/dir2/text$i.txt"; done
+roundtrip_dir group-small-files --group-small-files
+
+# the excluded directories are counted as errors so the exit status of restdir is not checked
+new_rest
+run restdir -i "$WORK/src/dir2/text5*" "$WORK/group-small-files.fsa" "$WORK/rest"
+if cmp -s "$WORK/src/dir2/text50.txt" "$WORK/rest$WORK/src/dir2/text50.txt" &&
+   [ ! -e "$WORK/rest$WORK/src/dir2/rand50.bin" ]
+then pass "group-small-files with -i"
+else fail "group-small-files with -i"
+fi
+finish
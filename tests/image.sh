@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Image mode: savefs --image of an ext4 filesystem restored to another device
+
+. "$(dirname "$0")/common.sh"
+
+make_tree "$WORK/src"
+if command -v mkfs.ext4 >/dev/null && dev1=$(new_loop ext4a 64M) && dev2=$(new_loop ext4b 64M); then
+    mkdir -p "$WORK/mnt1" "$WORK/mnt2"
+    mkfs.ext4 -q -F "$dev1" && mount "$dev1" "$WORK/mnt1" && MOUNTS="$MOUNTS $WORK/mnt1"
+    cp -a "$WORK/src" "$WORK/mnt1/"
+    umount "$WORK/mnt1"
+    if run savefs --image "$WORK/image.fsa" "$dev1" &&
+       run restfs "$WORK/image.fsa" id=0,dest="$dev2" &&
+       mount -o ro "$dev1" "$WORK/mnt1" && mount -o ro "$dev2" "$WORK/mnt2" && MOUNTS="$MOUNTS $WORK/mnt2" &&
+       same_tree "$WORK/mnt1/src" "$WORK/mnt2/src"
+    then pass image
+    else fail image
+    fi
+    umount "$WORK/mnt1" "$WORK/mnt2" 2>/dev/null
+else
+    skip image "no mkfs.ext4 or loop device"
+fi
+finish
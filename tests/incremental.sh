@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Incremental savedir: full save with --catalog, changes to the tree, save with
+# --incremental and restore of the incremental archive with --base
+
+. "$(dirname "$0")/common.sh"
+
+make_tree "$WORK/src"
+new_rest
+if run savedir --catalog="$WORK/full.cat" "$WORK/full.fsa" "$WORK/src"; then
+    sleep 1
+    echo "changed" >>"$WORK/src/dir2/file3.txt"
+    echo "new file" >"$WORK/src/dir1/new.txt"
+    rm -f "$WORK/src/dir2/file4.txt"
+    rm -rf "$WORK/src/empty"
+    mkdir "$WORK/src/newdir"
+    if run savedir --incremental="$WORK/full.cat" --catalog="$WORK/incr.cat" "$WORK/incr.fsa" "$WORK/src" &&
+       [ $(stat -c %s "$WORK/incr.fsa") -lt $(stat -c %s "$WORK/full.fsa") ] &&
+       run restdir --base="$WORK/full.fsa" "$WORK/incr.fsa" "$WORK/rest" &&
+       same_tree "$WORK/src" "$WORK/rest$WORK/src"
+    then pass incremental
+    else fail incremental
+    fi
+else
+    fail incremental
+fi
+finish
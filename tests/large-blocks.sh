@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Large-block mode: files larger than the blocks and archives with blocks of
+# 16 MB, restored by an fsarchiver which must accept them
+
+. "$(dirname "$0")/common.sh"
+
+make_tree "$WORK/src"
+head -c 20000000 /dev/urandom >"$WORK/src/dir1/big.bin"
+seq 1 5000000 >"$WORK/src/dir1/big.txt"
+roundtrip_dir large-blocks --large-blocks=16
+roundtrip_dir large-blocks-lz4 -z0 --large-blocks=32
+finish
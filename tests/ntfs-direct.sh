@@ -0,0 +1,91 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# ntfs volume saved and restored with --ntfs-direct: the archive must contain the
+# same objects as when the volume is read through the ntfs-3g fuse driver, and the
+# volume written with libntfs-3g must read back as the one restored through fuse
+
+. "$(dirname "$0")/common.sh"
+
+# objects, xattrs and windows attributes listed by savefs -vv without the progress
+objects()
+{
+    grep -E '^-\[|xattr:file=|winattr:file=' "$1" | sed 's/\[ *[0-9]*%\]//'
+}
+
+# what ntfs-3g reads back from the mft records of the files of a mounted volume
+ntfs_dump()
+{
+    (cd "$1" && find . -mindepth 1 | sort | while read -r f; do
+        stat -c '%n %F %s %Y' "$f"
+        for attr in system.ntfs_attrib_be system.ntfs_crtime_be system.ntfs_dos_name system.ntfs_acl; do
+            getfattr -h -e hex -n "$attr" "$f" 2>/dev/null | grep =
+        done
+        getfattr -h -d -m '^user\.' -e hex "$f" 2>/dev/null | grep =
+    done)
+}
+
+ntfs_mount()
+{
+    ntfs-3g -o streams_interface=xattr${3:+,$3} "$1" "$2" >>"$WORK/log" 2>&1 && MOUNTS="$MOUNTS $2"
+}
+
+make_tree "$WORK/src"
+if "$FSA" --ntfs-direct archinfo /dev/null 2>&1 | grep -q "disabled at compilation time"; then
+    skip ntfs-direct "fsarchiver compiled without libntfs-3g"
+elif command -v mkfs.ntfs >/dev/null && command -v ntfs-3g >/dev/null && command -v setfattr >/dev/null &&
+   dev1=$(new_loop ntfsa 64M) && dev2=$(new_loop ntfsb 64M) && dev3=$(new_loop ntfsc 64M)
+then
+    mkdir -p "$WORK/mnt1" "$WORK/mnt2" "$WORK/mnt3"
+    mkfs.ntfs -Q -F "$dev1" >>"$WORK/log" 2>&1 && ntfs_mount "$dev1" "$WORK/mnt1"
+    cp -a "$WORK/src" "$WORK/mnt1/"
+    setfattr -n user.stream -v "named stream" "$WORK/mnt1/src/dir2/file3.txt"
+    setfattr -n system.ntfs_dos_name -v "FILE10~1.TXT" "$WORK/mnt1/src/dir2/file10.txt"
+    setfattr -n system.ntfs_attrib_be -v 0x00000022 "$WORK/mnt1/src/dir2/file4.txt"
+    umount "$WORK/mnt1"
+    
+    # savefs: same objects read by libntfs-3g and through fuse
+    if "$FSA" savefs -vv "$WORK/fuse.fsa" "$dev1" >"$WORK/fuse.txt" 2>&1 &&
+       "$FSA" savefs -vv --ntfs-direct "$WORK/direct.fsa" "$dev1" >"$WORK/direct.txt" 2>&1 &&
+       [ "$(objects "$WORK/fuse.txt")" = "$(objects "$WORK/direct.txt")" ] && [ -n "$(objects "$WORK/fuse.txt")" ]
+    then pass "ntfs-direct savefs"
+    else fail "ntfs-direct savefs"
+    fi
+    
+    # restfs: the volume written by libntfs-3g reads back as the one restored through fuse
+    if run restfs "$WORK/fuse.fsa" id=0,dest="$dev2" &&
+       run restfs --ntfs-direct "$WORK/fuse.fsa" id=0,dest="$dev3" &&
+       { ! command -v ntfsfix >/dev/null || ntfsfix -n "$dev3" >>"$WORK/log" 2>&1; } &&
+       ntfs_mount "$dev1" "$WORK/mnt1" ro && ntfs_mount "$dev2" "$WORK/mnt2" ro && ntfs_mount "$dev3" "$WORK/mnt3" ro &&
+       same_tree "$WORK/mnt1/src" "$WORK/mnt3/src" && same_tree "$WORK/mnt2/src" "$WORK/mnt3/src" &&
+       [ "$(ntfs_dump "$WORK/mnt2")" = "$(ntfs_dump "$WORK/mnt3")" ]
+    then pass "ntfs-direct restfs"
+    else fail "ntfs-direct restfs"
+    fi
+    umount "$WORK/mnt1" "$WORK/mnt2" "$WORK/mnt3" 2>/dev/null
+    
+    # the archive saved with libntfs-3g lists the same objects once restored through libntfs-3g
+    if run restfs --ntfs-direct "$WORK/direct.fsa" id=0,dest="$dev3" &&
+       "$FSA" savefs -vv --ntfs-direct "$WORK/again.fsa" "$dev3" >"$WORK/again.txt" 2>&1 &&
+       [ "$(objects "$WORK/direct.txt")" = "$(objects "$WORK/again.txt")" ]
+    then pass "ntfs-direct round trip"
+    else fail "ntfs-direct round trip"
+    fi
+else
+    skip ntfs-direct "no mkfs.ntfs, ntfs-3g, setfattr or loop device"
+fi
+finish
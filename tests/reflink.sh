@@ -0,0 +1,49 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Reflink: files sharing extents on btrfs or xfs are saved with --reflink
+
+. "$(dirname "$0")/common.sh"
+
+if command -v mkfs.btrfs >/dev/null; then
+    mkfs="mkfs.btrfs -q -f"
+elif command -v mkfs.xfs >/dev/null; then
+    mkfs="mkfs.xfs -q -f -m reflink=1"
+else
+    mkfs=""
+fi
+if [ -n "$mkfs" ] && dev=$(new_loop reflink 512M) && $mkfs "$dev" >/dev/null 2>&1; then
+    mkdir -p "$WORK/mnt"
+    mount "$dev" "$WORK/mnt" && MOUNTS="$MOUNTS $WORK/mnt"
+    mkdir "$WORK/mnt/src"
+    head -c 8000000 /dev/urandom >"$WORK/mnt/src/orig.bin"
+    cp --reflink=always "$WORK/mnt/src/orig.bin" "$WORK/mnt/src/clone.bin"
+    head -c 4000000 "$WORK/mnt/src/orig.bin" >"$WORK/mnt/src/part.bin"
+    cp --reflink=always "$WORK/mnt/src/part.bin" "$WORK/mnt/src/partclone.bin"
+    echo "modified" | dd of="$WORK/mnt/src/clone.bin" bs=1 seek=100000 conv=notrunc 2>/dev/null
+    new_rest
+    if run savedir --reflink "$WORK/reflink.fsa" "$WORK/mnt/src" &&
+       run restdir "$WORK/reflink.fsa" "$WORK/rest" &&
+       same_tree "$WORK/mnt/src" "$WORK/rest$WORK/mnt/src"
+    then pass reflink
+    else fail reflink
+    fi
+    umount "$WORK/mnt"
+else
+    skip reflink "no mkfs.btrfs/mkfs.xfs or loop device"
+fi
+finish
@@ -0,0 +1,46 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Checkpoint journal: kill a slow split save once a checkpoint has been written
+# and finish it with --resume. The tree is larger than FSA_CHECKPOINT_COST so
+# that the save has a position to resume from before it ends.
+
+. "$(dirname "$0")/common.sh"
+
+make_tree "$WORK/src"
+mkdir "$WORK/src/resume"
+for i in $(seq 1 40); do head -c 1000000 /dev/urandom >"$WORK/src/resume/file$i.bin"; done
+
+"$FSA" savedir -z0 -s 1 --max-write-rate=4 "$WORK/resume.fsa" "$WORK/src" >>"$WORK/log" 2>&1 &
+pid=$!
+for i in $(seq 1 60); do
+    [ -f "$WORK/resume.fsa.ckpt" ] && break
+    sleep 1
+done
+kill -9 $pid 2>/dev/null
+wait $pid 2>/dev/null
+
+new_rest
+if [ -f "$WORK/resume.fsa.ckpt" ] &&
+   run savedir --resume -z0 -s 1 "$WORK/resume.fsa" "$WORK/src" &&
+   [ ! -f "$WORK/resume.fsa.ckpt" ] &&
+   run restdir "$WORK/resume.fsa" "$WORK/rest" &&
+   same_tree "$WORK/src" "$WORK/rest$WORK/src"
+then pass checkpoint-resume
+else fail checkpoint-resume
+fi
+finish
@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# fsarchiver: Filesystem Archiver
+#
+# Copyright (C) 2008-2018 Francois Dupoux.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License v2 as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# Homepage: http://www.fsarchiver.org
+#
+# Long distance matching of zstd (--zstd-long) in large blocks: the archive of
+# a file which contains the same data twice must be smaller than without it
+
+. "$(dirname "$0")/common.sh"
+
+if has_compress zstd; then
+    make_tree "$WORK/src"
+    head -c 12000000 /dev/urandom >"$WORK/src/dir1/half.bin"
+    cat "$WORK/src/dir1/half.bin" "$WORK/src/dir1/half.bin" >"$WORK/src/dir1/twice.bin"
+    rm -f "$WORK/src/dir1/half.bin"
+    roundtrip_dir zstd-long -Z3 --large-blocks=64 --zstd-long
+    roundtrip_dir zstd-nolong -Z3 --large-blocks=64
+    if [ $(stat -c %s "$WORK/zstd-long.fsa") -lt $(( $(stat -c %s "$WORK/zstd-nolong.fsa") * 3 / 4 )) ]; then
+        pass "zstd-long finds the repetition"
+    else
+        fail "zstd-long finds the repetition"
+    fi
+else
+    skip zstd-long "built without zstd"
+fi
+finish